@@ -50,6 +50,7 @@ extern void myTMCleanup(bool waitForFinishers);
 
 // ZZZ: Use these for mutually exclusive operation with any emulated TMTasks
 extern bool take_mytm_mutex();
+extern bool try_take_mytm_mutex();
 extern bool release_mytm_mutex();
 
 // ghs: exception-safe version of above
@@ -117,6 +117,14 @@ take_mytm_mutex() {
 
 
 
+// Returns false right away, rather than waiting, if a TMTask is running.
+bool
+try_take_mytm_mutex() {
+    return SDL_TryLockMutex(sTMTaskMutex) == 0;
+}
+
+
+
 bool
 release_mytm_mutex() {
     bool success = (SDL_UnlockMutex(sTMTaskMutex) != -1);
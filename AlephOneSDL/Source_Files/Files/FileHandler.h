@@ -335,6 +335,7 @@ public:
 	void SetToSavedGamesDir();		// Directory for saved games (per-user)
 	void SetToQuickSavesDir();		// Directory for auto-named saved games (per-user)
 	void SetToImageCacheDir();		// Directory for image cache (per-user)
+	void SetToMapCacheDir();		// Directory for cached redundant map data (per-user)
 	void SetToRecordingsDir();		// Directory for recordings (per-user)
 
 	void AddPart(const string &part);
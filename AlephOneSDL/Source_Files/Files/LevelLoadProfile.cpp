@@ -0,0 +1,267 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Where the time goes when a level is loaded (or a game is saved)
+*/
+
+#include "cseries.h"
+#include "LevelLoadProfile.h"
+
+#include "FileHandler.h"
+#include "game_errors.h"
+#include "game_wad.h"
+#include "map.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+// From shell.cpp
+extern void initialize_application(void);
+
+static LevelLoadPhase *innermost_phase = NULL;
+static std::vector<level_load_step> current_profile;
+static std::vector<level_load_step> finished_profile;
+
+// e.g. "  load_points 'PNTS'"
+static std::string step_label(const level_load_step& step)
+{
+	std::string label(2 * step.depth, ' ');
+	label += step.name;
+	if (step.tag)
+	{
+		label += " '";
+		for (int shift = 24; shift >= 0; shift -= 8)
+		{
+			char c = static_cast<char>((step.tag >> shift) & 0xff);
+			label += (c >= 0x20 && c < 0x7f) ? c : '?';
+		}
+		label += "'";
+	}
+	return label;
+}
+
+static void log_level_load_profile(const std::vector<level_load_step>& profile)
+{
+	double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+	for (std::vector<level_load_step>::const_iterator it = profile.begin(); it != profile.end(); ++it)
+	{
+		if (it->bytes)
+			logSummary("%s: %.2f ms, %lu bytes", step_label(*it).c_str(), it->ticks * 1e3 / frequency, static_cast<unsigned long>(it->bytes));
+		else
+			logSummary("%s: %.2f ms", step_label(*it).c_str(), it->ticks * 1e3 / frequency);
+	}
+}
+
+LevelLoadPhase::LevelLoadPhase(const char *name) :
+	outer_(innermost_phase), depth_(innermost_phase ? innermost_phase->depth_ + 1 : 0)
+{
+	if (!outer_)
+		current_profile.clear();
+
+	level_load_step step;
+	step.name = name;
+	step.tag = 0;
+	step.bytes = 0;
+	step.depth = depth_;
+	step.ticks = 0;
+	step_ = current_profile.size();
+	current_profile.push_back(step);
+
+	innermost_phase = this;
+	start_ = last_split_ = SDL_GetPerformanceCounter();
+}
+
+LevelLoadPhase::~LevelLoadPhase()
+{
+	uint64_t now = SDL_GetPerformanceCounter();
+	current_profile[step_].ticks = now - start_;
+
+	innermost_phase = outer_;
+	if (outer_)
+	{
+		// the outer phase's next split shouldn't count us again
+		outer_->last_split_ = now;
+	}
+	else
+	{
+		finished_profile.swap(current_profile);
+		log_level_load_profile(finished_profile);
+	}
+}
+
+void LevelLoadPhase::SetBytes(size_t bytes)
+{
+	current_profile[step_].bytes = bytes;
+}
+
+void level_load_split(const char *name, WadDataType tag, size_t bytes)
+{
+	if (!innermost_phase)
+		return;
+
+	uint64_t now = SDL_GetPerformanceCounter();
+
+	level_load_step step;
+	step.name = name;
+	step.tag = tag;
+	step.bytes = bytes;
+	step.depth = innermost_phase->depth_ + 1;
+	step.ticks = now - innermost_phase->last_split_;
+	current_profile.push_back(step);
+
+	innermost_phase->last_split_ = now;
+}
+
+const std::vector<level_load_step>& last_level_load_profile()
+{
+	return finished_profile;
+}
+
+// a step of the benchmark table, over all the levels that had it
+struct level_load_total
+{
+	level_load_step step;	// ticks and bytes are totals
+	int levels;
+	uint64_t max_ticks;
+};
+
+static bool same_step(const level_load_step& a, const level_load_step& b)
+{
+	return a.name == b.name && a.tag == b.tag && a.depth == b.depth;
+}
+
+static void add_to_totals(std::vector<level_load_total>& totals, const std::vector<level_load_step>& profile)
+{
+	std::vector<level_load_total>::iterator next = totals.begin();
+	for (std::vector<level_load_step>::const_iterator it = profile.begin(); it != profile.end(); ++it)
+	{
+		// levels mostly have the same steps in the same order, so look from the last match on;
+		// a step no level had before goes in after it
+		std::vector<level_load_total>::iterator total = next;
+		while (total != totals.end() && !same_step(total->step, *it))
+			++total;
+		if (total == totals.end())
+		{
+			total = totals.begin();
+			while (total != next && !same_step(total->step, *it))
+				++total;
+			if (total == next)
+				total = totals.end();
+		}
+		if (total == totals.end())
+		{
+			level_load_total new_total;
+			new_total.step = *it;
+			new_total.step.ticks = 0;
+			new_total.step.bytes = 0;
+			new_total.levels = 0;
+			new_total.max_ticks = 0;
+			total = totals.insert(next, new_total);
+		}
+
+		total->step.ticks += it->ticks;
+		total->step.bytes += it->bytes;
+		total->max_ticks = std::max(total->max_ticks, it->ticks);
+		total->levels++;
+		next = total + 1;
+	}
+}
+
+int run_level_load_benchmark(const std::string& path)
+{
+	initialize_application();
+
+	FileSpecifier map_file(path.c_str());
+	short level_count = map_file.Exists() ? number_of_wads_in_file(map_file) : static_cast<short>(NONE);
+	if (level_count <= 0)
+	{
+		fprintf(stderr, "bench-level-load: could not read map '%s'\n", path.c_str());
+		return 1;
+	}
+	set_map_file(map_file);
+
+	// a solo game with the defaults, the same every run
+	game_data game_information;
+	obj_clear(game_information);
+	game_information.game_time_remaining= INT32_MAX;
+	game_information.game_type= _game_of_kill_monsters;
+	game_information.game_options= _burn_items_on_death|_ammo_replenishes|_weapons_replenish|_monsters_replenish;
+	game_information.difficulty_level= _normal_level;
+
+	player_start_data start;
+	obj_clear(start);
+	strncpy(start.name, "Benchmark", MAXIMUM_PLAYER_START_NAME_LENGTH+1);
+
+	double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+	std::vector<level_load_total> totals;
+	int failures = 0;
+	bool in_level = false;
+
+	printf("Level load benchmark: %s, %d levels\n", path.c_str(), level_count);
+	printf("\n%5s  %-32s %10s %10s\n", "level", "name", "ms", "tag KB");
+	fflush(stdout);
+
+	for (short level = 0; level < level_count; ++level)
+	{
+		if (in_level)
+			leaving_map();
+
+		entry_point entry;
+		entry.level_number = level;
+		entry.level_name[0] = 0;
+
+		clear_game_error();
+		in_level = new_game(1, false, &game_information, &start, &entry);
+
+		const std::vector<level_load_step>& profile = last_level_load_profile();
+		if (!in_level || profile.empty())
+		{
+			printf("%5d  %-32s\n", level, "(failed to load)");
+			fflush(stdout);
+			clear_game_error();
+			failures++;
+			continue;
+		}
+
+		size_t tag_bytes = 0;
+		for (std::vector<level_load_step>::const_iterator it = profile.begin(); it != profile.end(); ++it)
+		{
+			if (it->tag)
+				tag_bytes += it->bytes;
+		}
+		printf("%5d  %-32.32s %10.1f %10lu\n", level, static_world->level_name,
+		       profile.front().ticks * 1e3 / frequency, static_cast<unsigned long>(tag_bytes / 1024));
+		fflush(stdout);
+
+		add_to_totals(totals, profile);
+	}
+
+	if (in_level)
+		leaving_map();
+
+	printf("\n%-44s %6s %10s %10s %10s %10s\n", "step", "levels", "KB", "total ms", "mean ms", "max ms");
+	for (std::vector<level_load_total>::iterator it = totals.begin(); it != totals.end(); ++it)
+	{
+		double ms = it->step.ticks * 1e3 / frequency;
+		printf("%-44.44s %6d %10lu %10.1f %10.2f %10.2f\n", step_label(it->step).c_str(), it->levels,
+		       static_cast<unsigned long>(it->step.bytes / 1024), ms, ms / it->levels, it->max_ticks * 1e3 / frequency);
+	}
+	fflush(stdout);
+
+	return failures ? 1 : 0;
+}
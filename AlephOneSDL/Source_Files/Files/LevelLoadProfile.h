@@ -0,0 +1,79 @@
+#ifndef LEVEL_LOAD_PROFILE_H
+#define LEVEL_LOAD_PROFILE_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Where the time goes when a level is loaded (or a game is saved)
+
+	A LevelLoadPhase times one step of the load, for as long as it is in scope.  Phases
+	nest; the outermost one starts a new profile and writes it to the log when it ends.
+	Inside a phase, level_load_split() records the time since the phase's last split (or
+	since it began) as a step of its own, along with the wad tag and the number of bytes
+	that step dealt with, so a run of unpacking needs only a line per tag.
+
+	Main thread only.
+*/
+
+#include "cseries.h"
+#include "wad.h"
+
+#include <string>
+#include <vector>
+
+struct level_load_step
+{
+	std::string name;
+	WadDataType tag;	// 0 if the step isn't about one tag
+	size_t bytes;
+	int depth;		// 0 for the outermost phase
+	uint64_t ticks;		// performance counter ticks, nested phases included
+};
+
+class LevelLoadPhase
+{
+public:
+	explicit LevelLoadPhase(const char *name);
+	~LevelLoadPhase();
+
+	void SetBytes(size_t bytes);
+
+private:
+	friend void level_load_split(const char *name, WadDataType tag, size_t bytes);
+
+	LevelLoadPhase *outer_;
+	size_t step_;
+	int depth_;
+	uint64_t start_;
+	uint64_t last_split_;
+
+	// not copyable
+	LevelLoadPhase(const LevelLoadPhase&);
+	LevelLoadPhase& operator=(const LevelLoadPhase&);
+};
+
+// A step of the innermost phase, ending now; does nothing outside a phase
+void level_load_split(const char *name, WadDataType tag = 0, size_t bytes = 0);
+
+// The last profile to finish, in the order its steps began
+const std::vector<level_load_step>& last_level_load_profile();
+
+// Loads every level of the map at path in turn, as a player going through them would,
+// and prints a table of where the time went; returns a process exit status
+int run_level_load_benchmark(const std::string& path);
+
+#endif
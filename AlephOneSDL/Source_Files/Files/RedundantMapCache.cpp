@@ -0,0 +1,254 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	An on-disk cache of what recalculate_redundant_map() and precalculate_map_indexes()
+	work out for a level
+*/
+
+#include "cseries.h"
+#include "RedundantMapCache.h"
+
+#include "FileHandler.h"
+#include "FilmProfile.h"
+#include "game_errors.h"
+#include "map.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+enum {
+	kEntryMagic = FOUR_CHARS_TO_INT('r','m','a','p'),
+	kEntryVersion = 2
+};
+
+// FNV-1a
+static const uint32 hash_basis = 2166136261U;
+
+static uint32 hash_bytes(uint32 hash, const void *data, size_t length)
+{
+	const uint8 *bytes = static_cast<const uint8 *>(data);
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+template<class T> static uint32 hash_list(uint32 hash, const std::vector<T>& list)
+{
+	return list.empty() ? hash : hash_bytes(hash, &list[0], list.size() * sizeof(T));
+}
+
+// Hashes the lists as they'd be written to a wad, which leaves out the padding and unused
+// fields that may still hold whatever the last level left in them
+template<class T> static uint32 hash_packed_list(uint32 hash, std::vector<T>& list, size_t count, int packed_size,
+	uint8 *(*pack)(uint8 *, T *, size_t))
+{
+	if (count == 0)
+		return hash;
+
+	std::vector<uint8> packed(count * packed_size);
+	pack(&packed[0], &list[0], count);
+	return hash_bytes(hash, &packed[0], packed.size());
+}
+
+template<class T> static bool read_list(OpenedFile& file, std::vector<T>& list, size_t count)
+{
+	list.resize(count);
+	return list.empty() || file.Read(static_cast<int32>(count * sizeof(T)), &list[0]);
+}
+
+template<class T> static bool write_list(OpenedFile& file, std::vector<T>& list)
+{
+	return list.empty() || file.Write(static_cast<int32>(list.size() * sizeof(T)), &list[0]);
+}
+
+static FileSpecifier entry_file(uint32 map_checksum, int16 level_index, uint32 profile_hash)
+{
+	char name[32];
+	sprintf(name, "%08lx-%d-%08lx", static_cast<unsigned long>(map_checksum), level_index, static_cast<unsigned long>(profile_hash));
+
+	FileSpecifier file;
+	file.SetToMapCacheDir();
+	file.AddPart(name);
+	return file;
+}
+
+RedundantMapCache::RedundantMapCache(uint32 map_checksum, int16 level_index) :
+	map_checksum_(map_checksum), level_index_(level_index), input_hash_(hash_basis)
+{
+	// all of it, not just the flags the calculation reads today; it's only bools
+	profile_hash_ = hash_bytes(hash_basis, &film_profile, sizeof(film_profile));
+
+	// the calculation appends to the map indexes, so it only comes out the same from empty
+	usable_ = level_index != NONE && MapIndexList.empty() && dynamic_world->map_index_count == 0 &&
+		EndpointList.size() == static_cast<size_t>(dynamic_world->endpoint_count) &&
+		LineList.size() == static_cast<size_t>(dynamic_world->line_count) &&
+		SideList.size() == static_cast<size_t>(dynamic_world->side_count) &&
+		PolygonList.size() == static_cast<size_t>(dynamic_world->polygon_count) &&
+		SavedObjectList.size() >= static_cast<size_t>(dynamic_world->initial_objects_count);
+	if (!usable_)
+		return;
+
+	input_hash_ = hash_packed_list(input_hash_, EndpointList, EndpointList.size(), SIZEOF_endpoint_data, pack_endpoint_data);
+	input_hash_ = hash_packed_list(input_hash_, LineList, LineList.size(), SIZEOF_line_data, pack_line_data);
+	input_hash_ = hash_packed_list(input_hash_, SideList, SideList.size(), SIZEOF_side_data, pack_side_data);
+	input_hash_ = hash_packed_list(input_hash_, PolygonList, PolygonList.size(), SIZEOF_polygon_data, pack_polygon_data);
+	input_hash_ = hash_packed_list(input_hash_, SavedObjectList, dynamic_world->initial_objects_count, SIZEOF_map_object, pack_map_object);
+}
+
+void RedundantMapCache::FillHeader(entry_header& header) const
+{
+	obj_clear(header);
+	header.magic = kEntryMagic;
+	header.version = kEntryVersion;
+	header.map_checksum = map_checksum_;
+	header.level_index = level_index_;
+	header.input_hash = input_hash_;
+	header.profile_hash = profile_hash_;
+
+	header.sizes[0] = sizeof(endpoint_data);
+	header.sizes[1] = sizeof(line_data);
+	header.sizes[2] = sizeof(side_data);
+	header.sizes[3] = sizeof(polygon_data);
+
+	header.counts[0] = EndpointList.size();
+	header.counts[1] = LineList.size();
+	header.counts[2] = SideList.size();
+	header.counts[3] = PolygonList.size();
+	header.counts[4] = MapIndexList.size();
+}
+
+bool RedundantMapCache::Load()
+{
+	if (!usable_)
+		return false;
+
+	FileSpecifier file = entry_file(map_checksum_, level_index_, profile_hash_);
+	if (!file.Exists())
+		return false;
+
+	// a bad entry is only a reason to do the calculation
+	short error_type, error = get_game_error(&error_type);
+
+	bool loaded = false;
+	OpenedFile opened;
+	if (file.Open(opened))
+	{
+		entry_header header, expected;
+		FillHeader(expected);
+
+		if (opened.Read(sizeof(header), &header))
+		{
+			// the only things we can't know ahead of time
+			expected.data_hash = header.data_hash;
+			expected.counts[4] = header.counts[4];
+		}
+
+		if (memcmp(&header, &expected, sizeof(header)) == 0 && header.counts[4] < UINT16_MAX)
+		{
+			std::vector<endpoint_data> endpoints;
+			std::vector<line_data> lines;
+			std::vector<side_data> sides;
+			std::vector<polygon_data> polygons;
+			std::vector<int16> indexes;
+
+			if (read_list(opened, endpoints, header.counts[0]) &&
+			    read_list(opened, lines, header.counts[1]) &&
+			    read_list(opened, sides, header.counts[2]) &&
+			    read_list(opened, polygons, header.counts[3]) &&
+			    read_list(opened, indexes, header.counts[4]))
+			{
+				uint32 data_hash = hash_basis;
+				data_hash = hash_list(data_hash, endpoints);
+				data_hash = hash_list(data_hash, lines);
+				data_hash = hash_list(data_hash, sides);
+				data_hash = hash_list(data_hash, polygons);
+				data_hash = hash_list(data_hash, indexes);
+
+				if (data_hash == header.data_hash)
+				{
+					// same sizes, so the lists stay where they are
+					std::copy(endpoints.begin(), endpoints.end(), EndpointList.begin());
+					std::copy(lines.begin(), lines.end(), LineList.begin());
+					std::copy(sides.begin(), sides.end(), SideList.begin());
+					std::copy(polygons.begin(), polygons.end(), PolygonList.begin());
+					MapIndexList.swap(indexes);
+					dynamic_world->map_index_count = static_cast<int16>(MapIndexList.size());
+					loaded = true;
+				}
+			}
+
+			if (!loaded)
+				logWarning("map cache entry %s is damaged", file.GetPath());
+		}
+	}
+
+	set_game_error(error_type, error);
+	return loaded;
+}
+
+void RedundantMapCache::Store()
+{
+	if (!usable_)
+		return;
+
+	entry_header header;
+	FillHeader(header);
+	header.data_hash = hash_basis;
+	header.data_hash = hash_list(header.data_hash, EndpointList);
+	header.data_hash = hash_list(header.data_hash, LineList);
+	header.data_hash = hash_list(header.data_hash, SideList);
+	header.data_hash = hash_list(header.data_hash, PolygonList);
+	header.data_hash = hash_list(header.data_hash, MapIndexList);
+
+	short error_type, error = get_game_error(&error_type);
+
+	// write it under another name first, so a reader never sees half an entry
+	FileSpecifier file = entry_file(map_checksum_, level_index_, profile_hash_);
+	FileSpecifier temp_file;
+	temp_file.SetTempName(file);
+
+	bool stored = false;
+	{
+		OpenedFile opened;
+		if (temp_file.Open(opened, true))
+		{
+			stored = opened.Write(sizeof(header), &header) &&
+				write_list(opened, EndpointList) &&
+				write_list(opened, LineList) &&
+				write_list(opened, SideList) &&
+				write_list(opened, PolygonList) &&
+				write_list(opened, MapIndexList);
+			stored = opened.Close() && stored;
+		}
+	}
+
+	if (stored)
+		stored = temp_file.Rename(file);
+	if (!stored)
+	{
+		temp_file.Delete();
+		logWarning("could not write map cache entry %s", file.GetPath());
+	}
+
+	set_game_error(error_type, error);
+}
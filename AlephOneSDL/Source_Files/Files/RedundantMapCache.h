@@ -0,0 +1,74 @@
+#ifndef REDUNDANT_MAP_CACHE_H
+#define REDUNDANT_MAP_CACHE_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	An on-disk cache of what recalculate_redundant_map() and precalculate_map_indexes()
+	work out for a level, which on a big map is most of the time it takes to load
+
+	Entries go by map checksum, level index and film profile, one file each in the map
+	cache directory; the profile changes what the calculation finds (Marathon Infinity
+	films count adjacent polygons as intersecting), so a film replaying a level under
+	another profile gets its own entry.  An entry holds the endpoints, lines, sides and polygons as they were
+	after the calculation, and the map indexes, all as they are laid out in memory, so
+	loading one is a matter of reading them straight back in.  Along with them goes a
+	hash of those lists (and the saved objects, for the sound sources) as they were
+	before, packed as in a wad; an entry is only used if that still matches, and if the
+	structures are the same size as in the build that wrote it.  Otherwise the caller
+	does the calculation and stores the result over it.
+*/
+
+#include "cseries.h"
+
+class RedundantMapCache
+{
+public:
+	// For the level just unpacked, before its redundant data has been calculated
+	RedundantMapCache(uint32 map_checksum, int16 level_index);
+
+	// Fills in the redundant data and map indexes from the cache; false, with nothing
+	// changed, if there's no good entry
+	bool Load();
+
+	// Saves the redundant data and map indexes, once they have been calculated
+	void Store();
+
+private:
+	struct entry_header
+	{
+		uint32 magic;
+		uint32 version;
+		uint32 map_checksum;
+		int32 level_index;
+		uint32 input_hash;	// of the lists before the calculation
+		uint32 profile_hash;	// of the film profile
+		uint32 data_hash;	// of what follows the header
+		uint32 sizes[4];	// of endpoint_data, line_data, side_data, polygon_data
+		uint32 counts[5];	// of those, then of the map indexes
+	};
+
+	void FillHeader(entry_header& header) const;
+
+	uint32 map_checksum_;
+	int16 level_index_;
+	uint32 profile_hash_;
+	uint32 input_hash_;
+	bool usable_;
+};
+
+#endif
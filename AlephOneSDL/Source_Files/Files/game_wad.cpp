@@ -129,6 +129,16 @@ Feb 15, 2002 (Br'fin (Jeremy Parsons)):
 
 #include "Music.h"
 
+#include "LevelLoadProfile.h"
+#include "RedundantMapCache.h"
+
+#include "SDL_rwops_ostream.h"
+#ifdef HAVE_SDL_IMAGE
+#include "SDL_image.h"
+#endif
+
+#include <sstream>
+
 // unify the save game code into one structure.
 
 /* -------- local globals */
@@ -138,6 +148,11 @@ static bool file_is_set= false;
 // LP addition: was a physics model loaded from the previous level loaded?
 static bool PhysicsModelLoadedEarlier = false;
 
+// The map file level being processed, for the redundant map cache; NONE when the wad
+// came from somewhere else (the network, a film keyframe)
+static uint32 processing_map_checksum= 0;
+static short processing_level_index= NONE;
+
 // The following local globals are for handling games that need to be restored.
 struct revert_game_info
 {
@@ -276,6 +291,7 @@ bool load_level_from_map(
 	struct wad_data *wad;
 	short index_to_load;
 	bool restoring_game= false;
+	LevelLoadPhase phase("load_level_from_map");
 
   // DJB Start progress
   //startProgress(-1); //DCW: I'm not super keen on this progress thing.
@@ -303,8 +319,16 @@ bool load_level_from_map(
 					wad= read_indexed_wad_from_file(MapFile, &header, index_to_load, true);
 					if (wad)
 					{
+						size_t wad_bytes= 0;
+						for (short i= 0; i<wad->tag_count; ++i)
+							wad_bytes+= wad->tag_data[i].length;
+						level_load_split("read_indexed_wad_from_file", 0, wad_bytes);
+
 						/* Process everything... */
+						processing_map_checksum= header.checksum;
+						processing_level_index= restoring_game ? NONE : index_to_load;
 						process_map_wad(wad, restoring_game, header.data_version);
+						processing_level_index= NONE;
 		
 						/* Nuke our memory... */
 						free_wad(wad);
@@ -347,6 +371,8 @@ void complete_loading_level(
 	size_t actual_platform_data_count,
 	short version)
 {
+	LevelLoadPhase phase("complete_loading_level");
+
 	/* Scan, add the doors, recalculate, and generally tie up all loose ends */
 	/* Recalculate the redundant data.. */
 	load_redundant_map_data(_map_indexes, map_index_count);
@@ -365,9 +391,11 @@ void complete_loading_level(
 		assert(0 <= static_cast<int16>(actual_platform_data_count));
 		dynamic_world->platform_count= static_cast<int16>(actual_platform_data_count);
 	}
+	level_load_split("scan_and_add_platforms", PLATFORM_STATIC_DATA_TAG, platform_data_count*SIZEOF_static_platform_data);
 
 	scan_and_add_scenery();
 	ok_to_reset_scenery_solidity = true;
+	level_load_split("scan_and_add_scenery");
 	
 	/* Gotta do this after recalculate redundant.. */
 	if(version==MARATHON_ONE_DATA_VERSION)
@@ -384,6 +412,7 @@ void complete_loading_level(
 					side->flags |= _side_is_lighted_switch;
 			}
 		}
+		level_load_split("guess_side_lightsource_indexes");
 	}
 }
 
@@ -466,6 +495,7 @@ bool new_game(
 {
 	short player_index, i;
 	bool success= true;
+	LevelLoadPhase phase("new_game");
 
 	ResetPassedLua();
 
@@ -534,6 +564,7 @@ bool new_game(
 		
 		// Reset the player queues (done here and in load_game)
 		reset_action_queues();
+		level_load_split("new_player");
 		
 		/* Load the collections */
 		/* entering map might fail if NetSync() fails.. */
@@ -754,6 +785,7 @@ bool goto_level(
 	short number_of_players)
 {
 	bool success= true;
+	LevelLoadPhase phase("goto_level");
 
 	if(!new_game)
 	{
@@ -762,6 +794,7 @@ bool goto_level(
 
 		// ghs: hack to get new MML-specified sounds loaded
 		SoundManager::instance()->UnloadAllSounds();
+		level_load_split("leaving_map");
 	}
 
 #if !defined(DISABLE_NETWORKING)
@@ -773,6 +806,7 @@ bool goto_level(
 		/* then calls process_map_wad on it. Non-server receives the map and then */
 		/* calls process_map_wad on it. */
 		success= NetChangeMap(entry);
+		level_load_split("NetChangeMap");
 	} 
 	else 
 #endif // !defined(DISABLE_NETWORKING)
@@ -806,9 +840,11 @@ bool goto_level(
 			LoadReplayNetLua();
 		}
 		LoadStatsLua();
+		level_load_split("RunLevelScript");
 
 		Music::instance()->PreloadLevelMusic();
 		set_game_error(SavedType,SavedError);
+		level_load_split("PreloadLevelMusic");
 		
 		if (!new_game)
 		{
@@ -822,11 +858,13 @@ bool goto_level(
 		// we want to be before place_initial_objects, and
 		// before MarkLuaCollections
 		RunLuaScript();
+		level_load_split("RunLuaScript");
 
 		if (film_profile.early_object_initialization)
 		{
 			place_initial_objects();
 			initialize_control_panels_for_level();
+			level_load_split("place_initial_objects");
 		}
 
 		if (!new_game) 
@@ -841,6 +879,7 @@ bool goto_level(
 		{
 			place_initial_objects();
 			initialize_control_panels_for_level();
+			level_load_split("place_initial_objects");
 		}
 		
 	}
@@ -1176,7 +1215,11 @@ void recalculate_redundant_map(
 bool load_game_from_file(FileSpecifier& File, bool run_scripts, bool *was_map_found)
 {
 	bool success= false;
+	LevelLoadPhase phase("load_game_from_file");
 
+	// it may be the one being saved
+	finish_background_saves();
+	
 	ResetPassedLua();
 	
 	/* Setup for a revert.. */
@@ -1254,6 +1297,7 @@ bool revert_game(
 	void)
 {
 	bool successful;
+	LevelLoadPhase phase("revert_game");
 	
 	assert(dynamic_world->player_count==1);
 
@@ -1381,113 +1425,344 @@ bool export_level(FileSpecifier& File)
 	
 }
 
+/* Film keyframes: the whole dynamic world, as a flat save-game wad */
+void *get_flat_save_game_data(
+	void)
+{
+	struct wad_header header;
+	struct wad_data *wad;
+	int32 wad_length;
+	void *data= NULL;
+
+	/* Save off the random seed. */
+	dynamic_world->random_seed= get_random_seed();
+
+	fill_default_wad_header(MapFileSpec, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 1, 0, &header);
+
+	wad= build_save_game_wad(&header, &wad_length);
+	if (wad)
+	{
+		data= get_flat_data_from_wad(wad, &header);
+		free_wad(wad);
+	}
+
+	return data;
+}
+
+/* Like revert_game(), but from a keyframe; takes ownership of the flat data */
+bool restore_film_keyframe(
+	void *data)
+{
+	struct wad_header header;
+	struct wad_data *wad;
+	bool successful= false;
+	LevelLoadPhase phase("restore_film_keyframe");
+
+	leaving_map();
+
+	wad= inflate_flat_data(data, &header);
+	if (wad)
+	{
+		successful= process_map_wad(wad, true, header.data_version);
+		free_wad(wad); /* Note that the flat data points into the wad. */
+	}
+	else
+	{
+		free(data);
+	}
+
+	if (successful)
+	{
+		// Being careful to carry over errors so that Pfhortran errors can be ignored
+		short SavedType, SavedError = get_game_error(&SavedType);
+		RunLevelScript(dynamic_world->current_level_number);
+		RunScriptChunks();
+		if (dynamic_world->player_count == 1)
+		{
+			LoadSoloLua();
+		}
+		else
+		{
+			LoadReplayNetLua();
+		}
+		LoadStatsLua();
+		set_game_error(SavedType,SavedError);
+
+		Music::instance()->PreloadLevelMusic();
+		RunLuaScript();
+
+		successful= entering_map(true /*restoring game*/);
+	}
+
+	if (successful)
+	{
+		update_interface(NONE);
+		ChaseCam_Reset();
+		ResetFieldOfView();
+		reset_messages();
+		ReloadViewContext();
+	}
+
+	return successful;
+}
+
 void get_current_saved_game_name(FileSpecifier& File)
 {
 	File = revert_game_data.SavedGame;
 }
 
-/* The current mapfile should be set to the save game file... */
-bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata)
+// A saved game on its way to disk
+struct saved_game_file
 {
+	saved_game_file(FileSpecifier& inFile, const std::string& inMetadata) :
+		File(inFile), wad(NULL), wad_length(0), metadata(inMetadata), preview(NULL),
+		err(0), success(false), thread(NULL), done(NULL), done_arg(NULL)
+	{
+		SDL_AtomicSet(&finished, 0);
+	}
+	
+	FileSpecifier File;
+	FileSpecifier TempFile;		// written first, for a safe save
+	OpenedFile SaveFile;
 	struct wad_header header;
-	short err = 0;
-	bool success= false;
-	int32 offset, wad_length;
-	struct directory_entry entries[2];
-	struct wad_data *wad, *meta_wad;
+	struct wad_data *wad;
+	int32 wad_length;
+	std::string metadata;
+	std::string imagedata;
+	SDL_Surface *preview;		// becomes imagedata when the file is written
+	short err;			// kept here, not in the game error, so the save can go on any thread
+	bool success;
+	
+	// for background saves
+	SDL_Thread *thread;
+	SDL_atomic_t finished;
+	saved_game_callback done;
+	void *done_arg;
+};
+
+static saved_game_file *background_save = NULL;
+
+// Everything that needs the world or can set the game error, which stays on the main thread
+static bool prepare_saved_game_file(saved_game_file& save)
+{
+	LevelLoadPhase phase("prepare_saved_game_file");
 
 	/* Save off the random seed. */
 	dynamic_world->random_seed= get_random_seed();
 
 	/* Setup to revert the game properly */
 	revert_game_data.game_is_from_disk= true;
-	revert_game_data.SavedGame = File;
+	revert_game_data.SavedGame = save.File;
 
+	/* Fill in the default wad header (we are using File instead of TempFile to get the name right in the header) */
+	fill_default_wad_header(save.File, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 2, 0, &save.header);
+	save.header.parent_checksum= read_wad_file_checksum(MapFileSpec);
+	level_load_split("read_wad_file_checksum");
+	
+	save.wad= build_save_game_wad(&save.header, &save.wad_length);
+	if (!save.wad)
+	{
+		save.err= error_pending() ? get_game_error(NULL) : 1;
+		clear_game_error();
+		return false;
+	}
+	phase.SetBytes(save.wad_length);
+	
 	// LP: add a file here; use temporary file for a safe save.
-	// Write into the temporary file first
-	FileSpecifier TempFile;
-	TempFile.SetTempName(File);
+	// Opening it sets the game error if it fails, so that's done here too
+	save.TempFile.SetTempName(save.File);
 	
-	/* Fill in the default wad header (we are using File instead of TempFile to get the name right in the header) */
-	fill_default_wad_header(File, CURRENT_WADFILE_VERSION, EDITOR_MAP_VERSION, 2, 0, &header);
-		
 	/* Assume that we confirmed on save as... */
-	if (create_wadfile(TempFile,_typecode_savegame))
+	if (!create_wadfile(save.TempFile,_typecode_savegame) || !open_wad_file_for_writing(save.TempFile,save.SaveFile))
 	{
-		OpenedFile SaveFile;
-		if(open_wad_file_for_writing(TempFile,SaveFile))
+		save.err= save.TempFile.GetError() ? save.TempFile.GetError() : 1;
+		clear_game_error();
+		free_wad(save.wad);
+		save.wad= NULL;
+		return false;
+	}
+	level_load_split("open_saved_game_file");
+	
+	return true;
+}
+
+// Everything else, which can be done on any thread: nothing here touches the game error,
+// and what went wrong is left in save.err to be reported once the save is finished
+static bool write_saved_game_file(saved_game_file& save)
+{
+	bool success= false;
+	int32 offset, wad_length;
+	struct directory_entry entries[2];
+	struct wad_data *meta_wad;
+	OpenedFile& SaveFile= save.SaveFile;
+	
+	if (save.preview)
+	{
+		std::ostringstream image_stream;
+		if (encode_saved_game_preview(save.preview, image_stream))
+			save.imagedata = image_stream.str();
+		SDL_FreeSurface(save.preview);
+		save.preview = NULL;
+	}
+
+	/* Write out the new header */
+	if (write_wad_header(SaveFile, &save.header))
+	{
+		offset= SIZEOF_wad_header;
+		
+		/* Set the entry data.. */
+		set_indexed_directory_offset_and_length(&save.header, 
+			entries, 0, offset, save.wad_length, 0);
+		
+		/* Save it.. */
+		if (write_wad(SaveFile, &save.header, save.wad, offset))
 		{
-			/* Write out the new header */
-			if (write_wad_header(SaveFile, &header))
+			/* Update the new header */
+			offset+= save.wad_length;
+			save.header.directory_offset= offset;
+			
+			/* Create metadata wad */
+			meta_wad = build_meta_game_wad(save.metadata, save.imagedata, &save.header, &wad_length);
+			if (meta_wad)
 			{
-				offset= SIZEOF_wad_header;
-		
-				wad= build_save_game_wad(&header, &wad_length);
-				if (wad)
+				set_indexed_directory_offset_and_length(&save.header,
+					entries, 1, offset, wad_length, SAVE_GAME_METADATA_INDEX);
+				
+				if (write_wad(SaveFile, &save.header, meta_wad, offset))
 				{
-					/* Set the entry data.. */
-					set_indexed_directory_offset_and_length(&header, 
-						entries, 0, offset, wad_length, 0);
-					
-					/* Save it.. */
-					if (write_wad(SaveFile, &header, wad, offset))
+					offset+= wad_length;
+					save.header.directory_offset= offset;
+			
+					if (write_wad_header(SaveFile, &save.header) && write_directorys(SaveFile, &save.header, entries))
 					{
-						/* Update the new header */
-						offset+= wad_length;
-						header.directory_offset= offset;
-						header.parent_checksum= read_wad_file_checksum(MapFileSpec);
-						
-						/* Create metadata wad */
-						meta_wad = build_meta_game_wad(metadata, imagedata, &header, &wad_length);
-						if (meta_wad)
-						{
-							set_indexed_directory_offset_and_length(&header,
-								entries, 1, offset, wad_length, SAVE_GAME_METADATA_INDEX);
-							
-							if (write_wad(SaveFile, &header, meta_wad, offset))
-							{
-								offset+= wad_length;
-								header.directory_offset= offset;
-						
-								if (write_wad_header(SaveFile, &header) && write_directorys(SaveFile, &header, entries))
-								{
-									/* We win. */
-									success= true;
-								}
-							}
-							
-							free_wad(meta_wad);
-						}
+						/* We win. */
+						success= true;
 					}
-
-					free_wad(wad);
 				}
+				
+				free_wad(meta_wad);
 			}
-
-			err = SaveFile.GetError();
-			close_wad_file(SaveFile);
 		}
-		
-		if (!err)
+	}
+
+	save.err = SaveFile.GetError();
+	if (!success && !save.err)
+		save.err = 1;
+	close_wad_file(SaveFile);
+	
+	if (!save.err)
+	{
+		if (!save.TempFile.Rename(save.File))
 		{
-			if (!TempFile.Rename(File))
-			{
-				err = 1;
-			}
+			save.err = 1;
 		}
 	}
 	
-	if(err || error_pending())
+	free_wad(save.wad);
+	save.wad = NULL;
+	
+	return success;
+}
+
+static bool report_saved_game_file(saved_game_file& save, bool success)
+{
+	if(save.err)
 	{
-		if(!err) err= get_game_error(NULL);
-		alert_user(infoError, strERRORS, fileError, err);
-		clear_game_error();
+		alert_user(infoError, strERRORS, fileError, save.err);
 		success= false;
 	}
 	
 	return success;
 }
 
+/* The current mapfile should be set to the save game file... */
+bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata)
+{
+	finish_background_saves();
+	
+	saved_game_file save(File, metadata);
+	save.imagedata = imagedata;
+	
+	bool success= prepare_saved_game_file(save) && write_saved_game_file(save);
+	return report_saved_game_file(save, success);
+}
+
+static int background_save_thread(void *data)
+{
+	saved_game_file *save = static_cast<saved_game_file *>(data);
+	save->success = write_saved_game_file(*save);
+	SDL_AtomicSet(&save->finished, 1);
+	return 0;
+}
+
+bool save_game_file_in_background(FileSpecifier& File, const std::string& metadata, SDL_Surface *preview,
+				  saved_game_callback done, void *arg)
+{
+	finish_background_saves();
+	
+	saved_game_file *save = new saved_game_file(File, metadata);
+	save->preview = preview;
+	save->done = done;
+	save->done_arg = arg;
+	
+	if (!prepare_saved_game_file(*save))
+	{
+		report_saved_game_file(*save, false);
+		SDL_FreeSurface(save->preview);
+		delete save;
+		return false;
+	}
+	
+	save->thread = SDL_CreateThread(background_save_thread, "save_game_file_in_background", save);
+	if (!save->thread)
+		background_save_thread(save);
+	
+	background_save = save;
+	return true;
+}
+
+void poll_background_saves(void)
+{
+	if (!background_save || !SDL_AtomicGet(&background_save->finished))
+		return;
+	
+	saved_game_file *save = background_save;
+	background_save = NULL;
+	
+	if (save->thread)
+		SDL_WaitThread(save->thread, NULL);
+	
+	bool success = report_saved_game_file(*save, save->success);
+	if (save->done)
+		save->done(save->File, success, save->imagedata, save->done_arg);
+	delete save;
+}
+
+void finish_background_saves(void)
+{
+	if (background_save && background_save->thread)
+	{
+		SDL_WaitThread(background_save->thread, NULL);
+		background_save->thread = NULL;
+	}
+	poll_background_saves();
+}
+
+bool encode_saved_game_preview(SDL_Surface *preview, std::ostream& ostream)
+{
+    SDL_RWops *rwops = SDL_RWFromOStream(ostream);
+//#if defined(HAVE_PNG) && defined(HAVE_SDL_IMAGE)
+//    int ret = aoIMG_SavePNG_RW(rwops, surface, IMG_COMPRESS_DEFAULT, NULL, 0);
+#ifdef HAVE_SDL_IMAGE
+	int ret = IMG_SavePNG_RW(preview, rwops, 0);
+#else
+    int ret = SDL_SaveBMP_RW(preview, rwops, false);
+#endif
+    SDL_RWclose(rwops);
+	
+    return (ret == 0);
+}
+
 /* -------- static functions */
 static void scan_and_add_platforms(
 	uint8 *platform_static_data,
@@ -1545,6 +1820,7 @@ bool process_map_wad(
 	uint8 *data;
 	size_t count;
 	bool is_preprocessed_map= false;
+	LevelLoadPhase phase("process_map_wad");
 
 	assert(version==MARATHON_INFINITY_DATA_VERSION || version==MARATHON_TWO_DATA_VERSION || version==MARATHON_ONE_DATA_VERSION);
 
@@ -1553,6 +1829,7 @@ bool process_map_wad(
 
 	/* Calculate the length (for reallocate map) */
 	allocate_map_structure_for_map(wad);
+	level_load_split("allocate_map_structure_for_map");
 
 	/* Extract points */
 	data= (uint8 *)extract_type_from_wad(wad, POINT_TAG, &data_length);
@@ -1562,6 +1839,7 @@ bool process_map_wad(
 	if(count)
 	{
 		load_points(data, count);
+		level_load_split("load_points", POINT_TAG, data_length);
 	} else {
          
 		data= (uint8 *)extract_type_from_wad(wad, ENDPOINT_DATA_TAG, &data_length);
@@ -1574,6 +1852,7 @@ bool process_map_wad(
 		assert(count == static_cast<size_t>(static_cast<int16>(count)));
 		assert(0 <= static_cast<int16>(count));
 		dynamic_world->endpoint_count= static_cast<int16>(count);
+		level_load_split("unpack_endpoint_data", ENDPOINT_DATA_TAG, data_length);
 
 		if (version > MARATHON_ONE_DATA_VERSION)
 			is_preprocessed_map= true;
@@ -1584,18 +1863,21 @@ bool process_map_wad(
 	count = data_length/SIZEOF_line_data;
 	assert(data_length == count*SIZEOF_line_data);
 	load_lines(data, count);
+	level_load_split("load_lines", LINE_TAG, data_length);
 
 	/* Order is important! */
 	data= (uint8 *)extract_type_from_wad(wad, SIDE_TAG, &data_length);
 	count = data_length/SIZEOF_side_data;
 	assert(data_length == count*SIZEOF_side_data);
 	load_sides(data, count, version);
+	level_load_split("load_sides", SIDE_TAG, data_length);
 
 	/* Extract polygons */
 	data= (uint8 *)extract_type_from_wad(wad, POLYGON_TAG, &data_length);
 	count = data_length/SIZEOF_polygon_data;
 	assert(data_length == count*SIZEOF_polygon_data);
 	load_polygons(data, count, version);
+	level_load_split("load_polygons", POLYGON_TAG, data_length);
 
 	/* Extract the lightsources */
 	if(restoring_game)
@@ -1606,6 +1888,7 @@ bool process_map_wad(
 		assert(data_length == count*SIZEOF_light_data);
 		LightList.resize(count);
 		unpack_light_data(data,lights,count);
+		level_load_split("unpack_light_data", LIGHTSOURCE_TAG, data_length);
 	}
 	else
 	{
@@ -1630,6 +1913,7 @@ bool process_map_wad(
 				map_polygons[count].first_object= NONE;
 			}
 		}
+		level_load_split("load_lights", LIGHTSOURCE_TAG, data_length);
 	}
 
 	/* Extract the annotations */
@@ -1637,12 +1921,14 @@ bool process_map_wad(
 	count = data_length/SIZEOF_map_annotation;
 	assert(data_length == count*SIZEOF_map_annotation);
 	load_annotations(data, count);
+	level_load_split("load_annotations", ANNOTATION_TAG, data_length);
 
 	/* Extract the objects */
 	data= (uint8 *)extract_type_from_wad(wad, OBJECT_TAG, &data_length);
 	count = data_length/SIZEOF_map_object;
 	assert(data_length == count*static_cast<size_t>(SIZEOF_map_object));
 	load_objects(data, count);
+	level_load_split("load_objects", OBJECT_TAG, data_length);
 
 	/* Extract the map info data */
 	data= (uint8 *)extract_type_from_wad(wad, MAP_INFO_TAG, &data_length);
@@ -1679,6 +1965,7 @@ bool process_map_wad(
     if (static_world->environment_flags & _environment_song_index_m1) {
 	    Music::instance()->SetClassicLevelMusic(static_world->song_index);
     }
+	level_load_split("load_map_info", MAP_INFO_TAG, data_length);
 
 	/* Extract the game difficulty info.. */
 	data= (uint8 *)extract_type_from_wad(wad, ITEM_PLACEMENT_STRUCTURE_TAG, &data_length);
@@ -1693,10 +1980,12 @@ bool process_map_wad(
 	load_placement_data(data + MAXIMUM_OBJECT_TYPES*SIZEOF_object_frequency_definition, data);
 	if (data_length == 0)
 		delete []data;
+	level_load_split("load_placement_data", ITEM_PLACEMENT_STRUCTURE_TAG, data_length);
 	
 	/* Extract the terminal data. */
 	data= (uint8 *)extract_type_from_wad(wad, TERMINAL_DATA_TAG, &data_length);
 	load_terminal_data(data, data_length);
+	level_load_split("load_terminal_data", TERMINAL_DATA_TAG, data_length);
 
 	/* Extract the media definitions */
 	if(restoring_game)
@@ -1715,6 +2004,7 @@ bool process_map_wad(
 		assert(count*SIZEOF_media_data==data_length);
 		load_media(data, count);
 	}
+	level_load_split("load_media", MEDIA_TAG, data_length);
 
 	/* Extract the ambient sound images */
 	data= (uint8 *)extract_type_from_wad(wad, AMBIENT_SOUND_TAG, &data_length);
@@ -1722,28 +2012,34 @@ bool process_map_wad(
 	assert(data_length == count*SIZEOF_ambient_sound_image_data);
 	load_ambient_sound_images(data, count);
 	load_ambient_sound_images(data, data_length/SIZEOF_ambient_sound_image_data);
+	level_load_split("load_ambient_sound_images", AMBIENT_SOUND_TAG, data_length);
 
 	/* Extract the random sound images */
 	data= (uint8 *)extract_type_from_wad(wad, RANDOM_SOUND_TAG, &data_length);
 	count = data_length/SIZEOF_random_sound_image_data;
 	assert(data_length == count*SIZEOF_random_sound_image_data);
 	load_random_sound_images(data, count);
+	level_load_split("load_random_sound_images", RANDOM_SOUND_TAG, data_length);
 
 	/* Extract embedded shapes */
 	data= (uint8 *)extract_type_from_wad(wad, SHAPE_PATCH_TAG, &data_length);
 	set_shapes_patch_data(data, data_length);
+	level_load_split("set_shapes_patch_data", SHAPE_PATCH_TAG, data_length);
 
 	/* Extract MMLS */
 	data= (uint8 *)extract_type_from_wad(wad, MMLS_TAG, &data_length);
 	SetMMLS(data, data_length);
+	level_load_split("SetMMLS", MMLS_TAG, data_length);
 
 	/* Extract LUAS */
 	data= (uint8 *)extract_type_from_wad(wad, LUAS_TAG, &data_length);
 	SetLUAS(data, data_length);
+	level_load_split("SetLUAS", LUAS_TAG, data_length);
 
 	/* Extract saved Lua state */
 	data =(uint8 *)extract_type_from_wad(wad, LUA_STATE_TAG, &data_length);
 	unpack_lua_states(data, data_length);
+	level_load_split("unpack_lua_states", LUA_STATE_TAG, data_length);
 
 	// LP addition: load the physics-model chunks (all fixed-size)
 	bool PhysicsModelLoaded = false;
@@ -1757,6 +2053,7 @@ bool process_map_wad(
 		if (!PhysicsModelLoaded) init_physics_wad_data();
 		PhysicsModelLoaded = true;
 		unpack_monster_definition(data,count);
+		level_load_split("unpack_monster_definition", MONSTER_PHYSICS_TAG, data_length);
 	}
 	
 	data= (uint8 *)extract_type_from_wad(wad, EFFECTS_PHYSICS_TAG, &data_length);
@@ -1768,6 +2065,7 @@ bool process_map_wad(
 		if (!PhysicsModelLoaded) init_physics_wad_data();
 		PhysicsModelLoaded = true;
 		unpack_effect_definition(data,count);
+		level_load_split("unpack_effect_definition", EFFECTS_PHYSICS_TAG, data_length);
 	}
 	
 	data= (uint8 *)extract_type_from_wad(wad, PROJECTILE_PHYSICS_TAG, &data_length);
@@ -1779,6 +2077,7 @@ bool process_map_wad(
 		if (!PhysicsModelLoaded) init_physics_wad_data();
 		PhysicsModelLoaded = true;
 		unpack_projectile_definition(data,count);
+		level_load_split("unpack_projectile_definition", PROJECTILE_PHYSICS_TAG, data_length);
 	}
 	
 	data= (uint8 *)extract_type_from_wad(wad, PHYSICS_PHYSICS_TAG, &data_length);
@@ -1790,6 +2089,7 @@ bool process_map_wad(
 		if (!PhysicsModelLoaded) init_physics_wad_data();
 		PhysicsModelLoaded = true;
 		unpack_physics_constants(data,count);
+		level_load_split("unpack_physics_constants", PHYSICS_PHYSICS_TAG, data_length);
 	}
 	
 	data= (uint8 *)extract_type_from_wad(wad, WEAPONS_PHYSICS_TAG, &data_length);
@@ -1801,13 +2101,17 @@ bool process_map_wad(
 		if (!PhysicsModelLoaded) init_physics_wad_data();
 		PhysicsModelLoaded = true;
 		unpack_weapon_definition(data,count);
+		level_load_split("unpack_weapon_definition", WEAPONS_PHYSICS_TAG, data_length);
 	}
 	
 	// LP addition: Reload the physics model if it had been loaded in the previous level,
 	// but not in the current level. This avoids the persistent-physics bug.
 	// ghs: always reload the physics model if there isn't one merged
 	if (PhysicsModelLoadedEarlier && !PhysicsModelLoaded && !game_is_networked)
+	{
 		import_definition_structures();
+		level_load_split("import_definition_structures");
+	}
 	PhysicsModelLoadedEarlier = PhysicsModelLoaded;
 	
 	/* If we are restoring the game, then we need to add the dynamic data */
@@ -1819,16 +2123,19 @@ bool process_map_wad(
 		assert(count*int32(sizeof(short))==data_length);
 		MapIndexList.resize(count);
 		StreamToList(data,map_indexes,count);
+		level_load_split("map_indexes", MAP_INDEXES_TAG, data_length);
 		
 		data= (uint8 *)extract_type_from_wad(wad, PLAYER_STRUCTURE_TAG, &data_length);
 		count= data_length/SIZEOF_player_data;
 		assert(count*SIZEOF_player_data==data_length);
 		unpack_player_data(data,players,count);
 		team_damage_from_player_data();
+		level_load_split("unpack_player_data", PLAYER_STRUCTURE_TAG, data_length);
 		
 		data= (uint8 *)extract_type_from_wad(wad, DYNAMIC_STRUCTURE_TAG, &data_length);
 		assert(data_length == SIZEOF_dynamic_data);
 		unpack_dynamic_data(data,dynamic_world,1);
+		level_load_split("unpack_dynamic_data", DYNAMIC_STRUCTURE_TAG, data_length);
 		
 		data= (uint8 *)extract_type_from_wad(wad, OBJECT_STRUCTURE_TAG, &data_length);
 		count= data_length/SIZEOF_object_data;
@@ -1836,12 +2143,14 @@ bool process_map_wad(
 		vassert(count <= MAXIMUM_OBJECTS_PER_MAP,
 			csprintf(temporary,"Number of map objects %lu > limit %u",count,MAXIMUM_OBJECTS_PER_MAP));
 		unpack_object_data(data,objects,count);
+		level_load_split("unpack_object_data", OBJECT_STRUCTURE_TAG, data_length);
 		
 		// Unpacking is E-Z here...
 		data= (uint8 *)extract_type_from_wad(wad, AUTOMAP_LINES, &data_length);
 		memcpy(automap_lines,data,data_length);
 		data= (uint8 *)extract_type_from_wad(wad, AUTOMAP_POLYGONS, &data_length);
 		memcpy(automap_polygons,data,data_length);
+		level_load_split("automap");
 
 		data= (uint8 *)extract_type_from_wad(wad, MONSTERS_STRUCTURE_TAG, &data_length);
 		count= data_length/SIZEOF_monster_data;
@@ -1849,6 +2158,7 @@ bool process_map_wad(
 		vassert(count <= MAXIMUM_MONSTERS_PER_MAP,
 			csprintf(temporary,"Number of monsters %lu > limit %u",count,MAXIMUM_MONSTERS_PER_MAP));
 		unpack_monster_data(data,monsters,count);
+		level_load_split("unpack_monster_data", MONSTERS_STRUCTURE_TAG, data_length);
 
 		data= (uint8 *)extract_type_from_wad(wad, EFFECTS_STRUCTURE_TAG, &data_length);
 		count= data_length/SIZEOF_effect_data;
@@ -1856,6 +2166,7 @@ bool process_map_wad(
 		vassert(count <= MAXIMUM_EFFECTS_PER_MAP,
 			csprintf(temporary,"Number of effects %lu > limit %u",count,MAXIMUM_EFFECTS_PER_MAP));
 		unpack_effect_data(data,effects,count);
+		level_load_split("unpack_effect_data", EFFECTS_STRUCTURE_TAG, data_length);
 
 		data= (uint8 *)extract_type_from_wad(wad, PROJECTILES_STRUCTURE_TAG, &data_length);
 		count= data_length/SIZEOF_projectile_data;
@@ -1863,22 +2174,26 @@ bool process_map_wad(
 		vassert(count <= MAXIMUM_PROJECTILES_PER_MAP,
 			csprintf(temporary,"Number of projectiles %lu > limit %u",count,MAXIMUM_PROJECTILES_PER_MAP));
 		unpack_projectile_data(data,projectiles,count);
+		level_load_split("unpack_projectile_data", PROJECTILES_STRUCTURE_TAG, data_length);
 		
 		data= (uint8 *)extract_type_from_wad(wad, PLATFORM_STRUCTURE_TAG, &data_length);
 		count= data_length/SIZEOF_platform_data;
 		assert(count*SIZEOF_platform_data==data_length);
 		PlatformList.resize(count);
 		unpack_platform_data(data,platforms,count);
+		level_load_split("unpack_platform_data", PLATFORM_STRUCTURE_TAG, data_length);
 		
 		data= (uint8 *)extract_type_from_wad(wad, WEAPON_STATE_TAG, &data_length);
 		count= data_length/SIZEOF_player_weapon_data;
 		assert(count*SIZEOF_player_weapon_data==data_length);
 		unpack_player_weapon_data(data,count);
+		level_load_split("unpack_player_weapon_data", WEAPON_STATE_TAG, data_length);
 		
 		data= (uint8 *)extract_type_from_wad(wad, TERMINAL_STATE_TAG, &data_length);
 		count= data_length/SIZEOF_player_terminal_data;
 		assert(count*SIZEOF_player_terminal_data==data_length);
 		unpack_player_terminal_data(data,count);
+		level_load_split("unpack_player_terminal_data", TERMINAL_STATE_TAG, data_length);
 		
 		complete_restoring_level(wad);
 	} else {
@@ -1968,11 +2283,25 @@ static void load_redundant_map_data(
 		assert(count == static_cast<size_t>(static_cast<int16>(count)));
 		assert(0 <= static_cast<int16>(count));
 		dynamic_world->map_index_count= static_cast<int16>(count);
+		level_load_split("load_redundant_map_data", MAP_INDEXES_TAG, count*sizeof(short));
 	}
 	else
 	{
-		recalculate_redundant_map();
-		precalculate_map_indexes();
+		RedundantMapCache cache(processing_map_checksum, processing_level_index);
+		if (cache.Load())
+		{
+			level_load_split("RedundantMapCache::Load");
+		}
+		else
+		{
+			recalculate_redundant_map();
+			level_load_split("recalculate_redundant_map");
+			precalculate_map_indexes();
+			level_load_split("precalculate_map_indexes");
+
+			cache.Store();
+			level_load_split("RedundantMapCache::Store");
+		}
 	}
 }
 
@@ -2565,6 +2894,7 @@ static struct wad_data *build_save_game_wad(
 	if(wad)
 	{
 		recalculate_map_counts();
+		level_load_split("recalculate_map_counts");
 		for(unsigned loop= 0; loop<NUMBER_OF_SAVE_ARRAYS; ++loop)
 		{
 			/* If there is a conversion function, let it handle it */
@@ -2576,6 +2906,7 @@ static struct wad_data *build_save_game_wad(
 				wad= append_data_to_wad(wad, save_data[loop].tag, array_to_slam, size, 0);
 				delete []array_to_slam;
 			}
+			level_load_split("tag_to_global_array_and_size", save_data[loop].tag, size);
 		}
 		if(wad) *length= calculate_wad_length(header, wad);
 	}
@@ -34,11 +34,27 @@ Aug 12, 2000 (Loren Petrich):
 */
 
 #include "cstypes.h"
+#include <ostream>
 #include <string>
 
 class FileSpecifier;
+struct SDL_Surface;
 
 bool save_game_file(FileSpecifier& File, const std::string& metadata, const std::string& imagedata);
+
+// Background saves: the world is packed up into the save game wad and the file opened at
+// once, and the file is written on another thread, along with the preview (which is ours to free) encoded as
+// its image.  Returns false if the save couldn't even be started; otherwise done is called
+// once the file is written, from poll_background_saves() on the main thread.
+typedef void (*saved_game_callback)(FileSpecifier& File, bool success, const std::string& imagedata, void *arg);
+bool save_game_file_in_background(FileSpecifier& File, const std::string& metadata, SDL_Surface *preview,
+				  saved_game_callback done = NULL, void *arg = NULL);
+void poll_background_saves(void);
+// Waits for the save in progress, if any, and reports it
+void finish_background_saves(void);
+
+// The saved game's preview image, as stored in its metadata
+bool encode_saved_game_preview(SDL_Surface *preview, std::ostream& ostream);
 struct wad_data *build_meta_game_wad(const std::string& metadata, const std::string& imagedata, struct wad_header *header, int32 *length);
 
 bool export_level(FileSpecifier& File);
@@ -53,6 +69,10 @@ void set_saved_game_name_to_default();
 // ZZZ: exposed this for netgame-resuming code
 bool process_map_wad(struct wad_data *wad, bool restoring_game, short version);
 
+// Film keyframes: snapshot the dynamic world as flat save-game data, and restore it
+void *get_flat_save_game_data(void);
+bool restore_film_keyframe(void *data);
+
 bool match_checksum_with_map(short vRefNum, long dirID, uint32 checksum, 
 	FileSpecifier& File);
 void set_map_file(FileSpecifier& File);
@@ -136,10 +136,9 @@ bool save_game(void)
   return true;
   
 	pause_game();
+    // the rest is reported when the save finishes
     bool success = create_quick_save();
-    if (success)
-        screen_printf("Game saved");
-    else
+    if (!success)
         screen_printf("Save failed");
 	resume_game();
 
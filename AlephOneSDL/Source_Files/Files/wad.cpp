@@ -904,6 +904,69 @@ struct wad_data *inflate_flat_data(
 	return wad;
 }
 
+void *get_flat_data_from_wad(
+	struct wad_data *wad, 
+	struct wad_header *header)
+{
+	short entry_header_length= get_entry_header_length(header);
+	int32 length= calculate_wad_length(header, wad);
+	uint8 *data;
+
+	assert(wad);
+	assert(!wad->read_only_data);
+
+	data= (uint8 *)malloc(length+SIZEOF_encapsulated_wad_data);
+	if(data)
+	{
+		// Pack the encapsulated header
+		uint8 *S = data;
+		ValueToStream(S,uint32(CURRENT_FLAT_MAGIC_COOKIE));
+		ValueToStream(S,int32(length + SIZEOF_encapsulated_wad_data));
+		S = pack_wad_header(S,header,1);
+		assert((S - data) == SIZEOF_encapsulated_wad_data);
+
+		/* Same layout as write_wad(), only into memory */
+		int32 running_offset= 0l;
+		for(short index=0; index<wad->tag_count; ++index)
+		{
+			struct entry_header entry;
+			entry.tag= wad->tag_data[index].tag;
+			entry.length= wad->tag_data[index].length;
+			entry.offset= wad->tag_data[index].offset;
+
+			if(index==wad->tag_count-1)
+			{
+				/* Last one's next offset is zero.. */
+				entry.next_offset= 0;
+			} else {
+				running_offset+= entry.length+entry_header_length;
+				entry.next_offset= running_offset;
+			}
+
+			switch (entry_header_length)
+			{
+			case SIZEOF_old_entry_header:
+				pack_old_entry_header(S,(old_entry_header *)&entry,1);
+				break;
+			case SIZEOF_entry_header:
+				pack_entry_header(S,&entry,1);
+				break;
+			default:
+				vassert(false,csprintf(temporary,"Unrecognized entry-header length: %d",entry_header_length));
+			}
+			S+= entry_header_length;
+
+			memcpy(S, wad->tag_data[index].data, entry.length);
+			S+= entry.length;
+		}
+		assert((S - data) == length+SIZEOF_encapsulated_wad_data);
+	} else {
+		set_game_error(systemError, memory_error());
+	}
+
+	return data;
+}
+
 /* ---------- debugging routines. */
 void dump_wad(
 	struct wad_data *wad)
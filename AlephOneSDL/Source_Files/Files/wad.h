@@ -192,6 +192,9 @@ int32 get_flat_data_length(void *data);
 /* This is how you dispose of it-> you inflate it, then use free_wad() */
 struct wad_data *inflate_flat_data(void *data, struct wad_header *header);
 
+/* Same encapsulation as get_flat_data(), but from a wad built in memory */
+void *get_flat_data_from_wad(struct wad_data *wad, struct wad_header *header);
+
 /* ------------  Write File functions */
 struct wad_data *create_empty_wad(void);
 void fill_default_wad_header(FileSpecifier& File, short wadfile_version,
@@ -330,9 +330,10 @@ const int SIZEOF_random_sound_image_data = 32;
 #define MARK_SLOT_AS_FREE(o) ((o)->flags&=(uint16)~0x8000)
 #define MARK_SLOT_AS_USED(o) ((o)->flags|=(uint16)0x8000)
 
-#define OBJECT_WAS_RENDERED(o) ((o)->flags&(uint16)0x4000)
-#define SET_OBJECT_RENDERED_FLAG(o) ((o)->flags|=(uint16)0x4000)
-#define CLEAR_OBJECT_RENDERED_FLAG(o) ((o)->flags&=(uint16)~0x4000)
+#define OBJECT_RENDERED_BIT 0x4000
+#define OBJECT_WAS_RENDERED(o) ((o)->flags&(uint16)OBJECT_RENDERED_BIT)
+#define SET_OBJECT_RENDERED_FLAG(o) ((o)->flags|=(uint16)OBJECT_RENDERED_BIT)
+#define CLEAR_OBJECT_RENDERED_FLAG(o) ((o)->flags&=(uint16)~OBJECT_RENDERED_BIT)
 
 /* this field is only valid after transmogrify_object_shape is called; in terms of our pipeline, that
 	means that its only valid if OBJECT_WAS_RENDERED returns true *and* was cleared before
@@ -120,6 +120,8 @@ Feb 8, 2003 (Woody Zenfell):
 #include "Statistics.h"
 
 #include "motion_sensor.h"
+#include "world_hash.h"
+#include "LevelLoadProfile.h"
 
 #include <limits.h>
 
@@ -441,6 +443,8 @@ update_world_elements_one_tick()
 
         dynamic_world->tick_count+= 1;
         dynamic_world->game_information.game_time_remaining-= 1;
+
+        update_world_hash();
         
         return kUpdateNormalCompletion;
 }
@@ -623,12 +627,14 @@ void leaving_map(
 bool entering_map(bool restoring_saved)
 {
 	bool success= true;
+	LevelLoadPhase phase("entering_map");
 
 	/* if any active monsters think they have paths, we'll make them reconsider */
 	initialize_monsters_for_new_level();
 
 	/* and since no monsters have paths, we should make sure no paths think they have monsters */
 	reset_paths();
+	level_load_split("initialize_monsters_for_new_level");
 	
 	/* mark our shape collections for loading and load them */
 	mark_environment_collections(static_world->environment_code, true);
@@ -640,13 +646,20 @@ bool entering_map(bool restoring_saved)
 	MarkLuaHUDCollections(true);
 
 	load_collections(true, get_screen_mode()->acceleration != _no_acceleration);
+	level_load_split("load_collections");
 
 	load_all_monster_sounds();
+	level_load_split("load_all_monster_sounds");
 	load_all_game_sounds(static_world->environment_code);
+	level_load_split("load_all_game_sounds");
 
 #if !defined(DISABLE_NETWORKING)
 	/* tell the keyboard controller to start recording keyboard flags */
-	if (game_is_networked) success= NetSync(); /* make sure everybody is ready */
+	if (game_is_networked)
+	{
+		success= NetSync(); /* make sure everybody is ready */
+		level_load_split("NetSync");
+	}
 #endif // !defined(DISABLE_NETWORKING)
 
 	/* make sure nobodys holding a weapon illegal in the new environment */
@@ -662,6 +675,7 @@ bool entering_map(bool restoring_saved)
 //	set_keyboard_controller_status(true);
 
 	L_Call_Init(restoring_saved);
+	level_load_split("L_Call_Init");
 
 #if !defined(DISABLE_NETWORKING)
 	NetSetChatCallbacks(InGameChatCallbacks::instance());
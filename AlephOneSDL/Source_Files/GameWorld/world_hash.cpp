@@ -0,0 +1,349 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+ 
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Per-subsystem hashes of the dynamic world
+*/
+
+#include "cseries.h"
+#include "world_hash.h"
+
+#include "map.h"
+#include "monsters.h"
+#include "projectiles.h"
+#include "platforms.h"
+#include "lightsource.h"
+#include "media.h"
+#include "player.h"
+#include "Packing.h"
+
+#include <SDL_mutex.h>
+
+/* ---------- globals */
+
+static uint32 running_hashes[NUMBER_OF_WORLD_HASH_SUBSYSTEMS];
+static bool period_is_complete= false;
+static int32 last_hashed_tick= NONE;
+static int16 last_hashed_level= NONE;
+
+// published snapshots, newest at snapshot_count-1 (mod MAXIMUM_WORLD_HASH_SNAPSHOTS)
+static world_hash_snapshot snapshots[MAXIMUM_WORLD_HASH_SNAPSHOTS];
+static int snapshot_count= 0;
+static SDL_mutex *snapshot_mutex= NULL;
+
+static const char *subsystem_names[NUMBER_OF_WORLD_HASH_SUBSYSTEMS]=
+{
+	"players",
+	"monsters",
+	"projectiles",
+	"objects",
+	"platforms",
+	"lights",
+	"media",
+	"random seed"
+};
+
+/* ---------- private prototypes */
+
+static inline uint32 hash_value(uint32 hash, int32 value);
+static void hash_slots(int phase);
+static void publish_snapshot(void);
+
+/* ---------- code */
+
+void update_world_hash(
+	void)
+{
+	int32 tick= dynamic_world->tick_count;
+	int16 level= dynamic_world->current_level_number;
+	int phase= tick % WORLD_HASH_PERIOD;
+
+	if (!snapshot_mutex) snapshot_mutex= SDL_CreateMutex();
+
+	// a new level, a loaded game or a film seek all break the chain
+	if (tick != last_hashed_tick+1 || level != last_hashed_level)
+	{
+		period_is_complete= false;
+		SDL_LockMutex(snapshot_mutex);
+		snapshot_count= 0;
+		SDL_UnlockMutex(snapshot_mutex);
+	}
+	last_hashed_tick= tick;
+	last_hashed_level= level;
+
+	if (phase == 0)
+	{
+		for (int i= 0; i<NUMBER_OF_WORLD_HASH_SUBSYSTEMS; i++) running_hashes[i]= 2166136261u;
+		period_is_complete= true;
+	}
+
+	if (!period_is_complete) return;
+
+	for (short player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		player_data *player= get_player_data(player_index);
+		uint32 hash= running_hashes[_hash_players];
+
+		hash= hash_value(hash, player->location.x);
+		hash= hash_value(hash, player->location.y);
+		hash= hash_value(hash, player->location.z);
+		hash= hash_value(hash, player->facing);
+		hash= hash_value(hash, player->elevation);
+		hash= hash_value(hash, player->suit_energy);
+		hash= hash_value(hash, player->suit_oxygen);
+		running_hashes[_hash_players]= hash;
+	}
+	running_hashes[_hash_random_seed]= hash_value(running_hashes[_hash_random_seed], get_random_seed());
+
+	hash_slots(phase);
+
+	if (phase == WORLD_HASH_PERIOD-1) publish_snapshot();
+}
+
+bool get_latest_world_hash(
+	world_hash_snapshot& snapshot)
+{
+	bool found= false;
+
+	if (!snapshot_mutex) return false;
+
+	SDL_LockMutex(snapshot_mutex);
+	if (snapshot_count)
+	{
+		snapshot= snapshots[(snapshot_count-1) % MAXIMUM_WORLD_HASH_SNAPSHOTS];
+		found= true;
+	}
+	SDL_UnlockMutex(snapshot_mutex);
+
+	return found;
+}
+
+short check_world_hash(
+	const world_hash_snapshot& reported,
+	short *subsystem)
+{
+	short result= _world_hash_expired;
+
+	if (!snapshot_mutex) return _world_hash_pending;
+
+	SDL_LockMutex(snapshot_mutex);
+	if (!snapshot_count)
+	{
+		result= _world_hash_pending;
+	}
+	else
+	{
+		const world_hash_snapshot& latest= snapshots[(snapshot_count-1) % MAXIMUM_WORLD_HASH_SNAPSHOTS];
+
+		if (reported.level != latest.level)
+		{
+			result= _world_hash_expired;
+		}
+		else if (reported.tick > latest.tick)
+		{
+			result= _world_hash_pending;
+		}
+		else
+		{
+			// snapshots are WORLD_HASH_PERIOD ticks apart, so the one we want is easy to find
+			int32 age= (latest.tick - reported.tick) / WORLD_HASH_PERIOD;
+			if (age < MIN(snapshot_count, int(MAXIMUM_WORLD_HASH_SNAPSHOTS)))
+			{
+				const world_hash_snapshot& ours= snapshots[(snapshot_count-1-age) % MAXIMUM_WORLD_HASH_SNAPSHOTS];
+				if (ours.tick == reported.tick)
+				{
+					result= _world_hash_matches;
+					for (short i= 0; i<NUMBER_OF_WORLD_HASH_SUBSYSTEMS; i++)
+					{
+						if (ours.hashes[i] != reported.hashes[i])
+						{
+							if (subsystem) *subsystem= i;
+							result= _world_hash_diverged;
+							break;
+						}
+					}
+				}
+			}
+		}
+	}
+	SDL_UnlockMutex(snapshot_mutex);
+
+	return result;
+}
+
+const char *get_world_hash_subsystem_name(
+	short subsystem)
+{
+	assert(subsystem>=0 && subsystem<NUMBER_OF_WORLD_HASH_SUBSYSTEMS);
+	return subsystem_names[subsystem];
+}
+
+uint8 *pack_world_hash_snapshot(
+	uint8 *Stream,
+	const world_hash_snapshot& snapshot)
+{
+	uint8 *S= Stream;
+
+	ValueToStream(S,snapshot.tick);
+	ValueToStream(S,snapshot.level);
+	for (int i= 0; i<NUMBER_OF_WORLD_HASH_SUBSYSTEMS; i++) ValueToStream(S,snapshot.hashes[i]);
+
+	assert((S - Stream) == SIZEOF_world_hash_snapshot);
+	return S;
+}
+
+uint8 *unpack_world_hash_snapshot(
+	uint8 *Stream,
+	world_hash_snapshot& snapshot)
+{
+	uint8 *S= Stream;
+
+	StreamToValue(S,snapshot.tick);
+	StreamToValue(S,snapshot.level);
+	for (int i= 0; i<NUMBER_OF_WORLD_HASH_SUBSYSTEMS; i++) StreamToValue(S,snapshot.hashes[i]);
+
+	assert((S - Stream) == SIZEOF_world_hash_snapshot);
+	return S;
+}
+
+/* ---------- private code */
+
+// FNV-1a over the four bytes of the value
+static inline uint32 hash_value(
+	uint32 hash,
+	int32 value)
+{
+	for (int i= 0; i<4; i++)
+	{
+		hash= (hash ^ ((value >> (8*i)) & 0xff)) * 16777619u;
+	}
+	return hash;
+}
+
+// hashes the slots in this tick's stripe of each list; unused slots only
+// contribute their index so that a slot being freed still shows up
+static void hash_slots(
+	int phase)
+{
+	size_t index;
+
+	for (index= phase; index<MonsterList.size(); index+= WORLD_HASH_PERIOD)
+	{
+		monster_data *monster= &MonsterList[index];
+		uint32 hash= hash_value(running_hashes[_hash_monsters], index);
+		if (SLOT_IS_USED(monster))
+		{
+			hash= hash_value(hash, monster->type);
+			hash= hash_value(hash, monster->vitality);
+			hash= hash_value(hash, monster->flags);
+			hash= hash_value(hash, monster->mode);
+			hash= hash_value(hash, monster->action);
+			hash= hash_value(hash, monster->target_index);
+			hash= hash_value(hash, monster->path);
+			hash= hash_value(hash, monster->external_velocity);
+			hash= hash_value(hash, monster->vertical_velocity);
+			hash= hash_value(hash, monster->ticks_since_attack);
+		}
+		running_hashes[_hash_monsters]= hash;
+	}
+
+	for (index= phase; index<ProjectileList.size(); index+= WORLD_HASH_PERIOD)
+	{
+		projectile_data *projectile= &ProjectileList[index];
+		uint32 hash= hash_value(running_hashes[_hash_projectiles], index);
+		if (SLOT_IS_USED(projectile))
+		{
+			hash= hash_value(hash, projectile->type);
+			hash= hash_value(hash, projectile->target_index);
+			hash= hash_value(hash, projectile->elevation);
+			hash= hash_value(hash, projectile->owner_index);
+			hash= hash_value(hash, projectile->distance_travelled);
+			hash= hash_value(hash, projectile->gravity);
+			hash= hash_value(hash, projectile->damage_scale);
+		}
+		running_hashes[_hash_projectiles]= hash;
+	}
+
+	for (index= phase; index<ObjectList.size(); index+= WORLD_HASH_PERIOD)
+	{
+		object_data *object= &ObjectList[index];
+		uint32 hash= hash_value(running_hashes[_hash_objects], index);
+		if (SLOT_IS_USED(object))
+		{
+			hash= hash_value(hash, object->location.x);
+			hash= hash_value(hash, object->location.y);
+			hash= hash_value(hash, object->location.z);
+			hash= hash_value(hash, object->polygon);
+			hash= hash_value(hash, object->facing);
+			hash= hash_value(hash, object->shape);
+			// the rendered bit depends on what this machine drew
+			hash= hash_value(hash, object->flags & (uint16)~OBJECT_RENDERED_BIT);
+			hash= hash_value(hash, object->permutation);
+		}
+		running_hashes[_hash_objects]= hash;
+	}
+
+	for (index= phase; index<PlatformList.size(); index+= WORLD_HASH_PERIOD)
+	{
+		platform_data *platform= &PlatformList[index];
+		uint32 hash= hash_value(running_hashes[_hash_platforms], index);
+		hash= hash_value(hash, platform->dynamic_flags);
+		hash= hash_value(hash, platform->floor_height);
+		hash= hash_value(hash, platform->ceiling_height);
+		hash= hash_value(hash, platform->ticks_until_restart);
+		running_hashes[_hash_platforms]= hash;
+	}
+
+	for (index= phase; index<LightList.size(); index+= WORLD_HASH_PERIOD)
+	{
+		light_data *light= &LightList[index];
+		uint32 hash= hash_value(running_hashes[_hash_lights], index);
+		hash= hash_value(hash, light->flags);
+		hash= hash_value(hash, light->state);
+		hash= hash_value(hash, light->intensity);
+		hash= hash_value(hash, light->phase);
+		hash= hash_value(hash, light->period);
+		running_hashes[_hash_lights]= hash;
+	}
+
+	for (index= phase; index<MediaList.size(); index+= WORLD_HASH_PERIOD)
+	{
+		media_data *media= &MediaList[index];
+		uint32 hash= hash_value(running_hashes[_hash_medias], index);
+		if (SLOT_IS_USED(media))
+		{
+			hash= hash_value(hash, media->height);
+			hash= hash_value(hash, media->origin.x);
+			hash= hash_value(hash, media->origin.y);
+			hash= hash_value(hash, media->current_direction);
+		}
+		running_hashes[_hash_medias]= hash;
+	}
+}
+
+static void publish_snapshot(
+	void)
+{
+	SDL_LockMutex(snapshot_mutex);
+	world_hash_snapshot& snapshot= snapshots[snapshot_count % MAXIMUM_WORLD_HASH_SNAPSHOTS];
+	snapshot.tick= dynamic_world->tick_count;
+	snapshot.level= dynamic_world->current_level_number;
+	for (int i= 0; i<NUMBER_OF_WORLD_HASH_SUBSYSTEMS; i++) snapshot.hashes[i]= running_hashes[i];
+	snapshot_count++;
+	// keep the count bounded but congruent, so indexing stays valid
+	if (snapshot_count >= 2*MAXIMUM_WORLD_HASH_SNAPSHOTS) snapshot_count-= MAXIMUM_WORLD_HASH_SNAPSHOTS;
+	SDL_UnlockMutex(snapshot_mutex);
+}
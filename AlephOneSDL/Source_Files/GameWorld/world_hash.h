@@ -0,0 +1,80 @@
+#ifndef __WORLD_HASH_H
+#define __WORLD_HASH_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+ 
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Per-subsystem hashes of the dynamic world, for catching netgames and
+	films that have gone out of sync and telling what diverged first.
+
+	Hashing is spread over a period: each tick hashes the players and the
+	random seed, plus every WORLD_HASH_PERIOD'th slot of the other lists,
+	so every slot is visited once per period at a fixed phase. Machines
+	running the same game hash the same slots on the same ticks, and a
+	snapshot of all the hashes is published at the end of each period.
+*/
+
+#include "cseries.h"
+
+enum /* world hash subsystems */
+{
+	_hash_players,
+	_hash_monsters,
+	_hash_projectiles,
+	_hash_objects,
+	_hash_platforms,
+	_hash_lights,
+	_hash_medias,
+	_hash_random_seed,
+	NUMBER_OF_WORLD_HASH_SUBSYSTEMS
+};
+
+enum
+{
+	WORLD_HASH_PERIOD= 30, // ticks
+	MAXIMUM_WORLD_HASH_SNAPSHOTS= 32 // periods remembered for late reports
+};
+
+struct world_hash_snapshot
+{
+	int32 tick;
+	int16 level;
+	uint32 hashes[NUMBER_OF_WORLD_HASH_SUBSYSTEMS];
+};
+const int SIZEOF_world_hash_snapshot= 4 + 2 + 4*NUMBER_OF_WORLD_HASH_SUBSYSTEMS;
+
+enum /* results of check_world_hash() */
+{
+	_world_hash_matches,
+	_world_hash_pending, // we haven't simulated that tick yet
+	_world_hash_expired, // too old to check, or from another level
+	_world_hash_diverged
+};
+
+/* called once per tick by update_world */
+void update_world_hash(void);
+
+/* these may be called from the network thread */
+bool get_latest_world_hash(world_hash_snapshot& snapshot);
+short check_world_hash(const world_hash_snapshot& reported, short *subsystem);
+
+const char *get_world_hash_subsystem_name(short subsystem);
+
+uint8 *pack_world_hash_snapshot(uint8 *Stream, const world_hash_snapshot& snapshot);
+uint8 *unpack_world_hash_snapshot(uint8 *Stream, world_hash_snapshot& snapshot);
+
+#endif
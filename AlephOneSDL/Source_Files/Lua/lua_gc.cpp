@@ -0,0 +1,211 @@
+/*
+LUA_GC.CPP
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Engine-paced garbage collection for the Lua states
+*/
+
+#include "cseries.h"
+#include "lua_script.h"
+
+#ifndef HAVE_LUA
+
+void SetLuaGCFrameBudget(float) {}
+bool SetLuaGCSetting(const std::string&, const std::string&, const std::string&) { return false; }
+void ReportLuaGC() {}
+
+#else /* HAVE_LUA */
+
+#include "lua_gc.h"
+#include "map.h"
+#include "shell.h"
+#include "vbl.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+static const char *collector_names[] = { "map", "netscript", "solo", "stats", "hud" };
+static const int number_of_collector_names = sizeof(collector_names) / sizeof(collector_names[0]);
+
+static std::map<std::string, LuaCollectorSettings> collector_settings;
+static std::vector<LuaCollector*> collectors;
+static float frame_budget_ms = 1.0f;
+
+static LuaCollectorSettings& settings_for(const std::string& name)
+{
+	std::map<std::string, LuaCollectorSettings>::iterator it = collector_settings.find(name);
+	if (it == collector_settings.end())
+	{
+		// Lua's own pause and stepmul
+		LuaCollectorSettings settings;
+		settings.generational = false;
+		settings.pause = 200;
+		settings.stepmul = 200;
+		settings.step_kb = 16;
+		it = collector_settings.insert(std::make_pair(name, settings)).first;
+	}
+	return it->second;
+}
+
+LuaCollector::LuaCollector(const char *name) :
+	name_(name), state_(0), in_cycle_(false), live_kb_(0),
+	cycles_(0), steps_(0), peak_kb_(0), ticks_(0), max_step_ticks_(0)
+{
+	settings_ = settings_for(name_);
+	collectors.push_back(this);
+}
+
+LuaCollector::~LuaCollector()
+{
+	collectors.erase(std::remove(collectors.begin(), collectors.end(), this), collectors.end());
+}
+
+void LuaCollector::Attach(lua_State *L)
+{
+	state_ = L;
+	ApplySettings();
+}
+
+void LuaCollector::ApplySettings()
+{
+	settings_ = settings_for(name_);
+	if (!state_)
+		return;
+
+	lua_gc(state_, settings_.generational ? LUA_GCGEN : LUA_GCINC, 0);
+	lua_gc(state_, LUA_GCSETPAUSE, settings_.pause);
+	lua_gc(state_, LUA_GCSETSTEPMUL, settings_.stepmul);
+	in_cycle_ = false;
+}
+
+bool LuaCollector::CycleDue()
+{
+	int kb = lua_gc(state_, LUA_GCCOUNT, 0);
+	peak_kb_ = std::max(peak_kb_, kb);
+
+	// a generational step is a whole minor collection; wait for something to collect
+	if (settings_.generational)
+		return kb >= live_kb_ + settings_.step_kb;
+
+	// halfway to where Lua would start one itself
+	return in_cycle_ || kb >= live_kb_ + live_kb_ * (settings_.pause - 100) / 200;
+}
+
+// true if that finished a cycle (or, in generational mode, a collection)
+bool LuaCollector::Step(int kb)
+{
+	uint64_t start = SDL_GetPerformanceCounter();
+	bool finished = lua_gc(state_, LUA_GCSTEP, kb) || settings_.generational;
+	uint64_t ticks = SDL_GetPerformanceCounter() - start;
+
+	ticks_ += ticks;
+	max_step_ticks_ = std::max(max_step_ticks_, ticks);
+	steps_++;
+
+	in_cycle_ = !finished;
+	if (finished)
+	{
+		cycles_++;
+		live_kb_ = lua_gc(state_, LUA_GCCOUNT, 0);
+	}
+	return finished;
+}
+
+void LuaCollector::StepTick()
+{
+	if (state_ && CycleDue())
+		Step(settings_.step_kb);
+}
+
+void LuaCollector::StepFrame()
+{
+	if (!state_ || frame_budget_ms <= 0 || !CycleDue())
+		return;
+
+	uint64_t deadline = SDL_GetPerformanceCounter() + static_cast<uint64_t>(frame_budget_ms * SDL_GetPerformanceFrequency() / 1000);
+	while (!Step(0) && SDL_GetPerformanceCounter() < deadline)
+		;
+}
+
+void LuaCollector::Report()
+{
+	if (!state_)
+		return;
+
+	double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+	screen_printf("%s: %d KB (peak %d KB), %s, pause %d, stepmul %d, %d KB per tick",
+		      name_.c_str(), lua_gc(state_, LUA_GCCOUNT, 0), peak_kb_,
+		      settings_.generational ? "generational" : "incremental",
+		      settings_.pause, settings_.stepmul, settings_.step_kb);
+	screen_printf("  %u %s in %u steps, %.1f ms, longest step %.2f ms",
+		      cycles_, settings_.generational ? "collections" : "cycles", steps_,
+		      ticks_ * 1e3 / frequency, max_step_ticks_ * 1e3 / frequency);
+}
+
+void SetLuaGCFrameBudget(float milliseconds)
+{
+	frame_budget_ms = std::max(milliseconds, 0.0f);
+}
+
+bool SetLuaGCSetting(const std::string& setting, const std::string& value, const std::string& script)
+{
+	if (!script.empty() && std::find(collector_names, collector_names + number_of_collector_names, script) == collector_names + number_of_collector_names)
+		return false;
+
+	// every collector but the HUD's runs in the game world, where another player, the
+	// film replaying it or the recording being replayed would collect at different times
+	bool game_state_locked = game_is_networked || game_is_recording() || game_is_replaying();
+
+	int number = atoi(value.c_str());
+	for (int i = 0; i < number_of_collector_names; ++i)
+	{
+		if (!script.empty() && script != collector_names[i])
+			continue;
+		if (game_state_locked && strcmp(collector_names[i], "hud") != 0)
+			return false;
+
+		LuaCollectorSettings& settings = settings_for(collector_names[i]);
+		if (setting == "mode" && (value == "incremental" || value == "generational"))
+			settings.generational = (value == "generational");
+		else if (setting == "pause" && number > 0)
+			settings.pause = number;
+		else if (setting == "stepmul" && number > 0)
+			settings.stepmul = number;
+		else if (setting == "step" && number > 0)
+			settings.step_kb = number;
+		else
+			return false;
+	}
+
+	for (std::vector<LuaCollector*>::iterator it = collectors.begin(); it != collectors.end(); ++it)
+	{
+		if (script.empty() || script == (*it)->Name())
+			(*it)->ApplySettings();
+	}
+	return true;
+}
+
+void ReportLuaGC()
+{
+	screen_printf("HUD collection budget: %.1f ms per frame", frame_budget_ms);
+	for (std::vector<LuaCollector*>::iterator it = collectors.begin(); it != collectors.end(); ++it)
+		(*it)->Report();
+}
+
+#endif /* HAVE_LUA */
@@ -0,0 +1,99 @@
+#ifndef __LUA_GC_H
+#define __LUA_GC_H
+
+/*
+LUA_GC.H
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Engine-paced garbage collection for the Lua states
+
+	Left to itself, Lua's collector does its work as scripts allocate, so a cycle's steps
+	land in whichever triggers happen to be running.  A LuaCollector starts each cycle
+	early, once the heap is halfway to where Lua would start one, and steps it along from
+	outside the triggers so that Lua rarely has to.
+
+	A game script's collector steps a fixed amount of work per tick: when its objects are
+	collected can show in weak tables and __gc metamethods, which must come out the same
+	on every machine and in replays.  The HUD script's is free to use the spare time after
+	a frame is rendered instead.
+*/
+
+#include "cseries.h"
+
+#ifdef HAVE_LUA
+extern "C"
+{
+#include "lua.h"
+}
+
+#include <string>
+
+struct LuaCollectorSettings
+{
+	bool generational;
+	int pause;		// percent of the heap after a cycle at which Lua starts the next
+	int stepmul;		// collector speed relative to allocation, in percent
+	int step_kb;		// work per tick, for collectors stepped per tick
+};
+
+class LuaCollector
+{
+public:
+	// name is the script kind the settings go with: "map", "netscript", "solo", "stats" or
+	// "hud"
+	LuaCollector(const char *name);
+	~LuaCollector();
+
+	// Takes over L's collector; L must outlive us
+	void Attach(lua_State *L);
+
+	// Per tick: one step of step_kb, if a cycle is due or under way
+	void StepTick();
+	// After a frame: steps until the cycle finishes or the frame budget runs out
+	void StepFrame();
+
+	const std::string& Name() const { return name_; }
+	void ApplySettings();
+	void Report();
+
+private:
+	bool CycleDue();
+	bool Step(int kb);
+
+	std::string name_;
+	lua_State *state_;
+	LuaCollectorSettings settings_;
+
+	bool in_cycle_;
+	int live_kb_;		// heap after the last cycle we finished
+
+	// stats
+	uint32 cycles_;
+	uint32 steps_;
+	int peak_kb_;
+	uint64_t ticks_;
+	uint64_t max_step_ticks_;
+
+	// not copyable
+	LuaCollector(const LuaCollector&);
+	LuaCollector& operator=(const LuaCollector&);
+};
+
+#endif
+
+#endif
@@ -34,6 +34,8 @@ LUA_HUD_OBJECTS.CPP
 #include "HUDRenderer.h"
 #include "HUDRenderer_Lua.h"
 #include "network.h"
+#include "network_distribution_types.h"
+#include "network_star_lossy.h"
 #include "FontHandler.h"
 #include "render.h"
 #include "Image_Blitter.h"
@@ -384,7 +386,7 @@ const luaL_Reg Lua_Image_Set[] = {
 
 static int Lua_Image_GC(lua_State *L)
 {
-	delete Lua_Image::Object(L, 1);
+	Lua_HUDInstance()->release_image(Lua_Image::Object(L, 1));
 	Lua_Image::Invalidate(L, Lua_Image::Index(L, 1));
 	return 0;
 }
@@ -703,7 +705,7 @@ const luaL_Reg Lua_Shape_Set[] = {
 
 static int Lua_Shape_GC(lua_State *L)
 {
-	delete Lua_Shape::Object(L, 1);
+	Lua_HUDInstance()->release_shape(Lua_Shape::Object(L, 1));
 	Lua_Shape::Invalidate(L, Lua_Shape::Index(L, 1));
 	return 0;
 }
@@ -907,7 +909,7 @@ const luaL_Reg Lua_Font_Set[] = {
 
 static int Lua_Font_GC(lua_State *L)
 {
-	delete Lua_Font::Object(L, 1);
+	Lua_HUDInstance()->release_font(Lua_Font::Object(L, 1));
 	Lua_Font::Invalidate(L, Lua_Font::Index(L, 1));
 	return 0;
 }
@@ -2609,6 +2611,12 @@ int Lua_Screen_Clear_Mask(lua_State *L)
 	return 0;
 }
 
+int Lua_Screen_Reuse_Frame(lua_State *L)
+{
+	lua_pushboolean(L, Lua_HUDInstance()->reuse_frame());
+	return 1;
+}
+
 int Lua_Screen_Fill_Rect(lua_State *L)
 {
 	float x = static_cast<float>(lua_tonumber(L, 1));
@@ -2657,6 +2665,7 @@ const luaL_Reg Lua_Screen_Get[] = {
 {"crosshairs", Lua_Screen_Get_Crosshairs},
 {"masking_mode", Lua_Screen_Get_Masking_Mode},
 {"clear_mask", L_TableFunction<Lua_Screen_Clear_Mask>},
+{"reuse_frame", L_TableFunction<Lua_Screen_Reuse_Frame>},
 {"fill_rect", L_TableFunction<Lua_Screen_Fill_Rect>},
 {"frame_rect", L_TableFunction<Lua_Screen_Frame_Rect>},
 {0, 0}
@@ -2669,7 +2678,6 @@ const luaL_Reg Lua_Screen_Set[] = {
 
 
 char Lua_HUDGame_Player_Name[] = "game_player";
-typedef L_Class<Lua_HUDGame_Player_Name> Lua_HUDGame_Player;
 
 static int Lua_HUDGame_Player_Get_Color(lua_State *L)
 {
@@ -2822,6 +2830,61 @@ static int Lua_HUDGame_Get_Version(lua_State *L)
 	return 1;
 }
 
+// Stream channels: lossy, unordered, rate-limited data to the other players' HUD scripts
+// (see Triggers.stream_received); false when it wasn't sent
+enum {
+	kMaximumStreamMessageBytes = 256
+};
+
+static int16 Lua_HUDGame_Stream_Channel(lua_State *L, const char *function)
+{
+	if (!lua_isnumber(L, 1))
+		luaL_error(L, "%s: incorrect argument type", function);
+	int channel = static_cast<int>(lua_tonumber(L, 1));
+	if (channel < 0 || channel >= kLuaHUDStreamChannelCount)
+		luaL_error(L, "%s: invalid channel", function);
+	return kLuaHUDStreamDistributionTypeID + channel;
+}
+
+static int Lua_HUDGame_Stream_Send(lua_State *L)
+{
+	int16 type = Lua_HUDGame_Stream_Channel(L, "stream_send");
+	if (!lua_isstring(L, 2))
+		return luaL_error(L, "stream_send: incorrect argument type");
+	size_t length;
+	const char *data = lua_tolstring(L, 2, &length);
+	if (length > kMaximumStreamMessageBytes)
+		return luaL_error(L, "stream_send: data longer than %d bytes", static_cast<int>(kMaximumStreamMessageBytes));
+	bool team_only = lua_toboolean(L, 3);
+
+	bool sent = false;
+#if !defined(DISABLE_NETWORKING)
+	if (game_is_networked && length > 0)
+	{
+		NetDistributeInformation(type, const_cast<char *>(data), static_cast<short>(length), false, team_only);
+		sent = true;
+	}
+#endif
+	lua_pushboolean(L, sent);
+	return 1;
+}
+
+static int Lua_HUDGame_Stream_Limits(lua_State *L)
+{
+	int16 type = Lua_HUDGame_Stream_Channel(L, "stream_limits");
+	if (!lua_isnumber(L, 2) || !lua_isnumber(L, 3))
+		return luaL_error(L, "stream_limits: incorrect argument type");
+
+	LossyByteStreamSettings settings;
+	settings.mPriority = static_cast<int16>(PIN(lua_tonumber(L, 2), -100, 100));
+	settings.mBytesPerSecond = static_cast<uint32>(std::max(lua_tonumber(L, 3), 0.0));
+	settings.mBurstBytes = lua_isnumber(L, 4) ? static_cast<uint32>(std::max(lua_tonumber(L, 4), 0.0)) : 0;
+#if !defined(DISABLE_NETWORKING)
+	set_lossy_byte_stream_settings(type, settings);
+#endif
+	return 0;
+}
+
 const luaL_Reg Lua_HUDGame_Get[] = {
 {"difficulty", Lua_HUDGame_Get_Difficulty},
 {"kill_limit", Lua_HUDGame_Get_Kill_Limit},
@@ -2831,6 +2894,8 @@ const luaL_Reg Lua_HUDGame_Get[] = {
 {"type", Lua_HUDGame_Get_Type},
 {"version", Lua_HUDGame_Get_Version},
 {"players", Lua_HUDGame_Get_Players},
+{"stream_send", L_TableFunction<Lua_HUDGame_Stream_Send>},
+{"stream_limits", L_TableFunction<Lua_HUDGame_Stream_Limits>},
 {0, 0}
 };
 
@@ -43,6 +43,9 @@ typedef L_Class<Lua_HUDPlayer_Name> Lua_HUDPlayer;
 extern char Lua_HUDGame_Name[]; // "Game"
 typedef L_Class<Lua_HUDGame_Name> Lua_HUDGame;
 
+extern char Lua_HUDGame_Player_Name[]; // "game_player"
+typedef L_Class<Lua_HUDGame_Player_Name> Lua_HUDGame_Player;
+
 extern char Lua_HUDScreen_Name[]; // "Screen"
 typedef L_Class<Lua_HUDScreen_Name> Lua_HUDScreen;
 
@@ -39,6 +39,9 @@ extern "C"
 using namespace std;
 #include <stdlib.h>
 #include <set>
+#include <deque>
+
+#include <SDL_atomic.h>
 
 
 #include "Logging.h"
@@ -48,6 +51,12 @@ using namespace std;
 
 #include "lua_hud_script.h"
 #include "lua_hud_objects.h"
+#include "lua_gc.h"
+#include "HUDRenderer_Lua.h"
+
+#include "network.h"
+#include "network_distribution_types.h"
+#include "network_star_lossy.h"
 
 #include <boost/shared_ptr.hpp>
 #include <boost/iostreams/device/array.hpp>
@@ -63,6 +72,10 @@ void L_Call_HUDInit() {}
 void L_Call_HUDCleanup() {}
 void L_Call_HUDDraw() {}
 void L_Call_HUDResize() {}
+void L_Collect_HUD_Garbage() {}
+
+void InstallLuaHUDStreams() {}
+void RemoveLuaHUDStreams() {}
 
 #else /* HAVE_LUA */
 
@@ -88,12 +101,33 @@ static const luaL_Reg lualibs[] = {
 
 void* L_Persistent_Table_Key();
 
+// Stream channel data from other players, queued by the network thread and handed to
+// Triggers.stream_received before the next draw.  The HUD's view of the game is its own,
+// so unlike the game script it can take data that shows up at different times on
+// different machines.
+struct LuaHUDStreamMessage
+{
+	int16 channel;
+	int16 player;
+	std::string data;
+};
+
+enum {
+	kMaximumQueuedStreamMessages = 256,	// the oldest go first beyond this
+	kDefaultStreamBytesPerSecond = 4096,
+	kDefaultStreamBurstBytes = 1024
+};
+
+static std::deque<LuaHUDStreamMessage> stream_messages;
+static SDL_SpinLock stream_messages_lock = 0;
+
 
 class LuaHUDState
 {
 public:
-	LuaHUDState() : running_(false), inited_(false), num_scripts_(0) {
+	LuaHUDState() : running_(false), inited_(false), num_scripts_(0), collector_("hud") {
 		state_.reset(luaL_newstate(), lua_close);
+		collector_.Attach(State());
 	}
 
 	virtual ~LuaHUDState() {
@@ -139,10 +173,16 @@ public:
 	void Resize();
 	void Cleanup();
 
+	void CollectGarbage() { collector_.StepFrame(); }
+
 private:
+	void StreamReceived();
+
 	bool running_;
 	int num_scripts_;
     bool inited_;
+
+	LuaCollector collector_;
 };
 
 LuaHUDState *hud_state = NULL;
@@ -184,10 +224,29 @@ void LuaHUDState::Init()
     inited_ = true;
 }
 
+void LuaHUDState::StreamReceived()
+{
+	std::deque<LuaHUDStreamMessage> messages;
+	SDL_AtomicLock(&stream_messages_lock);
+	messages.swap(stream_messages);
+	SDL_AtomicUnlock(&stream_messages_lock);
+
+	for (std::deque<LuaHUDStreamMessage>::const_iterator it = messages.begin(); it != messages.end(); ++it)
+	{
+		if (!GetTrigger("stream_received"))
+			break;
+		lua_pushnumber(State(), it->channel);
+		Lua_HUDGame_Player::Push(State(), it->player);
+		lua_pushlstring(State(), it->data.data(), it->data.size());
+		CallTrigger(3);
+	}
+}
+
 void LuaHUDState::Draw()
 {
     if (!inited_)
         return;
+	StreamReceived();
 	if (GetTrigger("draw"))
 		CallTrigger();
 }
@@ -304,6 +363,7 @@ bool LuaHUDRunning()
 
 void L_Call_HUDInit()
 {
+	Lua_HUDInstance()->invalidate_frame();
 	if (hud_state)
 		hud_state->Init();
 }
@@ -322,10 +382,78 @@ void L_Call_HUDDraw()
 
 void L_Call_HUDResize()
 {
+	Lua_HUDInstance()->invalidate_frame();
 	if (hud_state)
 		hud_state->Resize();
 }
 
+void L_Collect_HUD_Garbage()
+{
+	if (hud_state && hud_state->Running())
+		hud_state->CollectGarbage();
+}
+
+#if !defined(DISABLE_NETWORKING)
+static void queue_stream_message(int16 channel, void *buffer, short buffer_size, short player_index)
+{
+	if (player_index < 0 || player_index >= MAXIMUM_NUMBER_OF_NETWORK_PLAYERS)
+		return;
+
+	LuaHUDStreamMessage message;
+	message.channel = channel;
+	message.player = player_index;
+	message.data.assign(static_cast<const char *>(buffer), buffer_size);
+
+	SDL_AtomicLock(&stream_messages_lock);
+	if (stream_messages.size() >= kMaximumQueuedStreamMessages)
+		stream_messages.pop_front();
+	stream_messages.push_back(message);
+	SDL_AtomicUnlock(&stream_messages_lock);
+}
+
+// A distribution proc isn't told its type, so each channel gets its own
+template<int16 channel>
+static void received_stream_data(void *buffer, short buffer_size, short player_index)
+{
+	queue_stream_message(channel, buffer, buffer_size, player_index);
+}
+
+static const NetDistributionProc stream_procs[kLuaHUDStreamChannelCount] = {
+	received_stream_data<0>, received_stream_data<1>, received_stream_data<2>, received_stream_data<3>,
+	received_stream_data<4>, received_stream_data<5>, received_stream_data<6>, received_stream_data<7>,
+	received_stream_data<8>, received_stream_data<9>, received_stream_data<10>, received_stream_data<11>,
+	received_stream_data<12>, received_stream_data<13>, received_stream_data<14>, received_stream_data<15>
+};
+
+void InstallLuaHUDStreams()
+{
+	SDL_AtomicLock(&stream_messages_lock);
+	stream_messages.clear();
+	SDL_AtomicUnlock(&stream_messages_lock);
+
+	// Scripts can change these with Game.stream_limits
+	LossyByteStreamSettings settings = { 0, kDefaultStreamBytesPerSecond, kDefaultStreamBurstBytes };
+	for (int i = 0; i < kLuaHUDStreamChannelCount; ++i)
+	{
+		set_lossy_byte_stream_settings(kLuaHUDStreamDistributionTypeID + i, settings);
+		NetAddDistributionFunction(kLuaHUDStreamDistributionTypeID + i, stream_procs[i], true);
+	}
+}
+
+void RemoveLuaHUDStreams()
+{
+	for (int i = 0; i < kLuaHUDStreamChannelCount; ++i)
+		NetRemoveDistributionFunction(kLuaHUDStreamDistributionTypeID + i);
+
+	SDL_AtomicLock(&stream_messages_lock);
+	stream_messages.clear();
+	SDL_AtomicUnlock(&stream_messages_lock);
+}
+#else
+void InstallLuaHUDStreams() {}
+void RemoveLuaHUDStreams() {}
+#endif
+
 
 bool LoadLuaHUDScript(const char *buffer, size_t len)
 {
@@ -395,6 +523,7 @@ void CloseLuaHUDScript()
 {
 	delete hud_state;
 	hud_state = NULL;
+	Lua_HUDInstance()->invalidate_frame();
 }
 
 void MarkLuaHUDCollections(bool loading)
@@ -31,6 +31,13 @@ void L_Call_HUDCleanup();
 void L_Call_HUDDraw();
 void L_Call_HUDResize();
 
+// In the spare time after a frame is drawn (see lua_gc.h)
+void L_Collect_HUD_Garbage();
+
+// Game.stream_send and Triggers.stream_received, for the length of a netgame
+void InstallLuaHUDStreams();
+void RemoveLuaHUDStreams();
+
 bool LoadLuaHUDScript(const char *buffer, size_t len);
 bool RunLuaHUDScript();
 bool LuaHUDRunning();
@@ -37,6 +37,8 @@ LUA_MAP.CPP
 
 #include <boost/bind.hpp>
 
+#include <algorithm>
+
 #ifdef HAVE_LUA
 
 char Lua_AmbientSound_Name[] = "ambient_sound";
@@ -1473,6 +1475,200 @@ int16 Lua_Polygons_Length() {
 	return dynamic_world->polygon_count;
 }
 
+int16 L_To_Polygon_Index(lua_State *L, int index, const char *function)
+{
+	if (lua_isnumber(L, index))
+	{
+		int16 polygon_index = static_cast<int16>(lua_tonumber(L, index));
+		if (!Lua_Polygon::Valid(polygon_index))
+			luaL_error(L, "%s: invalid polygon index", function);
+		return polygon_index;
+	}
+	else if (Lua_Polygon::Is(L, index))
+	{
+		return Lua_Polygon::Index(L, index);
+	}
+
+	luaL_error(L, "%s: incorrect argument type", function);
+	return NONE;
+}
+
+void L_To_Point_And_Radius(lua_State *L, int index, world_point3d& point, int32& radius, const char *function)
+{
+	for (int i = index; i < index + 4; ++i)
+	{
+		if (!lua_isnumber(L, i))
+			luaL_error(L, "%s: incorrect argument type", function);
+	}
+
+	point.x = static_cast<world_distance>(lua_tonumber(L, index) * WORLD_ONE);
+	point.y = static_cast<world_distance>(lua_tonumber(L, index + 1) * WORLD_ONE);
+	point.z = static_cast<world_distance>(lua_tonumber(L, index + 2) * WORLD_ONE);
+	radius = static_cast<int32>(lua_tonumber(L, index + 3) * WORLD_ONE);
+}
+
+void L_Push_Results_Table(lua_State *L, int index)
+{
+	if (lua_istable(L, index))
+		lua_pushvalue(L, index);
+	else
+		lua_newtable(L);
+}
+
+int L_Finish_Results_Table(lua_State *L, int count)
+{
+	for (int i = count + 1; ; ++i)
+	{
+		lua_rawgeti(L, -1, i);
+		bool empty = lua_isnil(L, -1);
+		lua_pop(L, 1);
+		if (empty)
+			break;
+
+		lua_pushnil(L);
+		lua_rawseti(L, -2, i);
+	}
+
+	lua_pushnumber(L, count);
+	return 2;
+}
+
+// the polygon list the queries share; a polygon is in it if its mark is the current one,
+// so starting a new list doesn't have to clear the marks
+static std::vector<int16> listed_polygons;
+static std::vector<uint32> polygon_marks;
+static uint32 current_polygon_mark = 0;
+
+static void start_polygon_list()
+{
+	listed_polygons.clear();
+	if (polygon_marks.size() < static_cast<size_t>(dynamic_world->polygon_count))
+		polygon_marks.resize(dynamic_world->polygon_count, 0);
+
+	if (++current_polygon_mark == 0)
+	{
+		std::fill(polygon_marks.begin(), polygon_marks.end(), 0);
+		current_polygon_mark = 1;
+	}
+}
+
+static void list_polygon(int16 polygon_index)
+{
+	if (polygon_marks[polygon_index] != current_polygon_mark)
+	{
+		polygon_marks[polygon_index] = current_polygon_mark;
+		listed_polygons.push_back(polygon_index);
+	}
+}
+
+bool L_Polygon_Listed(int16 polygon_index)
+{
+	return polygon_index >= 0 && static_cast<size_t>(polygon_index) < polygon_marks.size() && polygon_marks[polygon_index] == current_polygon_mark;
+}
+
+// point_to_line_segment_distance_squared() overflows for lines across the map
+static double line_distance_squared(const world_point2d& p, const world_point2d& a, const world_point2d& b)
+{
+	double abx = b.x - a.x, aby = b.y - a.y;
+	double apx = p.x - a.x, apy = p.y - a.y;
+	double dot = abx * apx + aby * apy;
+	double length_squared = abx * abx + aby * aby;
+
+	if (dot <= 0 || length_squared == 0)
+		return apx * apx + apy * apy;
+
+	if (dot >= length_squared)
+	{
+		double bpx = p.x - b.x, bpy = p.y - b.y;
+		return bpx * bpx + bpy * bpy;
+	}
+
+	double cross = abx * apy - aby * apx;
+	return cross * cross / length_squared;
+}
+
+const std::vector<int16>& L_Polygons_Near(int16 polygon_index, const world_point2d& center, int32 radius)
+{
+	double radius_squared = static_cast<double>(radius) * radius;
+
+	start_polygon_list();
+	list_polygon(polygon_index);
+
+	// the list doubles as the breadth-first queue
+	for (size_t i = 0; i < listed_polygons.size(); ++i)
+	{
+		polygon_data *polygon = get_polygon_data(listed_polygons[i]);
+		for (int j = 0; j < polygon->vertex_count; ++j)
+		{
+			int16 adjacent_polygon_index = polygon->adjacent_polygon_indexes[j];
+			if (adjacent_polygon_index == NONE || L_Polygon_Listed(adjacent_polygon_index))
+				continue;
+
+			line_data *line = get_line_data(polygon->line_indexes[j]);
+			if (LINE_IS_SOLID(line))
+				continue;
+
+			if (line_distance_squared(center, get_endpoint_data(line->endpoint_indexes[0])->vertex, get_endpoint_data(line->endpoint_indexes[1])->vertex) > radius_squared)
+				continue;
+
+			list_polygon(adjacent_polygon_index);
+		}
+	}
+
+	return listed_polygons;
+}
+
+const std::vector<int16>& L_To_Polygon_List(lua_State *L, int index, const char *function)
+{
+	if (!lua_istable(L, index))
+		luaL_error(L, "%s: incorrect argument type", function);
+
+	start_polygon_list();
+	for (int i = 1; ; ++i)
+	{
+		lua_rawgeti(L, index, i);
+		if (lua_isnil(L, -1))
+		{
+			lua_pop(L, 1);
+			break;
+		}
+
+		list_polygon(L_To_Polygon_Index(L, -1, function));
+		lua_pop(L, 1);
+	}
+
+	return listed_polygons;
+}
+
+// Polygons.near(polygon, x, y, radius, [results])
+static int Lua_Polygons_Near(lua_State *L)
+{
+	int16 polygon_index = L_To_Polygon_Index(L, 1, "near");
+	if (!lua_isnumber(L, 2) || !lua_isnumber(L, 3) || !lua_isnumber(L, 4))
+		return luaL_error(L, "near: incorrect argument type");
+
+	world_point2d center;
+	center.x = static_cast<world_distance>(lua_tonumber(L, 2) * WORLD_ONE);
+	center.y = static_cast<world_distance>(lua_tonumber(L, 3) * WORLD_ONE);
+	int32 radius = static_cast<int32>(lua_tonumber(L, 4) * WORLD_ONE);
+
+	const std::vector<int16>& polygons = L_Polygons_Near(polygon_index, center, radius);
+
+	L_Push_Results_Table(L, 5);
+	for (size_t i = 0; i < polygons.size(); ++i)
+	{
+		Lua_Polygon::Push(L, polygons[i]);
+		lua_rawseti(L, -2, i + 1);
+	}
+
+	return L_Finish_Results_Table(L, polygons.size());
+}
+
+const luaL_Reg Lua_Polygons_Methods[] = {
+	{"near", L_TableFunction<Lua_Polygons_Near>},
+	{0, 0}
+};
+
 char Lua_Side_ControlPanel_Name[] = "side_control_panel";
 typedef L_Class<Lua_Side_ControlPanel_Name> Lua_Side_ControlPanel;
 
@@ -3261,7 +3457,7 @@ int Lua_Map_register(lua_State *L)
 	Lua_Polygon::Register(L, Lua_Polygon_Get, Lua_Polygon_Set);
 	Lua_Polygon::Valid = Lua_Polygon_Valid;
 
-	Lua_Polygons::Register(L);
+	Lua_Polygons::Register(L, Lua_Polygons_Methods);
 	Lua_Polygons::Length = Lua_Polygons_Length;
 
 	Lua_Side_ControlPanel::Register(L, Lua_Side_ControlPanel_Get, Lua_Side_ControlPanel_Set);
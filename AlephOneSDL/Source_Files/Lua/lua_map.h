@@ -38,6 +38,8 @@ extern "C"
 
 #include "lua_templates.h"
 
+#include <vector>
+
 extern char Lua_AmbientSound_Name[]; // "ambient sound"
 typedef L_Enum<Lua_AmbientSound_Name> Lua_AmbientSound;
 
@@ -142,6 +144,36 @@ typedef L_Container<Lua_Medias_Name, Lua_Media> Lua_Medias;
 
 int Lua_Map_register (lua_State *L);
 
+// Shared by the batch spatial queries (Polygons.near, Monsters.in_radius, and so on)
+
+// A polygon argument: a polygon or a polygon index
+int16 L_To_Polygon_Index(lua_State *L, int index, const char *function);
+
+// x, y, z and radius arguments, starting at index
+void L_To_Point_And_Radius(lua_State *L, int index, world_point3d& point, int32& radius, const char *function);
+
+// Pushes the table at index if it is one (so scripts can reuse a results table from
+// one tick to the next), otherwise a new table
+void L_Push_Results_Table(lua_State *L, int index);
+// Clears whatever the table held past count from last time, and leaves (table, count) on
+// the stack; returns 2
+int L_Finish_Results_Table(lua_State *L, int count);
+
+// The polygons reachable from polygon_index through lines that aren't solid and come
+// within radius of center
+const std::vector<int16>& L_Polygons_Near(int16 polygon_index, const world_point2d& center, int32 radius);
+// The polygons in the array at index (polygons or indices), without duplicates
+const std::vector<int16>& L_To_Polygon_List(lua_State *L, int index, const char *function);
+// Whether polygon_index is in the list one of the above returned last
+bool L_Polygon_Listed(int16 polygon_index);
+
+// Squared distance, without world_distance overflow
+inline int64_t L_Distance_Squared(const world_point3d& p0, const world_point3d& p1)
+{
+	int64_t dx = p1.x - p0.x, dy = p1.y - p0.y, dz = p1.z - p0.z;
+	return dx * dx + dy * dy + dz * dz;
+}
+
 #endif
 
 #endif
@@ -1007,7 +1007,127 @@ int Lua_Monsters_New(lua_State *L)
 	return 1;
 }
 
+// Monsters.in_radius(x, y, z, radius, [results])
+static int Lua_Monsters_In_Radius(lua_State *L)
+{
+	world_point3d center;
+	int32 radius;
+	L_To_Point_And_Radius(L, 1, center, radius, "in_radius");
+	int64_t radius_squared = static_cast<int64_t>(radius) * radius;
+
+	L_Push_Results_Table(L, 5);
+	int count = 0;
+	for (int16 monster_index = 0; monster_index < MAXIMUM_MONSTERS_PER_MAP; ++monster_index)
+	{
+		monster_data *monster = GetMemberWithBounds(monsters, monster_index, MAXIMUM_MONSTERS_PER_MAP);
+		if (SLOT_IS_USED(monster) && L_Distance_Squared(center, get_object_data(monster->object_index)->location) <= radius_squared)
+		{
+			Lua_Monster::Push(L, monster_index);
+			lua_rawseti(L, -2, ++count);
+		}
+	}
+
+	return L_Finish_Results_Table(L, count);
+}
+
+// adds the monsters standing in polygons to the results table on the top of the stack;
+// a negative radius_squared takes them all
+static int add_monsters_in_polygons(lua_State *L, const std::vector<int16>& polygons, const world_point3d& center, int64_t radius_squared)
+{
+	int count = 0;
+	for (size_t i = 0; i < polygons.size(); ++i)
+	{
+		short object_index = get_polygon_data(polygons[i])->first_object;
+		while (object_index != NONE)
+		{
+			object_data *object = get_object_data(object_index);
+			if (GET_OBJECT_OWNER(object) == _object_is_monster && (radius_squared < 0 || L_Distance_Squared(center, object->location) <= radius_squared))
+			{
+				Lua_Monster::Push(L, object->permutation);
+				lua_rawseti(L, -2, ++count);
+			}
+
+			object_index = object->next_object;
+		}
+	}
+
+	return count;
+}
+
+// Monsters.near(polygon, x, y, z, radius, [results]): like in_radius, but only through
+// polygons reachable from polygon without crossing solid lines
+static int Lua_Monsters_Near(lua_State *L)
+{
+	int16 polygon_index = L_To_Polygon_Index(L, 1, "near");
+	world_point3d center;
+	int32 radius;
+	L_To_Point_And_Radius(L, 2, center, radius, "near");
+
+	world_point2d center2d = { center.x, center.y };
+	const std::vector<int16>& polygons = L_Polygons_Near(polygon_index, center2d, radius);
+
+	L_Push_Results_Table(L, 6);
+	return L_Finish_Results_Table(L, add_monsters_in_polygons(L, polygons, center, static_cast<int64_t>(radius) * radius));
+}
+
+// Monsters.in_polygons(polygons, [results])
+static int Lua_Monsters_In_Polygons(lua_State *L)
+{
+	const std::vector<int16>& polygons = L_To_Polygon_List(L, 1, "in_polygons");
+	world_point3d center = { 0, 0, 0 };
+
+	L_Push_Results_Table(L, 2);
+	return L_Finish_Results_Table(L, add_monsters_in_polygons(L, polygons, center, -1));
+}
+
+// Monsters.in_sight(polygon, x, y, monsters, [results]): the monsters that can be seen from
+// (x, y); results may be monsters itself
+static int Lua_Monsters_In_Sight(lua_State *L)
+{
+	int16 polygon_index = L_To_Polygon_Index(L, 1, "in_sight");
+	if (!lua_isnumber(L, 2) || !lua_isnumber(L, 3) || !lua_istable(L, 4))
+		return luaL_error(L, "in_sight: incorrect argument type");
+
+	world_point2d origin;
+	origin.x = static_cast<world_distance>(lua_tonumber(L, 2) * WORLD_ONE);
+	origin.y = static_cast<world_distance>(lua_tonumber(L, 3) * WORLD_ONE);
+
+	L_Push_Results_Table(L, 5);
+	int count = 0;
+	for (int i = 1; ; ++i)
+	{
+		lua_rawgeti(L, 4, i);
+		if (lua_isnil(L, -1))
+		{
+			lua_pop(L, 1);
+			break;
+		}
+		if (!Lua_Monster::Is(L, -1))
+			return luaL_error(L, "in_sight: incorrect argument type");
+		int16 monster_index = Lua_Monster::Index(L, -1);
+		lua_pop(L, 1);
+
+		// a monster killed since it was found is out of sight
+		if (!Lua_Monster::Valid(monster_index))
+			continue;
+
+		object_data *object = get_object_data(get_monster_data(monster_index)->object_index);
+		world_point2d target = { object->location.x, object->location.y };
+		if (!line_is_obstructed(polygon_index, &origin, object->polygon, &target))
+		{
+			Lua_Monster::Push(L, monster_index);
+			lua_rawseti(L, -2, ++count);
+		}
+	}
+
+	return L_Finish_Results_Table(L, count);
+}
+
 const luaL_Reg Lua_Monsters_Methods[] = {
+	{"in_polygons", L_TableFunction<Lua_Monsters_In_Polygons>},
+	{"in_radius", L_TableFunction<Lua_Monsters_In_Radius>},
+	{"in_sight", L_TableFunction<Lua_Monsters_In_Sight>},
+	{"near", L_TableFunction<Lua_Monsters_Near>},
 	{"new", L_TableFunction<Lua_Monsters_New>},
 	{0, 0}
 };
@@ -417,7 +417,83 @@ int Lua_Items_New(lua_State *L)
 	return 1;
 }
 
+// Items.in_radius(x, y, z, radius, [results])
+static int Lua_Items_In_Radius(lua_State *L)
+{
+	world_point3d center;
+	int32 radius;
+	L_To_Point_And_Radius(L, 1, center, radius, "in_radius");
+	int64_t radius_squared = static_cast<int64_t>(radius) * radius;
+
+	L_Push_Results_Table(L, 5);
+	int count = 0;
+	for (int16 object_index = 0; object_index < MAXIMUM_OBJECTS_PER_MAP; ++object_index)
+	{
+		object_data *object = GetMemberWithBounds(objects, object_index, MAXIMUM_OBJECTS_PER_MAP);
+		if (SLOT_IS_USED(object) && GET_OBJECT_OWNER(object) == _object_is_item && L_Distance_Squared(center, object->location) <= radius_squared)
+		{
+			Lua_Item::Push(L, object_index);
+			lua_rawseti(L, -2, ++count);
+		}
+	}
+
+	return L_Finish_Results_Table(L, count);
+}
+
+// adds the items lying in polygons to the results table on the top of the stack; a
+// negative radius_squared takes them all
+static int add_items_in_polygons(lua_State *L, const std::vector<int16>& polygons, const world_point3d& center, int64_t radius_squared)
+{
+	int count = 0;
+	for (size_t i = 0; i < polygons.size(); ++i)
+	{
+		short object_index = get_polygon_data(polygons[i])->first_object;
+		while (object_index != NONE)
+		{
+			object_data *object = get_object_data(object_index);
+			if (GET_OBJECT_OWNER(object) == _object_is_item && (radius_squared < 0 || L_Distance_Squared(center, object->location) <= radius_squared))
+			{
+				Lua_Item::Push(L, object_index);
+				lua_rawseti(L, -2, ++count);
+			}
+
+			object_index = object->next_object;
+		}
+	}
+
+	return count;
+}
+
+// Items.near(polygon, x, y, z, radius, [results]): like in_radius, but only through polygons
+// reachable from polygon without crossing solid lines
+static int Lua_Items_Near(lua_State *L)
+{
+	int16 polygon_index = L_To_Polygon_Index(L, 1, "near");
+	world_point3d center;
+	int32 radius;
+	L_To_Point_And_Radius(L, 2, center, radius, "near");
+
+	world_point2d center2d = { center.x, center.y };
+	const std::vector<int16>& polygons = L_Polygons_Near(polygon_index, center2d, radius);
+
+	L_Push_Results_Table(L, 6);
+	return L_Finish_Results_Table(L, add_items_in_polygons(L, polygons, center, static_cast<int64_t>(radius) * radius));
+}
+
+// Items.in_polygons(polygons, [results])
+static int Lua_Items_In_Polygons(lua_State *L)
+{
+	const std::vector<int16>& polygons = L_To_Polygon_List(L, 1, "in_polygons");
+	world_point3d center = { 0, 0, 0 };
+
+	L_Push_Results_Table(L, 2);
+	return L_Finish_Results_Table(L, add_items_in_polygons(L, polygons, center, -1));
+}
+
 const luaL_Reg Lua_Items_Methods[] = {
+	{"in_polygons", L_TableFunction<Lua_Items_In_Polygons>},
+	{"in_radius", L_TableFunction<Lua_Items_In_Radius>},
+	{"near", L_TableFunction<Lua_Items_Near>},
 	{"new", L_TableFunction<Lua_Items_New>},
 	{0, 0}
 };
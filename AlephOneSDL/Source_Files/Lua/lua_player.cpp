@@ -2230,8 +2230,108 @@ int Lua_Players_Get_Local_Player(lua_State *L)
 	return 1;
 }
 
+// adds the players in range to the results table on the top of the stack: within radius,
+// unless radius_squared is negative, and in the listed polygons, if only_listed
+static int add_players(lua_State *L, const world_point3d& center, int64_t radius_squared, bool only_listed)
+{
+	int count = 0;
+	for (int16 player_index = 0; player_index < dynamic_world->player_count; ++player_index)
+	{
+		player_data *player = get_player_data(player_index);
+		if (only_listed && !L_Polygon_Listed(player->supporting_polygon_index))
+			continue;
+		if (radius_squared >= 0 && L_Distance_Squared(center, player->location) > radius_squared)
+			continue;
+
+		Lua_Player::Push(L, player_index);
+		lua_rawseti(L, -2, ++count);
+	}
+
+	return count;
+}
+
+// Players.in_radius(x, y, z, radius, [results])
+static int Lua_Players_In_Radius(lua_State *L)
+{
+	world_point3d center;
+	int32 radius;
+	L_To_Point_And_Radius(L, 1, center, radius, "in_radius");
+
+	L_Push_Results_Table(L, 5);
+	return L_Finish_Results_Table(L, add_players(L, center, static_cast<int64_t>(radius) * radius, false));
+}
+
+// Players.near(polygon, x, y, z, radius, [results]): like in_radius, but only through
+// polygons reachable from polygon without crossing solid lines
+static int Lua_Players_Near(lua_State *L)
+{
+	int16 polygon_index = L_To_Polygon_Index(L, 1, "near");
+	world_point3d center;
+	int32 radius;
+	L_To_Point_And_Radius(L, 2, center, radius, "near");
+
+	world_point2d center2d = { center.x, center.y };
+	L_Polygons_Near(polygon_index, center2d, radius);
+
+	L_Push_Results_Table(L, 6);
+	return L_Finish_Results_Table(L, add_players(L, center, static_cast<int64_t>(radius) * radius, true));
+}
+
+// Players.in_polygons(polygons, [results])
+static int Lua_Players_In_Polygons(lua_State *L)
+{
+	L_To_Polygon_List(L, 1, "in_polygons");
+	world_point3d center = { 0, 0, 0 };
+
+	L_Push_Results_Table(L, 2);
+	return L_Finish_Results_Table(L, add_players(L, center, -1, true));
+}
+
+// Players.in_sight(polygon, x, y, players, [results]): the players that can be seen from
+// (x, y); results may be players itself
+static int Lua_Players_In_Sight(lua_State *L)
+{
+	int16 polygon_index = L_To_Polygon_Index(L, 1, "in_sight");
+	if (!lua_isnumber(L, 2) || !lua_isnumber(L, 3) || !lua_istable(L, 4))
+		return luaL_error(L, "in_sight: incorrect argument type");
+
+	world_point2d origin;
+	origin.x = static_cast<world_distance>(lua_tonumber(L, 2) * WORLD_ONE);
+	origin.y = static_cast<world_distance>(lua_tonumber(L, 3) * WORLD_ONE);
+
+	L_Push_Results_Table(L, 5);
+	int count = 0;
+	for (int i = 1; ; ++i)
+	{
+		lua_rawgeti(L, 4, i);
+		if (lua_isnil(L, -1))
+		{
+			lua_pop(L, 1);
+			break;
+		}
+		if (!Lua_Player::Is(L, -1))
+			return luaL_error(L, "in_sight: incorrect argument type");
+		int16 player_index = Lua_Player::Index(L, -1);
+		lua_pop(L, 1);
+
+		player_data *player = get_player_data(player_index);
+		world_point2d target = { player->location.x, player->location.y };
+		if (!line_is_obstructed(polygon_index, &origin, player->supporting_polygon_index, &target))
+		{
+			Lua_Player::Push(L, player_index);
+			lua_rawseti(L, -2, ++count);
+		}
+	}
+
+	return L_Finish_Results_Table(L, count);
+}
+
 const luaL_Reg Lua_Players_Get[] = {
+	{"in_polygons", L_TableFunction<Lua_Players_In_Polygons>},
+	{"in_radius", L_TableFunction<Lua_Players_In_Radius>},
+	{"in_sight", L_TableFunction<Lua_Players_In_Sight>},
 	{"local_player", Lua_Players_Get_Local_Player},
+	{"near", L_TableFunction<Lua_Players_Near>},
 	{"print", L_TableFunction<Lua_Players_Print>},
 	{0, 0}
 };
@@ -76,6 +76,9 @@ extern "C"
 using namespace std;
 #include <stdlib.h>
 #include <set>
+#include <algorithm>
+#include <sstream>
+#include <vector>
 
 
 #include "alephversion.h"
@@ -119,11 +122,13 @@ using namespace std;
 #include "lua_projectiles.h"
 #include "lua_saved_objects.h"
 #include "lua_serialize.h"
+#include "lua_gc.h"
 
 #include <boost/bind.hpp>
 #include <boost/ptr_container/ptr_map.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/stream_buffer.hpp>
 namespace io = boost::iostreams;
 
@@ -194,6 +199,22 @@ void ResetLuaMute() {}
 bool UseLuaCameras() { return false; }
 bool LuaPlayerCanWieldWeapons(short) { return true; }
 
+void StartLuaProfiler() {}
+void StopLuaProfiler() {}
+void ReportLuaProfile() {}
+bool DumpLuaProfile(const std::string&) { return false; }
+void SetLuaInstructionBudget(int32, bool) {}
+
+int run_lua_trigger_benchmark(int) {
+	fprintf(stderr, "bench-lua-triggers: built without Lua\n");
+	return 1;
+}
+
+int run_lua_save_benchmark(int) {
+	fprintf(stderr, "bench-lua-save: built without Lua\n");
+	return 1;
+}
+
 int GetLuaGameEndCondition() {
 	return _game_normal_end_condition;
 }
@@ -237,15 +258,93 @@ void* L_Persistent_Table_Key()
 	return const_cast<char*>(key);
 }
 
-std::map<int, std::string> PassedLuaState;
-std::map<int, std::string> SavedLuaState;
+// Saved states, packed as in the save file: for each state with anything to save, its index
+// (int16), the length of its data (uint32) and the data
+std::vector<char> PassedLuaState;
+std::vector<char> SavedLuaState;
+
+enum LuaTrigger {
+	_trigger_init,
+	_trigger_cleanup,
+	_trigger_idle,
+	_trigger_postidle,
+	_trigger_start_refuel,
+	_trigger_end_refuel,
+	_trigger_tag_switch,
+	_trigger_light_switch,
+	_trigger_platform_switch,
+	_trigger_projectile_switch,
+	_trigger_terminal_enter,
+	_trigger_terminal_exit,
+	_trigger_pattern_buffer,
+	_trigger_got_item,
+	_trigger_light_activated,
+	_trigger_platform_activated,
+	_trigger_player_revived,
+	_trigger_player_killed,
+	_trigger_monster_killed,
+	_trigger_monster_damaged,
+	_trigger_player_damaged,
+	_trigger_projectile_detonated,
+	_trigger_projectile_created,
+	_trigger_item_created,
+	NUMBER_OF_LUA_TRIGGERS
+};
+
+static const char *trigger_names[NUMBER_OF_LUA_TRIGGERS] = {
+	"init",
+	"cleanup",
+	"idle",
+	"postidle",
+	"start_refuel",
+	"end_refuel",
+	"tag_switch",
+	"light_switch",
+	"platform_switch",
+	"projectile_switch",
+	"terminal_enter",
+	"terminal_exit",
+	"pattern_buffer",
+	"got_item",
+	"light_activated",
+	"platform_activated",
+	"player_revived",
+	"player_killed",
+	"monster_killed",
+	"monster_damaged",
+	"player_damaged",
+	"projectile_detonated",
+	"projectile_created",
+	"item_created"
+};
+
+static int L_Globals_Index(lua_State *L);
+static int L_Globals_Newindex(lua_State *L);
+static int L_Get_Metatable(lua_State *L);
+static int L_Set_Metatable(lua_State *L);
+static int L_Triggers_Newindex(lua_State *L);
+static int L_Triggers_Pairs(lua_State *L);
+static void L_Profiler_Hook(lua_State *L, lua_Debug *ar);
+
+// The profiler and instruction budget apply to every state; see CallTrigger()
+static bool lua_profiling = false;
+static int32 lua_instruction_budget = 0;	// per trigger call; 0 for none
+static bool lua_abort_over_budget = false;
 
 class LuaState
 {
 	friend bool CollectLuaStats(std::map<std::string, std::string>&, std::map<std::string, std::string>&);
+	friend int L_Globals_Newindex(lua_State *L);
+	friend int L_Triggers_Newindex(lua_State *L);
+	friend int L_Set_Metatable(lua_State *L);
+	friend int run_lua_trigger_benchmark(int events);
+	friend void L_Profiler_Hook(lua_State *L, lua_Debug *ar);
 public:
-	LuaState() : running_(false), num_scripts_(0) {
+	LuaState() : running_(false), num_scripts_(0), triggers_cached_(false), triggers_backing_(0), triggers_defined_(0), use_trigger_cache_(true), current_trigger_(_trigger_init), trigger_depth_(0) {
 		state_.reset(luaL_newstate(), lua_close);
+		for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+			trigger_refs_[i] = LUA_NOREF;
+		ResetProfile();
 	}
 
 	virtual ~LuaState() {
@@ -261,8 +360,8 @@ public:
 	bool Matches(lua_State *state) { return state == State(); }
 	void MarkCollections(std::set<short>* collections);
 	void ExecuteCommand(const std::string& line);
-	std::string SavePassed();
-	std::string SaveAll();
+	bool SavePassed(std::streambuf* sb);
+	bool SaveAll(std::streambuf* sb);
 
 	virtual void Initialize() {
 		const luaL_Reg *lib = lualibs;
@@ -287,7 +386,13 @@ public:
 		lua_newtable(State());
 		lua_settable(State(), LUA_REGISTRYINDEX);
 
+		// so L_Profiler_Hook can find us
+		lua_pushlightuserdata(State(), L_Profiler_Hook_Key());
+		lua_pushlightuserdata(State(), this);
+		lua_settable(State(), LUA_REGISTRYINDEX);
+
 		RegisterFunctions();
+		InstallTriggerCache();
 		LoadCompatibility();
 	}
 
@@ -295,16 +400,44 @@ public:
 		L_Set_Search_Path(State(), path);
 	}
 
+	// Paces our collection from now on; see lua_gc.h
+	void AttachCollector(const char *name) {
+		collector_.reset(new LuaCollector(name));
+		collector_->Attach(State());
+	}
+
+	void CollectGarbage() {
+		if (collector_)
+			collector_->StepTick();
+	}
+
+	// For the trigger benchmark: look every trigger up by name, as we used to
+	void UseTriggerCache(bool use) { use_trigger_cache_ = use; }
+
+	void ResetProfile();
+	// Prints the triggers and functions that took the most time to the screen
+	void ReportProfile(const char *desc);
+	// Writes the samples as folded stacks (microseconds per stack), each starting with desc
+	void DumpProfile(FILE *file, const char *desc);
+
 protected:
-	bool GetTrigger(const char *trigger);
+	bool GetTrigger(LuaTrigger trigger);
 	void CallTrigger(int numArgs = 0);
 
 	virtual void RegisterFunctions();
 	virtual void LoadCompatibility();
 
+	void InstallTriggerCache();
+	void TriggersAssigned(int index);
+	void TriggerAssigned(const void *backing, const char *name, int index);
+	void TriggersUnwatched(int index);
+	void ClearTriggerCache();
+
 	boost::shared_ptr<lua_State> state_;
 	lua_State* State() { return state_.get(); }
 
+	boost::shared_ptr<LuaCollector> collector_;
+
 public:
 	// triggers
 	void Init(bool fRestoringSaved);
@@ -337,12 +470,59 @@ public:
 	void InvalidateProjectile(short projectile_index);
 	void InvalidateObject(short object_index);
 
-	int RestorePassed(const std::string& s);
-	int RestoreAll(const std::string& s);
+	int RestorePassed(const char* data, size_t length);
+	int RestoreAll(const char* data, size_t length);
 
 private:
 	bool running_;
 	int num_scripts_;
+
+	// Triggers are called often, and most scripts define only a few of them, so rather than
+	// look each one up by name in the Triggers table every time, we keep a registry reference
+	// to each one that's defined and a bit for it in triggers_defined_.  Metamethods on the
+	// globals and on the Triggers table let us know when either changes (see
+	// InstallTriggerCache()); a Triggers we can't watch (not a table, or one with a
+	// metatable of its own, even one given it after it was assigned) means looking
+	// triggers up by name after all.
+	bool triggers_cached_;
+	const void *triggers_backing_;	// the table Triggers' contents really live in
+	uint32 triggers_defined_;
+	int trigger_refs_[NUMBER_OF_LUA_TRIGGERS];
+	bool use_trigger_cache_;
+
+	// The profiler: while the outermost trigger call runs, a count hook takes a sample every
+	// profiler_hook_interval instructions, charging the time since the last one to the call
+	// stack it finds.  The same hook keeps the instruction count for the budget.
+	static void *L_Profiler_Hook_Key() { static char key; return &key; }
+	void BeginTriggerCall();
+	void EndTriggerCall();
+	void SampleTriggerCall();
+	std::string FrameName(lua_Debug *ar);
+
+	struct trigger_profile {
+		uint32 calls;
+		uint32 over_budget;
+		uint64_t ticks;
+		uint64_t max_ticks;
+	};
+
+	LuaTrigger current_trigger_;	// set by GetTrigger()
+	int trigger_depth_;
+	LuaTrigger profiled_trigger_;
+	int hook_interval_;
+	lua_Hook saved_hook_;	// a debug.sethook() hook ours replaces for the call
+	int saved_hook_mask_;
+	int saved_hook_count_;
+	int32 trigger_instructions_;
+	bool over_budget_;
+	uint64_t call_start_;
+	uint64_t last_sample_;
+	std::string last_stack_;
+	std::string last_function_;
+
+	trigger_profile trigger_profiles_[NUMBER_OF_LUA_TRIGGERS];
+	std::map<std::string, uint64_t> stack_ticks_;
+	std::map<std::string, uint64_t> function_ticks_;
 };
 
 typedef LuaState EmbeddedLuaState;
@@ -361,11 +541,22 @@ public:
 	}
 };
 
-bool LuaState::GetTrigger(const char* trigger)
+bool LuaState::GetTrigger(LuaTrigger trigger)
 {
 	if (!running_)
 		return false;
 
+	current_trigger_ = trigger;
+
+	if (triggers_cached_ && use_trigger_cache_)
+	{
+		if (!(triggers_defined_ & (1u << trigger)))
+			return false;
+
+		lua_rawgeti(State(), LUA_REGISTRYINDEX, trigger_refs_[trigger]);
+		return true;
+	}
+
 	lua_getglobal(State(), "Triggers");
 	if (!lua_istable(State(), -1))
 	{
@@ -373,7 +564,7 @@ bool LuaState::GetTrigger(const char* trigger)
 		return false;
 	}
 
-	lua_pushstring(State(), trigger);
+	lua_pushstring(State(), trigger_names[trigger]);
 	lua_gettable(State(), -2);
 	if (!lua_isfunction(State(), -1))
 	{
@@ -387,13 +578,605 @@ bool LuaState::GetTrigger(const char* trigger)
 
 void LuaState::CallTrigger(int numArgs)
 {
-	if (lua_pcall(State(), numArgs, 0, 0) == LUA_ERRRUN)
+	// a trigger can set off another; that one's time is part of the first's
+	bool watched = (trigger_depth_ == 0 && (lua_profiling || lua_instruction_budget > 0));
+	if (watched)
+		BeginTriggerCall();
+
+	++trigger_depth_;
+	int result = lua_pcall(State(), numArgs, 0, 0);
+	--trigger_depth_;
+
+	if (watched)
+		EndTriggerCall();
+
+	if (result == LUA_ERRRUN)
 		L_Error(lua_tostring(State(), -1));
 }
 
+static const int profiler_hook_interval = 1000;
+
+void LuaState::BeginTriggerCall()
+{
+	profiled_trigger_ = current_trigger_;
+	trigger_instructions_ = 0;
+	over_budget_ = false;
+	call_start_ = last_sample_ = SDL_GetPerformanceCounter();
+	last_stack_ = last_function_ = trigger_names[profiled_trigger_];
+
+	hook_interval_ = profiler_hook_interval;
+	if (!lua_profiling)
+		hook_interval_ = PIN(lua_instruction_budget, 1, profiler_hook_interval);
+
+	saved_hook_ = lua_gethook(State());
+	saved_hook_mask_ = lua_gethookmask(State());
+	saved_hook_count_ = lua_gethookcount(State());
+	lua_sethook(State(), L_Profiler_Hook, LUA_MASKCOUNT, hook_interval_);
+}
+
+void LuaState::EndTriggerCall()
+{
+	// unless the trigger set a hook of its own
+	if (lua_gethook(State()) == L_Profiler_Hook)
+		lua_sethook(State(), saved_hook_, saved_hook_mask_, saved_hook_count_);
+
+	trigger_profile& profile = trigger_profiles_[profiled_trigger_];
+	if (over_budget_)
+		profile.over_budget++;
+
+	if (lua_profiling)
+	{
+		uint64_t now = SDL_GetPerformanceCounter();
+		stack_ticks_[last_stack_] += now - last_sample_;
+		function_ticks_[last_function_] += now - last_sample_;
+
+		profile.calls++;
+		profile.ticks += now - call_start_;
+		profile.max_ticks = std::max(profile.max_ticks, now - call_start_);
+	}
+}
+
+// A frame's name for the folded stacks, which use ';' between frames
+std::string LuaState::FrameName(lua_Debug *ar)
+{
+	std::ostringstream name;
+	if (strcmp(ar->what, "C") == 0)
+		name << (ar->name ? ar->name : "[C]");
+	else if (strcmp(ar->what, "main") == 0)
+		name << "main chunk (" << ar->short_src << ")";
+	else
+		name << (ar->name ? ar->name : "?") << " (" << ar->short_src << ":" << ar->linedefined << ")";
+
+	std::string s = name.str();
+	std::replace(s.begin(), s.end(), ';', ',');
+	return s;
+}
+
+void LuaState::SampleTriggerCall()
+{
+	trigger_instructions_ += hook_interval_;
+
+	if (lua_profiling)
+	{
+		std::vector<std::string> frames;
+		lua_Debug ar;
+		for (int level = 0; lua_getstack(State(), level, &ar); ++level)
+		{
+			lua_getinfo(State(), "Sn", &ar);
+			frames.push_back(FrameName(&ar));
+		}
+
+		std::string stack = trigger_names[profiled_trigger_];
+		for (std::vector<std::string>::reverse_iterator it = frames.rbegin(); it != frames.rend(); ++it)
+			stack += ";" + *it;
+
+		uint64_t now = SDL_GetPerformanceCounter();
+		last_stack_ = stack;
+		last_function_ = frames.empty() ? trigger_names[profiled_trigger_] : frames.front();
+		stack_ticks_[last_stack_] += now - last_sample_;
+		function_ticks_[last_function_] += now - last_sample_;
+		last_sample_ = now;
+	}
+
+	if (lua_instruction_budget > 0 && trigger_instructions_ > lua_instruction_budget && !over_budget_)
+	{
+		over_budget_ = true;
+		logWarning("Lua %s trigger ran over its budget of %d instructions", trigger_names[profiled_trigger_], lua_instruction_budget);
+
+		// stopping a trigger short changes the game, so not where the game has to come out
+		// the same elsewhere: in network games, or in films being recorded or replayed
+		if (lua_abort_over_budget && !game_is_networked && !game_is_recording() && !game_is_replaying())
+			luaL_error(State(), "%s trigger ran over its budget of %d instructions", trigger_names[profiled_trigger_], lua_instruction_budget);
+	}
+}
+
+static void L_Profiler_Hook(lua_State *L, lua_Debug *ar)
+{
+	lua_pushlightuserdata(L, LuaState::L_Profiler_Hook_Key());
+	lua_gettable(L, LUA_REGISTRYINDEX);
+	LuaState *state = static_cast<LuaState*>(lua_touserdata(L, -1));
+	lua_pop(L, 1);
+
+	if (state && state->Matches(L))
+		state->SampleTriggerCall();
+}
+
+void LuaState::ResetProfile()
+{
+	obj_clear(trigger_profiles_);
+	stack_ticks_.clear();
+	function_ticks_.clear();
+}
+
+static bool compare_ticks(const std::pair<std::string, uint64_t>& a, const std::pair<std::string, uint64_t>& b)
+{
+	return a.second > b.second;
+}
+
+void LuaState::ReportProfile(const char *desc)
+{
+	const int report_lines = 5;
+	double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+
+	// by time, most first
+	std::vector<std::pair<uint64_t, int> > triggers;
+	uint64_t total_ticks = 0;
+	for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+	{
+		if (trigger_profiles_[i].calls || trigger_profiles_[i].over_budget)
+			triggers.push_back(std::make_pair(trigger_profiles_[i].ticks, i));
+		total_ticks += trigger_profiles_[i].ticks;
+	}
+	if (triggers.empty())
+		return;
+
+	std::sort(triggers.rbegin(), triggers.rend());
+	screen_printf("%s: %.1f ms in triggers", desc, total_ticks * 1e3 / frequency);
+	for (size_t i = 0; i < triggers.size() && i < report_lines; ++i)
+	{
+		int trigger = triggers[i].second;
+		const trigger_profile& profile = trigger_profiles_[trigger];
+		screen_printf("  %s: %u calls, %.1f ms, max %.0f us, %u over budget", trigger_names[trigger], profile.calls, profile.ticks * 1e3 / frequency, profile.max_ticks * 1e6 / frequency, profile.over_budget);
+	}
+
+	std::vector<std::pair<std::string, uint64_t> > functions(function_ticks_.begin(), function_ticks_.end());
+	std::sort(functions.begin(), functions.end(), compare_ticks);
+	for (size_t i = 0; i < functions.size() && i < report_lines; ++i)
+		screen_printf("  %4.1f%% %s", total_ticks ? functions[i].second * 100.0 / total_ticks : 0.0, functions[i].first.c_str());
+}
+
+void LuaState::DumpProfile(FILE *file, const char *desc)
+{
+	double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+	for (std::map<std::string, uint64_t>::iterator it = stack_ticks_.begin(); it != stack_ticks_.end(); ++it)
+	{
+		uint64_t microseconds = static_cast<uint64_t>(it->second * 1e6 / frequency + 0.5);
+		if (microseconds)
+			fprintf(file, "%s;%s %llu\n", desc, it->first.c_str(), static_cast<unsigned long long>(microseconds));
+	}
+}
+
+static char L_TRIGGERS_KEY[] = "triggers";
+static char L_TRIGGERS_BACKING_KEY[] = "triggers_backing";
+static char L_GLOBALS_METATABLE_KEY[] = "globals_metatable";
+
+// Wraps the library function at name in table (the globals if NULL) in a closure of f, with
+// the original and us as its upvalues
+static void L_Wrap_Metatable_Function(lua_State *L, const char *table, const char *name, lua_CFunction f, void *state, bool honor_protection)
+{
+	if (table)
+	{
+		lua_getglobal(L, table);
+		if (!lua_istable(L, -1))
+		{
+			lua_pop(L, 1);
+			return;
+		}
+	}
+	else
+	{
+		lua_pushglobaltable(L);
+	}
+
+	lua_getfield(L, -1, name);
+	lua_pushlightuserdata(L, state);
+	lua_pushboolean(L, honor_protection);
+	lua_pushcclosure(L, f, 3);
+	lua_setfield(L, -2, name);
+	lua_pop(L, 1);
+}
+
+// Triggers itself is kept out of the globals table, so that assigning it goes through
+// L_Globals_Newindex; the globals' metatable, and whatever metatable the script gives the
+// globals with setmetatable(), see to the rest.  Neither our metatable for the globals nor
+// the one for Triggers is visible to the script: getmetatable() gives it back its own, and
+// setmetatable() on Triggers stops us watching it instead of unhooking us.  The debug
+// library's versions do the same, without the __metatable protection.
+void LuaState::InstallTriggerCache()
+{
+	lua_State *L = State();
+
+	lua_pushlightuserdata(L, reinterpret_cast<void*>(L_TRIGGERS_KEY));
+	lua_pushnil(L);
+	lua_settable(L, LUA_REGISTRYINDEX);
+
+	lua_pushglobaltable(L);
+	lua_newtable(L);
+	lua_pushlightuserdata(L, this);
+	lua_pushcclosure(L, L_Globals_Index, 1);
+	lua_setfield(L, -2, "__index");
+	lua_pushlightuserdata(L, this);
+	lua_pushcclosure(L, L_Globals_Newindex, 1);
+	lua_setfield(L, -2, "__newindex");
+	lua_setmetatable(L, -2);
+	lua_pop(L, 1);
+
+	L_Wrap_Metatable_Function(L, NULL, "getmetatable", L_Get_Metatable, this, true);
+	L_Wrap_Metatable_Function(L, NULL, "setmetatable", L_Set_Metatable, this, true);
+	L_Wrap_Metatable_Function(L, LUA_DBLIBNAME, "getmetatable", L_Get_Metatable, this, false);
+	L_Wrap_Metatable_Function(L, LUA_DBLIBNAME, "setmetatable", L_Set_Metatable, this, false);
+}
+
+void LuaState::ClearTriggerCache()
+{
+	for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+	{
+		luaL_unref(State(), LUA_REGISTRYINDEX, trigger_refs_[i]);
+		trigger_refs_[i] = LUA_NOREF;
+	}
+	triggers_defined_ = 0;
+	triggers_backing_ = 0;
+	triggers_cached_ = false;
+}
+
+// The value at index has just been assigned to Triggers
+void LuaState::TriggersAssigned(int index)
+{
+	lua_State *L = State();
+	index = lua_absindex(L, index);
+
+	ClearTriggerCache();
+
+	if (lua_istable(L, index))
+	{
+		if (!lua_getmetatable(L, index))
+		{
+			// Move its contents to a new backing table, and give it a metatable that sends
+			// reads and writes there, so that every write goes through L_Triggers_Newindex
+			lua_newtable(L);
+			int backing = lua_gettop(L);
+
+			lua_pushnil(L);
+			while (lua_next(L, index))
+			{
+				lua_pushvalue(L, -2);
+				lua_insert(L, -2);
+				lua_rawset(L, backing);
+			}
+
+			lua_pushnil(L);
+			while (lua_next(L, index))
+			{
+				lua_pop(L, 1);
+				lua_pushvalue(L, -1);
+				lua_pushnil(L);
+				lua_rawset(L, index);
+			}
+
+			lua_newtable(L);
+			lua_pushvalue(L, backing);
+			lua_setfield(L, -2, "__index");
+			lua_pushlightuserdata(L, this);
+			lua_pushvalue(L, backing);
+			lua_pushcclosure(L, L_Triggers_Newindex, 2);
+			lua_setfield(L, -2, "__newindex");
+			lua_pushvalue(L, backing);
+			lua_pushcclosure(L, L_Triggers_Pairs, 1);
+			lua_setfield(L, -2, "__pairs");
+			lua_pushlightuserdata(L, reinterpret_cast<void*>(L_TRIGGERS_BACKING_KEY));
+			lua_pushvalue(L, backing);
+			lua_rawset(L, -3);
+			lua_setmetatable(L, index);
+		}
+		else
+		{
+			// Ours, from an earlier assignment?
+			lua_pushlightuserdata(L, reinterpret_cast<void*>(L_TRIGGERS_BACKING_KEY));
+			lua_rawget(L, -2);
+			lua_remove(L, -2);
+		}
+
+		if (lua_istable(L, -1))
+		{
+			triggers_backing_ = lua_topointer(L, -1);
+			for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+			{
+				lua_getfield(L, -1, trigger_names[i]);
+				TriggerAssigned(triggers_backing_, trigger_names[i], -1);
+				lua_pop(L, 1);
+			}
+			triggers_cached_ = true;
+		}
+		lua_pop(L, 1);
+	}
+
+	lua_pushlightuserdata(L, reinterpret_cast<void*>(L_TRIGGERS_KEY));
+	lua_pushvalue(L, index);
+	lua_settable(L, LUA_REGISTRYINDEX);
+}
+
+// The script is about to give the Triggers table at index a metatable of its own: put its
+// contents back and take ours off, and if it's still Triggers, look triggers up by name
+void LuaState::TriggersUnwatched(int index)
+{
+	lua_State *L = State();
+	index = lua_absindex(L, index);
+
+	lua_getmetatable(L, index);
+	lua_pushlightuserdata(L, reinterpret_cast<void*>(L_TRIGGERS_BACKING_KEY));
+	lua_rawget(L, -2);
+	lua_remove(L, -2);
+	const void *backing = lua_topointer(L, -1);
+
+	lua_pushnil(L);
+	while (lua_next(L, -2))
+	{
+		lua_pushvalue(L, -2);
+		lua_insert(L, -2);
+		lua_rawset(L, index);
+	}
+	lua_pop(L, 1);
+
+	lua_pushnil(L);
+	lua_setmetatable(L, index);
+
+	if (backing == triggers_backing_)
+		ClearTriggerCache();
+}
+
+// The value at index has just been assigned to name in backing
+void LuaState::TriggerAssigned(const void *backing, const char *name, int index)
+{
+	// a Triggers table that has since been replaced
+	if (backing != triggers_backing_)
+		return;
+
+	for (int i = 0; i < NUMBER_OF_LUA_TRIGGERS; ++i)
+	{
+		if (strcmp(name, trigger_names[i]) == 0)
+		{
+			luaL_unref(State(), LUA_REGISTRYINDEX, trigger_refs_[i]);
+			trigger_refs_[i] = LUA_NOREF;
+			triggers_defined_ &= ~(1u << i);
+
+			if (lua_isfunction(State(), index))
+			{
+				lua_pushvalue(State(), index);
+				trigger_refs_[i] = luaL_ref(State(), LUA_REGISTRYINDEX);
+				triggers_defined_ |= (1u << i);
+			}
+			return;
+		}
+	}
+}
+
+// Pushes the __index or __newindex of the metatable the script gave the globals, if any
+static bool L_Get_Globals_Metamethod(lua_State *L, const char *event)
+{
+	lua_pushlightuserdata(L, reinterpret_cast<void*>(L_GLOBALS_METATABLE_KEY));
+	lua_gettable(L, LUA_REGISTRYINDEX);
+	if (!lua_istable(L, -1))
+	{
+		lua_pop(L, 1);
+		return false;
+	}
+
+	lua_getfield(L, -1, event);
+	lua_remove(L, -2);
+	if (lua_isnil(L, -1))
+	{
+		lua_pop(L, 1);
+		return false;
+	}
+	return true;
+}
+
+static bool L_Is_Triggers_Key(lua_State *L, int index)
+{
+	return lua_type(L, index) == LUA_TSTRING && strcmp(lua_tostring(L, index), "Triggers") == 0;
+}
+
+// A Triggers table, current or not, that still has our metatable
+static bool L_Is_Watched_Triggers(lua_State *L, int index)
+{
+	if (!lua_istable(L, index) || !lua_getmetatable(L, index))
+		return false;
+
+	lua_pushlightuserdata(L, reinterpret_cast<void*>(L_TRIGGERS_BACKING_KEY));
+	lua_rawget(L, -2);
+	bool watched = lua_istable(L, -1);
+	lua_pop(L, 2);
+	return watched;
+}
+
+static bool L_Is_Globals(lua_State *L, int index)
+{
+	lua_pushglobaltable(L);
+	bool globals = lua_rawequal(L, index, -1);
+	lua_pop(L, 1);
+	return globals;
+}
+
+// Pushes the script's own metatable for the globals, or nil
+static void L_Push_Globals_Metatable(lua_State *L)
+{
+	lua_pushlightuserdata(L, reinterpret_cast<void*>(L_GLOBALS_METATABLE_KEY));
+	lua_gettable(L, LUA_REGISTRYINDEX);
+}
+
+// __index for the globals: Triggers, or whatever the script's own metatable says
+static int L_Globals_Index(lua_State *L)
+{
+	if (L_Is_Triggers_Key(L, 2))
+	{
+		lua_pushlightuserdata(L, reinterpret_cast<void*>(L_TRIGGERS_KEY));
+		lua_gettable(L, LUA_REGISTRYINDEX);
+		return 1;
+	}
+
+	if (!L_Get_Globals_Metamethod(L, "__index"))
+		return 0;
+
+	if (lua_isfunction(L, -1))
+	{
+		lua_pushvalue(L, 1);
+		lua_pushvalue(L, 2);
+		lua_call(L, 2, 1);
+	}
+	else
+	{
+		lua_pushvalue(L, 2);
+		lua_gettable(L, -2);
+	}
+	return 1;
+}
+
+// __newindex for the globals: keeps the trigger cache up to date when Triggers is assigned
+static int L_Globals_Newindex(lua_State *L)
+{
+	if (L_Is_Triggers_Key(L, 2))
+	{
+		LuaState *state = static_cast<LuaState*>(lua_touserdata(L, lua_upvalueindex(1)));
+		state->TriggersAssigned(3);
+		return 0;
+	}
+
+	if (!L_Get_Globals_Metamethod(L, "__newindex"))
+	{
+		lua_settop(L, 3);
+		lua_rawset(L, 1);
+		return 0;
+	}
+
+	if (lua_isfunction(L, -1))
+	{
+		lua_pushvalue(L, 1);
+		lua_pushvalue(L, 2);
+		lua_pushvalue(L, 3);
+		lua_call(L, 3, 0);
+	}
+	else
+	{
+		lua_pushvalue(L, 2);
+		lua_pushvalue(L, 3);
+		lua_settable(L, -3);
+	}
+	return 0;
+}
+
+// getmetatable() that shows the script its own metatable for the globals, and none for a
+// Triggers table we're watching; upvalue 1 is the original, 3 whether to honor __metatable
+static int L_Get_Metatable(lua_State *L)
+{
+	if (L_Is_Globals(L, 1))
+	{
+		L_Push_Globals_Metatable(L);
+		if (lua_toboolean(L, lua_upvalueindex(3)) && lua_istable(L, -1))
+		{
+			lua_getfield(L, -1, "__metatable");
+			if (!lua_isnil(L, -1))
+				return 1;
+			lua_pop(L, 1);
+		}
+		return 1;
+	}
+
+	if (L_Is_Watched_Triggers(L, 1))
+	{
+		lua_pushnil(L);
+		return 1;
+	}
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+	return lua_gettop(L);
+}
+
+// setmetatable() that leaves the globals' metatable alone, consulting the script's after
+// Triggers, and stops watching a Triggers table before giving it the script's; upvalue 1
+// is the original, 2 the state, 3 whether to honor __metatable
+static int L_Set_Metatable(lua_State *L)
+{
+	if (L_Is_Globals(L, 1))
+	{
+		luaL_argcheck(L, lua_isnoneornil(L, 2) || lua_istable(L, 2), 2, "nil or table expected");
+		if (lua_toboolean(L, lua_upvalueindex(3)))
+		{
+			L_Push_Globals_Metatable(L);
+			if (lua_istable(L, -1))
+			{
+				lua_getfield(L, -1, "__metatable");
+				if (!lua_isnil(L, -1))
+					return luaL_error(L, "cannot change a protected metatable");
+			}
+		}
+		lua_pushlightuserdata(L, reinterpret_cast<void*>(L_GLOBALS_METATABLE_KEY));
+		lua_pushvalue(L, 2);
+		lua_settable(L, LUA_REGISTRYINDEX);
+		lua_settop(L, 1);
+		return 1;
+	}
+
+	if (L_Is_Watched_Triggers(L, 1))
+	{
+		LuaState *state = static_cast<LuaState*>(lua_touserdata(L, lua_upvalueindex(2)));
+		state->TriggersUnwatched(1);
+	}
+
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_insert(L, 1);
+	lua_call(L, lua_gettop(L) - 1, LUA_MULTRET);
+	return lua_gettop(L);
+}
+
+// __newindex for Triggers; upvalue 1 is the state, 2 the backing table
+static int L_Triggers_Newindex(lua_State *L)
+{
+	lua_pushvalue(L, 2);
+	lua_pushvalue(L, 3);
+	lua_rawset(L, lua_upvalueindex(2));
+
+	if (lua_type(L, 2) == LUA_TSTRING)
+	{
+		LuaState *state = static_cast<LuaState*>(lua_touserdata(L, lua_upvalueindex(1)));
+		state->TriggerAssigned(lua_topointer(L, lua_upvalueindex(2)), lua_tostring(L, 2), 3);
+	}
+	return 0;
+}
+
+static int L_Triggers_Next(lua_State *L)
+{
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_settop(L, 2);
+	if (lua_next(L, 1))
+		return 2;
+	lua_pushnil(L);
+	return 1;
+}
+
+// __pairs for Triggers, so iterating over it sees the backing table
+static int L_Triggers_Pairs(lua_State *L)
+{
+	lua_pushcfunction(L, L_Triggers_Next);
+	lua_pushvalue(L, lua_upvalueindex(1));
+	lua_pushnil(L);
+	return 3;
+}
+
 void LuaState::Init(bool fRestoringSaved)
 {
-	if (GetTrigger("init"))
+	if (GetTrigger(_trigger_init))
 	{
 		lua_pushboolean(State(), fRestoringSaved);
 		CallTrigger(1);
@@ -402,25 +1185,25 @@ void LuaState::Init(bool fRestoringSaved)
 
 void LuaState::Idle()
 {
-	if (GetTrigger("idle"))
+	if (GetTrigger(_trigger_idle))
 		CallTrigger();
 }
 
 void LuaState::Cleanup()
 {
-	if (GetTrigger("cleanup"))
+	if (GetTrigger(_trigger_cleanup))
 		CallTrigger();
 }
 
 void LuaState::PostIdle()
 {
-	if (GetTrigger("postidle"))
+	if (GetTrigger(_trigger_postidle))
 		CallTrigger();
 }
 
 void LuaState::StartRefuel(short type, short player_index, short panel_side_index)
 {
-	if (GetTrigger("start_refuel"))
+	if (GetTrigger(_trigger_start_refuel))
 	{
 		Lua_ControlPanelClass::Push(State(), type);
 		Lua_Player::Push(State(), player_index);
@@ -431,7 +1214,7 @@ void LuaState::StartRefuel(short type, short player_index, short panel_side_inde
 
 void LuaState::EndRefuel(short type, short player_index, short panel_side_index)
 {
-	if (GetTrigger("end_refuel"))
+	if (GetTrigger(_trigger_end_refuel))
 	{
 		Lua_ControlPanelClass::Push(State(), type);
 		Lua_Player::Push(State(), player_index);
@@ -442,7 +1225,7 @@ void LuaState::EndRefuel(short type, short player_index, short panel_side_index)
 
 void LuaState::TagSwitch(short tag, short player_index, short side_index)
 {
-	if (GetTrigger("tag_switch"))
+	if (GetTrigger(_trigger_tag_switch))
 	{
 		Lua_Tag::Push(State(), tag);
 		Lua_Player::Push(State(), player_index);
@@ -453,7 +1236,7 @@ void LuaState::TagSwitch(short tag, short player_index, short side_index)
 
 void LuaState::LightSwitch(short light, short player_index, short side_index)
 {
-	if (GetTrigger("light_switch"))
+	if (GetTrigger(_trigger_light_switch))
 	{
 		Lua_Light::Push(State(), light);
 		Lua_Player::Push(State(), player_index);
@@ -464,7 +1247,7 @@ void LuaState::LightSwitch(short light, short player_index, short side_index)
 
 void LuaState::PlatformSwitch(short platform, short player_index, short side_index)
 {
-	if (GetTrigger("platform_switch"))
+	if (GetTrigger(_trigger_platform_switch))
 	{
 		Lua_Polygon::Push(State(), platform);
 		Lua_Player::Push(State(), player_index);
@@ -475,7 +1258,7 @@ void LuaState::PlatformSwitch(short platform, short player_index, short side_ind
 
 void LuaState::ProjectileSwitch(short side_index, short projectile_index)
 {
-	if (GetTrigger("projectile_switch"))
+	if (GetTrigger(_trigger_projectile_switch))
 	{
 		Lua_Projectile::Push(State(), projectile_index);
 		Lua_Side::Push(State(), side_index);
@@ -485,7 +1268,7 @@ void LuaState::ProjectileSwitch(short side_index, short projectile_index)
 
 void LuaState::TerminalEnter(short terminal_id, short player_index)
 {
-	if (GetTrigger("terminal_enter"))
+	if (GetTrigger(_trigger_terminal_enter))
 	{
 		Lua_Terminal::Push(State(), terminal_id);
 		Lua_Player::Push(State(), player_index);
@@ -495,7 +1278,7 @@ void LuaState::TerminalEnter(short terminal_id, short player_index)
 
 void LuaState::TerminalExit(short terminal_id, short player_index)
 {
-	if (GetTrigger("terminal_exit"))
+	if (GetTrigger(_trigger_terminal_exit))
 	{
 		Lua_Terminal::Push(State(), terminal_id);
 		Lua_Player::Push(State(), player_index);
@@ -505,7 +1288,7 @@ void LuaState::TerminalExit(short terminal_id, short player_index)
 
 void LuaState::PatternBuffer(short side_index, short player_index)
 {
-	if (GetTrigger("pattern_buffer"))
+	if (GetTrigger(_trigger_pattern_buffer))
 	{
 		Lua_Side::Push(State(), side_index);
 		Lua_Player::Push(State(), player_index);
@@ -515,7 +1298,7 @@ void LuaState::PatternBuffer(short side_index, short player_index)
 
 void LuaState::GotItem(short type, short player_index)
 {
-	if (GetTrigger("got_item"))
+	if (GetTrigger(_trigger_got_item))
 	{
 		Lua_ItemType::Push(State(), type);
 		Lua_Player::Push(State(), player_index);
@@ -525,7 +1308,7 @@ void LuaState::GotItem(short type, short player_index)
 
 void LuaState::LightActivated(short index)
 {
-	if (GetTrigger("light_activated"))
+	if (GetTrigger(_trigger_light_activated))
 	{
 		Lua_Light::Push(State(), index);
 		CallTrigger(1);
@@ -534,7 +1317,7 @@ void LuaState::LightActivated(short index)
 
 void LuaState::PlatformActivated(short index)
 {
-	if (GetTrigger("platform_activated"))
+	if (GetTrigger(_trigger_platform_activated))
 	{
 		Lua_Polygon::Push(State(), index);
 		CallTrigger(1);
@@ -543,7 +1326,7 @@ void LuaState::PlatformActivated(short index)
 
 void LuaState::PlayerRevived (short player_index)
 {
-	if (GetTrigger("player_revived"))
+	if (GetTrigger(_trigger_player_revived))
 	{
 		Lua_Player::Push(State(), player_index);
 		CallTrigger(1);
@@ -552,7 +1335,7 @@ void LuaState::PlayerRevived (short player_index)
 
 void LuaState::PlayerKilled (short player_index, short aggressor_player_index, short action, short projectile_index)
 {
-	if (GetTrigger("player_killed"))
+	if (GetTrigger(_trigger_player_killed))
 	{
 		Lua_Player::Push(State(), player_index);
 
@@ -573,7 +1356,7 @@ void LuaState::PlayerKilled (short player_index, short aggressor_player_index, s
 
 void LuaState::MonsterKilled (short monster_index, short aggressor_player_index, short projectile_index)
 {
-	if (GetTrigger("monster_killed"))
+	if (GetTrigger(_trigger_monster_killed))
 	{
 		Lua_Monster::Push(State(), monster_index);
 		if (aggressor_player_index != -1)
@@ -592,7 +1375,7 @@ void LuaState::MonsterKilled (short monster_index, short aggressor_player_index,
 
 void LuaState::MonsterDamaged(short monster_index, short aggressor_monster_index, int16 damage_type, short damage_amount, short projectile_index)
 {
-	if (GetTrigger("monster_damaged"))
+	if (GetTrigger(_trigger_monster_damaged))
 	{
 		Lua_Monster::Push(State(), monster_index);
 		if (aggressor_monster_index != -1) 
@@ -615,7 +1398,7 @@ void LuaState::MonsterDamaged(short monster_index, short aggressor_monster_index
 
 void LuaState::PlayerDamaged (short player_index, short aggressor_player_index, short aggressor_monster_index, int16 damage_type, short damage_amount, short projectile_index)
 {
-	if (GetTrigger("player_damaged"))
+	if (GetTrigger(_trigger_player_damaged))
 	{
 		Lua_Player::Push(State(), player_index);
 
@@ -643,7 +1426,7 @@ void LuaState::PlayerDamaged (short player_index, short aggressor_player_index,
 
 void LuaState::ProjectileDetonated(short type, short owner_index, short polygon, world_point3d location) 
 {
-	if (GetTrigger("projectile_detonated"))
+	if (GetTrigger(_trigger_projectile_detonated))
 	{
 		Lua_ProjectileType::Push(State(), type);
 		if (owner_index != -1)
@@ -661,7 +1444,7 @@ void LuaState::ProjectileDetonated(short type, short owner_index, short polygon,
 
 void LuaState::ProjectileCreated (short projectile_index)
 {
-	if (GetTrigger("projectile_created"))
+	if (GetTrigger(_trigger_projectile_created))
 	{
 		Lua_Projectile::Push(State(), projectile_index);
 		CallTrigger(1);
@@ -670,7 +1453,7 @@ void LuaState::ProjectileCreated (short projectile_index)
 
 void LuaState::ItemCreated (short item_index)
 {
-	if (GetTrigger("item_created"))
+	if (GetTrigger(_trigger_item_created))
 	{
 		Lua_Item::Push(State(), item_index);
 		CallTrigger(1);
@@ -986,15 +1769,15 @@ void LuaState::MarkCollections(std::set<short>* collections)
 	}
 }
 
-int LuaState::RestoreAll(const std::string& s)
+int LuaState::RestoreAll(const char* data, size_t length)
 {
-	if (s.empty())
+	if (!length)
 	{
 		lua_pushboolean(State(), false);
 		return 1;
 	}
 
-	std::stringbuf sb(s);
+	io::stream_buffer<io::array_source> sb(data, length);
 	if (lua_restore(State(), &sb))
 	{
 		lua_pushlightuserdata(State(), L_Persistent_Table_Key());
@@ -1004,22 +1787,21 @@ int LuaState::RestoreAll(const std::string& s)
 	} 
 	else
 	{
-		lua_pop(State(), 2);
 		lua_pushboolean(State(), false);
 	}
 
 	return 1;
 }
 
-int LuaState::RestorePassed(const std::string& s)
+int LuaState::RestorePassed(const char* data, size_t length)
 {
-	if (s.empty())
+	if (!length)
 	{
 		lua_pushboolean(State(), false);
 		return 1;
 	}
 
-	std::stringbuf sb(s);
+	io::stream_buffer<io::array_source> sb(data, length);
 	if (lua_restore(State(), &sb))
 	{
 		lua_pushlightuserdata(State(), L_Persistent_Table_Key());
@@ -1037,30 +1819,23 @@ int LuaState::RestorePassed(const std::string& s)
 	}
 	else
 	{
-		lua_settop(State(), 0);
 		lua_pushboolean(State(), false);
 	}
 
 	return 1;
 }
 
-std::string LuaState::SaveAll()
+bool LuaState::SaveAll(std::streambuf* sb)
 {
 	lua_pushlightuserdata(State(), L_Persistent_Table_Key());
 	lua_gettable(State(), LUA_REGISTRYINDEX);
 
-	std::stringbuf sb;
-	if (lua_save(State(), &sb))
-	{
-		return sb.str();
-	}
-	else
-	{
-		return string();
-	}
+	bool saved = lua_save(State(), sb);
+	lua_pop(State(), 1);
+	return saved;
 }
 
-std::string LuaState::SavePassed()
+bool LuaState::SavePassed(std::streambuf* sb)
 {
 	// copy "player" and "Game" custom fields to a new table
 	lua_pushlightuserdata(State(), reinterpret_cast<void*>(L_Persistent_Table_Key()));
@@ -1075,19 +1850,77 @@ std::string LuaState::SavePassed()
 	
 	lua_remove(State(), -2);
 
-	std::stringbuf sb;
-	if (lua_save(State(), &sb))
+	bool saved = lua_save(State(), sb);
+	lua_pop(State(), 1);
+	return saved;
+}
+
+typedef boost::ptr_map<int, LuaState> state_map;
+state_map states;
+
+// Serializes a state straight onto the end of buffer, in the packed form above
+static void append_lua_state(std::vector<char>& buffer, int index, LuaState& state, bool passed)
+{
+	const size_t header_length = 6; // index, length
+	size_t start = buffer.size();
+	buffer.resize(start + header_length);
+
+	bool saved;
 	{
-		return sb.str();
-	} 
-	else
+		io::stream_buffer<io::back_insert_device<std::vector<char> > > sb(buffer);
+		saved = passed ? state.SavePassed(&sb) : state.SaveAll(&sb);
+	}
+
+	size_t length = buffer.size() - start - header_length;
+	if (!saved || !length)
 	{
-		return string();
+		buffer.resize(start);
+		return;
 	}
+
+	io::stream_buffer<io::array_sink> sb(&buffer[start], header_length);
+	BOStreamBE s(&sb);
+	s << static_cast<int16>(index)
+	  << static_cast<uint32>(length);
 }
 
-typedef boost::ptr_map<int, LuaState> state_map;
-state_map states;
+// Finds a state's data in a buffer packed as above
+static bool find_lua_state(const std::vector<char>& buffer, int index, const char*& data, size_t& length)
+{
+	if (buffer.empty())
+		return false;
+
+	io::stream_buffer<io::array_source> sb(&buffer[0], buffer.size());
+	BIStreamBE s(&sb);
+	try
+	{
+		while (s.tellg() != s.maxg())
+		{
+			int16 state_index;
+			uint32 state_length;
+			s >> state_index
+			  >> state_length;
+
+			size_t offset = static_cast<size_t>(s.tellg());
+			if (state_length > buffer.size() - offset)
+				return false;
+
+			if (state_index == index)
+			{
+				data = &buffer[offset];
+				length = state_length;
+				return true;
+			}
+
+			s.ignore(state_length);
+		}
+	}
+	catch (const basic_bstream::failure&)
+	{
+	}
+
+	return false;
+}
 
 // globals
 vector<lua_camera> lua_cameras;
@@ -1205,6 +2038,9 @@ void L_Call_Idle()
 void L_Call_PostIdle()
 {
 	L_Dispatch(boost::bind(&LuaState::PostIdle, _1));
+
+	// every tick, outside the triggers
+	L_Dispatch(boost::bind(&LuaState::CollectGarbage, _1));
 }
 
 void L_Call_Start_Refuel (short type, short player_index, short panel_side_index)
@@ -1410,7 +2246,10 @@ int L_Restore_Saved(lua_State *L)
 	{
 		if (it->second->Matches(L))
 		{
-			return it->second->RestoreAll(SavedLuaState[it->first]);
+			const char *data = 0;
+			size_t length = 0;
+			find_lua_state(SavedLuaState, it->first, data, length);
+			return it->second->RestoreAll(data, length);
 		}
 	}
 	
@@ -1423,7 +2262,10 @@ int L_Restore_Passed(lua_State *L)
 	{
 		if (it->second->Matches(L))
 		{
-			return it->second->RestorePassed(PassedLuaState[it->first]);
+			const char *data = 0;
+			size_t length = 0;
+			find_lua_state(PassedLuaState, it->first, data, length);
+			return it->second->RestorePassed(data, length);
 		}
 	}
 	
@@ -1760,6 +2602,37 @@ static LuaState* LuaStateFactory(ScriptType script_type)
 	return NULL;
 }
 
+static const char* ScriptTypeDescription(int script_type)
+{
+	switch (script_type) {
+		case _embedded_lua_script:
+			return "Map Lua";
+		case _lua_netscript:
+			return "Netscript";
+		case _solo_lua_script:
+			return "Solo Lua";
+		case _stats_lua_script:
+			return "Stats Lua";
+	}
+	return "level_script";
+}
+
+// The name its collector settings go by (see lua_gc.h)
+static const char* ScriptTypeCollectorName(int script_type)
+{
+	switch (script_type) {
+		case _embedded_lua_script:
+			return "map";
+		case _lua_netscript:
+			return "netscript";
+		case _solo_lua_script:
+			return "solo";
+		case _stats_lua_script:
+			return "stats";
+	}
+	return "map";
+}
+
 bool LoadLuaScript(const char *buffer, size_t len, ScriptType script_type)
 {
 	assert(script_type >= _embedded_lua_script && script_type <= _stats_lua_script);
@@ -1768,23 +2641,9 @@ bool LoadLuaScript(const char *buffer, size_t len, ScriptType script_type)
 		int type = script_type;
 		states.insert(type, LuaStateFactory(script_type));
 		states[script_type].Initialize();
+		states[script_type].AttachCollector(ScriptTypeCollectorName(script_type));
 	}
-	const char *desc = "level_script";
-	switch (script_type) {
-		case _embedded_lua_script:
-			desc = "Map Lua";
-			break;
-		case _lua_netscript:
-			desc = "Netscript";
-			break;
-		case _solo_lua_script:
-			desc = "Solo Lua";
-			break;
-		case _stats_lua_script:
-			desc = "Stats Lua";
-			break;
-	}
-	return states[script_type].Load(buffer, len, desc);
+	return states[script_type].Load(buffer, len, ScriptTypeDescription(script_type));
 }
 
 #ifdef HAVE_OPENGL
@@ -2048,7 +2907,7 @@ void CloseLuaScript()
 	PassedLuaState.clear();
 	for (state_map::iterator it = states.begin(); it != states.end(); ++it)
 	{
-		PassedLuaState[it->first] = it->second->SavePassed();
+		append_lua_state(PassedLuaState, it->first, *it->second, true);
 	}
 	states.clear();
 
@@ -2210,54 +3069,250 @@ int GetLuaGameEndCondition() {
 
 size_t save_lua_states()
 {
-	size_t length = 0;
-
 	SavedLuaState.clear();
 	for (state_map::iterator it = states.begin(); it != states.end(); ++it)
 	{
-		SavedLuaState[it->first] = it->second->SaveAll();
-		if (SavedLuaState[it->first].size())
-		{
-			length += 6; // id, length
-			length += SavedLuaState[it->first].size();
-		}
+		append_lua_state(SavedLuaState, it->first, *it->second, false);
 	}
 
-	return length;
+	return SavedLuaState.size();
 }
 
 void pack_lua_states(uint8* data, size_t length)
 {
-	io::stream_buffer<io::array_sink> sb(reinterpret_cast<char*>(data), length);
-	BOStreamBE s(&sb);
-	for (std::map<int, std::string>::iterator it = SavedLuaState.begin(); it != SavedLuaState.end(); ++it)
+	assert(length == SavedLuaState.size());
+	if (length)
+		memcpy(data, &SavedLuaState[0], length);
+
+	// don't hold on to a big state's memory
+	std::vector<char>().swap(SavedLuaState);
+}
+
+void unpack_lua_states(uint8* data, size_t length)
+{
+	SavedLuaState.assign(reinterpret_cast<char*>(data), reinterpret_cast<char*>(data) + length);
+}
+
+void StartLuaProfiler()
+{
+	for (state_map::iterator it = states.begin(); it != states.end(); ++it)
+		it->second->ResetProfile();
+	lua_profiling = true;
+}
+
+void StopLuaProfiler()
+{
+	lua_profiling = false;
+}
+
+void ReportLuaProfile()
+{
+	for (state_map::iterator it = states.begin(); it != states.end(); ++it)
+		it->second->ReportProfile(ScriptTypeDescription(it->first));
+}
+
+bool DumpLuaProfile(const std::string& path)
+{
+	FILE *file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+
+	for (state_map::iterator it = states.begin(); it != states.end(); ++it)
+		it->second->DumpProfile(file, ScriptTypeDescription(it->first));
+
+	return (fclose(file) == 0);
+}
+
+void SetLuaInstructionBudget(int32 instructions, bool abort)
+{
+	lua_instruction_budget = std::max<int32>(instructions, 0);
+	lua_abort_over_budget = abort;
+}
+
+// Monster damage, projectile creation and monster deaths, the per-tick triggers a busy level
+// fires most, against scripts that handle none, some and (through the compatibility
+// triggers) all of them; looked up by name each time, then through the trigger cache
+int run_lua_trigger_benchmark(int events)
+{
+	// Scripts that keep count in calls are checked against it afterwards: calls_per_event
+	// triggers should have run for each event, by name and cached alike
+	static const struct {
+		const char *name;
+		const char *script;
+		int calls_per_event;
+	} benchmark_scripts[] = {
+		{ "idle only", "Triggers = {} function Triggers.idle() end", 0 },
+		{ "damage", "Triggers = {} local n = 0 "
+		  "function Triggers.monster_damaged(monster, aggressor, damage_type, amount, projectile) n = n + amount end "
+		  "function Triggers.projectile_created(projectile) n = n + 1 end", 0 },
+		{ "compatibility", "n = 0 function monster_killed(monster, aggressor, projectile) n = n + 1 end", 0 },
+		// strict.lua's way of hooking the globals
+		{ "strict", "local mt = getmetatable(_G) if mt == nil then mt = {} setmetatable(_G, mt) end "
+		  "local declared = { calls = true } "
+		  "mt.__newindex = function(t, k, v) if not declared[k] then error(\"assign to undeclared variable \" .. k, 2) end rawset(t, k, v) end "
+		  "mt.__index = function(t, k) error(\"variable \" .. k .. \" is not declared\", 2) end "
+		  "calls = 0 Triggers = {} "
+		  "function Triggers.monster_killed(monster, aggressor, projectile) calls = calls + 1 end", 1 },
+		// a metatable on Triggers itself, then a trigger defined after it
+		{ "metatable", "calls = 0 Triggers = {} local handlers = {} "
+		  "setmetatable(Triggers, { __index = handlers }) "
+		  "function handlers.monster_killed(monster, aggressor, projectile) calls = calls + 1 end "
+		  "function Triggers.monster_damaged(monster, aggressor, damage_type, amount, projectile) calls = calls + 1 end", 2 }
+	};
+	const int number_of_scripts = sizeof(benchmark_scripts) / sizeof(benchmark_scripts[0]);
+	const int benchmark_objects = 32;
+
+	if (events <= 0)
+	{
+		fprintf(stderr, "bench-lua-triggers: the number of events must be positive\n");
+		return 1;
+	}
+
+	// Enough of a world for the triggers' arguments to be valid
+	MonsterList.resize(MAXIMUM_MONSTERS_PER_MAP);
+	ProjectileList.resize(MAXIMUM_PROJECTILES_PER_MAP);
+	for (int i = 0; i < benchmark_objects; ++i)
 	{
-		if (it->second.size())
+		MARK_SLOT_AS_USED(&MonsterList[i]);
+		MARK_SLOT_AS_USED(&ProjectileList[i]);
+	}
+
+	double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+
+	printf("Lua trigger benchmark: ns per event, %d events of each kind\n", events);
+	printf("\n%-14s %-9s %10s %10s %8s\n", "script", "event", "by name", "cached", "speedup");
+	fflush(stdout);
+
+	for (int i = 0; i < number_of_scripts; ++i)
+	{
+		double times[2][3];
+		for (int cached = 0; cached < 2; ++cached)
 		{
-			s << static_cast<int16>(it->first);
-			s << static_cast<uint32>(it->second.size());
-			s.write(&it->second[0], it->second.size());
+			LuaState state;
+			state.Initialize();
+			if (!state.Load(benchmark_scripts[i].script, strlen(benchmark_scripts[i].script), benchmark_scripts[i].name) || !state.Run())
+			{
+				fprintf(stderr, "bench-lua-triggers: the %s script failed to run\n", benchmark_scripts[i].name);
+				return 1;
+			}
+			state.UseTriggerCache(cached != 0);
+
+			uint64_t start = SDL_GetPerformanceCounter();
+			for (int event = 0; event < events; ++event)
+				state.MonsterDamaged(event % benchmark_objects, -1, 0, 10, event % benchmark_objects);
+			times[cached][0] = (SDL_GetPerformanceCounter() - start) * 1e9 / frequency / events;
+
+			start = SDL_GetPerformanceCounter();
+			for (int event = 0; event < events; ++event)
+				state.ProjectileCreated(event % benchmark_objects);
+			times[cached][1] = (SDL_GetPerformanceCounter() - start) * 1e9 / frequency / events;
+
+			start = SDL_GetPerformanceCounter();
+			for (int event = 0; event < events; ++event)
+				state.MonsterKilled(event % benchmark_objects, -1, -1);
+			times[cached][2] = (SDL_GetPerformanceCounter() - start) * 1e9 / frequency / events;
+
+			if (benchmark_scripts[i].calls_per_event)
+			{
+				lua_getglobal(state.State(), "calls");
+				int calls = static_cast<int>(lua_tointeger(state.State(), -1));
+				lua_pop(state.State(), 1);
+				if (calls != benchmark_scripts[i].calls_per_event * events)
+				{
+					fprintf(stderr, "bench-lua-triggers: the %s script's triggers ran %d times %s, not %d\n", benchmark_scripts[i].name, calls, cached ? "cached" : "by name", benchmark_scripts[i].calls_per_event * events);
+					return 1;
+				}
+			}
 		}
+
+		static const char *event_names[3] = { "damaged", "created", "killed" };
+		for (int j = 0; j < 3; ++j)
+			printf("%-14s %-9s %10.1f %10.1f %7.1fx\n", (j == 0) ? benchmark_scripts[i].name : "", event_names[j], times[0][j], times[1][j], times[0][j] / times[1][j]);
+		fflush(stdout);
 	}
 
-	SavedLuaState.clear();
+	return 0;
 }
 
-void unpack_lua_states(uint8* data, size_t length)
+int run_lua_save_benchmark(int records)
 {
-	io::stream_buffer<io::array_source> sb(reinterpret_cast<char*>(data), length);
-	BIStreamBE s(&sb);
+	// the sort of thing scenarios keep in their persistent tables
+	static const char *benchmark_script =
+		"local kinds = { 'fighter', 'trooper', 'hunter', 'enforcer', 'juggernaut' } "
+		"local shared = { difficulty = 'major damage', version = 3 } "
+		"records = {} "
+		"for i = 1, %d do "
+		"  records[i] = { kind = kinds[i %% #kinds + 1], name = 'record ' .. i, "
+		"    x = i * 0.25, y = i %% 1024, z = -i, health = 100, "
+		"    flags = { alive = i %% 3 ~= 0, seen = i %% 2 == 0 }, "
+		"    inventory = { 1, 2, 3, i }, settings = shared } "
+		"end";
+	const int rounds = 5;
 
-	SavedLuaState.clear();
-	while (s.tellg() != s.maxg())
+	if (records <= 0)
 	{
-		int16 index;
-		uint32 length;
-		s >> index 
-		  >> length;
+		fprintf(stderr, "bench-lua-save: the number of records must be positive\n");
+		return 1;
+	}
+
+	boost::shared_ptr<lua_State> state(luaL_newstate(), lua_close);
+	lua_State *L = state.get();
+	for (const luaL_Reg *lib = lualibs; lib->func; lib++)
+	{
+		luaL_requiref(L, lib->name, lib->func, 1);
+		lua_pop(L, 1);
+	}
 
-		SavedLuaState[index].resize(length);
-		s.read(&SavedLuaState[index][0], SavedLuaState[index].size());
+	std::vector<char> script(strlen(benchmark_script) + 16);
+	snprintf(&script[0], script.size(), benchmark_script, records);
+	if (luaL_dostring(L, &script[0]))
+	{
+		fprintf(stderr, "bench-lua-save: %s\n", lua_tostring(L, -1));
+		return 1;
 	}
+	lua_getglobal(L, "records");
+
+	double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+
+	printf("Lua save benchmark: %d records, best of %d rounds\n", records, rounds);
+	printf("\n%-8s %10s %10s %12s\n", "format", "KB", "save ms", "restore ms");
+	fflush(stdout);
+
+	for (uint16 version = 1; version <= kLuaSaveVersion; ++version)
+	{
+		std::vector<char> buffer;
+		double save_ms = 0, restore_ms = 0;
+		for (int round = 0; round < rounds; ++round)
+		{
+			buffer.clear();
+			uint64_t start = SDL_GetPerformanceCounter();
+			bool saved;
+			{
+				io::stream_buffer<io::back_insert_device<std::vector<char> > > sb(buffer);
+				saved = lua_save(L, &sb, version);
+			}
+			double ms = (SDL_GetPerformanceCounter() - start) * 1e3 / frequency;
+			save_ms = round ? std::min(save_ms, ms) : ms;
+
+			start = SDL_GetPerformanceCounter();
+			io::stream_buffer<io::array_source> sb(&buffer[0], buffer.size());
+			bool restored = saved && lua_restore(L, &sb);
+			ms = (SDL_GetPerformanceCounter() - start) * 1e3 / frequency;
+			restore_ms = round ? std::min(restore_ms, ms) : ms;
+
+			if (!restored)
+			{
+				fprintf(stderr, "bench-lua-save: version %d failed\n", version);
+				return 1;
+			}
+			lua_pop(L, 1);
+			lua_gc(L, LUA_GCCOLLECT, 0);
+		}
+
+		printf("%-8d %10.1f %10.2f %12.2f\n", version, buffer.size() / 1024.0, save_ms, restore_ms);
+		fflush(stdout);
+	}
+
+	return 0;
 }
 #endif /* HAVE_LUA */
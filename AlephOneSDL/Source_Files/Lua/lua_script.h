@@ -105,6 +105,34 @@ int LuaTexturePaletteSelected();
 
 bool LuaPlayerCanWieldWeapons(short player_index);
 
+// The trigger profiler (the console's .lua profile commands): time per trigger and per Lua
+// function for each script, and the samples behind it as folded stacks for flame graphs
+void StartLuaProfiler();
+void StopLuaProfiler();
+void ReportLuaProfile();
+bool DumpLuaProfile(const std::string& path);
+
+// Logs trigger calls that run more than instructions Lua instructions (0 for no limit), and
+// with abort, stops them with an error (except in network games and in films being recorded or
+// replayed, where that would go out of sync)
+void SetLuaInstructionBudget(int32 instructions, bool abort);
+
+// Lua garbage collection pacing (the console's .lua gc commands; see lua_gc.h): the HUD
+// script's time per frame, and for script ("map", "netscript", "solo", "stats", "hud", or
+// empty for all) a setting: mode (incremental or generational), pause, stepmul or step (KB
+// of work per tick).  False if the setting or its value makes no sense, or if it would change
+// a script other than the HUD's in a network game or while recording or replaying a film.
+void SetLuaGCFrameBudget(float milliseconds);
+bool SetLuaGCSetting(const std::string& setting, const std::string& value, const std::string& script);
+void ReportLuaGC();
+
+// Times trigger dispatch, with and without the trigger cache, over events calls of each
+// kind; for --bench-lua-triggers
+int run_lua_trigger_benchmark(int events);
+// Times saving and restoring a persistent table of records records in each save format;
+// for --bench-lua-save
+int run_lua_save_benchmark(int records);
+
 /* Custom game scoring modes */
 enum {
   _game_of_most_points,
@@ -26,8 +26,93 @@ LUA_SERIALIZE.CPP
 
 #include "BStream.h"
 
+#include <algorithm>
+#include <vector>
+
 const static int SAVED_REFERENCE_PSEUDOTYPE = -2;
-const uint16 kVersion = 1;
+const static int SAVED_STRING_REFERENCE_PSEUDOTYPE = -3;
+const static int SAVED_INTEGER_PSEUDOTYPE = -4;
+
+// Version 2 (kLuaSaveVersion) writes each string once and a numbered reference to it after
+// that, writes numbers that are 32-bit integers in 4 bytes, and writes how big each table's
+// array and hash parts are so it can be restored without rehashing
+
+// don't trust a saved table size beyond this
+const static uint32 kMaximumSizeHint = 1 << 20;
+
+// Numbers things by their address, for telling what has been written already; open
+// addressing, as it is consulted for every table, userdata and string saved
+class address_numbers
+{
+public:
+	address_numbers() : slots_(1 << 10), bits_(10), count_(0) { }
+
+	// the number given to address before, or 0 after giving it number
+	uint32 find_or_add(const void* address, uint32 number)
+	{
+		size_t i = slot_for(address);
+		if (slots_[i].address)
+			return slots_[i].number;
+
+		slots_[i].address = address;
+		slots_[i].number = number;
+		if (++count_ * 2 > slots_.size())
+			grow();
+		return 0;
+	}
+
+private:
+	struct slot
+	{
+		slot() : address(0), number(0) { }
+		const void* address;
+		uint32 number;
+	};
+
+	size_t slot_for(const void* address) const
+	{
+		// Fibonacci hashing: the top bits of the product
+		size_t mask = slots_.size() - 1;
+		size_t i = static_cast<size_t>((static_cast<uint64_t>(reinterpret_cast<uintptr_t>(address)) * 0x9E3779B97F4A7C15ull) >> (64 - bits_));
+		while (slots_[i].address && slots_[i].address != address)
+			i = (i + 1) & mask;
+		return i;
+	}
+
+	void grow()
+	{
+		std::vector<slot> old_slots(slots_.size() * 2);
+		old_slots.swap(slots_);
+		++bits_;
+		for (size_t i = 0; i < old_slots.size(); ++i)
+		{
+			if (old_slots[i].address)
+				slots_[slot_for(old_slots[i].address)] = old_slots[i];
+		}
+	}
+
+	std::vector<slot> slots_;	// 2^bits_ of them
+	int bits_;
+	size_t count_;
+};
+
+struct save_context
+{
+	save_context(std::streambuf* sb, uint16 version) : s(sb), version(version), counter(0), string_counter(0) { }
+
+	BOStreamBE s;
+	uint16 version;
+
+	// tables and userdata written so far; everything we see is reachable from the object
+	// being saved, so nothing is collected (and its address reused) while we are at it
+	address_numbers references;
+	uint32 counter;
+
+	// likewise for strings, by their contents' address; equal long strings can live at
+	// different addresses, which only costs a duplicate
+	address_numbers strings;
+	uint32 string_counter;
+};
 
 static bool valid_key(int type)
 {
@@ -38,49 +123,101 @@ static bool valid_key(int type)
 		type == LUA_TUSERDATA);
 }
 
-static void save(lua_State *L, BOStreamBE& s, uint32& counter)
+static bool is_saved_integer(lua_Number n)
 {
-	// if the object has already been written, write a reference to it
+	// not -0, which would come back as 0
+	return n >= -2147483648.0 && n <= 2147483647.0 &&
+		static_cast<lua_Number>(static_cast<int32>(n)) == n &&
+		(n != 0 || 1 / n > 0);
+}
+
+static void save_string(lua_State *L, save_context& c)
+{
+	size_t length;
+	const char *string = lua_tolstring(L, -1, &length);
 
-	lua_pushvalue(L, -1);
-	lua_rawget(L, 1);
-	if (!lua_isnil(L, -1))
+	if (c.version >= 2)
 	{
-		s << static_cast<int8>(SAVED_REFERENCE_PSEUDOTYPE)
-		  << static_cast<uint32>(lua_tonumber(L, -1));
-		lua_pop(L, 1);
-		return;
+		uint32 number = c.strings.find_or_add(string, c.string_counter + 1);
+		if (number)
+		{
+			c.s << static_cast<int8>(SAVED_STRING_REFERENCE_PSEUDOTYPE)
+			    << number;
+			return;
+		}
+		++c.string_counter;
 	}
-	lua_pop(L, 1);
 
-	s << static_cast<int8>(lua_type(L, -1));
-	switch (lua_type(L, -1))
+	c.s << static_cast<int8>(LUA_TSTRING)
+	    << static_cast<uint32>(length);
+	c.s.write(string, length);
+}
+
+static void save(lua_State *L, save_context& c)
+{
+	int type = lua_type(L, -1);
+
+	// if the object has already been written, write a reference to it
+	if (type == LUA_TTABLE || type == LUA_TUSERDATA)
+	{
+		uint32 number = c.references.find_or_add(lua_topointer(L, -1), c.counter + 1);
+		if (number)
+		{
+			c.s << static_cast<int8>(SAVED_REFERENCE_PSEUDOTYPE)
+			    << number;
+			return;
+		}
+		++c.counter;
+	}
+
+	switch (type)
 	{
 		case LUA_TNIL:
+			c.s << static_cast<int8>(type);
 			break;
 		case LUA_TNUMBER:
 			{
-				s << static_cast<double>(lua_tonumber(L, -1));
+				lua_Number n = lua_tonumber(L, -1);
+				if (c.version >= 2 && is_saved_integer(n))
+				{
+					c.s << static_cast<int8>(SAVED_INTEGER_PSEUDOTYPE)
+					    << static_cast<int32>(n);
+				}
+				else
+				{
+					c.s << static_cast<int8>(type)
+					    << static_cast<double>(n);
+				}
 			}
 			break;
 		case LUA_TBOOLEAN:
-			s << static_cast<uint8>(lua_toboolean(L, -1) ? 1 : 0);
+			c.s << static_cast<int8>(type)
+			    << static_cast<uint8>(lua_toboolean(L, -1) ? 1 : 0);
 			break;
 		case LUA_TSTRING: 
-			{
-				s << static_cast<uint32>(lua_rawlen(L, -1));
-				s.write(lua_tostring(L, -1), lua_rawlen(L, -1));
-			}
+			save_string(L, c);
 			break;
 		case LUA_TTABLE:
 			{
-				// add to the reference table
-				lua_pushvalue(L, -1);
-				lua_pushnumber(L, static_cast<lua_Number>(++counter));
-				lua_rawset(L, 1);
+				if (!lua_checkstack(L, 4))
+					throw basic_bstream::failure("tables nested too deeply");
 
 				// write the reference
-				s << counter;
+				c.s << static_cast<int8>(type)
+				    << c.counter;
+				if (c.version >= 2)
+				{
+					uint32 array_length = static_cast<uint32>(lua_rawlen(L, -1));
+					uint32 length = 0;
+					lua_pushnil(L);
+					while (lua_next(L, -2))
+					{
+						lua_pop(L, 1);
+						++length;
+					}
+					c.s << array_length
+					    << (length - std::min(length, array_length));
+				}
 
 				// write all k/v pairs
 				lua_pushnil(L);
@@ -90,10 +227,10 @@ static void save(lua_State *L, BOStreamBE& s, uint32& counter)
 						// another key
 						lua_pushvalue(L, -2);
 						
-						save(L, s, counter);
+						save(L, c);
 						lua_pop(L, 1);
 						
-						save(L, s, counter);
+						save(L, c);
 						lua_pop(L, 1);
 					} else {
 						lua_pop(L, 1);
@@ -101,74 +238,84 @@ static void save(lua_State *L, BOStreamBE& s, uint32& counter)
 				}
 
 				lua_pushnil(L);
-				save(L, s, counter);
+				save(L, c);
 				lua_pop(L, 1);
 			}
 			break;
 		case LUA_TUSERDATA:
 			{
-				// add to the reference table
-				lua_pushvalue(L, -1);
-				lua_pushnumber(L, static_cast<lua_Number>(++counter));
-				lua_rawset(L, 1);
-
 				// write the reference
-				s << counter;
+				c.s << static_cast<int8>(type)
+				    << c.counter;
 
 				// assume that this is one of our userdata
 				lua_getmetatable(L, -1);
 				lua_gettable(L, LUA_REGISTRYINDEX);
 
-				s << static_cast<uint8>(lua_rawlen(L, -1));
-				s.write(lua_tostring(L, -1), lua_rawlen(L, -1));
+				if (c.version >= 2)
+				{
+					save_string(L, c);
+				}
+				else
+				{
+					c.s << static_cast<uint8>(lua_rawlen(L, -1));
+					c.s.write(lua_tostring(L, -1), lua_rawlen(L, -1));
+				}
 				lua_pop(L, 1);
 
 				lua_getfield(L, -1, "index");
 				
-				s << static_cast<uint32>(lua_tonumber(L, -1));
+				c.s << static_cast<uint32>(lua_tonumber(L, -1));
 				lua_pop(L, 1);
 			}
 			break;
 		
 		default:
 			// we silently ignore other types
+			c.s << static_cast<int8>(type);
 			break;
 	}
 }
 
-bool lua_save(lua_State *L, std::streambuf* sb)
+bool lua_save(lua_State *L, std::streambuf* sb, uint16 version)
 {
-	lua_assert(lua_gettop(L) == 1);
-
-	// create a references table
-	lua_newtable(L);
+	int top = lua_gettop(L);
 
-	// put it at the bottom of the stack
-	lua_insert(L, 1);
-	
-	uint32 counter = 0;
-	BOStreamBE s(sb);
+	save_context c(sb, version);
 	try 
 	{
-		s << kVersion;
-		save(L, s, counter);
+		c.s << version;
+		save(L, c);
 	}
 	catch (const basic_bstream::failure& e)
 	{
 		logWarning("failed to save Lua data; %s", e.what());
-		lua_settop(L, 0);
+		lua_settop(L, top);
 		return false;
 	}
 
-	// remove the reference table
-	lua_remove(L, 1);
 	return true;
 }
 
-static int restore(lua_State *L, BIStreamBE& s)
+struct restore_context
+{
+	restore_context(std::streambuf* sb) : s(sb), version(0), references(0), strings(0), string_counter(0) { }
+
+	BIStreamBE s;
+	int16 version;
+
+	// stack indices of the tables of references and (version 2) strings read so far
+	int references;
+	int strings;
+	int string_counter;
+
+	std::vector<char> buffer;
+};
+
+static int restore(lua_State *L, restore_context& c)
 {
 	int8 type;
-	s >> type;
+	c.s >> type;
 
 	switch (type) 
 	{
@@ -177,40 +324,69 @@ static int restore(lua_State *L, BIStreamBE& s)
 			break;
 		case LUA_TBOOLEAN:
 			uint8 b;
-			s >> b;			
+			c.s >> b;			
 			lua_pushboolean(L, b == 1);
 			break;
 		case LUA_TNUMBER:
 			{
 				double d;
-				s >> d;
+				c.s >> d;
 				lua_pushnumber(L, static_cast<lua_Number>(d));
 			}
 			break;
+		case SAVED_INTEGER_PSEUDOTYPE:
+			{
+				int32 i;
+				c.s >> i;
+				lua_pushnumber(L, static_cast<lua_Number>(i));
+			}
+			break;
 		case LUA_TSTRING:
 			{
 				uint32 length;
-				s >> length;
-				std::vector<char> v(length);
-				s.read(&v[0], v.size());
-				lua_pushlstring(L, &v[0], v.size());
+				c.s >> length;
+				c.buffer.resize(length);
+				if (length)
+					c.s.read(&c.buffer[0], length);
+				lua_pushlstring(L, length ? &c.buffer[0] : "", length);
+
+				if (c.version >= 2)
+				{
+					lua_pushvalue(L, -1);
+					lua_rawseti(L, c.strings, ++c.string_counter);
+				}
+			}
+			break;
+		case SAVED_STRING_REFERENCE_PSEUDOTYPE:
+			{
+				uint32 index;
+				c.s >> index;
+				lua_rawgeti(L, c.strings, index);
 			}
 			break;
 		case LUA_TTABLE:
 			{
+				if (!lua_checkstack(L, 4))
+					throw basic_bstream::failure("tables nested too deeply");
+
 				uint32 reference;
-				s >> reference;
+				c.s >> reference;
+
+				uint32 array_length = 0;
+				uint32 hash_length = 0;
+				if (c.version >= 2)
+					c.s >> array_length
+					    >> hash_length;
 
 				// add to the reference table
-				lua_newtable(L);
-				lua_pushnumber(L, static_cast<lua_Number>(reference));
-				lua_pushvalue(L, -2);
-				lua_rawset(L, 1);
+				lua_createtable(L, std::min(array_length, kMaximumSizeHint), std::min(hash_length, kMaximumSizeHint));
+				lua_pushvalue(L, -1);
+				lua_rawseti(L, c.references, reference);
 
-				int key_type = restore(L, s);
+				int key_type = restore(L, c);
 				while (key_type != LUA_TNIL)
 				{
-					restore(L, s); // value
+					restore(L, c); // value
 					if (lua_isnil(L, -2)) 
 					{
 						// maybe an invalid userdata?
@@ -220,7 +396,7 @@ static int restore(lua_State *L, BIStreamBE& s)
 					{
 						lua_rawset(L, -3);
 					}
-					key_type = restore(L, s); // next key
+					key_type = restore(L, c); // next key
 				}
 				lua_pop(L, 1);
 			}
@@ -228,43 +404,53 @@ static int restore(lua_State *L, BIStreamBE& s)
 		case LUA_TUSERDATA:
 			{
 				uint32 reference;
-				s >> reference;
+				c.s >> reference;
 				
-				uint8 length;
-				s >> length;
-				std::vector<char> v(length);
-				s.read(&v[0], v.size());
-				lua_pushlstring(L, &v[0], v.size());
+				if (c.version >= 2)
+				{
+					int name_type = restore(L, c);
+					if (name_type != LUA_TSTRING && name_type != SAVED_STRING_REFERENCE_PSEUDOTYPE)
+						throw basic_bstream::failure("bad userdata type");
+				}
+				else
+				{
+					uint8 length;
+					c.s >> length;
+					c.buffer.resize(length);
+					if (length)
+						c.s.read(&c.buffer[0], length);
+					lua_pushlstring(L, length ? &c.buffer[0] : "", length);
+				}
 
 				uint32 index;
-				s >> index;
+				c.s >> index;
 				
 				// get the metatable
 				lua_gettable(L, LUA_REGISTRYINDEX);
-				// get the accessor we added
-				lua_getfield(L, -1, "__new");
-				if (lua_isfunction(L, -1))
+				if (lua_istable(L, -1))
 				{
-					lua_pushnumber(L, static_cast<lua_Number>(index));
-					lua_call(L, 1, 1);
-				}
+					// get the accessor we added
+					lua_getfield(L, -1, "__new");
+					if (lua_isfunction(L, -1))
+					{
+						lua_pushnumber(L, static_cast<lua_Number>(index));
+						lua_call(L, 1, 1);
+					}
 
-				lua_remove(L, -2);
+					lua_remove(L, -2);
+				}
 				
 				// add to the reference table
-				lua_pushnumber(L, static_cast<lua_Number>(reference));
-				lua_pushvalue(L, -2);
-				lua_rawset(L, 1);
-				
+				lua_pushvalue(L, -1);
+				lua_rawseti(L, c.references, reference);
 			}
 			break;
 				
 		case SAVED_REFERENCE_PSEUDOTYPE:
 			{
 				uint32 index;
-				s >> index;
-				lua_pushnumber(L, static_cast<lua_Number>(index));
-				lua_rawget(L, 1);
+				c.s >> index;
+				lua_rawgeti(L, c.references, index);
 			}
 			break;
 		default:
@@ -277,29 +463,36 @@ static int restore(lua_State *L, BIStreamBE& s)
 
 bool lua_restore(lua_State *L, std::streambuf* sb)
 {
-	// create a reference table
+	int top = lua_gettop(L);
+
+	// create the reference and string tables
 	lua_newtable(L);
+	lua_newtable(L);
+
+	restore_context c(sb);
+	c.references = top + 1;
+	c.strings = top + 2;
 
-	BIStreamBE s(sb);
 	try {
-		int16 version;
-		s >> version;
-		if (version > kVersion)
+		c.s >> c.version;
+		if (c.version > kLuaSaveVersion)
 		{
 			logWarning("failed to restore Lua data; saved data is newer version");
+			lua_settop(L, top);
 			return false;
 		}
 
-		restore(L, s);
+		restore(L, c);
 	}
 	catch (const basic_bstream::failure& e)
 	{
 		logWarning("failed to restore Lua data; %s", e.what());
-		lua_settop(L, 0);
+		lua_settop(L, top);
 		return false;
 	}
 	
-	// remove the reference table
-	lua_remove(L, -2);
+	// remove the reference and string tables
+	lua_remove(L, c.strings);
+	lua_remove(L, c.references);
 	return true;
 }
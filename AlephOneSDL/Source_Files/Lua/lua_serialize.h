@@ -35,10 +35,13 @@ extern "C"
 #include "lualib.h"
 }
 
-// saves object on top of the stack to s
-bool lua_save(lua_State *L, std::streambuf* sb);
+// the format lua_save writes unless told otherwise; lua_restore reads this and older ones
+const uint16 kLuaSaveVersion = 2;
 
-// restores object in s to top of the stack
+// saves object on top of the stack to s, leaving it there
+bool lua_save(lua_State *L, std::streambuf* sb, uint16 version = kLuaSaveVersion);
+
+// restores object in s to top of the stack; on failure, leaves the stack as it was
 bool lua_restore(lua_State *L, std::streambuf* sb);
 
 #endif
@@ -38,6 +38,7 @@ extern "C"
 #include "lua_mnemonics.h" // for lang_def and mnemonics
 #include <sstream>
 #include <map>
+#include <vector>
 
 static inline int luaL_typerror(lua_State* L, int narg, const char* tname)
 {
@@ -119,8 +120,25 @@ protected:
 
 	// special tables
 	static void _push_custom_fields_table(lua_State *L);
+
+	// Pushing an instance is most of what scripts that walk Monsters() or Polygons() every
+	// tick spend their time on, so for indices from 0 to _max_cached_index we keep registry
+	// references to the instances in an array, one per Lua state (keyed by its main thread);
+	// any others live in the registry's instances table
+	enum { _max_cached_index = 1 << 16 };
+	struct instance_refs {
+		lua_State *m_state;
+		std::vector<int> m_refs;
+	};
+	static std::vector<instance_refs> _instance_refs;
+
+	static std::vector<int>& _refs(lua_State *L);
+	static int _forget_refs(lua_State *L);
 };
 
+template<char *name, typename index_t>
+std::vector<typename L_Class<name, index_t>::instance_refs> L_Class<name, index_t>::_instance_refs;
+
 struct always_valid
 {
 	bool operator()(int32 x) { return true; }
@@ -203,6 +221,30 @@ L_Class<name, index_t> *L_Class<name, index_t>::Push(lua_State *L, index_t index
 		return 0;
 	}
 
+	if (index >= 0 && index < _max_cached_index)
+	{
+		std::vector<int>& refs = _refs(L);
+		size_t i = static_cast<size_t>(index);
+		if (i < refs.size() && refs[i] != LUA_NOREF)
+		{
+			lua_rawgeti(L, LUA_REGISTRYINDEX, refs[i]);
+			return static_cast<L_Class<name, index_t> *>(lua_touserdata(L, -1));
+		}
+
+		// create an instance
+		t = static_cast<L_Class<name, index_t> *>(lua_newuserdata(L, sizeof(L_Class<name, index_t>)));
+		luaL_getmetatable(L, name);
+		lua_setmetatable(L, -2);
+		t->m_index = index;
+
+		if (i >= refs.size())
+			refs.resize(i + 1, LUA_NOREF);
+		lua_pushvalue(L, -1);
+		refs[i] = luaL_ref(L, LUA_REGISTRYINDEX);
+
+		return t;
+	}
+
 	// look it up in the index table
 	_push_instances_key(L);
 	lua_gettable(L, LUA_REGISTRYINDEX);
@@ -272,14 +314,28 @@ bool L_Class<name, index_t>::Is(lua_State *L, int index)
 template<char *name, typename index_t>
 void L_Class<name, index_t>::Invalidate(lua_State *L, index_t index)
 {
-	// remove it from the index table
-	_push_instances_key(L);
-	lua_gettable(L, LUA_REGISTRYINDEX);
+	if (index >= 0 && index < _max_cached_index)
+	{
+		// drop our reference
+		std::vector<int>& refs = _refs(L);
+		size_t i = static_cast<size_t>(index);
+		if (i < refs.size() && refs[i] != LUA_NOREF)
+		{
+			luaL_unref(L, LUA_REGISTRYINDEX, refs[i]);
+			refs[i] = LUA_NOREF;
+		}
+	}
+	else
+	{
+		// remove it from the index table
+		_push_instances_key(L);
+		lua_gettable(L, LUA_REGISTRYINDEX);
 
-	lua_pushnumber(L, index);
-	lua_pushnil(L);
-	lua_settable(L, -3);
-	lua_pop(L, 1);
+		lua_pushnumber(L, index);
+		lua_pushnil(L);
+		lua_settable(L, -3);
+		lua_pop(L, 1);
+	}
 
 	// clear custom fields
 	lua_pushlightuserdata(L, (void *) (L_Persistent_Table_Key()));
@@ -294,6 +350,55 @@ void L_Class<name, index_t>::Invalidate(lua_State *L, index_t index)
 	lua_pop(L, 2);
 }
 
+template<char *name, typename index_t>
+std::vector<int>& L_Class<name, index_t>::_refs(lua_State *L)
+{
+	// scripts mostly run in the main thread, so try L as it is first
+	for (size_t i = 0; i < _instance_refs.size(); ++i)
+	{
+		if (_instance_refs[i].m_state == L)
+			return _instance_refs[i].m_refs;
+	}
+
+	lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+	lua_State *main_thread = lua_tothread(L, -1);
+	lua_pop(L, 1);
+
+	for (size_t i = 0; i < _instance_refs.size(); ++i)
+	{
+		if (_instance_refs[i].m_state == main_thread)
+			return _instance_refs[i].m_refs;
+	}
+
+	// first time in this state: leave something in its registry to tell us when it closes
+	lua_State **sentinel = static_cast<lua_State **>(lua_newuserdata(L, sizeof(lua_State *)));
+	*sentinel = main_thread;
+	lua_newtable(L);
+	lua_pushcfunction(L, _forget_refs);
+	lua_setfield(L, -2, "__gc");
+	lua_setmetatable(L, -2);
+	luaL_ref(L, LUA_REGISTRYINDEX);
+
+	_instance_refs.push_back(instance_refs());
+	_instance_refs.back().m_state = main_thread;
+	return _instance_refs.back().m_refs;
+}
+
+template<char *name, typename index_t>
+int L_Class<name, index_t>::_forget_refs(lua_State *L)
+{
+	lua_State *state = *static_cast<lua_State **>(lua_touserdata(L, 1));
+	for (size_t i = 0; i < _instance_refs.size(); ++i)
+	{
+		if (_instance_refs[i].m_state == state)
+		{
+			_instance_refs.erase(_instance_refs.begin() + i);
+			break;
+		}
+	}
+	return 0;
+}
+
 template<char *name, typename index_t>
 int L_Class<name, index_t>::_index(lua_State *L)
 {
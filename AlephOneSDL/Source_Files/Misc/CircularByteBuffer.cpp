@@ -133,7 +133,7 @@ CircularByteBuffer::peekBytes(void* outBytes, unsigned int inByteCount)
 
 void
 CircularByteBuffer::peekBytesNoCopy(unsigned int inByteCount, const void** outFirstBytes, unsigned int* outFirstByteCount,
-				    const void** outSecondBytes, unsigned int* outSecondByteCount)
+				    const void** outSecondBytes, unsigned int* outSecondByteCount, unsigned int inOffset)
 {
 	void* theFirstBytes = NULL;
 	void* theSecondBytes = NULL;
@@ -142,11 +142,12 @@ CircularByteBuffer::peekBytesNoCopy(unsigned int inByteCount, const void** outFi
 	
 	if(inByteCount > 0)
 	{
-		assert(inByteCount <= getCountOfElements());
+		assert(inOffset + inByteCount <= getCountOfElements());
 
-		std::pair<unsigned int, unsigned int> theChunkSizes = splitIntoChunks(inByteCount, mReadIndex, mQueueSize);
+		unsigned int theStartIndex = getReadIndex(inOffset);
+		std::pair<unsigned int, unsigned int> theChunkSizes = splitIntoChunks(inByteCount, theStartIndex, mQueueSize);
 
-		theFirstBytes = &(mData[getReadIndex()]);
+		theFirstBytes = &(mData[theStartIndex]);
 		theFirstByteCount = theChunkSizes.first;
 		theSecondByteCount = theChunkSizes.second;
 		theSecondBytes = (theSecondByteCount > 0) ? mData : NULL;
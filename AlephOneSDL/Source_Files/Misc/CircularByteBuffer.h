@@ -24,6 +24,8 @@
 
  July 19, 2003 (Woody Zenfell):
 	Additional "NoCopy" interface may let clients avoid a copy, though it's not as safe.
+
+ 2026: peekBytesNoCopy() can start partway into the queued bytes.
  
  */
 
@@ -57,8 +59,9 @@ public:
 	// Clearly, you may choose to read fewer than inByteCount bytes, as the read index is not actually advanced
 	// until you call dequeue().
 	// Any of the out-pointers may be passed as NULL if you don't care about the returned value.
+	// inOffset skips that many bytes at the front first (caller checks inOffset + inByteCount, then).
 	void peekBytesNoCopy(unsigned int inByteCount, const void** outFirstBytes, unsigned int* outFirstByteCount,
-				const void** outSecondBytes, unsigned int* outSecondByteCount);
+				const void** outSecondBytes, unsigned int* outSecondByteCount, unsigned int inOffset = 0);
 
 	// The following two should be paired...
 	// Call enqueueBytesNoCopyStart(), write your bytes into the pointer, then call enqueueBytesNoCopyFinish().
@@ -87,7 +87,8 @@ public:
 
         unsigned int	getTotalSpace() const { return (mQueueSize > 0) ? mQueueSize - 1 : 0; }
     
-        const T&        peek() const { return mData[getReadIndex()]; }
+        // inOffset elements past the oldest
+        const T&        peek(unsigned int inOffset = 0) const { return mData[getReadIndex(inOffset)]; }
 
         void            dequeue(unsigned int inAmount = 1) { advanceReadIndex(inAmount); }
 
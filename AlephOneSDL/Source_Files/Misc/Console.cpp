@@ -25,6 +25,7 @@
 #include "Logging.h"
 #include "InfoTree.h"
 
+#include <sstream>
 #include <string>
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
@@ -39,6 +40,10 @@
 // for saving
 #include "FileHandler.h"
 #include "game_wad.h"
+#include "lua_script.h"
+
+// for replays
+#include "interface.h"
 
 #include <boost/algorithm/string/predicate.hpp>
 
@@ -53,6 +58,8 @@ Console::Console() : m_active(false), m_carnage_messages_exist(false), m_use_lua
 	m_command_iter = m_prev_commands.end();
 	m_carnage_messages.resize(NUMBER_OF_PROJECTILE_TYPES);
 	register_save_commands();
+	register_lua_commands();
+	register_replay_commands();
 }
 
 Console *Console::instance() {
@@ -462,6 +469,155 @@ void Console::register_save_commands()
 	register_command("save", saveParser);
 }
 	
+struct lua_profile_start
+{
+	void operator() (const std::string&) const {
+		StartLuaProfiler();
+		screen_printf("Lua profiler started");
+	}
+};
+
+struct lua_profile_stop
+{
+	void operator() (const std::string&) const {
+		StopLuaProfiler();
+		screen_printf("Lua profiler stopped");
+	}
+};
+
+struct lua_profile_report
+{
+	void operator() (const std::string&) const {
+		ReportLuaProfile();
+	}
+};
+
+struct lua_profile_dump
+{
+	void operator() (const std::string& arg) const {
+		FileSpecifier fs;
+		fs.SetToLocalDataDir();
+		fs += (arg == "") ? std::string("lua_profile.folded") : arg;
+		if (DumpLuaProfile(fs.GetPath()))
+			screen_printf("Saved %s", utf8_to_mac_roman(fs.GetPath()).c_str());
+		else
+			screen_printf("An error occurred while saving the Lua profile");
+	}
+};
+
+// budget <instructions> [abort]
+struct lua_budget
+{
+	void operator() (const std::string& arg) const {
+		std::istringstream words(arg);
+		std::string count, mode, extra;
+		words >> count >> mode >> extra;
+
+		char *end;
+		long number = strtol(count.c_str(), &end, 10);
+		if (count.empty() || *end || number < 0 || number > INT32_MAX || !(mode.empty() || mode == "abort") || !extra.empty())
+		{
+			screen_printf("Usage: .lua budget <instructions> [abort]");
+			return;
+		}
+
+		int32 instructions = static_cast<int32>(number);
+		bool abort = (mode == "abort");
+		SetLuaInstructionBudget(instructions, abort);
+		if (instructions > 0)
+			screen_printf("Lua triggers over %d instructions will be %s", instructions, abort ? "stopped" : "logged");
+		else
+			screen_printf("Lua instruction budget off");
+	}
+};
+
+struct lua_gc_budget
+{
+	void operator() (const std::string& arg) const {
+		SetLuaGCFrameBudget(static_cast<float>(atof(arg.c_str())));
+		ReportLuaGC();
+	}
+};
+
+struct lua_gc_stats
+{
+	void operator() (const std::string&) const {
+		ReportLuaGC();
+	}
+};
+
+// <setting> <value> [script]
+struct lua_gc_setting
+{
+	lua_gc_setting(const std::string& setting) : m_setting(setting) {}
+
+	void operator() (const std::string& arg) const {
+		std::string value = arg;
+		std::string script;
+		std::string::size_type pos = arg.find(' ');
+		if (pos != std::string::npos)
+		{
+			value = arg.substr(0, pos);
+			script = arg.substr(pos + 1);
+		}
+
+		if (SetLuaGCSetting(m_setting, value, script))
+			ReportLuaGC();
+		else
+			screen_printf("Can't set Lua collection %s to \"%s\" for \"%s\"", m_setting.c_str(), value.c_str(), script.c_str());
+	}
+
+	std::string m_setting;
+};
+
+void Console::register_lua_commands()
+{
+	CommandParser profileParser;
+	profileParser.register_command("start", lua_profile_start());
+	profileParser.register_command("stop", lua_profile_stop());
+	profileParser.register_command("report", lua_profile_report());
+	profileParser.register_command("dump", lua_profile_dump());
+
+	CommandParser gcParser;
+	gcParser.register_command("budget", lua_gc_budget());
+	gcParser.register_command("stats", lua_gc_stats());
+	gcParser.register_command("mode", lua_gc_setting("mode"));
+	gcParser.register_command("pause", lua_gc_setting("pause"));
+	gcParser.register_command("stepmul", lua_gc_setting("stepmul"));
+	gcParser.register_command("step", lua_gc_setting("step"));
+
+	CommandParser luaParser;
+	luaParser.register_command("profile", profileParser);
+	luaParser.register_command("budget", lua_budget());
+	luaParser.register_command("gc", gcParser);
+	register_command("lua", luaParser);
+}
+
+// seek <tick>
+struct replay_seek
+{
+	void operator() (const std::string& arg) const {
+		if (arg == "")
+		{
+			screen_printf("Usage: .replay seek <tick>");
+			return;
+		}
+
+		int32 tick = atoi(arg.c_str());
+		if (seek_replay(tick))
+			screen_printf("Seeking to tick %d", tick);
+		else
+			screen_printf("Can't seek to tick %d: no keyframe at or before it in this film", tick);
+	}
+};
+
+void Console::register_replay_commands()
+{
+	CommandParser replayParser;
+	replayParser.register_command("seek", replay_seek());
+	register_command("replay", replayParser);
+}
+
 void Console::clear_saves()
 {
 	last_level.clear();
@@ -112,6 +112,8 @@ private:
 	bool m_use_lua_console;
 
 	void register_save_commands();
+	void register_lua_commands();
+	void register_replay_commands();
 };
 
 class InfoTree;
@@ -0,0 +1,289 @@
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+ 
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Replays a directory of films without rendering and writes one line
+	of JSON stats per film to standard output
+*/
+
+#include "cseries.h"
+#include "FilmAnalyzer.h"
+
+#include "FileHandler.h"
+#include "interface.h"
+#include "map.h"
+#include "player.h"
+#include "vbl.h"
+#include "world_hash.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <sstream>
+#include <stdio.h>
+#include <vector>
+
+#if !defined(__WIN32__) && !TARGET_OS_IPHONE
+#define FILM_ANALYZER_FORKS
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+// From shell.cpp
+extern void initialize_application(void);
+
+static std::string json_string(const std::string& s)
+{
+	std::ostringstream out;
+	out << '"';
+	for (std::string::const_iterator it = s.begin(); it != s.end(); ++it)
+	{
+		unsigned char c = *it;
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if (c < 0x20)
+		{
+			char escape[8];
+			sprintf(escape, "\\u%04x", c);
+			out << escape;
+		}
+		else
+			out << c;
+	}
+	out << '"';
+	return out.str();
+}
+
+static void write_player_stats(std::ostringstream& out, short player_index)
+{
+	player_data *player = get_player_data(player_index);
+
+	int32 kills = 0, suicides = 0, deaths = player->monster_damage_taken.kills;
+	int32 damage_taken = player->monster_damage_taken.damage;
+	for (short i = 0; i < dynamic_world->player_count; i++)
+	{
+		deaths += player->damage_taken[i].kills;
+		damage_taken += player->damage_taken[i].damage;
+		if (i == player_index)
+			suicides += player->damage_taken[i].kills;
+		else
+			kills += get_player_data(i)->damage_taken[player_index].kills;
+	}
+
+	// player names are Mac Roman
+	out << "{\"name\":" << json_string(mac_roman_to_utf8(player->name))
+	    << ",\"kills\":" << kills
+	    << ",\"suicides\":" << suicides
+	    << ",\"deaths\":" << deaths
+	    << ",\"monster_kills\":" << player->monster_damage_given.kills
+	    << ",\"damage_given\":" << player->total_damage_given.damage + player->monster_damage_given.damage
+	    << ",\"damage_taken\":" << damage_taken
+	    << "}";
+}
+
+// no rendering: feed the film as fast as it reads and step the world until it
+// ends; returns how many times the level changed, and leaves level at the last one
+static int replay_to_end(short& level)
+{
+	int level_changes = 0;
+
+	level = dynamic_world->current_level_number;
+	fast_forward_replay();
+	while (get_game_state() == _game_in_progress)
+	{
+		input_controller();
+		update_world();
+
+		if (dynamic_world->current_level_number != level)
+		{
+			level = dynamic_world->current_level_number;
+			level_changes++;
+		}
+	}
+	return level_changes;
+}
+
+static bool same_world_hash(const world_hash_snapshot& a, const world_hash_snapshot& b)
+{
+	return a.tick == b.tick && a.level == b.level &&
+		std::equal(a.hashes, a.hashes + NUMBER_OF_WORLD_HASH_SUBSYSTEMS, b.hashes);
+}
+
+// replays the film again from the keyframe at or before tick, and says whether
+// it ended where the straight replay did
+static void analyze_seek(std::ostringstream& out, FileSpecifier& film, int32 tick,
+			 int32 end_tick, bool have_end_hash, const world_hash_snapshot& end_hash)
+{
+	out << ",\"seek\":{\"tick\":" << tick;
+
+	if (!begin_headless_replay(film))
+	{
+		out << ",\"error\":\"could not replay film\"}";
+		return;
+	}
+
+	uint32 start_time = machine_tick_count();
+	if (!seek_replay(tick))
+	{
+		logError("could not seek film %s to tick %d", film.GetPath(), tick);
+		out << ",\"error\":\"no keyframe to seek from\"}";
+		end_headless_replay();
+		return;
+	}
+	uint32 seek_time = machine_tick_count() - start_time;
+	int32 resumed_tick = dynamic_world->tick_count;
+
+	short level;
+	replay_to_end(level);
+
+	world_hash_snapshot hash;
+	bool matches = dynamic_world->tick_count == end_tick &&
+		(!have_end_hash || (get_latest_world_hash(hash) && same_world_hash(hash, end_hash)));
+	if (!matches)
+		logError("film %s ended differently after seeking to tick %d", film.GetPath(), tick);
+
+	out << ",\"resumed_tick\":" << resumed_tick
+	    << ",\"seek_ms\":" << seek_time * 1000 / MACHINE_TICKS_PER_SECOND
+	    << ",\"ticks\":" << dynamic_world->tick_count
+	    << ",\"matches\":" << (matches ? "true" : "false")
+	    << "}";
+
+	end_headless_replay();
+}
+
+static void analyze_film(FileSpecifier& film, int32 seek_tick)
+{
+	std::ostringstream out;
+	out << "{\"film\":" << json_string(film.GetPath());
+
+	uint32 start_time = machine_tick_count();
+	if (!begin_headless_replay(film))
+	{
+		logError("could not replay film %s", film.GetPath());
+		out << ",\"error\":\"could not replay film\"}";
+		printf("%s\n", out.str().c_str());
+		fflush(stdout);
+		return;
+	}
+
+	short first_level = dynamic_world->current_level_number;
+	short level;
+	int levels_completed = replay_to_end(level);
+
+	bool finished_scenario = get_game_state() == _begin_display_of_epilogue;
+	uint32 elapsed = std::max(machine_tick_count() - start_time, static_cast<uint32>(1));
+	int32 ticks = dynamic_world->tick_count;
+
+	out << ",\"players\":[";
+	for (short player_index = 0; player_index < dynamic_world->player_count; player_index++)
+	{
+		if (player_index) out << ",";
+		write_player_stats(out, player_index);
+	}
+	out << "]"
+	    << ",\"first_level\":" << first_level
+	    << ",\"last_level\":" << level
+	    << ",\"levels_completed\":" << levels_completed
+	    << ",\"finished_scenario\":" << (finished_scenario ? "true" : "false")
+	    << ",\"ticks\":" << ticks
+	    << ",\"game_seconds\":" << ticks / TICKS_PER_SECOND
+	    << ",\"ticks_per_second\":" << static_cast<uint32>(static_cast<double>(ticks) * MACHINE_TICKS_PER_SECOND / elapsed);
+
+	world_hash_snapshot end_hash;
+	bool have_end_hash = get_latest_world_hash(end_hash);
+	end_headless_replay();
+
+	if (seek_tick != NONE)
+		analyze_seek(out, film, seek_tick, ticks, have_end_hash, end_hash);
+	out << "}";
+
+	printf("%s\n", out.str().c_str());
+	fflush(stdout);
+}
+
+// each worker starts the engine once and takes every jobs'th film
+static void analyze_film_share(std::vector<FileSpecifier>& films, size_t first, size_t stride, int32 seek_tick)
+{
+	initialize_application();
+
+	for (size_t i = first; i < films.size(); i += stride)
+	{
+		analyze_film(films[i], seek_tick);
+	}
+}
+
+int analyze_films(const std::string& directory, int jobs, int32 seek_tick)
+{
+	DirectorySpecifier dir(directory);
+	std::vector<dir_entry> entries;
+	if (!dir.ReadDirectory(entries))
+	{
+		fprintf(stderr, "Could not read film directory '%s'.\n", directory.c_str());
+		return 1;
+	}
+	std::sort(entries.begin(), entries.end());
+
+	std::vector<FileSpecifier> films;
+	for (std::vector<dir_entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+	{
+		if (it->is_directory) continue;
+
+		FileSpecifier file = dir + it->name;
+		if (file.GetType() == _typecode_film)
+			films.push_back(file);
+	}
+
+	if (films.empty()) return 0;
+
+	jobs = std::max(1, std::min(jobs, static_cast<int>(films.size())));
+
+#ifdef FILM_ANALYZER_FORKS
+	if (jobs > 1)
+	{
+		// the engine is full of globals, so workers are processes, not threads
+		std::vector<pid_t> workers;
+		fflush(stdout);
+		for (int job = 0; job < jobs; job++)
+		{
+			pid_t pid = fork();
+			if (pid == 0)
+			{
+				analyze_film_share(films, job, jobs, seek_tick);
+				exit(0);
+			}
+			else if (pid > 0)
+			{
+				workers.push_back(pid);
+			}
+			else
+			{
+				fprintf(stderr, "Could not start film analysis worker %d.\n", job);
+			}
+		}
+
+		int result = workers.size() == static_cast<size_t>(jobs) ? 0 : 1;
+		for (std::vector<pid_t>::iterator it = workers.begin(); it != workers.end(); ++it)
+		{
+			int status;
+			if (waitpid(*it, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+				result = 1;
+		}
+		return result;
+	}
+#endif
+
+	analyze_film_share(films, 0, 1, seek_tick);
+	return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef FILM_ANALYZER_H
+#define FILM_ANALYZER_H
+
+/*
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+ 
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+	Replays a directory of films without rendering and writes one line
+	of JSON stats per film to standard output
+*/
+
+#include "cseries.h"
+
+#include <string>
+
+// runs every film in directory, split across jobs worker processes where
+// the platform allows it; returns a process exit status.  With a seek tick,
+// each film is replayed a second time from the keyframe for that tick, and
+// its stats say whether that run ended in the same world.
+int analyze_films(const std::string& directory, int jobs, int32 seek_tick = NONE);
+
+#endif
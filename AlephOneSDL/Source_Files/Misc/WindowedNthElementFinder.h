@@ -21,32 +21,49 @@
  *  Created by Woody Zenfell, III on Thu May 08 2003.
  *
  *  Finds the nth (0 is first) largest or nth smallest element from a window of recently inserted elements.
+ *
+ *  The window's elements are kept in a treap (a binary search tree balanced by random priorities)
+ *  whose nodes know the size of their subtrees, so inserting, evicting and finding the nth element
+ *  are all O(log n) rather than a walk through the window.  Equal elements are ordered by when
+ *  they were inserted, so eviction removes exactly the oldest node (removing just any equal one
+ *  would skew the priorities, and the balance, of a window full of repeats).  Nodes live in one
+ *  vector, reused as elements come and go, so a full window doesn't allocate.
  */
 
 #ifndef WINDOWEDNTHELEMENTFINDER_H
 #define WINDOWEDNTHELEMENTFINDER_H
 
 #include "CircularQueue.h"
-#include <set>
+#include <algorithm>
+#include <vector>
 
 template <typename tElementType>
 class WindowedNthElementFinder {
 public:
-        WindowedNthElementFinder() : mQueue(0) {}
+        WindowedNthElementFinder() : mQueue(0) { reset(0); }
         
-        explicit WindowedNthElementFinder(unsigned int inWindowSize) : mQueue(inWindowSize) {}
+        explicit WindowedNthElementFinder(unsigned int inWindowSize) : mQueue(inWindowSize) { reset(inWindowSize); }
 
 	void	reset() { reset(window_size()); }
-        void	reset(unsigned int inWindowSize) { mQueue.reset(inWindowSize);  mSortedElements.clear(); }
+        void	reset(unsigned int inWindowSize)
+        {
+                mQueue.reset(inWindowSize);
+                mNodes.clear();
+                mNodes.reserve(inWindowSize);
+                mFreeNodes.clear();
+                mRoot = kNoNode;
+                mNextSequence = 0;
+                mPrioritySeed = 0x2545f491;
+        }
 
         void	insert(const tElementType& inNewElement)
         {
                 if(window_full())
                 {
-                        mSortedElements.erase(mSortedElements.find(mQueue.peek()));
+                        mRoot = erase(mRoot, mQueue.peek(), mNextSequence - size());
                         mQueue.dequeue();
                 }
-                mSortedElements.insert(inNewElement);
+                mRoot = insert(mRoot, new_node(inNewElement, mNextSequence++));
                 mQueue.enqueue(inNewElement);
         }
 
@@ -54,20 +71,35 @@ public:
         const tElementType&	nth_smallest_element(unsigned int n)
         {
                 assert(n < size());
-                typename std::multiset<tElementType>::const_iterator i = mSortedElements.begin();
-                for(unsigned int j = 0; j < n; ++j)
-                        ++i;
-                return *i;
+                int theNode = mRoot;
+                while(true)
+                {
+                        unsigned int theLeftSize = subtree_size(mNodes[theNode].mLeft);
+                        if(n == theLeftSize)
+                                return mNodes[theNode].mElement;
+
+                        if(n < theLeftSize)
+                                theNode = mNodes[theNode].mLeft;
+                        else
+                        {
+                                n -= theLeftSize + 1;
+                                theNode = mNodes[theNode].mRight;
+                        }
+                }
         }
 
         // 0-based indexing (not 1-based as name might imply)
         const tElementType&	nth_largest_element(unsigned int n)
         {
                 assert(n < size());
-		typename std::multiset<tElementType>::const_reverse_iterator i = mSortedElements.rbegin();
-                for(unsigned int j = 0; j < n; ++j)
-                        ++i;
-                return *i;
+                return nth_smallest_element(size() - 1 - n);
+        }
+
+        // The element inPercent of the way from the smallest (0) to the largest (100)
+        const tElementType&	percentile(unsigned int inPercent)
+        {
+                assert(size() > 0);
+                return nth_smallest_element((size() - 1) * std::min(inPercent, 100U) / 100);
         }
         
         bool	window_full()		{ return size() == window_size(); }
@@ -76,8 +108,148 @@ public:
         unsigned int window_size()	{ return mQueue.getTotalSpace(); }
 
 private:
+        enum { kNoNode = -1 };
+
+        struct Node
+        {
+                tElementType	mElement;
+                uint32		mSequence;	// when it was inserted
+                uint32		mPriority;
+                int		mLeft;
+                int		mRight;
+                unsigned int	mSize;		// of the subtree rooted here
+        };
+
+        unsigned int subtree_size(int inNode) const { return inNode == kNoNode ? 0 : mNodes[inNode].mSize; }
+
+        // Sequence numbers in the window are less than 2^31 apart, so they can wrap
+        bool	less(const tElementType& inElement, uint32 inSequence, int inNode) const
+        {
+                const Node& theNode = mNodes[inNode];
+                if(inElement < theNode.mElement || theNode.mElement < inElement)
+                        return inElement < theNode.mElement;
+                return static_cast<int32>(inSequence - theNode.mSequence) < 0;
+        }
+
+        void	update_size(int inNode)
+        {
+                mNodes[inNode].mSize = 1 + subtree_size(mNodes[inNode].mLeft) + subtree_size(mNodes[inNode].mRight);
+        }
+
+        int	new_node(const tElementType& inElement, uint32 inSequence)
+        {
+                // xorshift; the tree only needs the priorities to look random
+                mPrioritySeed ^= mPrioritySeed << 13;
+                mPrioritySeed ^= mPrioritySeed >> 17;
+                mPrioritySeed ^= mPrioritySeed << 5;
+
+                Node theNode = { inElement, inSequence, mPrioritySeed, kNoNode, kNoNode, 1 };
+                if(mFreeNodes.empty())
+                {
+                        mNodes.push_back(theNode);
+                        return static_cast<int>(mNodes.size()) - 1;
+                }
+
+                int theIndex = mFreeNodes.back();
+                mFreeNodes.pop_back();
+                mNodes[theIndex] = theNode;
+                return theIndex;
+        }
+
+        // Nodes before (inElement, inSequence) go to outLess, the rest to outRest
+        void	split(int inNode, const tElementType& inElement, uint32 inSequence, int& outLess, int& outRest)
+        {
+                if(inNode == kNoNode)
+                {
+                        outLess = outRest = kNoNode;
+                        return;
+                }
+
+                if(less(inElement, inSequence, inNode))
+                {
+                        split(mNodes[inNode].mLeft, inElement, inSequence, outLess, mNodes[inNode].mLeft);
+                        outRest = inNode;
+                }
+                else
+                {
+                        split(mNodes[inNode].mRight, inElement, inSequence, mNodes[inNode].mRight, outRest);
+                        outLess = inNode;
+                }
+                update_size(inNode);
+        }
+
+        // Every node of inLess must come before every node of inRest
+        int	merge(int inLess, int inRest)
+        {
+                if(inLess == kNoNode)
+                        return inRest;
+                if(inRest == kNoNode)
+                        return inLess;
+
+                if(mNodes[inLess].mPriority > mNodes[inRest].mPriority)
+                {
+                        mNodes[inLess].mRight = merge(mNodes[inLess].mRight, inRest);
+                        update_size(inLess);
+                        return inLess;
+                }
+                else
+                {
+                        mNodes[inRest].mLeft = merge(inLess, mNodes[inRest].mLeft);
+                        update_size(inRest);
+                        return inRest;
+                }
+        }
+
+        // Returns the new root of the subtree
+        int	insert(int inRoot, int inNode)
+        {
+                if(inRoot == kNoNode)
+                        return inNode;
+
+                if(mNodes[inNode].mPriority > mNodes[inRoot].mPriority)
+                {
+                        split(inRoot, mNodes[inNode].mElement, mNodes[inNode].mSequence, mNodes[inNode].mLeft, mNodes[inNode].mRight);
+                        update_size(inNode);
+                        return inNode;
+                }
+
+                if(less(mNodes[inNode].mElement, mNodes[inNode].mSequence, inRoot))
+                        mNodes[inRoot].mLeft = insert(mNodes[inRoot].mLeft, inNode);
+                else
+                        mNodes[inRoot].mRight = insert(mNodes[inRoot].mRight, inNode);
+                update_size(inRoot);
+                return inRoot;
+        }
+
+        // Removes the node for (inElement, inSequence), which must be there; returns the new root of the subtree
+        int	erase(int inRoot, const tElementType& inElement, uint32 inSequence)
+        {
+                assert(inRoot != kNoNode);
+
+                if(inSequence != mNodes[inRoot].mSequence)
+                {
+                        if(less(inElement, inSequence, inRoot))
+                                mNodes[inRoot].mLeft = erase(mNodes[inRoot].mLeft, inElement, inSequence);
+                        else
+                                mNodes[inRoot].mRight = erase(mNodes[inRoot].mRight, inElement, inSequence);
+                }
+                else
+                {
+                        int theReplacement = merge(mNodes[inRoot].mLeft, mNodes[inRoot].mRight);
+                        mFreeNodes.push_back(inRoot);
+                        return theReplacement;
+                }
+
+                update_size(inRoot);
+                return inRoot;
+        }
+
         CircularQueue<tElementType>	mQueue;
-        std::multiset<tElementType>	mSortedElements;
+        std::vector<Node>		mNodes;
+        std::vector<int>		mFreeNodes;
+        int				mRoot;
+        uint32				mNextSequence;
+        uint32				mPrioritySeed;
 };
 
 #endif // WINDOWEDNTHELEMENTFINDER_H
@@ -164,21 +164,9 @@ extern TP2PerfGlobals perf_globals;
 #include <bgfx/bgfx.h>
 
 
-/* Change this when marathon changes & replays are no longer valid */
-enum recording_version {
-	RECORDING_VERSION_UNKNOWN = 0,
-	RECORDING_VERSION_MARATHON = 1,
-	RECORDING_VERSION_MARATHON_2 = 2,
-	RECORDING_VERSION_MARATHON_INFINITY = 3,
-	RECORDING_VERSION_ALEPH_ONE_EARLY = 4,
-	RECORDING_VERSION_ALEPH_ONE_PRE_NET = 5,
-	RECORDING_VERSION_ALEPH_ONE_PRE_PIN = 6,
-	RECORDING_VERSION_ALEPH_ONE_1_0 = 7,
-	RECORDING_VERSION_ALEPH_ONE_1_1 = 8,
-	RECORDING_VERSION_ALEPH_ONE_1_2 = 9
-};
-const short default_recording_version = RECORDING_VERSION_ALEPH_ONE_1_2;
-const short max_handled_recording= RECORDING_VERSION_ALEPH_ONE_1_2;
+/* The recording versions are in vbl.h */
+const short default_recording_version = RECORDING_VERSION_ALEPH_ONE_1_3;
+const short max_handled_recording= RECORDING_VERSION_ALEPH_ONE_1_3;
 
 #include "screen_definitions.h"
 #include "interface_menus.h"
@@ -196,6 +184,7 @@ const short max_handled_recording= RECORDING_VERSION_ALEPH_ONE_1_2;
 // Network microphone/speaker
 #include "network_sound.h"
 #include "network_distribution_types.h"
+#include "network_star_lossy.h"
 
 // ZZZ: should the function that uses these (join_networked_resume_game()) go elsewhere?
 #include "wad.h"
@@ -732,6 +721,7 @@ static bool make_restored_game_relevant(bool inNetgame, const player_start_data*
                 } else {
                         game_state.current_netgame_allows_microphone= false;
                 }
+                InstallLuaHUDStreams();
 
                 // ZZZ: until players specify their behavior modifiers over the network,
                 // to avoid out-of-sync we must force them all the same.
@@ -1017,6 +1007,37 @@ bool handle_open_replay(FileSpecifier& File)
 	return success;
 }
 
+/* The film analyzer runs replays without the screens, fades and dialogs around them */
+bool begin_headless_replay(FileSpecifier& File)
+{
+	DraggedReplayFile = File;
+
+	return begin_game(_replay_from_file, false);
+}
+
+void end_headless_replay(void)
+{
+	set_keyboard_controller_status(false);
+	toggle_menus(false);
+	L_Call_HUDCleanup();
+	exit_screen();
+	stop_replay();
+
+	leaving_map();
+	CloseLuaHUDScript();
+	Music::instance()->StopLevelMusic();
+
+	free_and_unlock_memory();
+	unload_all_collections();
+	SoundManager::instance()->UnloadAllSounds();
+
+	load_environment_from_preferences();
+	Plugins::instance()->set_mode(Plugins::kMode_Menu);
+	load_film_profile(FILM_PROFILE_DEFAULT);
+
+	game_state.state= _close_game;
+}
+
 // Called from within update_world..
 bool check_level_change(
 	void)
@@ -1208,7 +1229,10 @@ bool idle_game_state(uint32 time)
 			// ticks elapsed rather than the number of (potentially predictive) ticks elapsed.
 			// This is a guess.
 			if (theUpdateResult.first)
+			{
 				render_screen(ticks_elapsed);
+				L_Collect_HUD_Garbage();
+			}
 		}
 		
 		return theUpdateResult.first;
@@ -2009,6 +2033,7 @@ static bool begin_game(
 				} else {
 					game_state.current_netgame_allows_microphone= false;
 				}
+				InstallLuaHUDStreams();
 				game_information.cheat_flags = network_game_info->cheat_flags;
 				std::fill_n(game_information.parameters, 2, 0);
 
@@ -2105,6 +2130,7 @@ static bool begin_game(
 						load_film_profile(FILM_PROFILE_ALEPH_ONE_1_1);
 						break;
 					case RECORDING_VERSION_ALEPH_ONE_1_2:
+					case RECORDING_VERSION_ALEPH_ONE_1_3:
 						load_film_profile(FILM_PROFILE_DEFAULT);
 						break;
 					default:
@@ -2367,6 +2393,7 @@ static void finish_game(
 		{
 			remove_network_microphone();
 		}
+		RemoveLuaHUDStreams();
 		NetUnSync(); // gracefully exit from the game
 
 		/* Don't update the screen, etc.. */
@@ -2417,6 +2444,7 @@ static void clean_up_after_failed_game(bool inNetgame, bool inRecording, bool in
                         {
                                 remove_network_microphone();
                         }
+                        RemoveLuaHUDStreams();
                         exit_networking();
 #endif // !defined(DISABLE_NETWORKING)
                 } else {
@@ -2820,6 +2848,10 @@ static void try_and_display_chapter_screen(
 void install_network_microphone(
 	void)
 {
+	// Voice goes ahead of other lossy streams (such as Lua's) when a packet is short of room
+	LossyByteStreamSettings theSettings = { 1, 0, 0 };
+	set_lossy_byte_stream_settings(kNewNetworkAudioDistributionTypeID, theSettings);
+
 	open_network_speaker();
 	NetAddDistributionFunction(kNewNetworkAudioDistributionTypeID, received_network_audio_proc, true);
 	open_network_microphone();
@@ -244,6 +244,8 @@ enum { /* states. */
 bool game_window_is_full_screen(void);
 void set_change_level_destination(short level_number);
 bool networking_available(void);
+bool begin_headless_replay(FileSpecifier& File);
+void end_headless_replay(void);
 void free_and_unlock_memory(void);
 
 /* ---------- prototypes/INTERFACE.C */
@@ -379,6 +381,8 @@ void check_recording_replaying(void);
 bool has_recording_file(void);
 void increment_replay_speed(void);
 void decrement_replay_speed(void);
+bool seek_replay(int32 tick);
+void fast_forward_replay(void);
 void reset_recording_and_playback_queues(void);
 uint32 parse_keymap(void);
 
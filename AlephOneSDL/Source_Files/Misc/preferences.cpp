@@ -2980,6 +2980,7 @@ InfoTree network_preferences_tree()
 	root.put_attr("join_address", network_preferences->join_address);
 	root.put_attr("local_game_port", network_preferences->game_port);
 	root.put_attr("game_protocol", sNetworkGameProtocolNames[network_preferences->game_protocol]);
+	root.put_attr("dedicated_hub", network_preferences->dedicated_hub_address);
 	root.put_attr("use_speex_netmic_encoder", network_preferences->use_speex_encoder);
 	root.put_attr("use_netscript", network_preferences->use_netscript);
 	root.put_attr_path("netscript_file", network_preferences->netscript_file);
@@ -3164,6 +3165,7 @@ static void default_network_preferences(network_preferences_data *preferences)
 	obj_clear(preferences->join_address);
 	preferences->game_port= DEFAULT_GAME_PORT;
 	preferences->game_protocol= _network_game_protocol_default;
+	obj_clear(preferences->dedicated_hub_address);
 #if !defined(DISABLE_NETWORKING)
 	DefaultStarPreferences();
 	DefaultRingPreferences();
@@ -3962,6 +3964,7 @@ void parse_network_preferences(InfoTree root, std::string version)
 	root.read_attr("join_by_address", network_preferences->join_by_address);
 	root.read_cstr("join_address", network_preferences->join_address, 255);
 	root.read_attr("local_game_port", network_preferences->game_port);
+	root.read_cstr("dedicated_hub", network_preferences->dedicated_hub_address, 255);
   root.read_attr("detect_desync", network_preferences->detect_desync);
 
 	std::string protocol;
@@ -126,6 +126,7 @@ struct network_preferences_data
 	char join_address[256];
 	uint16 game_port;	// TCP and UDP port number used for game traffic (not player-location traffic)
 	uint16 game_protocol; // _network_game_protocol_star, etc.
+	char dedicated_hub_address[256]; // host[:port] of a dedicated hub for games we gather; empty to host them ourselves
 	bool use_speex_encoder;
 	bool use_netscript;
 	char netscript_file[256];
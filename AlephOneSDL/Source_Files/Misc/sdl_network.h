@@ -120,6 +120,13 @@ void NetDDPDisposeFrame(DDPFramePtr frame);
 
 OSErr NetDDPSendFrame(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short socket);
 
+// Incoming packets wait in a queue until someone holding the mytm mutex hands them to the
+// packet handler; protocol ticks should call this before doing their own work.
+void NetDDPProcessReceivedPackets(void);
+
+// Packets dropped because the receive queue was full, and how deep it is (now and at worst).
+void NetDDPGetReceiveQueueStats(uint32* outDropped, int32* outDepth, int32* outMaxDepth);
+
 /* ---------- prototypes/NETWORK_ADSP.C */
 
 // jkvw: removed - we use TCPMess now
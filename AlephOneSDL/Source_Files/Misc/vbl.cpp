@@ -79,6 +79,13 @@ Feb 20, 2002 (Woody Zenfell):
 #include "cseries.h"
 #include <string.h>
 #include <stdlib.h>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <zlib.h>
+
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
 
 #include "map.h"
 #include "interface.h"
@@ -98,6 +105,9 @@ Feb 20, 2002 (Woody Zenfell):
 #include "joystick.h"
 #include "Movie.h"
 #include "InfoTree.h"
+#include "game_wad.h"
+#include "wad.h"
+#include "world_hash.h"
 
 #include "AlephOneHelper.h"
 
@@ -105,6 +115,12 @@ Feb 20, 2002 (Woody Zenfell):
 
 #define RECORD_CHUNK_SIZE            (MAXIMUM_QUEUE_SIZE/2)
 #define END_OF_RECORDING_INDICATOR  (RECORD_CHUNK_SIZE+1)
+#define KEYFRAME_INDICATOR          (RECORD_CHUNK_SIZE+2)
+#define KEYFRAME_INTERVAL           (TICKS_PER_MINUTE)
+#define KEYFRAME_INDEX_COOKIE       FOUR_CHARS_TO_INT('k', 'f', 'i', 'x')
+#define FILM_ROUND_INDICATOR        (RECORD_CHUNK_SIZE+3)
+#define WORLD_HASH_INDICATOR        (RECORD_CHUNK_SIZE+4)
+#define NUMBER_OF_FLAG_BITS         32
 #define MAXIMUM_TIME_DIFFERENCE     15 // allowed between heartbeat_count and dynamic_world->tick_count
 #define MAXIMUM_NET_QUEUE_SIZE       8
 #define DISK_CACHE_SIZE             ((sizeof(int16)+sizeof(uint32))*100)
@@ -133,6 +149,44 @@ static OpenedFile FilmFile;
 
 struct replay_private_data replay;
 
+// Keyframes are written after a round of chunks (one per player); the film
+// offset points at the KEYFRAME_INDICATOR run that introduces each of them.
+struct film_keyframe {
+	int32 tick;
+	int32 offset;
+};
+const int SIZEOF_film_keyframe = 8;
+
+static std::vector<film_keyframe> film_keyframes;
+static int32 ticks_since_keyframe;
+static int32 replay_seek_target= NONE;
+
+extern ModifiableActionQueues *GetGameQueue();
+
+// Compressing and writing the film happens on its own thread; the game only
+// hands over a round's worth of flags (or a packed keyframe) at a time.
+struct film_write {
+	int16 player_count;
+	int16 flag_count;
+	std::vector<uint32> flags; // RECORD_CHUNK_SIZE per player
+	std::vector<uint8> keyframe;
+	int32 keyframe_tick;
+	std::vector<uint8> world_hash;
+};
+
+static std::queue<film_write *> film_writes;
+static SDL_Thread *film_writer_thread= NULL;
+static SDL_mutex *film_writer_mutex= NULL;
+static SDL_cond *film_writer_cond= NULL;
+static bool film_writer_busy= false;
+static bool film_writer_quit= false;
+
+// Films carry the world hashes of the game that recorded them, so a replay
+// that goes its own way can say where and in what.
+static world_hash_snapshot last_recorded_world_hash;
+static std::deque<world_hash_snapshot> film_world_hashes;
+static bool film_has_diverged= false;
+
 #ifdef DEBUG
 ActionQueue *get_player_recording_queue(
 	short player_index)
@@ -146,13 +200,33 @@ ActionQueue *get_player_recording_queue(
 
 /* ---------- private prototypes */
 static void remove_input_controller(void);
-static void save_recording_queue_chunk(short player_index);
+static void save_recording_queue_round(void);
+static void start_film_writer(void);
+static void flush_film_writer(void);
+static void stop_film_writer(void);
+static int film_writer_loop(void *);
+static void queue_film_write(film_write *write);
+static void perform_film_write(film_write *write);
+static bool film_has_rounds(void);
+static void write_film_round(film_write *round);
+static void write_film_chunks(film_write *round);
+static bool unpack_film_round(uint8 *data, int32 length);
+static bool vblFSReadBlock(OpenedFile& File, int32 count, void *dest);
+static void save_film_keyframe(void);
+static void save_film_keyframe_index(void);
+static void read_film_keyframe_index(void);
+static bool skip_film_keyframe(int32 length);
+static void save_film_world_hash(void);
+static void expect_film_world_hash(uint8 *data, int32 length);
+static void check_film_world_hashes(void);
+static void reset_film_world_hashes(void);
 static void read_recording_queue_chunks(void);
 static bool pull_flags_from_recording(short count);
 // LP modifications for object-oriented file handling; returns a test for end-of-file
 static bool vblFSRead(OpenedFile& File, int32 *count, void *dest, bool& HitEOF);
 static void record_action_flags(short player_identifier, const uint32 *action_flags, short count);
 static short get_recording_queue_size(short which_queue);
+static short get_minimum_recording_queue_size(void);
 
 static uint8 *unpack_recording_header(uint8 *Stream, recording_header *Objects, size_t Count);
 static uint8 *pack_recording_header(uint8 *Stream, recording_header *Objects, size_t Count);
@@ -261,6 +335,16 @@ bool has_recording_file(void)
 	return get_recording_filedesc(File);
 }
 
+bool game_is_recording(void)
+{
+	return replay.game_is_being_recorded;
+}
+
+bool game_is_replaying(void)
+{
+	return replay.game_is_being_replayed;
+}
+
 /* Called by the time manager task in vbl_macintosh.c */
 bool input_controller(
 	void)
@@ -277,8 +361,24 @@ bool input_controller(
 			{
 				static short phase= 0; /* When this gets to 0, update the world */
 
+				/* Seeking simulates forward from the keyframe as fast as the film is read */
+				if(replay_seek_target != NONE)
+				{
+					short flag_count= MIN(replay_seek_target-heartbeat_count, get_minimum_recording_queue_size());
+
+					if (flag_count > 0 && pull_flags_from_recording(flag_count))
+					{
+						heartbeat_count+= flag_count;
+					}
+					else if (replay.have_read_last_chunk)
+					{
+						replay_seek_target= NONE;
+					}
+
+					if (heartbeat_count >= replay_seek_target) replay_seek_target= NONE;
+				}
 				/* Minimum replay speed is a pause. */
-				if(replay.replay_speed != MINIMUM_REPLAY_SPEED)
+				else if(replay.replay_speed != MINIMUM_REPLAY_SPEED)
 				{
 					if (replay.replay_speed > 0 || (--phase<=0))
 					{
@@ -355,78 +455,271 @@ static void record_action_flags(
 
 /*********************************************************************************************
  *
- * Function: save_recording_queue_chunk
- * Purpose:  saves one chunk of the queue to the recording file, using run-length encoding.
+ * Function: save_recording_queue_round
+ * Purpose:  hands one chunk of every player's queue to the film writer.
  *
  *********************************************************************************************/
-void save_recording_queue_chunk(
-	short player_index)
+static void save_recording_queue_round(
+	void)
 {
-	uint8 *location;
-	uint32 last_flag, count, flag = 0;
-	int16 i, run_count, num_flags_saved, max_flags;
-	static uint8 *buffer= NULL;
-	ActionQueue *queue;
-	
-	// The data format is (run length (int16)) + (action flag (uint32))
-	int DataSize = sizeof(int16) + sizeof(uint32);
-	
-	if (buffer == NULL)
-		buffer = new byte[RECORD_CHUNK_SIZE * DataSize];
-	
-	location= buffer;
-	count= 0; // keeps track of how many bytes we'll save.
-	last_flag= (uint32)NONE;
+	short player_index;
+	film_write *round= new film_write;
 
-	queue= get_player_recording_queue(player_index);
-	
 	// don't want to save too much stuff
-	max_flags= MIN(RECORD_CHUNK_SIZE, get_recording_queue_size(player_index)); 
+	round->player_count= dynamic_world->player_count;
+	round->flag_count= MIN(RECORD_CHUNK_SIZE, get_minimum_recording_queue_size());
+	round->flags.resize(round->player_count*RECORD_CHUNK_SIZE);
 
-	// save what's in the queue
-	run_count= num_flags_saved= 0;
-	for (i = 0; i<max_flags; i++)
+	for (player_index= 0; player_index<round->player_count; player_index++)
 	{
-		flag = queue->buffer[queue->read_index];
-		INCREMENT_QUEUE_COUNTER(queue->read_index);
-		
-		if (i && flag != last_flag)
+		ActionQueue *queue= get_player_recording_queue(player_index);
+		for (int16 i= 0; i<round->flag_count; i++)
 		{
-			ValueToStream(location,run_count);
-			ValueToStream(location,last_flag);
-			count += DataSize;
-			num_flags_saved += run_count;
-			run_count = 1;
+			round->flags[player_index*RECORD_CHUNK_SIZE + i]= queue->buffer[queue->read_index];
+			INCREMENT_QUEUE_COUNTER(queue->read_index);
 		}
+	}
+
+	queue_film_write(round);
+}
+
+/*********************************************************************************************
+ *
+ * Function: write_film_round
+ * Purpose:  compresses a round and writes it to the film (film writer thread).
+ *           Each player's flags are XORed with the previous tick's, split into bitplanes,
+ *           and the planes that aren't all zero are deflated together. A round with fewer
+ *           than RECORD_CHUNK_SIZE flags ends the recording. If it can't be compressed, it's
+ *           written the old way instead, which a replay reads just as well.
+ *
+ *********************************************************************************************/
+static void write_film_round(
+	film_write *round)
+{
+	const int plane_size= (round->flag_count+7)/8;
+	std::vector<uint8> raw(sizeof(int16) + round->player_count*(sizeof(uint32) + NUMBER_OF_FLAG_BITS*plane_size));
+	uint8 *S= &raw[0];
+
+	ValueToStream(S,round->flag_count);
+	for (short player_index= 0; player_index<round->player_count; player_index++)
+	{
+		const uint32 *flags= &round->flags[player_index*RECORD_CHUNK_SIZE];
+		uint32 deltas[RECORD_CHUNK_SIZE];
+		uint32 last_flag= 0, used_planes= 0;
+
+		for (int16 i= 0; i<round->flag_count; i++)
+		{
+			deltas[i]= flags[i] ^ last_flag;
+			used_planes|= deltas[i];
+			last_flag= flags[i];
+		}
+
+		ValueToStream(S,used_planes);
+		for (int bit= 0; bit<NUMBER_OF_FLAG_BITS; bit++)
+		{
+			if (!(used_planes & (1u<<bit))) continue;
+
+			memset(S, 0, plane_size);
+			for (int16 i= 0; i<round->flag_count; i++)
+			{
+				if (deltas[i] & (1u<<bit)) S[i>>3]|= (1<<(i&7));
+			}
+			S+= plane_size;
+		}
+	}
+
+	uLongf raw_length= S - &raw[0];
+	uLongf packed_length= compressBound(raw_length);
+	std::vector<uint8> buffer(sizeof(int16) + 2*sizeof(uint32) + packed_length);
+	if (compress(&buffer[sizeof(int16) + 2*sizeof(uint32)], &packed_length, &raw[0], raw_length) != Z_OK)
+	{
+		// dropping the round would throw off everything after it
+		logErrorNMT("film round could not be compressed; writing it run-length encoded");
+		write_film_chunks(round);
+		return;
+	}
+
+	S= &buffer[0];
+	ValueToStream(S,int16(FILM_ROUND_INDICATOR));
+	ValueToStream(S,uint32(sizeof(uint32) + packed_length));
+	ValueToStream(S,uint32(raw_length));
+	S+= packed_length;
+
+	FilmFile.Write(S - &buffer[0],&buffer[0]);
+	replay.header.length+= S - &buffer[0];
+}
+
+/*********************************************************************************************
+ *
+ * Function: write_film_chunks
+ * Purpose:  writes a round as one run-length encoded chunk per player, as films older than
+ *           RECORDING_VERSION_ALEPH_ONE_1_3 have them (film writer thread).
+ *
+ *********************************************************************************************/
+static void write_film_chunks(
+	film_write *round)
+{
+	// The data format is (run length (int16)) + (action flag (uint32))
+	const int DataSize= sizeof(int16) + sizeof(uint32);
+	std::vector<uint8> buffer((RECORD_CHUNK_SIZE+1)*DataSize);
+
+	for (short player_index= 0; player_index<round->player_count; player_index++)
+	{
+		const uint32 *flags= &round->flags[player_index*RECORD_CHUNK_SIZE];
+		uint8 *location= &buffer[0];
+		uint32 last_flag= (uint32)NONE;
+		int16 run_count= 0;
+
+		for (int16 i= 0; i<round->flag_count; i++)
+		{
+			if (i && flags[i] != last_flag)
+			{
+				ValueToStream(location,run_count);
+				ValueToStream(location,last_flag);
+				run_count= 1;
+			}
+			else
+			{
+				run_count++;
+			}
+			last_flag= flags[i];
+		}
+
+		// now save the final run
+		ValueToStream(location,run_count);
+		ValueToStream(location,last_flag);
+
+		if (round->flag_count<RECORD_CHUNK_SIZE)
+		{
+			ValueToStream(location,int16(END_OF_RECORDING_INDICATOR));
+			ValueToStream(location,int32(0));
+		}
+
+		int32 count= location - &buffer[0];
+		FilmFile.Write(count,&buffer[0]);
+		replay.header.length+= count;
+	}
+}
+
+// Compressed rounds, keyframes and world hashes are only in films whose version says so;
+// in older ones those indicators would just be (bad) run lengths
+static bool film_has_rounds(
+	void)
+{
+	return replay.header.version >= RECORDING_VERSION_ALEPH_ONE_1_3;
+}
+
+static void perform_film_write(
+	film_write *write)
+{
+	if (!write->world_hash.empty())
+	{
+		if (FilmFile.Write(write->world_hash.size(),&write->world_hash[0]))
+			replay.header.length+= write->world_hash.size();
+	}
+	else if (write->keyframe.empty())
+	{
+		if (film_has_rounds())
+			write_film_round(write);
 		else
+			write_film_chunks(write);
+	}
+	else
+	{
+		film_keyframe keyframe;
+		keyframe.tick= write->keyframe_tick;
+		FilmFile.GetPosition(keyframe.offset);
+		if (FilmFile.Write(write->keyframe.size(),&write->keyframe[0]))
 		{
-			run_count++;
+			film_keyframes.push_back(keyframe);
+			replay.header.length+= write->keyframe.size();
 		}
-		last_flag = flag;
 	}
-	
-	// now save the final run
-	ValueToStream(location,run_count);
-	ValueToStream(location,last_flag);
-	count += DataSize;
-	num_flags_saved += run_count;
-	
-	if (max_flags<RECORD_CHUNK_SIZE)
+	delete write;
+}
+
+static void queue_film_write(
+	film_write *write)
+{
+	// without a writer thread, just do it here
+	if (!film_writer_thread)
 	{
-		short end_indicator = END_OF_RECORDING_INDICATOR;
-		ValueToStream(location,end_indicator);
-		int32 end_flag = 0;
-		ValueToStream(location,end_flag);
-		count += DataSize;
-		num_flags_saved += RECORD_CHUNK_SIZE-max_flags;
+		perform_film_write(write);
+		return;
 	}
-	
-	FilmFile.Write(count,buffer);
-	replay.header.length+= count;
-		
-	vwarn(num_flags_saved == RECORD_CHUNK_SIZE,
-		csprintf(temporary, "bad recording: %d flags, max=%d, count = %u;dm #%p #%u", num_flags_saved, max_flags,
-			count, buffer, count));
+
+	SDL_LockMutex(film_writer_mutex);
+	film_writes.push(write);
+	SDL_CondSignal(film_writer_cond);
+	SDL_UnlockMutex(film_writer_mutex);
+}
+
+static int film_writer_loop(
+	void *)
+{
+	SDL_LockMutex(film_writer_mutex);
+	for (;;)
+	{
+		if (film_writes.empty())
+		{
+			film_writer_busy= false;
+			SDL_CondBroadcast(film_writer_cond);
+			if (film_writer_quit) break;
+			SDL_CondWait(film_writer_cond, film_writer_mutex);
+			continue;
+		}
+
+		film_write *write= film_writes.front();
+		film_writes.pop();
+		film_writer_busy= true;
+		SDL_UnlockMutex(film_writer_mutex);
+
+		perform_film_write(write);
+
+		SDL_LockMutex(film_writer_mutex);
+	}
+	SDL_UnlockMutex(film_writer_mutex);
+
+	return 0;
+}
+
+static void start_film_writer(
+	void)
+{
+	assert(!film_writer_thread);
+	if (!film_writer_mutex) film_writer_mutex= SDL_CreateMutex();
+	if (!film_writer_cond) film_writer_cond= SDL_CreateCond();
+	film_writer_quit= false;
+	film_writer_busy= false;
+	film_writer_thread= SDL_CreateThread(film_writer_loop, "FilmWriter_thread", NULL);
+}
+
+/* Waits for everything handed to the film writer to be on disk */
+static void flush_film_writer(
+	void)
+{
+	if (!film_writer_thread) return;
+
+	SDL_LockMutex(film_writer_mutex);
+	while (!film_writes.empty() || film_writer_busy)
+	{
+		SDL_CondWait(film_writer_cond, film_writer_mutex);
+	}
+	SDL_UnlockMutex(film_writer_mutex);
+}
+
+static void stop_film_writer(
+	void)
+{
+	if (!film_writer_thread) return;
+
+	SDL_LockMutex(film_writer_mutex);
+	film_writer_quit= true;
+	SDL_CondBroadcast(film_writer_cond);
+	SDL_UnlockMutex(film_writer_mutex);
+
+	SDL_WaitThread(film_writer_thread, NULL);
+	film_writer_thread= NULL;
 }
 
 /*********************************************************************************************
@@ -490,6 +783,19 @@ static short get_recording_queue_size(
 	return size;
 }
 
+static short get_minimum_recording_queue_size(
+	void)
+{
+	short player_index, size= MAXIMUM_QUEUE_SIZE;
+
+	for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		size= MIN(size, get_recording_queue_size(player_index));
+	}
+
+	return size;
+}
+
 void set_recording_header_data(
 	short number_of_players, 
 	short level_number, 
@@ -551,6 +857,8 @@ bool setup_for_replay_from_file(
 		FilmFile.Read(SIZEOF_recording_header,Header);
 		unpack_recording_header(Header,&replay.header,1);
 		replay.header.game_information.cheat_flags = _allow_crosshair | _allow_tunnel_vision | _allow_behindview | _allow_overlay_map;
+		read_film_keyframe_index();
+		replay_seek_target= NONE;
 	
 		/* Set to the mapfile this replay came from.. */
 		if(use_map_file(replay.header.map_checksum))
@@ -596,11 +904,16 @@ void start_recording(
 		if (FilmFileSpec.Open(FilmFile,true))
 		{
 			replay.game_is_being_recorded= true;
+			film_keyframes.clear();
+			ticks_since_keyframe= KEYFRAME_INTERVAL;
+			reset_film_world_hashes();
 	
 			// save a header containing information about the game.
 			byte Header[SIZEOF_recording_header];
 			pack_recording_header(Header,&replay.header,1);
 			FilmFile.Write(SIZEOF_recording_header,Header);
+
+			start_film_writer();
 		}
 	}
 }
@@ -612,13 +925,18 @@ void stop_recording(
 	{
 		replay.game_is_being_recorded = false;
 		
-		short player_index;
 		int32 total_length;
 
 		assert(replay.valid);
-		for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
+		save_recording_queue_round();
+		stop_film_writer();
+
+		/* The index lives past the end of the recording, so it isn't counted in the length */
+		int32 index_length= 0;
+		if (!film_keyframes.empty())
 		{
-			save_recording_queue_chunk(player_index);
+			save_film_keyframe_index();
+			index_length= film_keyframes.size()*SIZEOF_film_keyframe + sizeof(int32) + sizeof(uint32);
 		}
 
 		/* Rewrite the header, since it has the new length */
@@ -633,7 +951,7 @@ void stop_recording(
 		assert(successfulWrite);
 		
 		FilmFile.GetLength(total_length);
-		assert(total_length==replay.header.length);
+		assert(total_length==replay.header.length+index_length);
 		
 		FilmFile.Close();
 	}
@@ -653,6 +971,7 @@ void rewind_recording(
 		FilmFile.SetPosition(sizeof(recording_header));
 		*/
 		// Alternative that does not use "SetLength", but instead creates and re-creates the file.
+		flush_film_writer();
 		FilmFile.SetPosition(0);
 		byte Header[SIZEOF_recording_header];
 		FilmFile.Read(SIZEOF_recording_header,Header);
@@ -664,6 +983,10 @@ void rewind_recording(
 		
 		// Use the packed length here!!!
 		replay.header.length= SIZEOF_recording_header;
+
+		film_keyframes.clear();
+		ticks_since_keyframe= KEYFRAME_INTERVAL;
+		reset_film_world_hashes();
 	}
 }
 
@@ -694,12 +1017,17 @@ void check_recording_replaying(
 			success= FilmFile_Check.GetFreeSpace(freespace);
 			if (success && freespace>(RECORD_CHUNK_SIZE*sizeof(int16)*sizeof(uint32)*dynamic_world->player_count))
 			{
-				for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
+				save_recording_queue_round();
+
+				ticks_since_keyframe+= RECORD_CHUNK_SIZE;
+				if (ticks_since_keyframe >= KEYFRAME_INTERVAL && film_has_rounds())
 				{
-					save_recording_queue_chunk(player_index);
+					save_film_keyframe();
 				}
 			}
 		}
+
+		if (film_has_rounds()) save_film_world_hash();
 	}
 	else if (replay.game_is_being_replayed)
 	{
@@ -718,6 +1046,8 @@ void check_recording_replaying(
 			// we'll fill 'em up.
 			read_recording_queue_chunks();
 		}
+
+		check_film_world_hashes();
 	}
 }
 
@@ -740,6 +1070,9 @@ void stop_replay(
 		assert(replay.valid);
 
 		replay.game_is_being_replayed= false;
+		replay_seek_target= NONE;
+		film_keyframes.clear();
+		reset_film_world_hashes();
 		if (replay.resource_data)
 		{
 			delete []replay.resource_data;
@@ -792,6 +1125,32 @@ static void read_recording_queue_chunks(
 					S = (uint8 *)(replay.resource_data + replay.film_resource_offset);
 					StreamToValue(S,action_flags);
 					replay.film_resource_offset+= sizeof(action_flags);
+
+					if (num_flags == KEYFRAME_INDICATOR && film_has_rounds())
+					{
+						replay.film_resource_offset+= action_flags;
+						continue;
+					}
+
+					if (num_flags == WORLD_HASH_INDICATOR && film_has_rounds())
+					{
+						if (replay.film_resource_offset + int32(action_flags) <= replay.resource_data_size)
+							expect_film_world_hash((uint8 *)(replay.resource_data + replay.film_resource_offset), action_flags);
+						replay.film_resource_offset+= action_flags;
+						continue;
+					}
+
+					if (num_flags == FILM_ROUND_INDICATOR && film_has_rounds())
+					{
+						if (replay.film_resource_offset + int32(action_flags) > replay.resource_data_size ||
+							!unpack_film_round((uint8 *)(replay.resource_data + replay.film_resource_offset), action_flags))
+						{
+							logError("film round is corrupt");
+							replay.have_read_last_chunk= true;
+						}
+						replay.film_resource_offset+= action_flags;
+						return;
+					}
 				}
 				
 				if (hit_end || num_flags == END_OF_RECORDING_INDICATOR)
@@ -828,6 +1187,43 @@ static void read_recording_queue_chunks(
 					replay.have_read_last_chunk = true;
 					break;
 				}
+
+				// the flags in a keyframe's (or round's) length slot count its bytes
+				if (num_flags == KEYFRAME_INDICATOR && film_has_rounds())
+				{
+					if (!skip_film_keyframe(action_flags))
+					{
+						logError("film keyframe is truncated");
+						replay.have_read_last_chunk = true;
+						break;
+					}
+					continue;
+				}
+
+				if (num_flags == WORLD_HASH_INDICATOR && film_has_rounds())
+				{
+					std::vector<uint8> Hash(action_flags);
+					if (!action_flags || !vblFSReadBlock(FilmFile, action_flags, &Hash[0]))
+					{
+						logError("film world hash is truncated");
+						replay.have_read_last_chunk = true;
+						break;
+					}
+					expect_film_world_hash(&Hash[0], action_flags);
+					continue;
+				}
+
+				// a compressed round holds every player's chunk
+				if (num_flags == FILM_ROUND_INDICATOR && film_has_rounds())
+				{
+					std::vector<uint8> Round(action_flags);
+					if (!vblFSReadBlock(FilmFile, action_flags, &Round[0]) || !unpack_film_round(&Round[0], action_flags))
+					{
+						logError("film round is corrupt");
+						replay.have_read_last_chunk = true;
+					}
+					return;
+				}
 			}
 
 			if (!(replay.have_read_last_chunk || num_flags))
@@ -919,6 +1315,407 @@ static bool vblFSRead(
 	return status;
 }
 
+/*********************************************************************************************
+ *
+ * Function: save_film_keyframe
+ * Purpose:  saves the dynamic world after a round of chunks, so that replays can seek.
+ *           Flags the world hasn't consumed yet are either still in the recording queue
+ *           (they start the next round, and are skipped on restore) or already written
+ *           (they're repeated in the keyframe as a lead-in).
+ *
+ *********************************************************************************************/
+static void save_film_keyframe(
+	void)
+{
+	short player_index;
+	int16 lead_in[MAXIMUM_NUMBER_OF_PLAYERS];
+	int32 count;
+	void *flat_data;
+
+	count= sizeof(int32);
+	for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		int16 pending= GetRealActionQueues()->countActionFlags(player_index) + GetGameQueue()->countActionFlags(player_index);
+		lead_in[player_index]= pending - get_recording_queue_size(player_index);
+
+		// the written flags are only still around for one chunk
+		if (lead_in[player_index] > RECORD_CHUNK_SIZE) return;
+
+		count+= sizeof(int16) + MAX(lead_in[player_index], 0)*sizeof(uint32);
+	}
+
+	flat_data= get_flat_save_game_data();
+	if (!flat_data) return;
+
+	int32 flat_length= get_flat_data_length(flat_data);
+	count+= flat_length;
+
+	film_write *write= new film_write;
+	write->keyframe.resize(sizeof(int16) + sizeof(uint32) + count);
+	write->keyframe_tick= dynamic_world->tick_count;
+	uint8 *S= &write->keyframe[0];
+
+	ValueToStream(S,int16(KEYFRAME_INDICATOR));
+	ValueToStream(S,uint32(count));
+	ValueToStream(S,int32(dynamic_world->tick_count));
+	for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		ActionQueue *queue= get_player_recording_queue(player_index);
+		int16 index= queue->read_index - MAX(lead_in[player_index], 0);
+		if (index<0) index+= MAXIMUM_QUEUE_SIZE;
+
+		ValueToStream(S,lead_in[player_index]);
+		for (int16 i= 0; i<lead_in[player_index]; i++)
+		{
+			ValueToStream(S,queue->buffer[index]);
+			INCREMENT_QUEUE_COUNTER(index);
+		}
+	}
+	BytesToStream(S,flat_data,flat_length);
+	free(flat_data);
+	assert(S - &write->keyframe[0] == static_cast<int32>(write->keyframe.size()));
+
+	// the film writer notes the offset once it gets there
+	queue_film_write(write);
+
+	ticks_since_keyframe= 0;
+}
+
+static void save_film_keyframe_index(
+	void)
+{
+	int32 length= film_keyframes.size()*SIZEOF_film_keyframe + sizeof(int32) + sizeof(uint32);
+	uint8 *buffer= new uint8[length];
+	uint8 *S= buffer;
+
+	for (size_t i= 0; i<film_keyframes.size(); i++)
+	{
+		ValueToStream(S,film_keyframes[i].tick);
+		ValueToStream(S,film_keyframes[i].offset);
+	}
+	ValueToStream(S,int32(film_keyframes.size()));
+	ValueToStream(S,uint32(KEYFRAME_INDEX_COOKIE));
+	assert(S - buffer == length);
+
+	FilmFile.Write(length,buffer);
+	delete []buffer;
+}
+
+static void read_film_keyframe_index(
+	void)
+{
+	const int32 trailer_length= sizeof(int32) + sizeof(uint32);
+	int32 file_length, count;
+	uint32 cookie;
+
+	film_keyframes.clear();
+
+	// films without keyframes end with the recording
+	if (!film_has_rounds() || !FilmFile.GetLength(file_length) || file_length - replay.header.length < trailer_length)
+		return;
+
+	uint8 Trailer[trailer_length];
+	FilmFile.SetPosition(file_length - trailer_length);
+	if (FilmFile.Read(trailer_length,Trailer))
+	{
+		uint8 *S= Trailer;
+		StreamToValue(S,count);
+		StreamToValue(S,cookie);
+
+		if (cookie == KEYFRAME_INDEX_COOKIE && count > 0 &&
+			count*SIZEOF_film_keyframe + trailer_length == file_length - replay.header.length)
+		{
+			std::vector<uint8> Index(count*SIZEOF_film_keyframe);
+			FilmFile.SetPosition(replay.header.length);
+			if (FilmFile.Read(Index.size(),&Index[0]))
+			{
+				S= &Index[0];
+				film_keyframes.resize(count);
+				for (int32 i= 0; i<count; i++)
+				{
+					StreamToValue(S,film_keyframes[i].tick);
+					StreamToValue(S,film_keyframes[i].offset);
+				}
+			}
+		}
+	}
+
+	FilmFile.SetPosition(SIZEOF_recording_header);
+}
+
+/* Skips a keyframe's body during sequential playback */
+static bool skip_film_keyframe(
+	int32 length)
+{
+	// use up what's in the cache, then skip the rest on disk
+	int32 from_cache= MIN(length, replay.bytes_in_cache);
+	replay.bytes_in_cache-= from_cache;
+	replay.location_in_cache+= from_cache;
+	length-= from_cache;
+
+	if (length)
+	{
+		int32 position;
+		FilmFile.GetPosition(position);
+		if (position + length > replay.header.length) return false;
+		FilmFile.SetPosition(position + length);
+	}
+
+	return true;
+}
+
+static void save_film_world_hash(
+	void)
+{
+	world_hash_snapshot snapshot;
+
+	if (!get_latest_world_hash(snapshot)) return;
+	if (snapshot.tick == last_recorded_world_hash.tick && snapshot.level == last_recorded_world_hash.level) return;
+	last_recorded_world_hash= snapshot;
+
+	film_write *write= new film_write;
+	write->world_hash.resize(sizeof(int16) + sizeof(uint32) + SIZEOF_world_hash_snapshot);
+	uint8 *S= &write->world_hash[0];
+	ValueToStream(S,int16(WORLD_HASH_INDICATOR));
+	ValueToStream(S,uint32(SIZEOF_world_hash_snapshot));
+	pack_world_hash_snapshot(S,snapshot);
+
+	queue_film_write(write);
+}
+
+static void expect_film_world_hash(
+	uint8 *data,
+	int32 length)
+{
+	if (length != SIZEOF_world_hash_snapshot) return;
+
+	world_hash_snapshot snapshot;
+	unpack_world_hash_snapshot(data,snapshot);
+	film_world_hashes.push_back(snapshot);
+}
+
+// hashes can be read before or after the replay reaches their tick
+static void check_film_world_hashes(
+	void)
+{
+	while (!film_world_hashes.empty())
+	{
+		short subsystem;
+		short result= check_world_hash(film_world_hashes.front(), &subsystem);
+		if (result == _world_hash_pending) break;
+
+		if (result == _world_hash_diverged && !film_has_diverged)
+		{
+			logWarning("film diverged in %s at tick %d", get_world_hash_subsystem_name(subsystem), film_world_hashes.front().tick);
+			screen_printf("Film went out of sync (%s, tick %d)", get_world_hash_subsystem_name(subsystem), film_world_hashes.front().tick);
+			film_has_diverged= true;
+		}
+		film_world_hashes.pop_front();
+	}
+}
+
+static void reset_film_world_hashes(
+	void)
+{
+	last_recorded_world_hash.tick= NONE;
+	last_recorded_world_hash.level= NONE;
+	film_world_hashes.clear();
+	film_has_diverged= false;
+}
+
+/*********************************************************************************************
+ *
+ * Function: seek_replay
+ * Purpose:  restores the last keyframe at or before the given tick, then fast-forwards to it.
+ * Returns:  false if the film has no usable keyframe.
+ *
+ *********************************************************************************************/
+bool seek_replay(
+	int32 tick)
+{
+	short player_index;
+	const film_keyframe *keyframe= NULL;
+
+	if (!replay.game_is_being_replayed || replay.resource_data) return false;
+
+	for (size_t i= 0; i<film_keyframes.size(); i++)
+	{
+		if (film_keyframes[i].tick <= tick) keyframe= &film_keyframes[i];
+	}
+	if (!keyframe) return false;
+
+	uint8 Marker[sizeof(int16) + sizeof(uint32)];
+	int16 indicator;
+	uint32 length;
+	FilmFile.SetPosition(keyframe->offset);
+	if (!FilmFile.Read(sizeof(Marker),Marker)) return false;
+	uint8 *S= Marker;
+	StreamToValue(S,indicator);
+	StreamToValue(S,length);
+	if (indicator != KEYFRAME_INDICATOR) return false;
+
+	std::vector<uint8> Body(length);
+	if (!FilmFile.Read(length,&Body[0])) return false;
+
+	int32 keyframe_tick;
+	int16 lead_in[MAXIMUM_NUMBER_OF_PLAYERS];
+	std::vector<uint32> lead_in_flags[MAXIMUM_NUMBER_OF_PLAYERS];
+
+	S= &Body[0];
+	StreamToValue(S,keyframe_tick);
+	for (player_index= 0; player_index<replay.header.num_players; player_index++)
+	{
+		StreamToValue(S,lead_in[player_index]);
+		for (int16 i= 0; i<lead_in[player_index]; i++)
+		{
+			uint32 action_flags;
+			StreamToValue(S,action_flags);
+			lead_in_flags[player_index].push_back(action_flags);
+		}
+	}
+
+	// the flat data belongs to the restored wad from here on
+	size_t flat_length= length - (S - &Body[0]);
+	void *flat_data= malloc(flat_length);
+	if (!flat_data) return false;
+	memcpy(flat_data, S, flat_length);
+
+	if (!restore_film_keyframe(flat_data))
+	{
+		if (get_game_state() == _game_in_progress) set_game_state(_switch_demo);
+		return false;
+	}
+
+	// restoring emptied every queue; pick the film up right after the keyframe
+	reset_film_world_hashes();
+	replay.location_in_cache= NULL;
+	replay.bytes_in_cache= 0;
+	replay.have_read_last_chunk= false;
+	FilmFile.SetPosition(keyframe->offset + sizeof(Marker) + length);
+
+	for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		ActionQueue *queue= get_player_recording_queue(player_index);
+		for (size_t i= 0; i<lead_in_flags[player_index].size(); i++)
+		{
+			*(queue->buffer + queue->write_index)= lead_in_flags[player_index][i];
+			INCREMENT_QUEUE_COUNTER(queue->write_index);
+		}
+	}
+
+	read_recording_queue_chunks();
+
+	for (player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		ActionQueue *queue= get_player_recording_queue(player_index);
+		for (int16 i= lead_in[player_index]; i<0 && queue->read_index != queue->write_index; i++)
+		{
+			INCREMENT_QUEUE_COUNTER(queue->read_index);
+		}
+	}
+
+	sync_heartbeat_count();
+	replay_seek_target= (tick > dynamic_world->tick_count) ? tick : NONE;
+
+	return true;
+}
+
+/* Feeds the rest of the film as fast as it can be read; used by the film analyzer */
+void fast_forward_replay(
+	void)
+{
+	if (replay.game_is_being_replayed) replay_seek_target= INT32_MAX;
+}
+
+/* Reads something that may be bigger than the disk cache */
+static bool vblFSReadBlock(
+	OpenedFile& File,
+	int32 count,
+	void *dest)
+{
+	int32 from_cache= MIN(count, replay.bytes_in_cache);
+	memcpy(dest, replay.location_in_cache, from_cache);
+	replay.bytes_in_cache-= from_cache;
+	replay.location_in_cache+= from_cache;
+	count-= from_cache;
+
+	if (count)
+	{
+		int32 position;
+		File.GetPosition(position);
+		if (position + count > replay.header.length) return false;
+		return File.Read(count, (uint8 *)dest + from_cache);
+	}
+
+	return true;
+}
+
+/* Undoes write_film_round() into the recording queues */
+static bool unpack_film_round(
+	uint8 *data,
+	int32 length)
+{
+	uint32 raw_length;
+	int16 flag_count;
+	uint8 *S= data;
+
+	if (length < int32(sizeof(uint32))) return false;
+	StreamToValue(S,raw_length);
+
+	std::vector<uint8> raw(raw_length);
+	uLongf unpacked_length= raw_length;
+	if (raw_length < sizeof(int16) ||
+		uncompress(&raw[0], &unpacked_length, S, length - sizeof(uint32)) != Z_OK ||
+		unpacked_length != raw_length)
+	{
+		return false;
+	}
+
+	uint8 *end= &raw[0] + raw_length;
+	S= &raw[0];
+	StreamToValue(S,flag_count);
+	if (flag_count < 0 || flag_count > RECORD_CHUNK_SIZE) return false;
+
+	const int plane_size= (flag_count+7)/8;
+	for (short player_index= 0; player_index<dynamic_world->player_count; player_index++)
+	{
+		uint32 deltas[RECORD_CHUNK_SIZE];
+		uint32 used_planes, action_flags= 0;
+
+		if (end - S < int32(sizeof(uint32))) return false;
+		StreamToValue(S,used_planes);
+
+		objlist_clear(deltas, flag_count);
+		for (int bit= 0; bit<NUMBER_OF_FLAG_BITS; bit++)
+		{
+			if (!(used_planes & (1u<<bit))) continue;
+
+			if (end - S < plane_size) return false;
+			for (int16 i= 0; i<flag_count; i++)
+			{
+				if (S[i>>3] & (1<<(i&7))) deltas[i]|= (1u<<bit);
+			}
+			S+= plane_size;
+		}
+
+		ActionQueue *queue= get_player_recording_queue(player_index);
+		for (int16 i= 0; i<flag_count; i++)
+		{
+			action_flags^= deltas[i];
+			*(queue->buffer + queue->write_index)= action_flags;
+			INCREMENT_QUEUE_COUNTER(queue->write_index);
+			assert(queue->read_index != queue->write_index);
+		}
+	}
+
+	if (flag_count < RECORD_CHUNK_SIZE)
+	{
+		replay.have_read_last_chunk= true;
+	}
+
+	return true;
+}
+
 static void remove_input_controller(
 	void)
 {
@@ -33,11 +33,28 @@ Jul 5, 2000 (Loren Petrich):
 // LP: CodeWarrior complains unless I give the full definition of these classes
 #include "FileHandler.h"
 
+/* Change this when marathon changes & replays are no longer valid */
+enum recording_version {
+	RECORDING_VERSION_UNKNOWN = 0,
+	RECORDING_VERSION_MARATHON = 1,
+	RECORDING_VERSION_MARATHON_2 = 2,
+	RECORDING_VERSION_MARATHON_INFINITY = 3,
+	RECORDING_VERSION_ALEPH_ONE_EARLY = 4,
+	RECORDING_VERSION_ALEPH_ONE_PRE_NET = 5,
+	RECORDING_VERSION_ALEPH_ONE_PRE_PIN = 6,
+	RECORDING_VERSION_ALEPH_ONE_1_0 = 7,
+	RECORDING_VERSION_ALEPH_ONE_1_1 = 8,
+	RECORDING_VERSION_ALEPH_ONE_1_2 = 9,
+	RECORDING_VERSION_ALEPH_ONE_1_3 = 10	// compressed rounds, keyframes and world hashes
+};
+
 /* ------------ prototypes/VBL.C */
 bool setup_for_replay_from_file(FileSpecifier& File, uint32 map_checksum, bool prompt_to_export = false);
 bool setup_replay_from_random_resource(uint32 map_checksum);
 
 void start_recording(void);
+bool game_is_recording(void);
+bool game_is_replaying(void);
 
 bool find_replay_to_use(bool ask_user, FileSpecifier& File);
 
@@ -0,0 +1,206 @@
+/*
+ *  ChunkedDataTransfer.cpp
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  See ChunkedDataTransfer.h.
+ */
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "ChunkedDataTransfer.h"
+#include "Logging.h"
+
+#include <SDL_cpuinfo.h>
+#include <zlib.h>
+
+ChunkedDataCompressor::ChunkedDataCompressor(MessageTypeID inDataType, const byte* inBuffer, size_t inLength)
+	: mDataType(inDataType), mBuffer(inBuffer), mLength(inLength), mNextChunk(0), mCancelled(false)
+{
+	mTransferID = crc32(0, inBuffer, inLength);
+
+	// an empty buffer still gets one (empty) chunk, so the joiner hears about it
+	mChunks.resize(std::max<size_t>(1, (inLength + kChunkSize - 1) / kChunkSize));
+
+	mMutex = SDL_CreateMutex();
+	if (!mMutex)
+		return;
+
+	// leave a core for the main thread, which is busy sending the chunks
+	size_t theWorkerCount = std::min<size_t>(std::max(SDL_GetCPUCount() - 1, 1), kMaximumWorkers);
+	theWorkerCount = std::min(theWorkerCount, mChunks.size());
+	for (size_t i = 0; i < theWorkerCount; i++)
+	{
+		SDL_Thread* theThread = SDL_CreateThread(worker_thread, "ChunkedDataCompressor_worker", this);
+		if (!theThread)
+			break;
+		mWorkers.push_back(theThread);
+	}
+}
+
+ChunkedDataCompressor::~ChunkedDataCompressor()
+{
+	if (mMutex)
+	{
+		SDL_LockMutex(mMutex);
+		mCancelled = true;
+		SDL_UnlockMutex(mMutex);
+	}
+
+	for (size_t i = 0; i < mWorkers.size(); i++)
+	{
+		int status;
+		SDL_WaitThread(mWorkers[i], &status);
+	}
+
+	if (mMutex)
+		SDL_DestroyMutex(mMutex);
+}
+
+int ChunkedDataCompressor::worker_thread(void* p)
+{
+	return static_cast<ChunkedDataCompressor*>(p)->Worker();
+}
+
+int ChunkedDataCompressor::Worker()
+{
+	while (true)
+	{
+		SDL_LockMutex(mMutex);
+		size_t theIndex = mNextChunk++;
+		bool done = mCancelled || theIndex >= mChunks.size();
+		SDL_UnlockMutex(mMutex);
+
+		if (done)
+			return 0;
+
+		// nobody else touches a chunk until it's marked ready
+		compressChunk(theIndex, mChunks[theIndex]);
+
+		SDL_LockMutex(mMutex);
+		mChunks[theIndex].mReady = true;
+		SDL_UnlockMutex(mMutex);
+	}
+}
+
+void ChunkedDataCompressor::compressChunk(size_t inIndex, Chunk& outChunk) const
+{
+	size_t theOffset = chunkOffset(inIndex);
+	size_t theLength = std::min<size_t>(kChunkSize, mLength - theOffset);
+	const byte* theSource = mLength ? mBuffer + theOffset : NULL;
+
+	uLongf theCompressedLength = compressBound(theLength);
+	outChunk.mCompressedData.resize(theCompressedLength);
+	outChunk.mCompressed = (compress(&outChunk.mCompressedData[0], &theCompressedLength, theSource, theLength) == Z_OK);
+	outChunk.mCompressedData.resize(outChunk.mCompressed ? theCompressedLength : 0);
+	outChunk.mChecksum = crc32(0, theSource, theLength);
+}
+
+bool ChunkedDataCompressor::isChunkReady(size_t inIndex)
+{
+	if (mWorkers.empty())
+		return true;
+
+	SDL_LockMutex(mMutex);
+	bool theChunkIsReady = mChunks[inIndex].mReady;
+	SDL_UnlockMutex(mMutex);
+	return theChunkIsReady;
+}
+
+bool ChunkedDataCompressor::getChunk(size_t inIndex, DataChunkMessage& outMessage)
+{
+	Chunk& theChunk = mChunks[inIndex];
+	if (mWorkers.empty() && !theChunk.mReady)
+	{
+		compressChunk(inIndex, theChunk);
+		theChunk.mReady = true;
+	}
+
+	assert(isChunkReady(inIndex));
+	if (!theChunk.mCompressed)
+	{
+		logWarning("Error compressing data chunk %i of type %i", (int) inIndex, mDataType);
+		return false;
+	}
+
+	outMessage.mDataType = mDataType;
+	outMessage.mTransferID = mTransferID;
+	outMessage.mTotalLength = mLength;
+	outMessage.mOffset = chunkOffset(inIndex);
+	outMessage.mLength = std::min<size_t>(kChunkSize, mLength - chunkOffset(inIndex));
+	outMessage.mChecksum = theChunk.mChecksum;
+	outMessage.mCompressedData.swap(theChunk.mCompressedData);
+	return true;
+}
+
+bool ChunkedDataAssembler::add(const DataChunkMessage& inChunk)
+{
+	if (inChunk.mOffset > inChunk.mTotalLength || inChunk.mLength > inChunk.mTotalLength - inChunk.mOffset)
+	{
+		logWarning("Data chunk of type %i is outside its buffer (%u bytes at %u of %u)", inChunk.mDataType, inChunk.mLength, inChunk.mOffset, inChunk.mTotalLength);
+		return false;
+	}
+
+	if (inChunk.mTotalLength > kMaximumTotalLength)
+	{
+		logWarning("Data chunk of type %i is for a %u byte buffer, which is too big", inChunk.mDataType, inChunk.mTotalLength);
+		return false;
+	}
+
+	if (mReceivedOffsets.empty() || inChunk.mTransferID != mTransferID || inChunk.mTotalLength != mBuffer.size())
+	{
+		reset();
+		mTransferID = inChunk.mTransferID;
+		mBuffer.resize(inChunk.mTotalLength);
+	}
+	else if (mReceivedOffsets.count(inChunk.mOffset))
+	{
+		// already have it; the gatherer is resending
+		return true;
+	}
+
+	uLongf theLength = inChunk.mLength;
+	if (theLength > 0)
+	{
+		int ret = inChunk.mCompressedData.empty() ? Z_DATA_ERROR : uncompress(&mBuffer[inChunk.mOffset], &theLength, &inChunk.mCompressedData[0], inChunk.mCompressedData.size());
+		if (ret != Z_OK || theLength != inChunk.mLength)
+		{
+			logWarning("Error decompressing data chunk of type %i at %u; result is %i", inChunk.mDataType, inChunk.mOffset, ret);
+			return false;
+		}
+	}
+
+	if (crc32(0, buffer() ? buffer() + inChunk.mOffset : NULL, inChunk.mLength) != inChunk.mChecksum)
+	{
+		logWarning("Data chunk of type %i at %u failed its checksum", inChunk.mDataType, inChunk.mOffset);
+		return false;
+	}
+
+	mReceivedOffsets.insert(inChunk.mOffset);
+	mReceivedLength += inChunk.mLength;
+	return true;
+}
+
+void ChunkedDataAssembler::reset()
+{
+	mTransferID = 0;
+	std::vector<byte>().swap(mBuffer);
+	mReceivedOffsets.clear();
+	mReceivedLength = 0;
+}
+
+#endif // !defined(DISABLE_NETWORKING)
@@ -0,0 +1,125 @@
+/*
+ *  ChunkedDataTransfer.h
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  Sending big buffers (maps, physics, Lua) to joiners as a series of DataChunkMessages.
+ *
+ *  The gatherer splits a buffer into fixed-size chunks and zips them on worker threads, so
+ *  the first chunk can go out while later ones are still being compressed.  The joiner
+ *  unzips each chunk into place as it arrives and checks it against its CRC, so there's no
+ *  big decompression at the end and a corrupt chunk is caught where it happened.
+ *
+ *  Every chunk carries the transfer ID (the buffer's CRC), its offset and the total length,
+ *  so chunks can arrive in any order and a chunk the joiner already has is just skipped:
+ *  sending the same buffer again only fills in what's missing.
+ */
+
+#ifndef CHUNKED_DATA_TRANSFER_H
+#define CHUNKED_DATA_TRANSFER_H
+
+#include "cseries.h"
+#include "network_messages.h"
+
+#include <set>
+#include <vector>
+
+#include <SDL_thread.h>
+#include <SDL_mutex.h>
+
+class ChunkedDataCompressor
+{
+public:
+	// Starts compressing inBuffer, which must outlive this
+	ChunkedDataCompressor(MessageTypeID inDataType, const byte* inBuffer, size_t inLength);
+	~ChunkedDataCompressor();
+
+	size_t chunkCount() const { return mChunks.size(); }
+	size_t chunkOffset(size_t inIndex) const { return inIndex * kChunkSize; }
+
+	// False while a worker is still compressing it
+	bool isChunkReady(size_t inIndex);
+
+	// Once per chunk, when it's ready; compresses it here if there are no workers.
+	// False if zlib failed
+	bool getChunk(size_t inIndex, DataChunkMessage& outMessage);
+
+	enum {
+		kChunkSize = 256 * 1024,
+		kMaximumWorkers = 8
+	};
+
+private:
+	struct Chunk
+	{
+		Chunk() : mReady(false), mCompressed(false), mChecksum(0) { }
+
+		bool mReady;
+		bool mCompressed;
+		uint32 mChecksum;
+		std::vector<byte> mCompressedData;
+	};
+
+	void compressChunk(size_t inIndex, Chunk& outChunk) const;
+
+	static int worker_thread(void*);
+	int Worker();
+
+	MessageTypeID mDataType;
+	const byte* mBuffer;
+	size_t mLength;
+	uint32 mTransferID;
+
+	std::vector<Chunk> mChunks;
+	std::vector<SDL_Thread*> mWorkers;
+
+	// guards mNextChunk, mCancelled and each chunk's mReady
+	SDL_mutex* mMutex;
+	size_t mNextChunk;
+	bool mCancelled;
+};
+
+class ChunkedDataAssembler
+{
+public:
+	ChunkedDataAssembler() : mTransferID(0), mReceivedLength(0) { }
+
+	// Unzips the chunk into place; a chunk from a different transfer starts over.
+	// False (and logged) if the chunk is bad
+	bool add(const DataChunkMessage& inChunk);
+
+	bool complete() const { return !mReceivedOffsets.empty() && mReceivedLength == mBuffer.size(); }
+	size_t receivedLength() const { return mReceivedLength; }
+	size_t totalLength() const { return mBuffer.size(); }
+	const byte* buffer() const { return mBuffer.empty() ? NULL : &mBuffer[0]; }
+
+	void reset();
+
+	enum {
+		// Bigger than any map, physics or Lua the gatherer will send; a chunk
+		// claiming more than this is refused rather than allocated for
+		kMaximumTotalLength = 64 * 1024 * 1024
+	};
+
+private:
+	uint32 mTransferID;
+	std::vector<byte> mBuffer;
+	std::set<uint32> mReceivedOffsets;
+	size_t mReceivedLength;
+};
+
+#endif // CHUNKED_DATA_TRANSFER_H
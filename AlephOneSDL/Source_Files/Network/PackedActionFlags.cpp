@@ -0,0 +1,223 @@
+/*
+ *  PackedActionFlags.cpp
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  See PackedActionFlags.h for the format.
+ */
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "PackedActionFlags.h"
+
+enum {
+	kMaximumGammaBits = 16,		// a run can't be longer than a packet's tick count anyway
+	kMaximumPlayerIndex = 31	// players are bits in a uint32 everywhere else
+};
+
+class BitWriter
+{
+public:
+	BitWriter() : mBitCount(0) {}
+
+	void write(uint32 inValue, int inCount)
+	{
+		for (int i = inCount - 1; i >= 0; i--)
+		{
+			if ((mBitCount & 7) == 0)
+				mBytes.push_back(0);
+			if (inValue & (((uint32)1) << i))
+				mBytes.back() |= 0x80 >> (mBitCount & 7);
+			mBitCount++;
+		}
+	}
+
+	// inValue >= 1
+	void writeGamma(uint32 inValue)
+	{
+		int theBits = 0;
+		while ((inValue >> theBits) > 1)
+			theBits++;
+		write(0, theBits);
+		write(inValue, theBits + 1);
+	}
+
+	std::vector<byte>& bytes() { return mBytes; }
+
+private:
+	std::vector<byte> mBytes;
+	size_t mBitCount;
+};
+
+
+
+void
+PackedActionFlagsWriter::append(size_t inPlayer, action_flags_t inFlags)
+{
+	assert(inPlayer <= kMaximumPlayerIndex);
+
+	Entry theEntry;
+	theEntry.mPlayer = inPlayer;
+	theEntry.mFlags = inFlags;
+	mEntries.push_back(theEntry);
+	mTickHasFlags = true;
+}
+
+
+
+void
+PackedActionFlagsWriter::endTick()
+{
+	if (mTickHasFlags)
+		mTickCount++;
+	mTickHasFlags = false;
+}
+
+
+
+void
+PackedActionFlagsWriter::write(AOStream& outStream) const
+{
+	action_flags_t thePreviousFlags[kMaximumPlayerIndex + 1];
+	uint32 theRepeatsLeft[kMaximumPlayerIndex + 1];
+	obj_clear(thePreviousFlags);
+	obj_clear(theRepeatsLeft);
+
+	BitWriter theBits;
+	for (size_t i = 0; i < mEntries.size(); i++)
+	{
+		size_t thePlayer = mEntries[i].mPlayer;
+		action_flags_t theFlags = mEntries[i].mFlags;
+
+		// Already covered by an earlier run
+		if (theRepeatsLeft[thePlayer] > 0)
+		{
+			theRepeatsLeft[thePlayer]--;
+			continue;
+		}
+
+		action_flags_t theDifference = theFlags ^ thePreviousFlags[thePlayer];
+		if (theDifference == 0)
+		{
+			uint32 theRunLength = 1;
+			for (size_t j = i + 1; j < mEntries.size(); j++)
+			{
+				if (mEntries[j].mPlayer != thePlayer)
+					continue;
+				if (mEntries[j].mFlags != theFlags)
+					break;
+				theRunLength++;
+			}
+
+			theBits.write(0, 1);
+			theBits.writeGamma(theRunLength);
+			theRepeatsLeft[thePlayer] = theRunLength - 1;
+		}
+		else
+		{
+			uint32 theChangedBytes = 0;
+			for (int b = 0; b < 4; b++)
+				if (theDifference & (0xffU << (b * 8)))
+					theChangedBytes |= 1 << b;
+
+			theBits.write(1, 1);
+			theBits.write(theChangedBytes, 4);
+			for (int b = 0; b < 4; b++)
+				if (theChangedBytes & (1 << b))
+					theBits.write((theDifference >> (b * 8)) & 0xff, 8);
+
+			thePreviousFlags[thePlayer] = theFlags;
+		}
+	}
+
+	outStream << mTickCount;
+	if (!theBits.bytes().empty())
+		outStream.write(&theBits.bytes()[0], theBits.bytes().size());
+}
+
+
+
+void
+PackedActionFlagsReader::readFrom(AIStream& inStream)
+{
+	inStream >> mTickCount;
+
+	mBits.resize(inStream.maxg() - inStream.tellg());
+	if (!mBits.empty())
+		inStream.read(&mBits[0], mBits.size());
+
+	mBitPosition = 0;
+	mPreviousFlags.assign(kMaximumPlayerIndex + 1, 0);
+	mRepeatsLeft.assign(kMaximumPlayerIndex + 1, 0);
+}
+
+
+
+uint32
+PackedActionFlagsReader::readBits(int inCount)
+{
+	if (mBitPosition + inCount > mBits.size() * 8)
+		throw AStream::failure("packed action flags ended early");
+
+	uint32 theValue = 0;
+	for (int i = 0; i < inCount; i++, mBitPosition++)
+		theValue = (theValue << 1) | ((mBits[mBitPosition >> 3] >> (7 - (mBitPosition & 7))) & 1);
+
+	return theValue;
+}
+
+
+
+action_flags_t
+PackedActionFlagsReader::read(size_t inPlayer)
+{
+	if (inPlayer > kMaximumPlayerIndex || mPreviousFlags.empty())
+		throw AStream::failure("packed action flags for unknown player");
+
+	if (mRepeatsLeft[inPlayer] > 0)
+	{
+		mRepeatsLeft[inPlayer]--;
+		return mPreviousFlags[inPlayer];
+	}
+
+	if (readBits(1) == 0)
+	{
+		int theBits = 0;
+		while (readBits(1) == 0)
+		{
+			if (++theBits > kMaximumGammaBits)
+				throw AStream::failure("packed action flags have a bad run length");
+		}
+
+		uint32 theRunLength = (((uint32)1) << theBits) | readBits(theBits);
+		mRepeatsLeft[inPlayer] = theRunLength - 1;
+	}
+	else
+	{
+		uint32 theChangedBytes = readBits(4);
+		action_flags_t theDifference = 0;
+		for (int b = 0; b < 4; b++)
+			if (theChangedBytes & (1 << b))
+				theDifference |= readBits(8) << (b * 8);
+
+		mPreviousFlags[inPlayer] ^= theDifference;
+	}
+
+	return mPreviousFlags[inPlayer];
+}
+
+#endif // !defined(DISABLE_NETWORKING)
@@ -0,0 +1,106 @@
+/*
+ *  PackedActionFlags.h
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  The action flags section of the star protocol's packed game data packets ('S2', 'H2', 'F2').
+ *
+ *  Flags are written and read in the same order as the unpacked packets use (tick-major, with
+ *  the same players skipped), so the code walking a packet doesn't change; only where each
+ *  flag comes from does.  Each player's flags are XORed against that player's previous flags
+ *  in the packet, and the difference is written as a bit saying it changed, a nibble saying
+ *  which bytes changed and then just those bytes.  An unchanged flag is a 0 bit followed by
+ *  how many of that player's flags in a row are unchanged (Elias gamma coded), so an idle
+ *  player costs a couple of bytes per packet however many ticks it carries.
+ *
+ *  On the wire: uint16 tick count, then the bits, most significant first, padded to a byte.
+ */
+
+#ifndef PACKED_ACTION_FLAGS_H
+#define PACKED_ACTION_FLAGS_H
+
+#include "cseries.h"
+#include "network_star.h" // action_flags_t
+#include "AStream.h"
+
+#include <vector>
+
+class PackedActionFlagsWriter
+{
+public:
+	PackedActionFlagsWriter() : mTickCount(0), mTickHasFlags(false) {}
+
+	// In the order the receiver will read them
+	void append(size_t inPlayer, action_flags_t inFlags);
+	// Call after each tick's flags; ticks without any don't count
+	void endTick();
+
+	bool empty() const { return mEntries.empty(); }
+	// What the same flags take unpacked, in bytes
+	size_t unpackedSize() const { return mEntries.size() * kActionFlagsSerializedLength; }
+
+	// Throws AStream::failure if they don't fit
+	void write(AOStream& outStream) const;
+
+private:
+	struct Entry
+	{
+		size_t		mPlayer;
+		action_flags_t	mFlags;
+	};
+
+	std::vector<Entry> mEntries;
+	uint16 mTickCount;
+	bool mTickHasFlags;
+};
+
+class PackedActionFlagsReader
+{
+public:
+	PackedActionFlagsReader() : mTickCount(0), mBitPosition(0) {}
+
+	// The packed flags take up the rest of inStream
+	void readFrom(AIStream& inStream);
+
+	int32 tickCount() const { return mTickCount; }
+
+	// Throws AStream::failure if the packet doesn't have it
+	action_flags_t read(size_t inPlayer);
+
+private:
+	uint32 readBits(int inCount);
+
+	std::vector<byte> mBits;
+	std::vector<action_flags_t> mPreviousFlags;
+	std::vector<uint32> mRepeatsLeft;
+	uint16 mTickCount;
+	size_t mBitPosition;
+};
+
+// The next flags in a game data packet: from inReader if it's packed, or straight from ps if not
+static inline action_flags_t
+read_action_flags(AIStream& ps, PackedActionFlagsReader* inReader, size_t inPlayer)
+{
+	if (inReader)
+		return inReader->read(inPlayer);
+
+	action_flags_t theFlags;
+	ps >> theFlags;
+	return theFlags;
+}
+
+#endif // PACKED_ACTION_FLAGS_H
@@ -125,6 +125,20 @@ StarGameProtocol::Sync(NetTopology* inTopology, int32 inSmallestGameTick, size_t
                 theConnectedPlayerStatus[i] = ((sTopology->players[i].identifier != NONE) && !sTopology->players[i].net_dead);
         }
 
+        if(sTopology->dedicated_hub_game != 0)
+        {
+		// Nobody in the game is the hub; we're all spokes of a dedicated one
+		sHubIsLocal = false;
+
+		spoke_initialize(sTopology->dedicated_hub, inSmallestGameTick, sTopology->player_count,
+				 sStarQueues, theConnectedPlayerStatus, inLocalPlayerIndex, false, sTopology->dedicated_hub_game, sTopology->packed_action_flags,
+				 sTopology->dedicated_hub_join_tokens);
+
+		*sNetStatePtr = netActive;
+
+		return true;
+        }
+
         if(inLocalPlayerIndex == inServerPlayerIndex)
         {
 		sHubIsLocal = true;
@@ -140,7 +154,7 @@ StarGameProtocol::Sync(NetTopology* inTopology, int32 inSmallestGameTick, size_t
 		sHubIsLocal = false;
 
         spoke_initialize(sTopology->players[inServerPlayerIndex].ddpAddress, inSmallestGameTick, sTopology->player_count,
-                         sStarQueues, theConnectedPlayerStatus, inLocalPlayerIndex, sHubIsLocal);
+                         sStarQueues, theConnectedPlayerStatus, inLocalPlayerIndex, sHubIsLocal, 0, sTopology->packed_action_flags);
 
         *sNetStatePtr = netActive;
 
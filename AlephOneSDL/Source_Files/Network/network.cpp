@@ -140,6 +140,7 @@ clearly this is all broken until we have packet types
 #include <string.h>
 
 #include <map>
+#include <random>
 #include <vector>
 #include "Logging.h"
 
@@ -151,6 +152,7 @@ clearly this is all broken until we have packet types
 #include "network_data_formats.h"
 
 #include "network_messages.h"
+#include "ChunkedDataTransfer.h"
 
 #include "NetworkGameProtocol.h"
 
@@ -161,7 +163,6 @@ clearly this is all broken until we have packet types
 
 #include "libnat.h"
 
-#include <boost/bind.hpp>
 
 #include "network_metaserver.h"
 
@@ -214,6 +215,8 @@ static std::vector<NetworkStats> sNetworkStats;
 const static NetworkStats sInvalidStats = {
 	NetworkStats::invalid,
 	NetworkStats::invalid,
+	0,
+	0,
 	0
 };
 uint32 last_network_stats_send = 0;
@@ -322,6 +325,8 @@ static int net_compare(void const *p1, void const *p2);
 
 static void NetUpdateTopology(void);
 static void NetDistributeTopology(short tag);
+static void NetChooseDedicatedHub(void);
+static void NetChooseActionFlagsPacking(void);
 
 static bool NetSetSelfSend(bool on);
 
@@ -941,6 +946,51 @@ static void handlePhysicsMessage(BigChunkOfDataMessage *physicsMessage, Communic
 	}
 }
 
+static ChunkedDataAssembler sMapAssembler;
+static ChunkedDataAssembler sPhysicsAssembler;
+static ChunkedDataAssembler sLuaAssembler;
+
+static void handleDataChunkMessage(DataChunkMessage *chunkMessage, CommunicationsChannel *channel) {
+	if (netState != netStartingUp && netState != netDown) {
+		logAnomaly("unexpected data chunk message received (netState is %i)", netState);
+		return;
+	}
+
+	ChunkedDataAssembler *assembler;
+	void (*handler)(BigChunkOfDataMessage *, CommunicationsChannel *);
+	switch (chunkMessage->mDataType) {
+	case kMAP_MESSAGE:
+		assembler = &sMapAssembler;
+		handler = handleMapMessage;
+		break;
+	case kPHYSICS_MESSAGE:
+		assembler = &sPhysicsAssembler;
+		handler = handlePhysicsMessage;
+		break;
+	case kLUA_MESSAGE:
+		assembler = &sLuaAssembler;
+		handler = handleLuaMessage;
+		break;
+	default:
+		logAnomaly("data chunk of unknown type %i received", chunkMessage->mDataType);
+		return;
+	}
+
+	// a bad chunk leaves a hole, so EndGameDataMessage finds the data missing
+	if (!assembler->add(*chunkMessage))
+		return;
+
+	if (assembler == &sMapAssembler)
+		draw_progress_bar(assembler->receivedLength(), assembler->totalLength());
+
+	if (assembler->complete()) {
+		// hand it over as if it had come in one piece
+		BigChunkOfDataMessage wholeMessage(chunkMessage->mDataType, assembler->buffer(), assembler->totalLength());
+		assembler->reset();
+		handler(&wholeMessage, channel);
+	}
+}
+
 /*
 static void handleScriptMessage(ScriptMessage* scriptMessage, CommunicationsChannel*) {
   if (netState == netJoining) {
@@ -1052,6 +1102,7 @@ static TypedMessageHandlerFunction<BigChunkOfDataMessage> luaMessageHandler(&han
 static TypedMessageHandlerFunction<BigChunkOfDataMessage> mapMessageHandler(&handleMapMessage);
 static TypedMessageHandlerFunction<NetworkChatMessage> networkChatMessageHandler(&handleNetworkChatMessage);
 static TypedMessageHandlerFunction<BigChunkOfDataMessage> physicsMessageHandler(&handlePhysicsMessage);
+static TypedMessageHandlerFunction<DataChunkMessage> dataChunkMessageHandler(&handleDataChunkMessage);
  static TypedMessageHandlerFunction<CapabilitiesMessage> capabilitiesMessageHandler(&handleCapabilitiesMessage);
 static TypedMessageHandlerFunction<TopologyMessage> topologyMessageHandler(&handleTopologyMessage);
 static TypedMessageHandlerFunction<ServerWarningMessage> serverWarningMessageHandler(&handleServerWarningMessage);
@@ -1190,12 +1241,14 @@ bool NetEnter(void)
 		inflater->learnPrototype(NetworkChatMessage());
 		inflater->learnPrototype(PhysicsMessage());
 		inflater->learnPrototype(ZippedPhysicsMessage());
+		inflater->learnPrototype(DataChunkMessage());
 		inflater->learnPrototype(CapabilitiesMessage());
 		inflater->learnPrototype(TopologyMessage());
 		inflater->learnPrototype(ChangeColorsMessage());
 		inflater->learnPrototype(ServerWarningMessage());
 		inflater->learnPrototype(ClientInfoMessage());
 		inflater->learnPrototype(NetworkStatsMessage());
+		inflater->learnPrototype(NetworkStatsMessage(true));
 		inflater->learnPrototype(GameSessionMessage());
 	}
   
@@ -1212,11 +1265,13 @@ bool NetEnter(void)
 		joinDispatcher->setHandlerForType(&networkChatMessageHandler, NetworkChatMessage::kType);
 		joinDispatcher->setHandlerForType(&physicsMessageHandler, PhysicsMessage::kType);
 		joinDispatcher->setHandlerForType(&physicsMessageHandler, ZippedPhysicsMessage::kType);
+		joinDispatcher->setHandlerForType(&dataChunkMessageHandler, DataChunkMessage::kType);
 		joinDispatcher->setHandlerForType(&capabilitiesMessageHandler, CapabilitiesMessage::kType);
 		joinDispatcher->setHandlerForType(&serverWarningMessageHandler, ServerWarningMessage::kType);
 		joinDispatcher->setHandlerForType(&clientInfoMessageHandler, ClientInfoMessage::kType);
 		joinDispatcher->setHandlerForType(&topologyMessageHandler, TopologyMessage::kType);
 		joinDispatcher->setHandlerForType(&networkStatsMessageHandler, NetworkStatsMessage::kType);
+		joinDispatcher->setHandlerForType(&networkStatsMessageHandler, NetworkStatsMessage::kWithBandwidthType);
 		joinDispatcher->setHandlerForType(&gameSessionMessageHandler, GameSessionMessage::kType);
 	}
 
@@ -1226,6 +1281,8 @@ bool NetEnter(void)
 	my_capabilities[Capabilities::kSpeex] = Capabilities::kSpeexVersion;
 	if (network_preferences->game_protocol == _network_game_protocol_star) {
 		my_capabilities[Capabilities::kStar] = Capabilities::kStarVersion;
+		my_capabilities[Capabilities::kDedicatedHub] = Capabilities::kDedicatedHubVersion;
+		my_capabilities[Capabilities::kPackedActionFlags] = Capabilities::kPackedActionFlagsVersion;
 	} else {
 		my_capabilities[Capabilities::kRing] = Capabilities::kRingVersion;
 	}
@@ -1234,6 +1291,7 @@ bool NetEnter(void)
 #endif
 	my_capabilities[Capabilities::kGatherable] = Capabilities::kGatherableVersion;
 	my_capabilities[Capabilities::kZippedData] = Capabilities::kZippedDataVersion;
+	my_capabilities[Capabilities::kChunkedData] = Capabilities::kChunkedDataVersion;
 	my_capabilities[Capabilities::kNetworkStats] = Capabilities::kNetworkStatsVersion;
 	my_capabilities[Capabilities::kRugby] = Capabilities::kRugbyVersion;
 
@@ -1567,11 +1625,91 @@ bool NetStart(
                 NetUpdateTopology();
         }
 
+	NetChooseDedicatedHub();
+	NetChooseActionFlagsPacking();
+
 	NetDistributeTopology(resuming_saved_game ? tagRESUME_GAME : tagSTART_GAME);
 
 	return true;
 }
 
+// Hand the star hub off to the dedicated hub in network_preferences, if there is one and
+// everyone can talk to it; otherwise we host it ourselves as usual.
+static void NetChooseDedicatedHub(
+	void)
+{
+	topology->dedicated_hub_game = 0;
+	obj_clear(topology->dedicated_hub);
+	obj_clear(topology->dedicated_hub_join_tokens);
+
+	if (network_preferences->game_protocol != _network_game_protocol_star || network_preferences->dedicated_hub_address[0] == '\0')
+		return;
+
+	for (int i = 0; i < topology->player_count; i++)
+	{
+		if (i == localPlayerIndex || topology->players[i].identifier == NONE)
+			continue;
+
+		client_map_t::iterator it = connections_to_clients.find(topology->players[i].stream_id);
+		if (it == connections_to_clients.end() || it->second->capabilities[Capabilities::kDedicatedHub] < Capabilities::kDedicatedHubVersion)
+		{
+			logWarning("%s can't use a dedicated hub; hosting the game here instead", topology->players[i].player_data.name);
+			return;
+		}
+	}
+
+	std::string theHost = network_preferences->dedicated_hub_address;
+	uint16 thePort = DEFAULT_GAME_PORT;
+	std::string::size_type theColon = theHost.rfind(':');
+	if (theColon != std::string::npos)
+	{
+		thePort = atoi(theHost.c_str() + theColon + 1);
+		theHost.erase(theColon);
+	}
+
+	IPaddress theAddress;
+	if (SDLNet_ResolveHost(&theAddress, theHost.c_str(), thePort) < 0)
+	{
+		logWarning("couldn't resolve dedicated hub %s; hosting the game here instead", network_preferences->dedicated_hub_address);
+		return;
+	}
+
+	// Anyone who can reach the hub can send it a join, so neither the game identifier nor
+	// the join tokens may be guessable
+	std::random_device theRandomDevice;
+	uint32 theGame = 0;
+	while (theGame == 0)
+		theGame = theRandomDevice();
+	for (int i = 0; i < MAXIMUM_NUMBER_OF_NETWORK_PLAYERS; i++)
+		topology->dedicated_hub_join_tokens[i] = theRandomDevice();
+
+	topology->dedicated_hub = theAddress;
+	topology->dedicated_hub_game = theGame;
+	logNote("using dedicated hub %s for game %u", network_preferences->dedicated_hub_address, theGame);
+}
+
+// Packed action flags go both ways between the hub and every spoke, so everyone has to have them
+static void NetChooseActionFlagsPacking(
+	void)
+{
+	topology->packed_action_flags = false;
+
+	if (network_preferences->game_protocol != _network_game_protocol_star)
+		return;
+
+	for (int i = 0; i < topology->player_count; i++)
+	{
+		if (i == localPlayerIndex || topology->players[i].identifier == NONE)
+			continue;
+
+		client_map_t::iterator it = connections_to_clients.find(topology->players[i].stream_id);
+		if (it == connections_to_clients.end() || it->second->capabilities[Capabilities::kPackedActionFlags] < Capabilities::kPackedActionFlagsVersion)
+			return;
+	}
+
+	topology->packed_action_flags = true;
+}
+
 static int net_compare(
 	void const *p1, 
 	void const *p2)
@@ -1998,6 +2136,60 @@ void SetNetscriptStatus (bool status)
         do_netscript = status;
 }
 
+enum {
+	kMaximumQueuedDataChunks = 4,		// per channel, before we let it catch up
+	kDataChunkPumpInterval = 10,		// ms
+	kDataChunkInactivityTimeout = 30000	// ms; a channel this quiet isn't worth waiting for
+};
+
+static bool channels_are_backed_up(const std::vector<CommunicationsChannel *>& channels, Uint32 ticksAtStart)
+{
+	for (std::vector<CommunicationsChannel *>::const_iterator it = channels.begin(); it != channels.end(); ++it)
+	{
+		if ((*it)->isConnected() &&
+		    (*it)->outgoingMessageCount() > kMaximumQueuedDataChunks &&
+		    SDL_GetTicks() - std::max((*it)->ticksAtLastSend(), ticksAtStart) < kDataChunkInactivityTimeout)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Queues buffer for chunkChannels as DataChunkMessages, each one as soon as a worker has
+// compressed it, pumping allChannels meanwhile.  The map's progress bar follows the chunks
+// out the door.
+static void distribute_data_in_chunks(MessageTypeID dataType, const byte *buffer, size_t length,
+				      const std::vector<CommunicationsChannel *>& chunkChannels,
+				      const std::vector<CommunicationsChannel *>& allChannels)
+{
+	Uint32 ticksAtStart = SDL_GetTicks();
+	ChunkedDataCompressor compressor(dataType, buffer, length);
+	for (size_t i = 0; i < compressor.chunkCount(); i++)
+	{
+		while (!compressor.isChunkReady(i) || channels_are_backed_up(chunkChannels, ticksAtStart))
+		{
+			SDL_Delay(kDataChunkPumpInterval);
+			for (std::vector<CommunicationsChannel *>::const_iterator it = allChannels.begin(); it != allChannels.end(); ++it)
+				(*it)->pump();
+		}
+
+		DataChunkMessage chunkMessage;
+		if (!compressor.getChunk(i, chunkMessage))
+		{
+			// the joiners can still take it whole
+			BigChunkOfDataMessage wholeMessage(dataType, buffer, length);
+			CommunicationsChannel::multipleEnqueueOutgoingMessage(chunkChannels, wholeMessage);
+			return;
+		}
+
+		CommunicationsChannel::multipleEnqueueOutgoingMessage(chunkChannels, chunkMessage);
+		if (dataType == kMAP_MESSAGE)
+			draw_progress_bar(compressor.chunkOffset(i) + chunkMessage.mLength, length);
+	}
+}
+
 // ZZZ this "ought" to distribute to all players simultaneously (by interleaving send calls)
 // in case the server bandwidth is much greater than the others' bandwidths.  But that would
 // take a fair amount of reworking of the streaming system, which only groks talking with one
@@ -2028,7 +2220,9 @@ OSErr NetDistributeGameDataToAllPlayers(byte *wad_buffer,
 	// build a list of players to send to
 	std::vector<CommunicationsChannel *> channels;
 
-	// also a list of who and who can not take compressed data
+	// also a list of who can take data in chunks, who can take it compressed, and who
+	// can't take it compressed at all
+	std::vector<CommunicationsChannel *> chunkCapableChannels;
 	std::vector<CommunicationsChannel *> zipCapableChannels;
 	std::vector<CommunicationsChannel *> zipIncapableChannels;
 	for (playerIndex = 0; playerIndex < topology->player_count; playerIndex++)
@@ -2042,7 +2236,11 @@ OSErr NetDistributeGameDataToAllPlayers(byte *wad_buffer,
 		{
 			Client *client = connections_to_clients[player.stream_id];
 			channels.push_back(client->channel);
-			if (client->capabilities[Capabilities::kZippedData] >= my_capabilities[Capabilities::kZippedData])
+			if (client->capabilities[Capabilities::kChunkedData] >= my_capabilities[Capabilities::kChunkedData])
+			{
+				chunkCapableChannels.push_back(client->channel);
+			}
+			else if (client->capabilities[Capabilities::kZippedData] >= my_capabilities[Capabilities::kZippedData])
 			{
 				zipCapableChannels.push_back(client->channel);
 			}
@@ -2060,58 +2258,69 @@ OSErr NetDistributeGameDataToAllPlayers(byte *wad_buffer,
 	
 	if (physics_buffer)
 	{
+		if (chunkCapableChannels.size())
+		{
+			distribute_data_in_chunks(kPHYSICS_MESSAGE, physics_buffer, physics_length, chunkCapableChannels, channels);
+		}
+
 		if (zipCapableChannels.size())
 		{
 			ZippedPhysicsMessage zippedPhysicsMessage(physics_buffer, physics_length);
-			std::auto_ptr<UninflatedMessage> uninflatedMessage(zippedPhysicsMessage.deflate());
-			std::for_each(zipCapableChannels.begin(), zipCapableChannels.end(), boost::bind(&CommunicationsChannel::enqueueOutgoingMessage, _1, *uninflatedMessage));
+			CommunicationsChannel::multipleEnqueueOutgoingMessage(zipCapableChannels, zippedPhysicsMessage);
 		}
 
 		if (zipIncapableChannels.size())
 		{
 			PhysicsMessage physicsMessage(physics_buffer, physics_length);
-			std::for_each(zipIncapableChannels.begin(), zipIncapableChannels.end(), boost::bind(&CommunicationsChannel::enqueueOutgoingMessage, _1, physicsMessage));
+			CommunicationsChannel::multipleEnqueueOutgoingMessage(zipIncapableChannels, physicsMessage);
 		}
 	}
 	
 	{
+		if (chunkCapableChannels.size())
+		{
+			distribute_data_in_chunks(kMAP_MESSAGE, wad_buffer, wad_length, chunkCapableChannels, channels);
+		}
+
 		// send zipped map to anyone who can accept it
 		if (zipCapableChannels.size())
 		{
 			ZippedMapMessage zippedMapMessage(wad_buffer, wad_length);
-			// zipped messages are compressed when deflated
-			// since we may have to send this to multiple joiners,
-			// deflate it now so that compression only happens once
-			std::auto_ptr<UninflatedMessage> uninflatedMessage(zippedMapMessage.deflate());
-			std::for_each(zipCapableChannels.begin(), zipCapableChannels.end(), boost::bind(&CommunicationsChannel::enqueueOutgoingMessage, _1, *uninflatedMessage));
+			// zipped messages are compressed when deflated; this deflates (so compresses)
+			// only once, and every joiner's channel sends from the same copy
+			CommunicationsChannel::multipleEnqueueOutgoingMessage(zipCapableChannels, zippedMapMessage);
 		}
 
 		if (zipIncapableChannels.size())
 		{
 			MapMessage mapMessage(wad_buffer, wad_length);
-			std::for_each(zipIncapableChannels.begin(), zipIncapableChannels.end(), boost::bind(&CommunicationsChannel::enqueueOutgoingMessage, _1, mapMessage));
+			CommunicationsChannel::multipleEnqueueOutgoingMessage(zipIncapableChannels, mapMessage);
 		}
 	}
 
 	if (do_netscript)
 	{
+		if (chunkCapableChannels.size())
+		{
+			distribute_data_in_chunks(kLUA_MESSAGE, deferred_script_data, deferred_script_length, chunkCapableChannels, channels);
+		}
+
 		if (zipCapableChannels.size())
 		{
 			ZippedLuaMessage zippedLuaMessage(deferred_script_data, deferred_script_length);
-			std::auto_ptr<UninflatedMessage> uninflatedMessage(zippedLuaMessage.deflate());
-			std::for_each(zipCapableChannels.begin(), zipCapableChannels.end(), boost::bind(&CommunicationsChannel::enqueueOutgoingMessage, _1, *uninflatedMessage));
+			CommunicationsChannel::multipleEnqueueOutgoingMessage(zipCapableChannels, zippedLuaMessage);
 		}
 
 		if (zipIncapableChannels.size())
 		{
 			LuaMessage luaMessage(deferred_script_data, deferred_script_length);
-			std::for_each(zipIncapableChannels.begin(), zipIncapableChannels.end(), boost::bind(&CommunicationsChannel::enqueueOutgoingMessage, _1, luaMessage));
+			CommunicationsChannel::multipleEnqueueOutgoingMessage(zipIncapableChannels, luaMessage);
 		}
 	}
 
 	{
 		EndGameDataMessage endGameDataMessage;
-		std::for_each(channels.begin(), channels.end(), boost::bind(&CommunicationsChannel::enqueueOutgoingMessage, _1, endGameDataMessage));
+		CommunicationsChannel::multipleEnqueueOutgoingMessage(channels, endGameDataMessage);
 	}
 
 	CommunicationsChannel::multipleFlushOutgoingMessages(channels, false, 30000, 30000);
@@ -2209,6 +2418,11 @@ byte *NetReceiveGameData(bool do_physics)
     
     alert_user(infoError, strNETWORK_ERRORS, netErrMapDistribFailed, 1);
   }
+
+  // anything still half assembled isn't coming
+  sMapAssembler.reset();
+  sPhysicsAssembler.reset();
+  sLuaAssembler.reset();
   
   return map_buffer;
 }
@@ -2244,6 +2458,7 @@ void NetProcessMessagesInGame() {
 			}
 
 			NetworkStatsMessage statsMessage(stats);
+			NetworkStatsMessage bandwidthStatsMessage(stats, true);
 			for (int playerIndex = 0; playerIndex < topology->player_count; ++playerIndex)
 			{
 				NetPlayer player = topology->players[playerIndex];
@@ -2251,6 +2466,10 @@ void NetProcessMessagesInGame() {
 				{
 					Client *client = connections_to_clients[player.stream_id];
 					if (client->capabilities[Capabilities::kNetworkStats] >= Capabilities::kNetworkStatsVersion)
+					{
+						client->channel->enqueueOutgoingMessage(bandwidthStatsMessage);
+					}
+					else if (client->capabilities[Capabilities::kNetworkStats] >= 1)
 					{
 						client->channel->enqueueOutgoingMessage(statsMessage);
 					}
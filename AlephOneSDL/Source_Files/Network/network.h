@@ -300,6 +300,11 @@ struct NetworkStats
 	int16 latency;
 	int16 jitter;
 	uint16 errors;
+
+	// Star game data to and from the player, and what it would have taken without
+	// packed action flags (the same when the player doesn't use them)
+	uint16 bytes_per_tick;
+	uint16 unpacked_bytes_per_tick;
 };
 
 // returns latency in ms, or kNetLatencyInvalid or kNetLatencyDisconnected
@@ -45,8 +45,11 @@ class Capabilities : public capabilities_t
   static const int kSpeexVersion = 1;
   static const int kGatherableVersion = 1;
   static const int kZippedDataVersion = 1; // map, lua, physics
-  static const int kNetworkStatsVersion = 1; // latency, jitter, errors
+  static const int kNetworkStatsVersion = 2; // latency, jitter, errors; 2: bytes/tick
   static const int kRugbyVersion = 1; // sane score limit
+  static const int kDedicatedHubVersion = 2; // star games hosted by --dedicated-hub; 2: join tokens
+  static const int kPackedActionFlagsVersion = 1; // star 'S2'/'H2'/'F2' packets
+  static const int kChunkedDataVersion = 1; // map, lua, physics in DataChunkMessages
 
   static const string kGameworld;    // the PRNG, physics, etc.
   static const string kGameworldM1;  // like gameworld, but for Marathon 1 compatibility
@@ -59,6 +62,9 @@ class Capabilities : public capabilities_t
   static const string kZippedData;   // can receive zipped data
   static const string kNetworkStats; // can receive network stats
   static const string kRugby;        // rugby version
+  static const string kDedicatedHub; // can play through a dedicated star hub
+  static const string kPackedActionFlags; // can send and receive packed star action flags
+  static const string kChunkedData;  // can receive data in separately zipped chunks
   
   uint32& operator[](const string& k) { 
     assert(k.length() < kMaxKeySize);
@@ -30,7 +30,9 @@
 
 enum {
         kOriginalNetworkAudioDistributionTypeID = 0,    // for compatibility with older versions
-        kNewNetworkAudioDistributionTypeID = 1          // new-style realtime network audio data
+        kNewNetworkAudioDistributionTypeID = 1,         // new-style realtime network audio data
+        kLuaHUDStreamDistributionTypeID = 0x4c00,       // 'L' 0: Lua HUD stream channels (Game.stream_send),
+        kLuaHUDStreamChannelCount = 16                  // one type each, counting up from the above
 };
 
 #endif // NETWORK_DISTRIBUTION_TYPES_H
@@ -32,6 +32,11 @@ NETWORK_MESSAGES.CPP
 
 #include <zlib.h>
 
+// Bits of the star options byte that can follow the dedicated hub in a topology
+enum {
+  kTopologyPackedActionFlags = 0x01
+};
+
 static void write_string(AOStream& outputStream, const char *s) {
   outputStream.write(const_cast<char *>(s), strlen(s) + 1);
 }
@@ -144,6 +149,41 @@ UninflatedMessage* BigChunkOfZippedDataMessage::deflate() const
 	return theMessage;
 }
 
+enum { kDataChunkHeaderLength = 2 + 5 * 4 };
+
+bool DataChunkMessage::inflateFrom(const UninflatedMessage& inUninflated)
+{
+	if (inUninflated.length() < kDataChunkHeaderLength)
+		return false;
+
+	AIStreamBE inputStream(inUninflated.buffer(), kDataChunkHeaderLength);
+	inputStream >> mDataType
+		    >> mTransferID
+		    >> mTotalLength
+		    >> mOffset
+		    >> mLength
+		    >> mChecksum;
+
+	mCompressedData.assign(inUninflated.buffer() + kDataChunkHeaderLength, inUninflated.buffer() + inUninflated.length());
+	return true;
+}
+
+UninflatedMessage* DataChunkMessage::deflate() const
+{
+	UninflatedMessage* theMessage = new UninflatedMessage(type(), kDataChunkHeaderLength + mCompressedData.size());
+	AOStreamBE outputStream(theMessage->buffer(), kDataChunkHeaderLength);
+	outputStream << mDataType
+		     << mTransferID
+		     << mTotalLength
+		     << mOffset
+		     << mLength
+		     << mChecksum;
+
+	if (mCompressedData.size())
+		memcpy(theMessage->buffer() + kDataChunkHeaderLength, &mCompressedData[0], mCompressedData.size());
+	return theMessage;
+}
+
 void AcceptJoinMessage::reallyDeflateTo(AOStream& outputStream) const {
   outputStream << (Uint8) mAccepted;
   deflateNetPlayer(outputStream, mPlayer);
@@ -254,6 +294,11 @@ void NetworkStatsMessage::reallyDeflateTo(AOStream& outputStream) const {
 		outputStream << it->latency;
 		outputStream << it->jitter;
 		outputStream << it->errors;
+		if (mWithBandwidth)
+		{
+			outputStream << it->bytes_per_tick;
+			outputStream << it->unpacked_bytes_per_tick;
+		}
 	}
 }
 
@@ -264,6 +309,16 @@ bool NetworkStatsMessage::reallyInflateFrom(AIStream& inputStream) {
 		inputStream >> stats.latency;
 		inputStream >> stats.jitter;
 		inputStream >> stats.errors;
+		if (mWithBandwidth)
+		{
+			inputStream >> stats.bytes_per_tick;
+			inputStream >> stats.unpacked_bytes_per_tick;
+		}
+		else
+		{
+			stats.bytes_per_tick = 0;
+			stats.unpacked_bytes_per_tick = 0;
+		}
 
 		mStats.push_back(stats);
 	}
@@ -318,6 +373,20 @@ void TopologyMessage::reallyDeflateTo(AOStream& outputStream) const {
   for (int i = 0; i < MAXIMUM_NUMBER_OF_NETWORK_PLAYERS; i++) {
     deflateNetPlayer(outputStream, mTopology.players[i]);
   }
+
+  // Only gatherers who've checked that everyone understands it send these
+  if (mTopology.dedicated_hub_game || mTopology.packed_action_flags) {
+    outputStream << mTopology.dedicated_hub_game;
+    outputStream.write((byte *) &mTopology.dedicated_hub.host, 4);
+    outputStream.write((byte *) &mTopology.dedicated_hub.port, 2);
+    if (mTopology.dedicated_hub_game) {
+      for (int i = 0; i < MAXIMUM_NUMBER_OF_NETWORK_PLAYERS; i++)
+        outputStream << mTopology.dedicated_hub_join_tokens[i];
+    }
+  }
+  if (mTopology.packed_action_flags) {
+    outputStream << (uint8) kTopologyPackedActionFlags;
+  }
 }
 
 bool TopologyMessage::reallyInflateFrom(AIStream& inputStream) {
@@ -344,6 +413,30 @@ bool TopologyMessage::reallyInflateFrom(AIStream& inputStream) {
     inflateNetPlayer(inputStream, mTopology.players[i]);
   }
 
+  if (inputStream.tellg() < inputStream.maxg()) {
+    inputStream >> mTopology.dedicated_hub_game;
+    inputStream.read((byte *) &mTopology.dedicated_hub.host, 4);
+    inputStream.read((byte *) &mTopology.dedicated_hub.port, 2);
+  } else {
+    mTopology.dedicated_hub_game = 0;
+    obj_clear(mTopology.dedicated_hub);
+  }
+
+  if (mTopology.dedicated_hub_game) {
+    for (int i = 0; i < MAXIMUM_NUMBER_OF_NETWORK_PLAYERS; i++)
+      inputStream >> mTopology.dedicated_hub_join_tokens[i];
+  } else {
+    obj_clear(mTopology.dedicated_hub_join_tokens);
+  }
+
+  if (inputStream.tellg() < inputStream.maxg()) {
+    uint8 options;
+    inputStream >> options;
+    mTopology.packed_action_flags = (options & kTopologyPackedActionFlags) != 0;
+  } else {
+    mTopology.packed_action_flags = false;
+  }
+
   return true;
 }
 
@@ -52,7 +52,9 @@ enum {
   kZIPPED_PHYSICS_MESSAGE,
   kZIPPED_LUA_MESSAGE,
   kNETWORK_STATS_MESSAGE,
-  kGAME_SESSION_MESSAGE
+  kGAME_SESSION_MESSAGE,
+  kNETWORK_STATS_WITH_BANDWIDTH_MESSAGE,
+  kDATA_CHUNK_MESSAGE
 };
 
 template <MessageTypeID tMessageType, typename tValueType>
@@ -297,6 +299,32 @@ typedef TemplatizedDataMessage<kZIPPED_PHYSICS_MESSAGE, BigChunkOfZippedDataMess
 typedef TemplatizedDataMessage<kLUA_MESSAGE, BigChunkOfDataMessage> LuaMessage;
 typedef TemplatizedDataMessage<kZIPPED_LUA_MESSAGE, BigChunkOfZippedDataMessage> ZippedLuaMessage;
 
+// One piece of a map, physics model or Lua script, compressed on its own so it can be sent
+// as soon as it's ready and unpacked as soon as it arrives (see ChunkedDataTransfer.h)
+class DataChunkMessage : public Message
+{
+public:
+	enum { kType = kDATA_CHUNK_MESSAGE };
+
+	DataChunkMessage() : mDataType(0), mTransferID(0), mTotalLength(0), mOffset(0), mLength(0), mChecksum(0) { }
+
+	bool inflateFrom(const UninflatedMessage& inUninflated);
+	UninflatedMessage* deflate() const;
+	MessageTypeID type() const { return kType; }
+
+	DataChunkMessage* clone() const {
+		return new DataChunkMessage(*this);
+	}
+
+	MessageTypeID mDataType;	// kMAP_MESSAGE, kPHYSICS_MESSAGE or kLUA_MESSAGE
+	uint32 mTransferID;		// the same for every chunk of one buffer
+	uint32 mTotalLength;		// of the whole buffer, uncompressed
+	uint32 mOffset;			// of this chunk in the buffer
+	uint32 mLength;			// of this chunk, uncompressed
+	uint32 mChecksum;		// CRC-32 of this chunk, uncompressed
+	std::vector<byte> mCompressedData;
+};
+
 
 class NetworkChatMessage : public SmallMessageHelper
 {
@@ -343,17 +371,20 @@ class NetworkStatsMessage : public SmallMessageHelper
 {
 public:
 	enum { kType = kNETWORK_STATS_MESSAGE };
+	// Also carries bytes_per_tick; for kNetworkStatsVersion 2 and up
+	enum { kWithBandwidthType = kNETWORK_STATS_WITH_BANDWIDTH_MESSAGE };
 
-	NetworkStatsMessage() : SmallMessageHelper() { }
-	NetworkStatsMessage(const std::vector<NetworkStats>& stats) : SmallMessageHelper(), mStats(stats) { }
+	NetworkStatsMessage(bool withBandwidth = false) : SmallMessageHelper(), mWithBandwidth(withBandwidth) { }
+	NetworkStatsMessage(const std::vector<NetworkStats>& stats, bool withBandwidth = false) : SmallMessageHelper(), mStats(stats), mWithBandwidth(withBandwidth) { }
 
 	NetworkStatsMessage* clone() const {
 		return new NetworkStatsMessage(*this);
 	}
 	
-	MessageTypeID type() const { return kType; }
+	MessageTypeID type() const { return mWithBandwidth ? kWithBandwidthType : kType; }
 
 	std::vector<NetworkStats> mStats;
+	bool mWithBandwidth;
 protected:
 	void reallyDeflateTo(AOStream& outputStream) const;
 	bool reallyInflateFrom(AIStream& inputStream);
@@ -31,34 +31,23 @@
  *
  *  May 28, 2003 (Gregory Smith):
  *	Speex audio compression
+ *
+ *  2026: compression and sending moved to the voice thread (network_voice.cpp); this just
+ *	resamples into frames for it
  */
 
 #if !defined(DISABLE_NETWORKING)
 
 #include    "cseries.h"
-#include    "network_speaker_sdl.h"
-#include    "network_data_formats.h"
-#include    "network_distribution_types.h"
-
-#include	<algorithm>	// for STL pair<> type
+#include    "network_microphone_shared.h"
+#include    "network_voice.h"
 
-#ifdef SPEEX
-#include "speex/speex.h"
-#include "preferences.h"
-#include "network_speex.h"
-#endif
-
-#include "map.h" // _force_unique_teams!
+#include	<algorithm>
 
 using namespace std;
 
-#ifdef DEBUG
-// For testing: don't send audio on the network - pass it directly to network_speaker.
-//#define MICROPHONE_LOCAL_LOOPBACK
-#endif
-
 enum {
-	kNetworkAudioSamplesPerPacket = 800,
+	kNetworkAudioSamplesPerPacket = kNetworkVoiceFramesPerPacket * kNetworkVoiceFrameSamples,
 };
 
 static uint32 sSamplesPerSecond = 0;
@@ -123,21 +112,18 @@ inline int16 getSample(void *data)
 
 #ifdef SPEEX
 template <bool stereo, bool sixteenBit>
-int32 copy_and_speex_encode_template(uint8* outStorage, void* inStorage, int32 inCount)
+void copy_and_queue_frames_template(void* inStorage, int32 inCount)
 {
-	static int16 frame[160];
+	static int16 frame[kNetworkVoiceFrameSamples];
 	static int storedSamples = 0;
-	int bytesWritten = 0;
 
 	while (inCount > 0)
 	{
 		int16 left_sample = getSample<stereo, sixteenBit>(inStorage);
-
 		if (inCount > sNumberOfBytesPerSample)
 		{
 			uint8* data = (uint8 *) inStorage + sNumberOfBytesPerSample;
 			int16 right_sample = getSample<stereo, sixteenBit>(data);
-
 			int32 sample = left_sample + (((right_sample - left_sample) * (counter & 0xffff)) >> 16);
 			frame[storedSamples++] = (int16) sample;
 		}
@@ -145,7 +131,7 @@ int32 copy_and_speex_encode_template(uint8* outStorage, void* inStorage, int32 i
 		{
 			frame[storedSamples++] = left_sample;
 		}
-			
+
 		// advance data
 		counter += rate;
 		if (counter >= 0x10000) 
@@ -156,68 +142,47 @@ int32 copy_and_speex_encode_template(uint8* outStorage, void* inStorage, int32 i
 			inCount -= sNumberOfBytesPerSample * count;
 		}
 
-		if (storedSamples >= 160)
+		if (storedSamples >= kNetworkVoiceFrameSamples)
 		{
-			// encode the frame
-			speex_bits_reset(&gEncoderBits);
-			speex_encode_int(gEncoderState, frame, &gEncoderBits);
-			uint8 nbytes = speex_bits_write(&gEncoderBits, reinterpret_cast<char *>(outStorage) + 1, 200);
-			bytesWritten += nbytes + 1;
-			// first put the size of this frame in storage
-			*(outStorage) = nbytes;
-			outStorage += nbytes + 1;
-
+			// the voice thread encodes and sends it
+			queue_captured_network_voice(frame);
 			storedSamples = 0;
 		}
-		
 	}
-
-	return bytesWritten;
 }
 
-int32 copy_and_speex_encode(uint8* outStorage, void *inStorage, int32 inCount)
+void copy_and_queue_frames(void *inStorage, int32 inCount)
 {
 	if (sStereo) 
 	{
 		if (s16Bit)
 		{
-			return copy_and_speex_encode_template<true, true>(outStorage, inStorage, inCount);
+			copy_and_queue_frames_template<true, true>(inStorage, inCount);
 		}
 		else
 		{
-			return copy_and_speex_encode_template<true, false>(outStorage, inStorage, inCount);
+			copy_and_queue_frames_template<true, false>(inStorage, inCount);
 		}
 	}
 	else
 	{
 		if (s16Bit)
 		{
-			return copy_and_speex_encode_template<false, true>(outStorage, inStorage, inCount);
+			copy_and_queue_frames_template<false, true>(inStorage, inCount);
 		}
 		else
 		{
-			return copy_and_speex_encode_template<false, false>(outStorage, inStorage, inCount);
+			copy_and_queue_frames_template<false, false>(inStorage, inCount);
 		}
 	}
 }
-
-static void
-send_audio_data(void* inData, short inSize) {
-#ifdef MICROPHONE_LOCAL_LOOPBACK
-#include "network_sound.h"
-    received_network_audio_proc(inData, inSize, 0);
-#else
-    NetDistributeInformation(kNewNetworkAudioDistributionTypeID, inData, inSize, false, !(GET_GAME_OPTIONS() & _force_unique_teams));
-#endif
-}
-
 #endif
 
 int32
 copy_and_send_audio_data(uint8* inFirstChunkReadPosition, int32 inFirstChunkBytesRemaining,
                          uint8* inSecondChunkReadPosition, int32 inSecondChunkBytesRemaining,
                          bool inForceSend) {
-                         
+
     // Make sure the capture format has been announced to us
     assert(sSamplesPerSecond > 0);
 
@@ -234,73 +199,15 @@ copy_and_send_audio_data(uint8* inFirstChunkReadPosition, int32 inFirstChunkByte
     }
 
 #ifdef SPEEX
-    // Let runtime system worry about allocating and freeing the buffer (and don't do it on the stack).
-    // assume Speex will not encode kNetworkAudioSamplesPerPacket samples to be larger than kNetworkAudioSamplesPerPacket * kNetworkAudioBytesPerFrame!
-    static uint8 sOutgoingPacketBuffer[kNetworkAudioSamplesPerPacket * kNetworkAudioBytesPerFrame + SIZEOF_network_audio_header];
+	// Take whole packets' worth, unless we're squeezing out the last drop
+	int32 theTotalCaptureBytesConsumed = inFirstChunkBytesRemaining + inSecondChunkBytesRemaining;
+	if (!inForceSend)
+		theTotalCaptureBytesConsumed -= theTotalCaptureBytesConsumed % sCaptureBytesPerPacket;
 
-    network_audio_header    theHeader;
-    theHeader.mReserved = 1;
-	theHeader.mFlags    = 0;
+	int32 theFirstChunkBytesConsumed = std::min(inFirstChunkBytesRemaining, theTotalCaptureBytesConsumed);
+	copy_and_queue_frames(inFirstChunkReadPosition, theFirstChunkBytesConsumed);
+	copy_and_queue_frames(inSecondChunkReadPosition, theTotalCaptureBytesConsumed - theFirstChunkBytesConsumed);
 
-	network_audio_header_NET*   theHeader_NET = (network_audio_header_NET*) sOutgoingPacketBuffer;
-	
-	netcpy(theHeader_NET, &theHeader);
-	
-	uint8*   theOutgoingAudioData = &sOutgoingPacketBuffer[SIZEOF_network_audio_header];
-	
-	// Do the copying and sending
-	pair<int32, int32>  theBytesConsumed;
-	int32 theTotalCaptureBytesConsumed = 0;
-	
-	// Keep sending if we have data and either we're squeezing out the last drop or we have a packet's-worth.
-	while(inFirstChunkBytesRemaining >= static_cast<int32>(sNumberOfBytesPerSample) &&
-	      (inForceSend || inFirstChunkBytesRemaining + inSecondChunkBytesRemaining >= (int32)sCaptureBytesPerPacket)) {
-		
-		int captureBytesToCopy = std::min(inFirstChunkBytesRemaining, sCaptureBytesPerPacket);
-		int bytesCopied = copy_and_speex_encode(theOutgoingAudioData, inFirstChunkReadPosition, captureBytesToCopy);
-		
-		theTotalCaptureBytesConsumed += captureBytesToCopy;
-		
-		// If there's space left in the packet and we have a second chunk, start on it.
-		if(captureBytesToCopy < sCaptureBytesPerPacket && inSecondChunkBytesRemaining > 0) {
-			int secondCaptureBytesToCopy = std::min(sCaptureBytesPerPacket - captureBytesToCopy, inSecondChunkBytesRemaining);
-			
-			int secondBytesCopied = copy_and_speex_encode(&theOutgoingAudioData[bytesCopied], inSecondChunkReadPosition, secondCaptureBytesToCopy);
-			theTotalCaptureBytesConsumed += secondCaptureBytesToCopy;
-			
-			send_audio_data((void *) sOutgoingPacketBuffer,
-					SIZEOF_network_audio_header + bytesCopied + secondBytesCopied);
-			
-			// Update the second chunk position and length
-			inSecondChunkReadPosition += secondCaptureBytesToCopy;
-			inSecondChunkBytesRemaining -= secondCaptureBytesToCopy;
-		}
-		// Else, either we've filled up a packet or exhausted the buffer (or both).
-		else {
-			send_audio_data((void *) sOutgoingPacketBuffer, SIZEOF_network_audio_header + bytesCopied);
-		}
-		
-		// Update the first chunk position and length
-		inFirstChunkReadPosition += captureBytesToCopy;
-		inFirstChunkBytesRemaining -= captureBytesToCopy;
-    }
-	
-	// Now, the first chunk is exhausted.  See if there's any left in the second chunk.  Same rules apply.
-	while(inSecondChunkBytesRemaining >= static_cast<int32>(sNumberOfBytesPerSample) &&
-	      (inForceSend || inSecondChunkBytesRemaining >= (int32) sCaptureBytesPerPacket)) {
-		
-		int captureBytesToCopy = std::min(inSecondChunkBytesRemaining, sCaptureBytesPerPacket);
-		
-		int bytesCopied = copy_and_speex_encode(theOutgoingAudioData, inSecondChunkReadPosition, captureBytesToCopy);
-		
-		theTotalCaptureBytesConsumed += captureBytesToCopy;
-		
-		send_audio_data((void *) sOutgoingPacketBuffer, SIZEOF_network_audio_header + bytesCopied);
-		
-		inSecondChunkReadPosition += captureBytesToCopy;
-		inSecondChunkBytesRemaining -= captureBytesToCopy;
-	}
-	
 	return theTotalCaptureBytesConsumed;
 #else
 	return inFirstChunkBytesRemaining + inSecondChunkBytesRemaining; // eat the entire thing, we only support speex
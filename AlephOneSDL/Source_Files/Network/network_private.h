@@ -211,6 +211,15 @@ struct NetTopology
   game_info game_data;
 	
 	struct NetPlayer players[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+
+	// Nonzero when the star hub is a dedicated hub at dedicated_hub rather than the server player
+	uint32 dedicated_hub_game;
+	NetAddrBlock dedicated_hub;
+	// With a dedicated hub, the secret each player shows it to take their slot
+	uint32 dedicated_hub_join_tokens[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+
+	// Everyone can use the packed star game data packets
+	bool packed_action_flags;
 };
 typedef struct NetTopology NetTopology, *NetTopologyPtr;
 
@@ -43,9 +43,6 @@ void network_speaker_idle_proc();
 // Called by main thread to shut down network speaker system
 void close_network_speaker();
 
-// Called by received_network_audio_proc, but also available to others
-void queue_network_speaker_data(byte* inData, short inLength);
-
 // Called by network routines to store incoming network audio for playback
 void received_network_audio_proc(void *buffer, short buffer_size, short player_index);
 
@@ -31,6 +31,9 @@
  *
  *  14 January 2003 (Woody Zenfell): reworked memory management so all new/delete are called
  *      from the main thread: buffers are released by the audio system and returned to us for reuse.
+ *
+ *  2026: the buffers are now frames mixed by the voice thread (network_voice.cpp), taken straight
+ *      from its lock-free output ring and released back to it.
  */
 
 #if !defined(DISABLE_NETWORKING)
@@ -38,36 +41,19 @@
 #include    "network_sound.h"
 #include    "network_speaker_sdl.h"
 
-#include    "network_distribution_types.h"
-#include    "CircularQueue.h"
+#include    "network_voice.h"
 #include    "world.h"   // local_random()
 #include "Mixer.h"
 
-#ifdef SPEEX
-#include "network_speex.h"
-#endif //def SPEEX
-
 enum {
-    kSoundBufferQueueSize = 32,     // should never get anywhere near here, but at 12 bytes/struct these are cheap.
     kNoiseBufferSize = 1280 * 2,        // how big a buffer we should use for noise (at 11025 this is about 1/9th of a second)
-    kMaxDryDequeues = 1,            // how many consecutive empty-buffers before we stop playing?
-    kNumPumpPrimes = 1,             // how many noise-buffers should we start with while buffering incoming data?
-    kNumSoundDataBuffers = 8,		// how many actual audio storage buffers should we have?
-    kSoundDataBufferSize = 2048 * 2		// how big will each audio storage buffer be?
+    kMaxDryDequeues = 1             // how many consecutive empty-buffers before we stop playing?
 };
 
-// "Send queue" of buffers from us to audio code (with descriptors)
-static  CircularQueue<NetworkSpeakerSoundBufferDescriptor>    sSoundBuffers(kSoundBufferQueueSize);
-
-// "Return queue" of buffers from audio code to us for reuse
-static	CircularQueue<byte*>				sSoundDataBuffers(kNumSoundDataBuffers + 2);  // +2: breathing room
-
 // We can provide static noise instead of a "real" buffer once in a while if we need to.
-// Also, we provide kNumPumpPrimes of static noise before getting to the "meat" as well.
 static  byte*                       		sNoiseBufferStorage = NULL;
 static  NetworkSpeakerSoundBufferDescriptor	sNoiseBufferDesc;
 static  int                         		sDryDequeues = 0;
-static  bool                        		sSpeakerIsOn = false;
 
 
 OSErr
@@ -89,65 +75,20 @@ open_network_speaker() {
     sNoiseBufferDesc.mLength    = kNoiseBufferSize;
     sNoiseBufferDesc.mFlags     = 0;
 
-    // Reset the buffer descriptor queue
-    sSoundBuffers.reset();
-    
-    // Reset the data buffer queue
-    sSoundDataBuffers.reset();
-    
-    // Allocate storage for audio data buffers
-    for(int i = 0; i < kNumSoundDataBuffers; i++) {
-        byte* theBuffer = new byte[kSoundDataBufferSize];
-        sSoundDataBuffers.enqueue(theBuffer);
-    }
-
-    // Reset a couple others to sane values
     sDryDequeues    = 0;
-    sSpeakerIsOn    = false;
-    
-#ifdef SPEEX
-        init_speex_decoder();
-#endif
-    
-    return 0;
-}
 
-void
-queue_network_speaker_data(byte* inData, short inLength) {
-    if(inLength > 0) {
-        if(sSoundDataBuffers.getCountOfElements() > 0) {
-            // Fill out a descriptor for a new chunk of storage
-            NetworkSpeakerSoundBufferDescriptor theBufferDesc;
-            theBufferDesc.mData     = sSoundDataBuffers.peek();
-            sSoundDataBuffers.dequeue();
-            theBufferDesc.mLength   = inLength;
-            theBufferDesc.mFlags    = kSoundDataIsDisposable;
-    
-            // and copy the data
-            memcpy(theBufferDesc.mData, inData, inLength);
-    
-            // If we're just turning on, prime the queue with a few buffers of noise.
-            if(!sSpeakerIsOn) {
-                for(int i = 0; i < kNumPumpPrimes; i++) {
-                    sSoundBuffers.enqueue(sNoiseBufferDesc);
-                }
-    
-                sSpeakerIsOn = true;
-            }
-    
-            // Enqueue the actual sound data.
-            sSoundBuffers.enqueue(theBufferDesc);
-        }
-        else {
-            fdprintf("No sound data buffer space available - audio discarded");
-        }
-    }
+    // Decoding, jitter buffering and mixing happen on the voice thread; we just play the result
+    start_network_voice();
+
+    return 0;
 }
 
 
 void
 network_speaker_idle_proc() {
-    if(sSpeakerIsOn)
+    send_network_voice_packets();
+
+    if(network_voice_frames_waiting())
 	    Mixer::instance()->EnsureNetworkAudioPlaying();
 }
 
@@ -157,20 +98,20 @@ dequeue_network_speaker_data() {
     // We need this to stick around between calls
     static NetworkSpeakerSoundBufferDescriptor    sBufferDesc;
 
-    // If there is actual sound data, reset the "ran dry" count and return a pointer to the buffer descriptor
-    if(sSoundBuffers.getCountOfElements() > 0) {
+    // If there is a mixed frame, reset the "ran dry" count and return a pointer to the buffer descriptor
+    byte* theFrame = take_network_voice_frame();
+    if(theFrame != NULL) {
         sDryDequeues = 0;
-        sBufferDesc = sSoundBuffers.peek();
-        sSoundBuffers.dequeue();
+        sBufferDesc.mData   = theFrame;
+        sBufferDesc.mLength = kNetworkVoiceFrameBytes;
+        sBufferDesc.mFlags  = kSoundDataIsDisposable;
         return &sBufferDesc;
     }
     // If there's no data available, inc the "ran dry" count and return either a noise buffer or NULL.
     else {
         sDryDequeues++;
-        if(sDryDequeues > kMaxDryDequeues) {
-            sSpeakerIsOn = false;
+        if(sDryDequeues > kMaxDryDequeues)
             return NULL;
-        }
         else
             return &sNoiseBufferDesc;
     }
@@ -182,19 +123,7 @@ close_network_speaker() {
     // Tell the audio system not to get our data anymore
 	Mixer::instance()->StopNetworkAudio();
 
-    // Bleed the queue dry of any leftover data
-    NetworkSpeakerSoundBufferDescriptor*  theDesc;
-    while((theDesc = dequeue_network_speaker_data()) != NULL) {
-        if(is_sound_data_disposable(theDesc))
-            release_network_speaker_buffer(theDesc->mData);
-    }
-    
-    // Free the sound data buffers
-    while(sSoundDataBuffers.getCountOfElements() > 0) {
-        byte* theBuffer = sSoundDataBuffers.peek();
-        delete [] theBuffer;
-        sSoundDataBuffers.dequeue();
-    }
+    stop_network_voice();
 
     // Free the noise buffer and restore some values
     if(sNoiseBufferStorage != NULL) {
@@ -202,18 +131,13 @@ close_network_speaker() {
         sNoiseBufferStorage = NULL;
     }
     sDryDequeues    = 0;
-    sSpeakerIsOn    = false;
-    
-    #ifdef SPEEX
-    destroy_speex_decoder();
-    #endif
 }
 
 
 
 void
-release_network_speaker_buffer(byte* inBuffer) {
-    sSoundDataBuffers.enqueue(inBuffer);
+release_network_speaker_buffer(byte*) {
+    release_network_voice_frame();
 }
 
 #endif // !defined(DISABLE_NETWORKING)
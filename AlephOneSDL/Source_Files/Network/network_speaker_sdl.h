@@ -60,11 +60,11 @@ is_sound_data_disposable(NetworkSpeakerSoundBufferDescriptor* inBuffer) {
 
 
 // Called by sound playback routines to get incoming network audio
-// (also called by main thread in close_network_speaker())
+// (also called by main thread to start the network audio channel)
 // Calling this invalidates the pointer returned the previous call.
 NetworkSpeakerSoundBufferDescriptor* dequeue_network_speaker_data();
 
-// Called by sound playback routines to return storage-buffers to the freequeue
+// Called by sound playback routines to return storage-buffers to the voice thread, oldest first
 void release_network_speaker_buffer(byte* inBuffer);
 
 #endif // NETWORK_SPEAKER_SDL_H
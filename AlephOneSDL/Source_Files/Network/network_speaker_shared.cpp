@@ -31,6 +31,8 @@
  *
  *  May 28, 2003 (Gregory Smith):
  *	Speex audio decompression 
+ *
+ *  2026: decompression moved to the voice thread (network_voice.cpp)
  */
 
 #if !defined(DISABLE_NETWORKING)
@@ -41,11 +43,7 @@
 #include "network_audio_shared.h"
 #include "player.h"
 #include "shell.h" // screen_print
-
-#ifdef SPEEX
-#include "speex/speex.h"
-#include "network_speex.h"
-#endif
+#include "network_voice.h"
 
 #include <set>
 
@@ -63,39 +61,16 @@ received_network_audio_proc(void *buffer, short buffer_size, short player_index)
 
 	netcpy(&theHeader, theHeader_NET);
 
-#ifdef SPEEX
 	byte* theSoundData = ((byte*)buffer) + sizeof(network_audio_header_NET);
-#endif
 
 	// 0 if using uncompressed audio, 1 if using speex
 	if(!(theHeader.mFlags & kNetworkAudioForTeammatesOnlyFlag) || (local_player->team == get_player_data(player_index)->team)) 
 	{
-#ifdef SPEEX
 		if (theHeader.mReserved == 1) 
 		{
-			
-			// decode the data
-			const int max_frames = 2048 / 160;
-			static int16 frames[max_frames][160];
-			int nbytes;
-
-			int numFrames = 0;
-			while (theSoundData < static_cast<byte*>(buffer) + buffer_size && 
-			       numFrames < max_frames)
-			{
-				// decode a frame
-				nbytes = *theSoundData++;
-
-				speex_bits_read_from(&gDecoderBits, (char *) theSoundData, nbytes);
-				speex_decode_int(gDecoderState, &gDecoderBits, frames[numFrames]);
-
-				numFrames++;
-				theSoundData += nbytes;
-			}
-
-			queue_network_speaker_data((byte *) frames[0], 160 * 2 * numFrames);
+			// the voice thread decodes it when it's due to be played
+			queue_received_network_voice(player_index, theSoundData, static_cast<byte*>(buffer) + buffer_size - theSoundData);
 		}
-#endif
 	}
 }
 
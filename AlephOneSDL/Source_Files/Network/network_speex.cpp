@@ -32,14 +32,20 @@
 #include "preferences.h"
 
 #include <speex/speex_preprocess.h>
+#include <SDL_mutex.h>
 
 void *gEncoderState = 0;
 SpeexBits gEncoderBits;
 SpeexPreprocessState *gPreprocessState = 0;
-void *gDecoderState = 0;
-SpeexBits gDecoderBits;
+
+// Created with the first encoder and kept for good
+static SDL_mutex* sEncoderMutex = NULL;
 
 void init_speex_encoder() {
+    if (!sEncoderMutex)
+        sEncoderMutex = SDL_CreateMutex();
+
+    SDL_LockMutex(sEncoderMutex);
     if (!gEncoderState) {
         gEncoderState = speex_encoder_init(&speex_nb_mode);
 	int quality = 3; // 8000 bps
@@ -63,10 +69,14 @@ void init_speex_encoder() {
 	float agc_level = 32768.0 * 0.7;
 	speex_preprocess_ctl(gPreprocessState, SPEEX_PREPROCESS_SET_AGC_LEVEL, &agc_level);
     }
-    
+    SDL_UnlockMutex(sEncoderMutex);
 }
 
 void destroy_speex_encoder() {
+    if (!sEncoderMutex)
+        return;
+
+    SDL_LockMutex(sEncoderMutex);
     if (gEncoderState != NULL) {
         speex_encoder_destroy(gEncoderState);
         speex_bits_destroy(&gEncoderBits);
@@ -78,25 +88,36 @@ void destroy_speex_encoder() {
 	    speex_preprocess_state_destroy(gPreprocessState);
 	    gPreprocessState = 0;
     }
+    SDL_UnlockMutex(sEncoderMutex);
 }
 
-void init_speex_decoder() {
-    if (gDecoderState == NULL) {
-        gDecoderState = speex_decoder_init(&speex_nb_mode);
-        int tmp = 1;
-        speex_decoder_ctl(gDecoderState, SPEEX_SET_ENH, &tmp);
-        tmp = kNetworkAudioSampleRate;
-        speex_decoder_ctl(gDecoderState, SPEEX_SET_SAMPLING_RATE, &tmp);
-        speex_bits_init(&gDecoderBits);
+int speex_encode_frame(int16* inFrame, char* outStorage, int inMaximumBytes) {
+    if (!sEncoderMutex)
+        return 0;
+
+    int theLength = 0;
+    SDL_LockMutex(sEncoderMutex);
+    if (gEncoderState != NULL) {
+        speex_bits_reset(&gEncoderBits);
+        speex_encode_int(gEncoderState, inFrame, &gEncoderBits);
+        theLength = speex_bits_write(&gEncoderBits, outStorage, inMaximumBytes);
     }
+    SDL_UnlockMutex(sEncoderMutex);
+    return theLength;
 }
 
-void destroy_speex_decoder() {
-    if (gDecoderState != NULL) {
-        speex_decoder_destroy(gDecoderState);
-        speex_bits_destroy(&gDecoderBits);
-        gDecoderState = NULL;
-    }
+void* create_speex_decoder() {
+    void* theDecoder = speex_decoder_init(&speex_nb_mode);
+    int tmp = 1;
+    speex_decoder_ctl(theDecoder, SPEEX_SET_ENH, &tmp);
+    tmp = kNetworkAudioSampleRate;
+    speex_decoder_ctl(theDecoder, SPEEX_SET_SAMPLING_RATE, &tmp);
+    return theDecoder;
+}
+
+void destroy_speex_decoder(void* inDecoder) {
+    if (inDecoder != NULL)
+        speex_decoder_destroy(inDecoder);
 }
 
 #endif //def SPEEX
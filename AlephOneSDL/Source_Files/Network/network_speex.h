@@ -34,14 +34,20 @@
 // encoder
 extern void *gEncoderState;
 extern SpeexBits gEncoderBits;
-extern void *gDecoderState;
-extern SpeexBits gDecoderBits;
 extern SpeexPreprocessState* gPreprocessState;
 
+// The microphone code sets the encoder up and tears it down while the voice thread may be
+// using it, so these are serialized with speex_encode_frame()
 void init_speex_encoder();
 void destroy_speex_encoder();
-void init_speex_decoder();
-void destroy_speex_decoder();
+
+// Encodes a frame of kNetworkVoiceFrameSamples into outStorage; returns the number of bytes
+// written (at most inMaximumBytes), or 0 if there is no encoder
+int speex_encode_frame(int16* inFrame, char* outStorage, int inMaximumBytes);
+
+// decoders, one per player talking to us
+void* create_speex_decoder();
+void destroy_speex_decoder(void* inDecoder);
 #endif //def SPEEX
 
 #endif
@@ -51,9 +51,15 @@ enum {
 	kSpokeToHubGameDataPacketV1Magic = 0x5331, // 'S1'
 	kHubToSpokeGameDataPacketV1Magic = 0x4831, // 'H1'
 	kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic = 0x4631, // 'F1'
+	// V1 with the action flags packed (see PackedActionFlags.h)
+	kSpokeToHubGameDataPacketV2Magic = 0x5332, // 'S2'
+	kHubToSpokeGameDataPacketV2Magic = 0x4832, // 'H2'
+	kHubToSpokeGameDataPacketWithSpokeFlagsV2Magic = 0x4632, // 'F2'
 	kPingRequestPacket = 0x5051, // 'PQ'
 	kPingResponsePacket = 0x5052, // 'PR'
   kSpokeToHubPositionSyncSum = 0x5059, // 'PY'
+  kSpokeToHubWorldHash = 0x5748, // 'WH'
+	kSpokeToHubJoinGame = 0x4a47, // 'JG' - identification for a dedicated hub
   
   kPregameTicks = TICKS_PER_SECOND * 3,	// Synchronization/timing adjustment before real data
   kActionFlagsSerializedLength = 4,	// bytes for each serialized action_flags_t (should be elsewhere)
@@ -75,7 +81,9 @@ extern void DefaultHubPreferences();
 extern InfoTree HubPreferencesTree();
 extern void HubParsePreferencesTree(InfoTree prefs, std::string version);
 
-extern void spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnectedStatus[], size_t inLocalPlayerIndex, bool inHubIsLocal);
+// inDedicatedHubGame is nonzero when inHubAddress is a dedicated hub hosting that game, and
+// inDedicatedHubJoinTokens then has each player's token for joining it
+extern void spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnectedStatus[], size_t inLocalPlayerIndex, bool inHubIsLocal, uint32 inDedicatedHubGame = 0, bool inPackedActionFlags = false, const uint32* inDedicatedHubJoinTokens = NULL);
 extern void spoke_cleanup(bool inGraceful);
 extern void spoke_received_network_packet(DDPPacketBufferPtr inPacket);
 extern int32 spoke_get_net_time();
@@ -93,4 +101,10 @@ extern InfoTree SpokePreferencesTree();
 extern void SpokeParsePreferencesTree(InfoTree prefs, std::string version);
 extern void capture_position_sums_and_check_for_dsync();
 
+// Runs hubs for any number of games on one UDP port until interrupted; returns an exit status
+extern int run_dedicated_star_hub(uint16 inPort);
+
+// Runs a hub and spokes over simulated links (see network_star_stress.cpp) and prints what happened
+extern int run_star_stress_test(const char* inOptions);
+
 #endif // NETWORK_STAR_H
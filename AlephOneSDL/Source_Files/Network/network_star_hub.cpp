@@ -40,11 +40,18 @@
  *	NAT-friendly networking - we no longer get spoke addresses form topology -
  *	instead spokes send identification packets to hub with player ID.
  *	Hub can then associate the ID in the identification packet with the paket's source address.
+ *
+ *  The hub's state now lives in a StarHub, so a dedicated hub can run one for each of many
+ *  games (see network_star_hub_dedicated.cpp); the hub_* functions below run the one for the
+ *  game we're playing.
+ *
+ *  2026: lossy byte streams go through a LossyByteStreamMultiplexer (network_star_lossy.h), so
+ *  a packet carries as many chunks as fit, by stream priority, rather than one.
  */
 
 #if !defined(DISABLE_NETWORKING)
 
-#include "network_star.h"
+#include "network_star_hub.h"
 
 //#include "sdl_network.h"
 #include "TickBasedCircularQueue.h"
@@ -53,7 +60,6 @@
 #include "AStream.h"
 #include "Logging.h"
 #include "WindowedNthElementFinder.h"
-#include "CircularByteBuffer.h"
 #include "InfoTree.h"
 #include "SDL_timer.h" // SDL_Delay()
 
@@ -67,11 +73,14 @@
 #include <iomanip>
 
 #include "crc.h"
+#include "PackedActionFlags.h"
 #include "player.h" // for masking out action flags triggers :(
 #include "shell.h" //only for doing screen_printf
 #include "preferences.h"
+#include "world_hash.h"
 
-// Synchronization:
+// Synchronization (for the hub of the game we're playing; a dedicated hub runs all of its
+// StarHubs from a single thread):
 // hub_received_network_packet() is not reentrant
 // hub_tick() is not reentrant
 // hub_tick() and hub_received_network_packet() are mutex
@@ -130,7 +139,6 @@ static NetworkState sNetworkState;
 
 
 enum {
-	kFlagsQueueSize = TICKS_PER_SECOND * 5,
         kDefaultPregameWindowSize = TICKS_PER_SECOND / 2,
         kDefaultInGameWindowSize = TICKS_PER_SECOND * 5,
 	kDefaultPregameNthElement = 2,
@@ -141,9 +149,6 @@ enum {
 	kDefaultSendPeriod = 1,
         kDefaultRecoverySendPeriod = TICKS_PER_SECOND / 2,
 	kDefaultMinimumSendPeriod = 5,
-	kLossyByteStreamDataBufferSize = 1280,
-	kTypicalLossyByteStreamChunkSize = 56,
-	kLossyByteStreamDescriptorCount = kLossyByteStreamDataBufferSize / kTypicalLossyByteStreamChunkSize,
 
 	kLatencyBufferSize = TICKS_PER_SECOND * 5, // store 5 seconds of ping counts
 	kDisplayLatencyWindow = TICKS_PER_SECOND * 1, // display last second's ping
@@ -163,226 +168,67 @@ struct HubPreferences {
 	int32	mRecoverySendPeriod;
 	int32   mMinimumSendPeriod;
 	bool    mBandwidthReduction;
+	bool    mAdaptiveTiming;
 };
 
+// Shared by every StarHub in the process
 static HubPreferences sHubPreferences;
 
-  //The number of ticks to wait for position sum verfication. The player gets a desync strike if position is not verified upon wraparound.
-#define numPositionSnapshots 100
-
-struct positionSumSnapshot {
-  int32 positionSum[8];
-};
-static positionSumSnapshot positionRecords[numPositionSnapshots];
-static int currentSnapshotIndex;
-static bool playerIsOutOfSync[8];
-static int32 positionOfInterest[8];
-static int32 desyncCountdown[8];
-static int32 desyncStrikes[8];
-
 int32& hub_get_minimum_send_period() { return sHubPreferences.mMinimumSendPeriod; }
 
 void hub_set_minimum_send_period(int32 new_minimum) { sHubPreferences.mMinimumSendPeriod = new_minimum; }
 
-// sNetworkTicker advances even if the game clock doesn't.
-// sLastNetworkTickSent is used to force us to resend packets (at a lower rate) even if we're no longer
-// getting new data.
-static int32 sNetworkTicker;
-static int32 sLastNetworkTickSent;
-
-// We have a pregame startup period to help establish (via standard adjustment mechanism) everyone's
-// timing.  Ticks smaller than sSmallestRealGameTick are part of this startup period.  They smell
-// just like real in-game ticks, except that spokes won't enqueue them on player_queues, and we
-// may have different adjustment window sizes and timeout periods for pre-game and in-game ticks.
-static int32 sSmallestRealGameTick;
-
-// Once everyone ACKs this tick, we're satisfied the game is ended.  (They should all agree on which
-// tick is last due to the symmetric execution model.)
-static int32 sSmallestPostGameTick;
-
-// The sFlagsQueues hold all flags for ticks for which we've received data from at least one
-// station, but for which we haven't received an ACK from all stations.
-// sFlagsQueues[all].getReadIndex() == sPlayerDataDisposition.getReadIndex();
-// max(sFlagsQueues[all].getWriteIndex()) == sPlayerDataDisposition.getWriteIndex();
-// min(sFlagsQueues[all].getWriteIndex()) == sSmallestIncompleteTick;
-typedef std::vector<TickBasedActionQueue> TickBasedActionQueueCollection;
-static TickBasedActionQueueCollection	sFlagsQueues;
-
-// tracks the net ticks each flags tick was *first* sent out at
-static ConcreteTickBasedCircularQueue<int32> sFlagSendTimeQueue(kFlagsQueueSize);
-static int32 sLastRealUpdate;
-
-struct NetworkPlayer_hub {
-        NetAddrBlock	mAddress;		// network address of player
-	bool		mAddressKnown;		// did player tell us his address yet?
-        bool		mConnected;		// is player still connected?
-        int32		mLastNetworkTickHeard;	// our sNetworkTicker last time we got a packet from them
-        int32		mSmallestUnacknowledgedTick;
-
-	WindowedNthElementFinder<int32>	mNthElementFinder;
-	// We can "hear" ticks that we can't enqueue - this is useful for timing data.
-	int32		mSmallestUnheardTick;
-
-        // When we decide a timing adjustment is needed, we include the timing adjustment
-        // request in every packet outbound to the player until we're sure he's seen it.
-        // In particular, mTimingAdjustmentTick is set to the sSmallestIncompleteTick, so we
-        // know nobody's received data for that tick yet.  We continue to send the message
-        // until the station ACKs past that tick; at that point we know he must have seen
-        // our message.
-        // When we get that ACK, we clear the window and let it fill up again to make sure
-        // we have clean, fresh, post-adjustment data to work from.  We won't make any new
-        // timing adjustment requests to a station with an outstanding timing adjustment
-        // or an incomplete averaging window.
-        int		mOutstandingTimingAdjustment;
-        int32		mTimingAdjustmentTick;
-
-        // If the player is dropped during a game, we need to tell the other players about it.
-        // This is accomplished in much the same way as the timing adjustment - we include
-        // a "player netdead" message in every outbound packet until we're sure they've gotten
-        // the message.  mNetDeadTick, then, works pretty much just like mTimingAdjustmentTick.
-        // mNetDeadTick is the first tick for which the netdead player isn't providing data.
-        int32		mNetDeadTick;
-
-	// the last time a recovery set of flags was sent instead of incremental
-	int32           mLastRecoverySend;
-
-	// latency stuff
-	int32 mLatencyTicks; // sum of the latency ticks from the last second
-	deque<int32> mLatencyBuffer;
-
-	NetworkStats mStats;
-};
-
-// Housekeeping queues:
-// sPlayerDataDisposition holds an element for every tick for which data has been received from
-// someone, but which at least one player has not yet acknowledged.
-// sPlayerDataDisposition.getReadIndex() <= sSmallestIncompleteTick <= sPlayerDataDisposition.getWriteIndex()
-// sSmallestIncompleteTick indexes into sPlayerDataDisposition also; it divides the queue into ticks
-// for which data has been received from someone but not yet everyone (>= sSmallestIncompleteTick) and
-// ticks for which data has been sent out (to everyone) but for which someone hasn't yet acknowledged
-// (< sSmallestIncompleteTick).
-
-// The value of a queue element is a bit-set (indexed by player index) with a 1 bit for each player
-// that we're waiting on.  So, we can mask out successive players' bits as their traffic reaches us;
-// when the value hits 0, all players have checked in and we can advance an index.
-// sConnectedPlayersBitmask has '1' set for every connected player.
-static MutableElementsTickBasedCircularQueue<uint32>	sPlayerDataDisposition(kFlagsQueueSize);
-static int32 sSmallestIncompleteTick;
-static uint32 sConnectedPlayersBitmask;
-static uint32 sLaggingPlayersBitmask;
-
-
-// sPlayerReflectedFlags holds an element for every tick for which data has been
-// sent but at least one player has not yet acknowledged
-//
-// the value of a queue element is a bit-set (indexed by player index) with a 1
-// bit for each player we've altered flags and need to reflect flags for
-static MutableElementsTickBasedCircularQueue<uint32> sPlayerReflectedFlags(kFlagsQueueSize);
-
-// sLateFlagsQueues hold late flags we've received from lagging players
-static TickBasedActionQueueCollection sLateFlagsQueues;
-
-// holds the last real flags we received from this player
-static vector<action_flags_t> sLastFlagsReceived;
-
-// sSmallestUnsentTick is used for reducing the number of packets sent: we won't send a packet unless
-// sSmallestIncompleteTick - sSmallestUnsentTick >= sHubPreferences.mSendPeriod
-static int32 sSmallestUnsentTick;
-
-struct NetAddrBlockCompare
-{
-
-  bool operator()(const NetAddrBlock& a, const NetAddrBlock& b) const
-  {
-    if (a.host == b.host)
-      return a.port < b.port;
-    else
-      return a.host < b.host;
-  }
-};
-
-  typedef std::map<NetAddrBlock, int, NetAddrBlockCompare>	AddressToPlayerIndexType;
-static AddressToPlayerIndexType	sAddressToPlayerIndex;
-
-typedef std::vector<NetworkPlayer_hub>	NetworkPlayerCollection;
-static NetworkPlayerCollection	sNetworkPlayers;
 
-// Local player index is used to decide how to send a packet; ref is used for timing.
-static size_t			sLocalPlayerIndex;
-static size_t			sReferencePlayerIndex;
+// The hub for the game we're playing, if we're the one hosting it
+static StarHub*		sHub = NULL;
+static myTMTaskPtr	sHubTickTask = NULL;
 
-static DDPFramePtr	sOutgoingFrame = NULL;
 
-#ifndef A1_NETWORK_STANDALONE_HUB
-static DDPPacketBuffer	sLocalOutgoingBuffer;
-static bool		sNeedToSendLocalOutgoingBuffer = false;
-#endif
+static bool hub_tick();
 
 
-struct HubLossyByteStreamChunkDescriptor
+// The timing adjustment to ask of a player whose in-game arrival offsets are in inFinder
+// (which must be full).  Ordinarily that's the inNthElement'th smallest offset; with adaptive
+// timing it's never less than the window's lower fence (the 25th percentile less one and a half
+// times the spread up to the 75th), so a few freakishly early packets in an otherwise steady
+// stream don't pull the player forward only to leave its flags arriving late afterwards.
+static int32
+in_game_timing_adjustment(WindowedNthElementFinder<int32>& inFinder, int32 inNthElement)
 {
-	uint16	mLength;
-	int16	mType;
-	uint32	mDestinations;
-	uint8	mSender;
-};
+	int32 theAdjustment = inFinder.nth_smallest_element(inNthElement);
+	if(!sHubPreferences.mAdaptiveTiming)
+		return theAdjustment;
 
-// This holds outgoing lossy byte stream data
-static CircularByteBuffer sOutgoingLossyByteStreamData(kLossyByteStreamDataBufferSize);
+	int32 theLowerQuartile = inFinder.percentile(25);
+	int32 theUpperQuartile = inFinder.percentile(75);
+	int32 theLowerFence = theLowerQuartile - (3 * (theUpperQuartile - theLowerQuartile) + 1) / 2;
 
-// This holds a descriptor for each chunk of lossy byte stream data held in the above buffer
-static CircularQueue<HubLossyByteStreamChunkDescriptor> sOutgoingLossyByteStreamDescriptors(kLossyByteStreamDescriptorCount);
-
-// This is used to copy between AStream and CircularByteBuffer
-// It's used in both directions, but that's ok because the routines that do so are mutex.
-static byte sScratchBuffer[kLossyByteStreamDataBufferSize];
-
-
-static myTMTaskPtr	sHubTickTask = NULL;
-static bool		sHubActive = false;	// used to enable the packet handler
-static bool		sHubInitialized = false;
-
-
-
-static void hub_check_for_completion();
-static void player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowledgedTick);
-static bool player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTick, int32 inSmallestUnreceivedTick);
-static void hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex);
-static void hub_received_position_sync_packet(AIStream& ps, int inSenderIndex);
-static void reset_position_sums();
-static void playerReportedPositionSum(int32 inSenderIndex, int32 positionSum);
-static void hub_received_identification_packet(AIStream& ps, NetAddrBlock address);
-static void hub_received_ping_request(AIStream& ps, NetAddrBlock address);
-static void hub_received_ping_response(AIStream& ps, NetAddrBlock address);
-static void process_messages(AIStream& ps, int inSenderIndex);
-static void process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType);
-static void make_player_netdead(int inPlayerIndex);
-static bool hub_tick();
-static void send_packets();
+	return std::max(theAdjustment, theLowerFence);
+}
 
 
 
 // These are excellent candidates for templatization, but MSVC++6.0 has broken function templates.
 // (Actually, they might not be broken if the template parameter is a typename, but... not taking chances.)
-static inline NetworkPlayer_hub&
-getNetworkPlayer(size_t inIndex)
+inline StarHub::NetworkPlayer_hub&
+StarHub::getNetworkPlayer(size_t inIndex)
 {
-        assert(inIndex < sNetworkPlayers.size());
-        return sNetworkPlayers[inIndex];
+        assert(inIndex < mNetworkPlayers.size());
+        return mNetworkPlayers[inIndex];
 }
 
-static inline TickBasedActionQueue&
-getFlagsQueue(size_t inIndex)
+inline TickBasedActionQueue&
+StarHub::getFlagsQueue(size_t inIndex)
 {
-        assert(inIndex < sFlagsQueues.size());
-        return sFlagsQueues[inIndex];
+        assert(inIndex < mFlagsQueues.size());
+        return mFlagsQueues[inIndex];
 }
 
-static inline TickBasedActionQueue&
-getLateFlagsQueue(size_t inIndex)
+inline TickBasedActionQueue&
+StarHub::getLateFlagsQueue(size_t inIndex)
 {
-	assert(inIndex < sFlagsQueues.size());
-	return sLateFlagsQueues[inIndex];
+	assert(inIndex < mFlagsQueues.size());
+	return mLateFlagsQueues[inIndex];
 }
 
 
@@ -393,35 +239,29 @@ operator <(const NetAddrBlock& a, const NetAddrBlock& b)
 }
 
 
-static OSErr
-send_frame_to_local_spoke(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port)
+OSErr
+StarHub::send_frame_to_local_spoke(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port)
 {
-#ifndef A1_NETWORK_STANDALONE_HUB
-        sLocalOutgoingBuffer.datagramSize = frame->data_size;
-        memcpy(sLocalOutgoingBuffer.datagramData, frame->data, frame->data_size);
-        sLocalOutgoingBuffer.protocolType = protocolType;
+	// Dedicated hub should never call this routine
+	assert(!isDedicated());
+
+        mLocalOutgoingBuffer.datagramSize = frame->data_size;
+        memcpy(mLocalOutgoingBuffer.datagramData, frame->data, frame->data_size);
+        mLocalOutgoingBuffer.protocolType = protocolType;
         // We ignore the 'source address' because the spoke does too.
-        sNeedToSendLocalOutgoingBuffer = true;
+        mNeedToSendLocalOutgoingBuffer = true;
         return noErr;
-#else
-	// Standalone hub should never call this routine
-	assert(false);
-	return noErr;
-#endif // A1_NETWORK_STANDALONE_HUB
 }
 
 
 
-static inline void
-check_send_packet_to_spoke()
+void
+StarHub::check_send_packet_to_spoke()
 {
-	// Routine exists but has no implementation on standalone hub.
-#ifndef A1_NETWORK_STANDALONE_HUB
-        if(sNeedToSendLocalOutgoingBuffer)
-                spoke_received_network_packet(&sLocalOutgoingBuffer);
+        if(mNeedToSendLocalOutgoingBuffer)
+                spoke_received_network_packet(&mLocalOutgoingBuffer);
 
-        sNeedToSendLocalOutgoingBuffer = false;
-#endif // A1_NETWORK_STANDALONE_HUB
+        mNeedToSendLocalOutgoingBuffer = false;
 }
 
 
@@ -440,96 +280,56 @@ std::ofstream dout;
 bool debug_timing_adjustments = false;
 #endif
 
-void
-hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, size_t inLocalPlayerIndex)
+StarHub::StarHub(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, size_t inLocalPlayerIndex, StarHubSendFrameProc inSendFrame) :
+	mSendFrame(inSendFrame),
+	mFlagSendTimeQueue(kFlagsQueueSize),
+	mPlayerDataDisposition(kFlagsQueueSize),
+	mPlayerReflectedFlags(kFlagsQueueSize),
+	mOutgoingLossyByteStreams(true)
 {
-//        assert(sNetworkState == eNetworkDown);
-
-//        sNetworkState = eNetworkJustStartingUp;
-
-#ifdef DEBUG_TIMING_ADJUSTMENTS
-	FileSpecifier fs;
-	fs.SetToLocalDataDir();
-	fs.AddPart("TimingDebug");
-	if (fs.Exists() && fs.IsDir())
-	{
-		time_t t;
-		struct tm* now;
-		
-		time(&t);
-		now = localtime(&t);
-		
-		char buffer[80];
-		strftime(buffer, 80, "%Y%m%d%H%M%S", now);
-
-		std::stringstream ss;
-		ss << buffer << "_" << inNumPlayers << "P.txt";
-
-		fs.AddPart(ss.str());
-		dout.open(fs.GetPath());
-		dout << "Players: " << inNumPlayers << std::endl;
-		dout << "Latency Tolerance: " << sHubPreferences.mMinimumSendPeriod << std::endl;
-		debug_timing_adjustments = true;
-	}
-	else
-	{
-		debug_timing_adjustments = false;
-	}
-#endif
+        assert(inNumPlayers <= kMaximumPlayers);
+        assert(inLocalPlayerIndex < inNumPlayers || inLocalPlayerIndex == static_cast<size_t>(NONE));
+        mLocalPlayerIndex = inLocalPlayerIndex;
+	mReferencePlayerIndex = mLocalPlayerIndex;
 
-        assert(inLocalPlayerIndex < inNumPlayers);
-        sLocalPlayerIndex = inLocalPlayerIndex;
-	sReferencePlayerIndex = sLocalPlayerIndex;
-
-#ifdef A1_NETWORK_STANDALONE_HUB
-	// There is no local player on standalone hub.
-	sLocalPlayerIndex = (size_t)NONE;
-#endif
-
-	sSmallestPostGameTick = INT32_MAX;
-        sSmallestRealGameTick = inStartingTick;
+	mSmallestPostGameTick = INT32_MAX;
+        mSmallestRealGameTick = inStartingTick;
         int32 theFirstTick = inStartingTick - kPregameTicks;
 
-        if(sOutgoingFrame == NULL)
-                sOutgoingFrame = NetDDPNewFrame();
-
-#ifndef A1_NETWORK_STANDALONE_HUB
-        sNeedToSendLocalOutgoingBuffer = false;
-#endif
+        mOutgoingFrame = NetDDPNewFrame();
+	mTelemetry.reset(true, inNumPlayers);
 
-        sNetworkPlayers.clear();
-        sFlagsQueues.clear();
-	sLateFlagsQueues.clear();
-        sNetworkPlayers.resize(inNumPlayers);
-        sFlagsQueues.resize(inNumPlayers, TickBasedActionQueue(kFlagsQueueSize));
-	sLateFlagsQueues.resize(inNumPlayers, TickBasedActionQueue(kFlagsQueueSize));
+        mNeedToSendLocalOutgoingBuffer = false;
 
-        sAddressToPlayerIndex.clear();
-        sConnectedPlayersBitmask = 0;
+        mNetworkPlayers.resize(inNumPlayers);
+        mFlagsQueues.resize(inNumPlayers, TickBasedActionQueue(kFlagsQueueSize));
+	mLateFlagsQueues.resize(inNumPlayers, TickBasedActionQueue(kFlagsQueueSize));
 
-	sOutgoingLossyByteStreamDescriptors.reset();
-	sOutgoingLossyByteStreamData.reset();
+        mConnectedPlayersBitmask = 0;
 
   reset_position_sums();
   
         for(size_t i = 0; i < inNumPlayers; i++)
         {
-                NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
+                NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
 
                 if(inPlayerAddresses[i] != NULL)
                 {
                         thePlayer.mConnected = true;
-                        sConnectedPlayersBitmask |= (((uint32)1) << i);
+                        mConnectedPlayersBitmask |= (((uint32)1) << i);
 			thePlayer.mAddressKnown = false;
                         // thePlayer.mAddress = *(inPlayerAddresses[i]); (jkvw: see note below)
                         // Currently, all-0 address is cue for local spoke.
 			// jkvw: The "real" addresses for spokes won't be known unti we get some UDP traffic
 			//	 from them - we'll update as they become known.
-                        if(i == sLocalPlayerIndex) { // jkvw: I don't need this, do I?
+                        if(i == mLocalPlayerIndex) { // jkvw: I don't need this, do I?
                                 obj_clear(thePlayer.mAddress);
-				sAddressToPlayerIndex[thePlayer.mAddress] = i;
+				mAddressToPlayerIndex[thePlayer.mAddress] = i;
 				thePlayer.mAddressKnown = true;
 			}
+
+			if(mReferencePlayerIndex == static_cast<size_t>(NONE))
+				mReferencePlayerIndex = i;
                 }
                 else
                 {
@@ -546,32 +346,117 @@ hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* co
                 thePlayer.mNetDeadTick = theFirstTick - 1;
 
 
-		thePlayer.mLatencyBuffer.clear();
 		thePlayer.mLatencyTicks = 0;
 		thePlayer.mStats.latency = NetworkStats::invalid;
 		thePlayer.mStats.jitter = NetworkStats::invalid;
 		thePlayer.mStats.errors = 0;
-
-                sFlagsQueues[i].reset(theFirstTick);
-		sLateFlagsQueues[i].reset(theFirstTick);
+		thePlayer.mStats.bytes_per_tick = 0;
+		thePlayer.mStats.unpacked_bytes_per_tick = 0;
+		thePlayer.mPackedActionFlags = false;
+		thePlayer.mGameDataBytes = 0;
+		thePlayer.mUnpackedGameDataBytes = 0;
+
+                mFlagsQueues[i].reset(theFirstTick);
+		mLateFlagsQueues[i].reset(theFirstTick);
         }
+
+	// Nobody's connected; there's no one to time against, but keep the index valid anyway
+	if(mReferencePlayerIndex == static_cast<size_t>(NONE))
+		mReferencePlayerIndex = 0;
         
-        sPlayerDataDisposition.reset(theFirstTick);
-	sPlayerReflectedFlags.reset(theFirstTick);
-	sLastFlagsReceived.resize(inNumPlayers);
-	sFlagSendTimeQueue.reset(theFirstTick);
-        sSmallestIncompleteTick = theFirstTick;
-	sSmallestUnsentTick = theFirstTick;
-        sNetworkTicker = 0;
-        sLastNetworkTickSent = 0;
-	sLastRealUpdate = 0;
-	sLaggingPlayersBitmask = 0;
-
-        sHubActive = true;
+        mPlayerDataDisposition.reset(theFirstTick);
+	mPlayerReflectedFlags.reset(theFirstTick);
+	mLastFlagsReceived.resize(inNumPlayers);
+	mFlagSendTimeQueue.reset(theFirstTick);
+        mSmallestIncompleteTick = theFirstTick;
+	mSmallestUnsentTick = theFirstTick;
+        mNetworkTicker = 0;
+        mLastNetworkTickSent = 0;
+	mLastRealUpdate = 0;
+	mLaggingPlayersBitmask = 0;
+
+        mHubActive = true;
+}
 
-        sHubTickTask = myXTMSetup(1000/TICKS_PER_SECOND, hub_tick);
 
-	sHubInitialized = true;
+
+StarHub::~StarHub()
+{
+	NetDDPDisposeFrame(mOutgoingFrame);
+}
+
+
+
+void
+StarHub::endGame(int32 inSmallestPostGameTick)
+{
+	// Signal our demise
+	mSmallestPostGameTick = inSmallestPostGameTick;
+
+	// We have to do a check now in case the conditions are already met
+	hub_check_for_completion();
+}
+
+
+
+void
+StarHub::playerIdentified(int inPlayerIndex, const NetAddrBlock& inAddress)
+{
+	if(inPlayerIndex < 0 || static_cast<size_t>(inPlayerIndex) >= mNetworkPlayers.size())
+		return;
+
+	NetworkPlayer_hub& thePlayer = mNetworkPlayers[inPlayerIndex];
+	if (!thePlayer.mConnected)
+		return;
+
+	// A player who rejoins from somewhere else (e.g. after a NAT rebinding) replaces the old address
+	if (thePlayer.mAddressKnown)
+		mAddressToPlayerIndex.erase(thePlayer.mAddress);
+
+	mAddressToPlayerIndex[inAddress] = inPlayerIndex;
+	thePlayer.mAddressKnown = true;
+	thePlayer.mAddress = inAddress;
+}
+
+
+
+void
+hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, size_t inLocalPlayerIndex)
+{
+#ifdef DEBUG_TIMING_ADJUSTMENTS
+	FileSpecifier fs;
+	fs.SetToLocalDataDir();
+	fs.AddPart("TimingDebug");
+	if (fs.Exists() && fs.IsDir())
+	{
+		time_t t;
+		struct tm* now;
+		
+		time(&t);
+		now = localtime(&t);
+		
+		char buffer[80];
+		strftime(buffer, 80, "%Y%m%d%H%M%S", now);
+
+		std::stringstream ss;
+		ss << buffer << "_" << inNumPlayers << "P.txt";
+
+		fs.AddPart(ss.str());
+		dout.open(fs.GetPath());
+		dout << "Players: " << inNumPlayers << std::endl;
+		dout << "Latency Tolerance: " << sHubPreferences.mMinimumSendPeriod << std::endl;
+		debug_timing_adjustments = true;
+	}
+	else
+	{
+		debug_timing_adjustments = false;
+	}
+#endif
+
+	assert(sHub == NULL);
+	sHub = new StarHub(inStartingTick, inNumPlayers, inPlayerAddresses, inLocalPlayerIndex, NetDDPSendFrame);
+
+        sHubTickTask = myXTMSetup(1000/TICKS_PER_SECOND, hub_tick);
 }
 
 
@@ -579,23 +464,19 @@ hub_initialize(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* co
 void
 hub_cleanup(bool inGraceful, int32 inSmallestPostGameTick)
 {
-	if(sHubInitialized)
+	if(sHub)
 	{
 		if(inGraceful)
 		{
-			// Signal our demise
-			sSmallestPostGameTick = inSmallestPostGameTick;
-
-			// We have to do a check now in case the conditions are already met
 			if(take_mytm_mutex())
 			{
-				hub_check_for_completion();
+				sHub->endGame(inSmallestPostGameTick);
 				release_mytm_mutex();
 			}
 			
 			// Now we should wait/sleep for the rest of the machinery to wind down
-			// Packet handler will set sHubActive = false once it has acks from all connected players;
-			while(sHubActive)
+			// Packet handler will deactivate the hub once it has acks from all connected players;
+			while(sHub->isActive())
 			{
 // Here we try to isolate the "Classic" Mac OS (we can only sleep on the others)
 				SDL_Delay(10);
@@ -604,11 +485,11 @@ hub_cleanup(bool inGraceful, int32 inSmallestPostGameTick)
 		else
 		{		
 			// Stop processing incoming packets (packet processor won't start processing another packet
-			// due to sHubActive = false, and we know it's not in the middle of processing one because
+			// due to the hub being inactive, and we know it's not in the middle of processing one because
 			// we take the mutex).
 			if(take_mytm_mutex())
 			{
-				sHubActive = false;
+				sHub->deactivate();
 				release_mytm_mutex();
 			}
 		}
@@ -620,14 +501,11 @@ hub_cleanup(bool inGraceful, int32 inSmallestPostGameTick)
 		// This waits for the tick task to actually finish - so we know the tick task isn't in
 		// the middle of processing when we do the rest of the cleanup below.
 		myTMCleanup(true);
-		
-		sNetworkPlayers.clear();
-		sFlagsQueues.clear();
-		sLateFlagsQueues.clear();
 
-		sAddressToPlayerIndex.clear();
-		NetDDPDisposeFrame(sOutgoingFrame);
-		sOutgoingFrame = NULL;
+		// The packet handler may still be holding on to us
+		MyTMMutexTaker mutex;
+		delete sHub;
+		sHub = NULL;
 
 #ifdef DEBUG_TIMING_ADJUSTMENTS
 		if (debug_timing_adjustments)
@@ -640,17 +518,55 @@ hub_cleanup(bool inGraceful, int32 inSmallestPostGameTick)
 
 
 
-static void
-hub_check_for_completion()
+void
+hub_received_network_packet(DDPPacketBufferPtr inPacket)
+{
+	if(sHub)
+		sHub->receivedNetworkPacket(inPacket);
+}
+
+
+
+static bool
+hub_tick()
 {
-	// When all players (including the local spoke) have either ACKed up to sSmallestPostGameTick
+	// Handle whatever arrived since the receiving thread last got a chance to deliver it
+	NetDDPProcessReceivedPackets();
+
+	return sHub->tick();
+}
+
+
+
+const NetworkStats&
+hub_stats(int player_index)
+{
+	static NetworkStats sInvalidStats = { NetworkStats::invalid, NetworkStats::invalid, 0, 0, 0 };
+	return sHub ? sHub->stats(player_index) : sInvalidStats;
+}
+
+
+
+void
+capture_position_sums_and_check_for_dsync()
+{
+	if(sHub)
+		sHub->capturePositionSumsAndCheckForDesync();
+}
+
+
+
+void
+StarHub::hub_check_for_completion()
+{
+	// When all players (including the local spoke) have either ACKed up to mSmallestPostGameTick
 	// or become disconnected, we're clear to cleanup.  (In other words, we should avoid cleaning
 	// up if there are connected players that haven't ACKed up to the game's end tick.)
 	bool someoneStillActive = false;
-	for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+	for(size_t i = 0; i < mNetworkPlayers.size(); i++)
 	{
-		NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
-		if(thePlayer.mConnected && thePlayer.mSmallestUnacknowledgedTick < sSmallestPostGameTick)
+		NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
+		if(thePlayer.mConnected && thePlayer.mSmallestUnacknowledgedTick < mSmallestPostGameTick)
 		{
 			someoneStillActive = true;
 			break;
@@ -658,15 +574,17 @@ hub_check_for_completion()
 	}
 
 	if(!someoneStillActive)
-		sHubActive = false;
+		mHubActive = false;
 }
 		
 
 
 void
-hub_received_network_packet(DDPPacketBufferPtr inPacket)
+StarHub::receivedNetworkPacket(DDPPacketBufferPtr inPacket)
 {
 	logContextNMT("hub processing a received packet");
+
+	mTelemetry.received(*inPacket);
 	
         AIStreamBE ps(inPacket->datagramData, inPacket->datagramSize);
 
@@ -675,7 +593,7 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
 		ps >> thePacketMagic;
 
 		// Processing packets?
-		if(!sHubActive &&
+		if(!mHubActive &&
 		   thePacketMagic != kPingRequestPacket &&
 		   thePacketMagic != kPingResponsePacket)
 			return;
@@ -689,10 +607,10 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
 
 		if (thePacketCRC != calculate_data_crc_ccitt(inPacket->datagramData, inPacket->datagramSize))
 		{
-			if (thePacketMagic == kSpokeToHubGameDataPacketV1Magic)
+			if (thePacketMagic == kSpokeToHubGameDataPacketV1Magic || thePacketMagic == kSpokeToHubGameDataPacketV2Magic)
 			{
-				AddressToPlayerIndexType::iterator theEntry = sAddressToPlayerIndex.find(inPacket->sourceAddress);
-				if (theEntry != sAddressToPlayerIndex.end())
+				AddressToPlayerIndexType::iterator theEntry = mAddressToPlayerIndex.find(inPacket->sourceAddress);
+				if (theEntry != mAddressToPlayerIndex.end())
 				{
 					int theSenderIndex = theEntry->second;
 					getNetworkPlayer(theSenderIndex).mStats.errors++;
@@ -704,21 +622,22 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
     switch(thePacketMagic)
     {
       case kSpokeToHubGameDataPacketV1Magic:
+      case kSpokeToHubGameDataPacketV2Magic:
 			{
 				// Find sender
-				AddressToPlayerIndexType::iterator theEntry = sAddressToPlayerIndex.find(inPacket->sourceAddress);
-				if(theEntry == sAddressToPlayerIndex.end())
+				AddressToPlayerIndexType::iterator theEntry = mAddressToPlayerIndex.find(inPacket->sourceAddress);
+				if(theEntry == mAddressToPlayerIndex.end())
 					return;
 				
 				int theSenderIndex = theEntry->second;
 				
 				if (getNetworkPlayer(theSenderIndex).mConnected)
 				{
-					hub_received_game_data_packet_v1(ps, theSenderIndex);
+					hub_received_game_data_packet_v1(ps, theSenderIndex, thePacketMagic == kSpokeToHubGameDataPacketV2Magic);
 				}
 				else
 				{
-					// Unconnected players should not have entries in sAddressToPlayerIndex
+					// Unconnected players should not have entries in mAddressToPlayerIndex
 					logWarningNMT("received game data packet from disconnected player %i; ignoring", theSenderIndex);
 				}
 			}
@@ -739,8 +658,8 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
       case kSpokeToHubPositionSyncSum:
       {
         // Find sender
-        AddressToPlayerIndexType::iterator theEntry = sAddressToPlayerIndex.find(inPacket->sourceAddress);
-        if(theEntry == sAddressToPlayerIndex.end())
+        AddressToPlayerIndexType::iterator theEntry = mAddressToPlayerIndex.find(inPacket->sourceAddress);
+        if(theEntry == mAddressToPlayerIndex.end())
           return;
         
         int theSenderIndex = theEntry->second;
@@ -750,6 +669,20 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
         }
       }
       break;
+
+      case kSpokeToHubWorldHash:
+      {
+        AddressToPlayerIndexType::iterator theEntry = mAddressToPlayerIndex.find(inPacket->sourceAddress);
+        if(theEntry == mAddressToPlayerIndex.end())
+          return;
+
+        int theSenderIndex = theEntry->second;
+        if (getNetworkPlayer(theSenderIndex).mConnected)
+        {
+          hub_received_world_hash_packet(ps, theSenderIndex);
+        }
+      }
+      break;
 						
       default:
 			break;
@@ -764,66 +697,57 @@ hub_received_network_packet(DDPPacketBufferPtr inPacket)
 }
 
 
-static void
-hub_received_identification_packet(AIStream& ps, NetAddrBlock address)
+void
+StarHub::hub_received_identification_packet(AIStream& ps, NetAddrBlock address)
 {
 	int16 theSenderIndex;
 	ps >> theSenderIndex;
+
+	if (theSenderIndex < 0 || static_cast<size_t>(theSenderIndex) >= mNetworkPlayers.size())
+		return;
 	
-	if (!sNetworkPlayers[theSenderIndex].mAddressKnown) {
-		sAddressToPlayerIndex[address] = theSenderIndex;
-		sNetworkPlayers[theSenderIndex].mAddressKnown = true;
-		sNetworkPlayers[theSenderIndex].mAddress = address;
+	if (!mNetworkPlayers[theSenderIndex].mAddressKnown) {
+		mAddressToPlayerIndex[address] = theSenderIndex;
+		mNetworkPlayers[theSenderIndex].mAddressKnown = true;
+		mNetworkPlayers[theSenderIndex].mAddress = address;
 	}
 
 } // hub_received_idetification_packet()
 
 
-static void
-hub_received_ping_request(AIStream& ps, NetAddrBlock address)
+void
+StarHub::hub_received_ping_request(AIStream& ps, NetAddrBlock address)
 {
 	uint16 pingIdentifier;
 	ps >> pingIdentifier;
 	
 	// respond back to requestor
-	bool initedFrame = false;
-	if (!sOutgoingFrame)
-	{
-		sOutgoingFrame = NetDDPNewFrame();
-		initedFrame = true;
-	}
-	
-	AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-	AOStreamBE ops(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+	AOStreamBE hdr(mOutgoingFrame->data, kStarPacketHeaderSize);
+	AOStreamBE ops(mOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
 	
 	try {
 		hdr << (uint16)kPingResponsePacket;
 		ops << pingIdentifier;
 		
 		// blank out the CRC field before calculating
-		sOutgoingFrame->data[2] = 0;
-		sOutgoingFrame->data[3] = 0;
+		mOutgoingFrame->data[2] = 0;
+		mOutgoingFrame->data[3] = 0;
 		
-		uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ops.tellp());
+		uint16 crc = calculate_data_crc_ccitt(mOutgoingFrame->data, ops.tellp());
 		hdr << crc;
 		
 		// Send the packet
-		sOutgoingFrame->data_size = ops.tellp();
-		NetDDPSendFrame(sOutgoingFrame, &address, kPROTOCOL_TYPE, 0 /* ignored */);
+		mOutgoingFrame->data_size = ops.tellp();
+		mTelemetry.sent(*mOutgoingFrame);
+		mSendFrame(mOutgoingFrame, &address, kPROTOCOL_TYPE, 0 /* ignored */);
 	} catch (...) {
 		logWarningNMT("Caught exception while constructing/sending ping response packet");
 	}
-	
-	if (initedFrame)
-	{
-		NetDDPDisposeFrame(sOutgoingFrame);
-		sOutgoingFrame = NULL;
-	}
 } // hub_received_ping_request()
 
 
-static void
-hub_received_ping_response(AIStream& ps, NetAddrBlock address)
+void
+StarHub::hub_received_ping_response(AIStream& ps, NetAddrBlock address)
 {
 	uint16 pingIdentifier;
 	ps >> pingIdentifier;
@@ -837,17 +761,24 @@ hub_received_ping_response(AIStream& ps, NetAddrBlock address)
 // I suppose to be safer, this should check the entire packet before acting on any of it.
 // As it stands, a malformed packet could have have a well-formed prefix of it interpreted
 // before the remainder is discarded.
-static void
-hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
+void
+StarHub::hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex, bool inPacked)
 {
+	// Once a player packs, we pack for them too
+	NetworkPlayer_hub& thePlayer = getNetworkPlayer(inSenderIndex);
+	if(inPacked)
+		thePlayer.mPackedActionFlags = true;
+
+	int32 thePacketSize = ps.maxg();
+
         // Process the piggybacked acknowledgement
         int32	theSmallestUnacknowledgedTick;
         ps >> theSmallestUnacknowledgedTick;
 
         // If ack is too soon we throw out the entire packet to be safer
-        if(theSmallestUnacknowledgedTick > sSmallestIncompleteTick)
+        if(theSmallestUnacknowledgedTick > mSmallestIncompleteTick)
         {
-                logAnomalyNMT("received ack from player %d for tick %d; have only sent up to %d", inSenderIndex, theSmallestUnacknowledgedTick, sSmallestIncompleteTick);
+                logAnomalyNMT("received ack from player %d for tick %d; have only sent up to %d", inSenderIndex, theSmallestUnacknowledgedTick, mSmallestIncompleteTick);
                 return;
         }                
 
@@ -855,25 +786,46 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 
         // If that's all the data, we're done
         if(ps.tellg() == ps.maxg())
+	{
+		thePlayer.mGameDataBytes += thePacketSize;
+		thePlayer.mUnpackedGameDataBytes += thePacketSize;
                 return;
+	}
 
         // Process messages, if present
         process_messages(ps, inSenderIndex);
 
         // If that's all the data, we're done
         if(ps.tellg() == ps.maxg())
+	{
+		thePlayer.mGameDataBytes += thePacketSize;
+		thePlayer.mUnpackedGameDataBytes += thePacketSize;
                 return;
+	}
 
         // If present, process the action_flags
         int32	theStartTick;
         ps >> theStartTick;
 
-        // Make sure there's an integral number of action_flags
-        int	theRemainingDataLength = ps.maxg() - ps.tellg();
-        if(theRemainingDataLength % kActionFlagsSerializedLength != 0)
-                return;
+	int	theRemainingDataLength = ps.maxg() - ps.tellg();
+	int32	theActionFlagsCount;
+	PackedActionFlagsReader theReader;
+	if(inPacked)
+	{
+		theReader.readFrom(ps);
+		theActionFlagsCount = theReader.tickCount();
+	}
+	else
+	{
+		// Make sure there's an integral number of action_flags
+		if(theRemainingDataLength % kActionFlagsSerializedLength != 0)
+			return;
 
-        int32	theActionFlagsCount = theRemainingDataLength / kActionFlagsSerializedLength;
+		theActionFlagsCount = theRemainingDataLength / kActionFlagsSerializedLength;
+	}
+
+	thePlayer.mGameDataBytes += thePacketSize;
+	thePlayer.mUnpackedGameDataBytes += thePacketSize - theRemainingDataLength + theActionFlagsCount * kActionFlagsSerializedLength;
 
         TickBasedActionQueue& theQueue = getFlagsQueue(inSenderIndex);
 	TickBasedActionQueue& theLateQueue = getLateFlagsQueue(inSenderIndex);
@@ -888,7 +840,7 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 	{
 		while (theLateQueue.getWriteTick() < theQueue.getWriteTick())
 		{
-			theLateQueue.enqueue(sLastFlagsReceived[inSenderIndex]);
+			theLateQueue.enqueue(mLastFlagsReceived[inSenderIndex]);
 			theLateQueue.dequeue();
 		}
 	}
@@ -896,24 +848,33 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
         // Skip redundant flags without processing/checking them
 //        int	theRedundantActionFlagsCount = std::min(theQueue.getWriteTick() - theStartTick, theActionFlagsCount);
 	int     theRedundantActionFlagsCount = std::min(theLateQueue.getWriteTick() - theStartTick, theActionFlagsCount);
-	int	theRedundantDataLength = theRedundantActionFlagsCount * kActionFlagsSerializedLength;
-	ps.ignore(theRedundantDataLength);
+	if(inPacked)
+	{
+		// Packed flags only make sense read in order
+		for(int i = 0; i < theRedundantActionFlagsCount; i++)
+			theReader.read(inSenderIndex);
+	}
+	else
+	{
+		int	theRedundantDataLength = theRedundantActionFlagsCount * kActionFlagsSerializedLength;
+		ps.ignore(theRedundantDataLength);
+	}
 
 	assert(theQueue.getWriteTick() >= theLateQueue.getWriteTick());
 	// Enqueue late flags
 	int theLateActionFlagsCount = std::min(theQueue.getWriteTick() - theLateQueue.getWriteTick(), theActionFlagsCount - theRedundantActionFlagsCount);
+	mTelemetry.lateFlags(theLateActionFlagsCount);
 	for (int i = 0; i < theLateActionFlagsCount; i++)
 	{
-		action_flags_t theActionFlags;
-		ps >> theActionFlags;
+		action_flags_t theActionFlags = read_action_flags(ps, inPacked ? &theReader : NULL, inSenderIndex);
 		// we consume these faster than we enqueue them (hopefully)
 		// so, not checking for capacity though we probably should
 		theLateQueue.enqueue(theActionFlags);
-		sLastFlagsReceived[inSenderIndex] = theActionFlags;
+		mLastFlagsReceived[inSenderIndex] = theActionFlags;
 	}
 
         // Enqueue flags that are new to us
-        int	theRemainingQueueSpace = (sPlayerDataDisposition.getReadTick() < sSmallestRealGameTick && theQueue.size() > sHubPreferences.mPregameWindowSize) ? 0 : theQueue.availableCapacity();
+        int	theRemainingQueueSpace = (mPlayerDataDisposition.getReadTick() < mSmallestRealGameTick && theQueue.size() > sHubPreferences.mPregameWindowSize) ? 0 : theQueue.availableCapacity();
 	int theUsefulActionFlagsCount = theActionFlagsCount - theRedundantActionFlagsCount - theLateActionFlagsCount;
         int	theEnqueueableFlagsCount = std::min(theUsefulActionFlagsCount, theRemainingQueueSpace);
 
@@ -921,16 +882,14 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
         
         for(int i = 0; i < theEnqueueableFlagsCount; i++)
         {
-                action_flags_t theActionFlags;
-                ps >> theActionFlags;
+                action_flags_t theActionFlags = read_action_flags(ps, inPacked ? &theReader : NULL, inSenderIndex);
                 theQueue.enqueue(theActionFlags);
 		theLateQueue.enqueue(theActionFlags);
-		sLastFlagsReceived[inSenderIndex] = theActionFlags;
+		mLastFlagsReceived[inSenderIndex] = theActionFlags;
         }
 
 	// Update timing data
-	NetworkPlayer_hub& thePlayer = getNetworkPlayer(inSenderIndex);
-	NetworkPlayer_hub& theReferencePlayer = getNetworkPlayer(sReferencePlayerIndex);
+	NetworkPlayer_hub& theReferencePlayer = getNetworkPlayer(mReferencePlayerIndex);
 	while(thePlayer.mSmallestUnheardTick < theStartTick + theActionFlagsCount)
 	{
 		int32 theReferenceTick = theReferencePlayer.mSmallestUnheardTick;
@@ -941,28 +900,32 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
 	}
 
         // Make the pregame -> ingame transition
-        if(thePlayer.mSmallestUnheardTick >= sSmallestRealGameTick && static_cast<int32>(thePlayer.mNthElementFinder.window_size()) != sHubPreferences.mInGameWindowSize)
+        if(thePlayer.mSmallestUnheardTick >= mSmallestRealGameTick && static_cast<int32>(thePlayer.mNthElementFinder.window_size()) != sHubPreferences.mInGameWindowSize)
 		thePlayer.mNthElementFinder.reset(sHubPreferences.mInGameWindowSize);
 
 	if(thePlayer.mOutstandingTimingAdjustment == 0 && thePlayer.mNthElementFinder.window_full())
 	{
-		thePlayer.mOutstandingTimingAdjustment = thePlayer.mNthElementFinder.nth_smallest_element((thePlayer.mSmallestUnheardTick >= sSmallestRealGameTick) ? sHubPreferences.mInGameNthElement : sHubPreferences.mPregameNthElement);
+		if(thePlayer.mSmallestUnheardTick >= mSmallestRealGameTick)
+			thePlayer.mOutstandingTimingAdjustment = in_game_timing_adjustment(thePlayer.mNthElementFinder, sHubPreferences.mInGameNthElement);
+		else
+			thePlayer.mOutstandingTimingAdjustment = thePlayer.mNthElementFinder.nth_smallest_element(sHubPreferences.mPregameNthElement);
 
 		if(thePlayer.mOutstandingTimingAdjustment != 0)
 		{
-			thePlayer.mTimingAdjustmentTick = sSmallestIncompleteTick;
-			logTraceNMT("tick %d: asking player %d to adjust timing by %d", sSmallestIncompleteTick, inSenderIndex, thePlayer.mOutstandingTimingAdjustment);
+			thePlayer.mTimingAdjustmentTick = mSmallestIncompleteTick;
+			mTelemetry.timingAdjustment(mNetworkTicker, inSenderIndex, thePlayer.mOutstandingTimingAdjustment, mSmallestIncompleteTick);
+			logTraceNMT("tick %d: asking player %d to adjust timing by %d", mSmallestIncompleteTick, inSenderIndex, thePlayer.mOutstandingTimingAdjustment);
 
 #ifdef DEBUG_TIMING_ADJUSTMENTS
-			if (debug_timing_adjustments && thePlayer.mSmallestUnheardTick >= sSmallestRealGameTick)
+			if (debug_timing_adjustments && !isDedicated() && thePlayer.mSmallestUnheardTick >= mSmallestRealGameTick)
 			{
-				dout << sNetworkTicker
+				dout << mNetworkTicker
 				     << ": "
 				     << "P" << inSenderIndex
 				     << " "
 				     << "H" << thePlayer.mLastNetworkTickHeard
 				     << " "
-				     << "T" << sSmallestIncompleteTick
+				     << "T" << mSmallestIncompleteTick
 				     << " "
 				     << "A" << thePlayer.mSmallestUnacknowledgedTick
 				     << " "
@@ -1007,15 +970,15 @@ hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex)
         // Do any needed post-processing
         if(theEnqueueableFlagsCount > 0)
         {
-		// Actually the shouldSend business is probably unnecessary now with sSmallestUnsentTick
+		// Actually the shouldSend business is probably unnecessary now with mSmallestUnsentTick
                 bool shouldSend = player_provided_flags_from_tick_to_tick(inSenderIndex, theStartTick + theRedundantActionFlagsCount + theLateActionFlagsCount, theStartTick + theRedundantActionFlagsCount + theEnqueueableFlagsCount + theLateActionFlagsCount);
-                if(shouldSend && (sSmallestIncompleteTick - sSmallestUnsentTick >= sHubPreferences.mSendPeriod))
+                if(shouldSend && (mSmallestIncompleteTick - mSmallestUnsentTick >= sHubPreferences.mSendPeriod))
                         send_packets();
         }
 } // hub_received_game_data_packet_v1()
 
-static void
-hub_received_position_sync_packet(AIStream& ps, int inSenderIndex)
+void
+StarHub::hub_received_position_sync_packet(AIStream& ps, int inSenderIndex)
 {
   int32 positionSum;
   ps >> positionSum;
@@ -1023,68 +986,114 @@ hub_received_position_sync_packet(AIStream& ps, int inSenderIndex)
   playerReportedPositionSum(inSenderIndex, positionSum);
 }
 
-static void
-reset_position_sums()
+void
+StarHub::reset_position_sums()
 {
   for( int p = 0; p < 8; ++p ) {
-    playerIsOutOfSync[p] = false;
-    positionOfInterest[p] = 0;
-    desyncCountdown[p] = 0;
-    desyncStrikes[p]=0;
-    for(int i = 0; i < numPositionSnapshots; ++i )
+    mPlayerIsOutOfSync[p] = false;
+    mPositionOfInterest[p] = 0;
+    mDesyncCountdown[p] = 0;
+    mDesyncStrikes[p]=0;
+    mReportedWorldHashes[p].clear();
+    for(int i = 0; i < kNumPositionSnapshots; ++i )
     {
-      positionRecords[i].positionSum[p] = 0;
+      mPositionRecords[i].positionSum[p] = 0;
     }
-    currentSnapshotIndex=0;
+    mCurrentSnapshotIndex=0;
   }
 }
 
-static void
-playerReportedPositionSum(int32 inSenderIndex, int32 positionSum)
+void
+StarHub::playerReportedPositionSum(int32 inSenderIndex, int32 positionSum)
 {
-  if ( !network_preferences->detect_desync )
+  // A dedicated hub has no game of its own to compare against
+  if ( isDedicated() || !network_preferences->detect_desync )
     return;
   
     //If we currently don't have a position of interest, create one.
-  if ( positionOfInterest[inSenderIndex] == 0 ) {
-    positionOfInterest[inSenderIndex]=positionSum;
-    desyncCountdown[inSenderIndex] = numPositionSnapshots + 3;
+  if ( mPositionOfInterest[inSenderIndex] == 0 ) {
+    mPositionOfInterest[inSenderIndex]=positionSum;
+    mDesyncCountdown[inSenderIndex] = kNumPositionSnapshots + 3;
   }
 }
 
-void capture_position_sums_and_check_for_dsync()
+void
+StarHub::hub_received_world_hash_packet(AIStream& ps, int inSenderIndex)
+{
+  world_hash_snapshot snapshot;
+  ps >> snapshot.tick
+     >> snapshot.level;
+  for (int i = 0; i < NUMBER_OF_WORLD_HASH_SUBSYSTEMS; i++)
+    ps >> snapshot.hashes[i];
+
+  if ( isDedicated() || !network_preferences->detect_desync )
+    return;
+
+  std::deque<world_hash_snapshot>& reports = mReportedWorldHashes[inSenderIndex];
+  reports.push_back(snapshot);
+  if (reports.size() > MAXIMUM_WORLD_HASH_SNAPSHOTS)
+    reports.pop_front();
+
+  check_reported_world_hashes(inSenderIndex);
+}
+
+  //Compares a player's world hashes with ours once we've played the same ticks. The first
+  //mismatch names the subsystem that diverged, which is much more useful than a position.
+void
+StarHub::check_reported_world_hashes(int inPlayerIndex)
+{
+  std::deque<world_hash_snapshot>& reports = mReportedWorldHashes[inPlayerIndex];
+  while (!reports.empty())
+  {
+    short subsystem;
+    short result = check_world_hash(reports.front(), &subsystem);
+    if (result == _world_hash_pending)
+      break;
+
+    if (result == _world_hash_diverged && !mPlayerIsOutOfSync[inPlayerIndex])
+    {
+      logWarningNMT("Player %d diverged from the hub in %s at tick %d", inPlayerIndex, get_world_hash_subsystem_name(subsystem), reports.front().tick);
+      mPlayerIsOutOfSync[inPlayerIndex] = true;
+      screen_printf("%s went out of sync (%s, tick %d)!", reinterpret_cast<player_info*>(NetGetPlayerData(inPlayerIndex))->name, get_world_hash_subsystem_name(subsystem), reports.front().tick);
+    }
+    reports.pop_front();
+  }
+}
+
+void
+StarHub::capturePositionSumsAndCheckForDesync()
 {
   if ( !network_preferences->detect_desync )
     return;
   
-  if ( currentSnapshotIndex >= (numPositionSnapshots-1) ) {
-    currentSnapshotIndex=0;
+  if ( mCurrentSnapshotIndex >= (kNumPositionSnapshots-1) ) {
+    mCurrentSnapshotIndex=0;
   } else {
-    currentSnapshotIndex++;
+    mCurrentSnapshotIndex++;
   }
-  for( int p = 0; p < sNetworkPlayers.size(); ++p ) {
+  for( int p = 0; p < mNetworkPlayers.size(); ++p ) {
     
       //If a player has a position of interest, check to see if that is in the buffer before overwriting. If the countdown expires, the player is out-of-sync.
       //There is a small chance that the real position sum is zero, and will be wrongly ignored. Who cares?
-    if ( positionOfInterest[p] != 0 ) {
-      if (positionRecords[currentSnapshotIndex].positionSum[p] == positionOfInterest[p] ) {
+    if ( mPositionOfInterest[p] != 0 ) {
+      if (mPositionRecords[mCurrentSnapshotIndex].positionSum[p] == mPositionOfInterest[p] ) {
           //We verified a position of interest; now clear it and carry on.
-        positionOfInterest[p] = 0;
-        desyncCountdown[p] = 0;
+        mPositionOfInterest[p] = 0;
+        mDesyncCountdown[p] = 0;
         logDumpNMT("Player %d verified their location\n", p);
-        desyncStrikes[p]=0;
+        mDesyncStrikes[p]=0;
       } else {
-        desyncCountdown[p]--;
-        if( desyncCountdown[p] <= 0 ) {
-          logDumpNMT("Player %d got a desync strike for position %d!\n", p, positionOfInterest[p]);
+        mDesyncCountdown[p]--;
+        if( mDesyncCountdown[p] <= 0 ) {
+          logDumpNMT("Player %d got a desync strike for position %d!\n", p, mPositionOfInterest[p]);
           
             //The countdown for this player has expired, and we have not found the reported position of interest. The player is now gets a strike, which might make them out of sync.
-          positionOfInterest[p] = 0;
-          desyncCountdown[p]=0;
-          desyncStrikes[p]++;
+          mPositionOfInterest[p] = 0;
+          mDesyncCountdown[p]=0;
+          mDesyncStrikes[p]++;
           
-          if(desyncStrikes[p] >= 3) {
-            playerIsOutOfSync[p]=true;
+          if(mDesyncStrikes[p] >= 3) {
+            mPlayerIsOutOfSync[p]=true;
             screen_printf("%s seems to have gone out of sync!", reinterpret_cast<player_info*>(NetGetPlayerData(p))->name);
           }
         }
@@ -1093,13 +1102,15 @@ void capture_position_sums_and_check_for_dsync()
     
     player_data *player= get_player_data(p);
 
-    positionRecords[currentSnapshotIndex].positionSum[p] = player->location.x + player->location.y + player->location.z;
+    mPositionRecords[mCurrentSnapshotIndex].positionSum[p] = player->location.x + player->location.y + player->location.z;
+
+    check_reported_world_hashes(p);
   }
 
 }
 
-static void
-player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowledgedTick)
+void
+StarHub::player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowledgedTick)
 {
 	logTraceNMT("player_acknowledged_up_to_tick(%d, %d)", inPlayerIndex, inSmallestUnacknowledgedTick);
 	
@@ -1110,18 +1121,18 @@ player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowled
                 return;
 
         // We've heard from this player
-        thePlayer.mLastNetworkTickHeard = sNetworkTicker;
+        thePlayer.mLastNetworkTickHeard = mNetworkTicker;
 
         // Mark us ACKed for each intermediate tick
         for(int theTick = thePlayer.mSmallestUnacknowledgedTick; theTick < inSmallestUnacknowledgedTick; theTick++)
         {
-		logDumpNMT("tick %d: sPlayerDataDisposition=%d", theTick, sPlayerDataDisposition[theTick]);
+		logDumpNMT("tick %d: mPlayerDataDisposition=%d", theTick, mPlayerDataDisposition[theTick]);
 		
-                assert(sPlayerDataDisposition[theTick] & (((uint32)1) << inPlayerIndex));
-                sPlayerDataDisposition[theTick] &= ~(((uint32)1) << inPlayerIndex);
-		if (inPlayerIndex != sLocalPlayerIndex) 
+                assert(mPlayerDataDisposition[theTick] & (((uint32)1) << inPlayerIndex));
+                mPlayerDataDisposition[theTick] &= ~(((uint32)1) << inPlayerIndex);
+		if (inPlayerIndex != mLocalPlayerIndex) 
 		{
-			assert(theTick < sFlagSendTimeQueue.getWriteTick());
+			assert(theTick < mFlagSendTimeQueue.getWriteTick());
 
 			// update the latency calculations
 			if (thePlayer.mLatencyBuffer.size() >= kDisplayLatencyWindow)
@@ -1133,27 +1144,28 @@ player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowled
 			{
 				thePlayer.mLatencyBuffer.pop_back();
 			}
-			int32 latency = sNetworkTicker - sFlagSendTimeQueue.peek(theTick);
+			int32 latency = mNetworkTicker - mFlagSendTimeQueue.peek(theTick);
 			thePlayer.mLatencyBuffer.push_front(latency);
 			thePlayer.mLatencyTicks += latency;
+			mTelemetry.roundTrip(inPlayerIndex, latency);
 
 		}
 			
-                if(sPlayerDataDisposition[theTick] == 0)
+                if(mPlayerDataDisposition[theTick] == 0)
                 {
-                        assert(theTick == sPlayerDataDisposition.getReadTick());
-			assert(theTick == sFlagSendTimeQueue.getReadTick());
-			assert(theTick == sPlayerReflectedFlags.getReadTick());
+                        assert(theTick == mPlayerDataDisposition.getReadTick());
+			assert(theTick == mFlagSendTimeQueue.getReadTick());
+			assert(theTick == mPlayerReflectedFlags.getReadTick());
                         
-                        sPlayerDataDisposition.dequeue();
-			sFlagSendTimeQueue.dequeue();
-			sPlayerReflectedFlags.dequeue();
-                        for(size_t i = 0; i < sFlagsQueues.size(); i++)
+                        mPlayerDataDisposition.dequeue();
+			mFlagSendTimeQueue.dequeue();
+			mPlayerReflectedFlags.dequeue();
+                        for(size_t i = 0; i < mFlagsQueues.size(); i++)
                         {
-                                if(sFlagsQueues[i].size() > 0)
+                                if(mFlagsQueues[i].size() > 0)
                                 {
-                                        assert(sFlagsQueues[i].getReadTick() == theTick);
-                                        sFlagsQueues[i].dequeue();
+                                        assert(mFlagsQueues[i].getReadTick() == theTick);
+                                        mFlagsQueues[i].dequeue();
                                 }
                         }
                 }
@@ -1173,35 +1185,36 @@ player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowled
 	
 } // player_acknowledged_up_to_tick()
 
-static bool make_up_flags_for_first_incomplete_tick()
+bool
+StarHub::make_up_flags_for_first_incomplete_tick()
 {
 	// find the smallest incomplete tick, and make up flags for anybody in that tick!
 	
-	if (sPlayerDataDisposition.getWriteTick() == sSmallestIncompleteTick) 
+	if (mPlayerDataDisposition.getWriteTick() == mSmallestIncompleteTick) 
 		// we don't have flags for anybody!
 		return false;
 
 	// never make up flags for ourself
-	if (getFlagsQueue(sLocalPlayerIndex).getWriteTick() == sSmallestIncompleteTick)
+	if (!isDedicated() && getFlagsQueue(mLocalPlayerIndex).getWriteTick() == mSmallestIncompleteTick)
 		return false;
 
 	// check to make sure everyone we want to make up flags for is in the lagging players bitmask
-	for (int i = 0; i < sNetworkPlayers.size(); i++)
+	for (int i = 0; i < mNetworkPlayers.size(); i++)
 	{
-		if (getFlagsQueue(i).getWriteTick() == sSmallestIncompleteTick && !(sLaggingPlayersBitmask & (1 << i)))
+		if (getFlagsQueue(i).getWriteTick() == mSmallestIncompleteTick && !(mLaggingPlayersBitmask & (1 << i)))
 			return false;
 	}
 
-	logTraceNMT("making up flags for tick %i", sSmallestIncompleteTick);
+	logTraceNMT("making up flags for tick %i", mSmallestIncompleteTick);
 
-	for (int i = 0; i < sNetworkPlayers.size(); i++)
+	for (int i = 0; i < mNetworkPlayers.size(); i++)
 	{
-		if (getFlagsQueue(i).getWriteTick() == sSmallestIncompleteTick)
+		if (getFlagsQueue(i).getWriteTick() == mSmallestIncompleteTick)
 		{
 			// network code shouldn't figure this out, someone else should
 			action_flags_t motionFlags;
 			TickBasedActionQueue& theLateQueue = getLateFlagsQueue(i);
-			if (sLaggingPlayersBitmask & (1 << i) && theLateQueue.getWriteTick() > theLateQueue.getReadTick())
+			if (mLaggingPlayersBitmask & (1 << i) && theLateQueue.getWriteTick() > theLateQueue.getReadTick())
 			{
 				uint32 midpoint = ((theLateQueue.getWriteTick() - theLateQueue.getReadTick()) / 2 + theLateQueue.getReadTick());
 				// collapse the queue up to the midpoint
@@ -1219,59 +1232,60 @@ static bool make_up_flags_for_first_incomplete_tick()
 			} 
 			else
 			{
-				motionFlags = sLastFlagsReceived[i] & (_moving | _sidestepping);
-				if (local_random() % 10 > 8) sLastFlagsReceived[i] = 0;
+				motionFlags = mLastFlagsReceived[i] & (_moving | _sidestepping);
+				if (local_random() % 10 > 8) mLastFlagsReceived[i] = 0;
 			}
-			sPlayerReflectedFlags[sSmallestIncompleteTick] |= (1 << i);
+			mPlayerReflectedFlags[mSmallestIncompleteTick] |= (1 << i);
 			getFlagsQueue(i).enqueue(motionFlags);
+			mTelemetry.madeUpFlags(1);
 		}
 	}
-	sPlayerDataDisposition[sSmallestIncompleteTick] = sConnectedPlayersBitmask;
-	sSmallestIncompleteTick++;
-	sLastRealUpdate = sNetworkTicker;
+	mPlayerDataDisposition[mSmallestIncompleteTick] = mConnectedPlayersBitmask;
+	mSmallestIncompleteTick++;
+	mLastRealUpdate = mNetworkTicker;
 	return true;
 }
 
 // Returns true if we now have enough data to send at least one new tick
-static bool
-player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTick, int32 inSmallestUnreceivedTick)
+bool
+StarHub::player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTick, int32 inSmallestUnreceivedTick)
 {
 	logTraceNMT("player_provided_flags_from_tick_to_tick(%d, %d, %d)", inPlayerIndex, inFirstNewTick, inSmallestUnreceivedTick);
 	
         bool shouldSend = false;
 
-	assert(sPlayerDataDisposition.getWriteTick() == sPlayerReflectedFlags.getWriteTick());
+	assert(mPlayerDataDisposition.getWriteTick() == mPlayerReflectedFlags.getWriteTick());
 
-        for(int i = sPlayerDataDisposition.getWriteTick(); i < inSmallestUnreceivedTick; i++)
+        for(int i = mPlayerDataDisposition.getWriteTick(); i < inSmallestUnreceivedTick; i++)
         {
-		logDumpNMT("tick %d: enqueueing sPlayerDataDisposition %d", i, sConnectedPlayersBitmask);
-                sPlayerDataDisposition.enqueue(sConnectedPlayersBitmask);
-		sPlayerReflectedFlags.enqueue(0);
+		logDumpNMT("tick %d: enqueueing mPlayerDataDisposition %d", i, mConnectedPlayersBitmask);
+                mPlayerDataDisposition.enqueue(mConnectedPlayersBitmask);
+		mPlayerReflectedFlags.enqueue(0);
         }
 
         for(int i = inFirstNewTick; i < inSmallestUnreceivedTick; i++)
         {
-		logDumpNMT("tick %d: sPlayerDataDisposition=%d", i, sPlayerDataDisposition[i]);
+		logDumpNMT("tick %d: mPlayerDataDisposition=%d", i, mPlayerDataDisposition[i]);
 		
-                assert(sPlayerDataDisposition[i] & (((uint32)1) << inPlayerIndex));
-                sPlayerDataDisposition[i] &= ~(((uint32)1) << inPlayerIndex);
+                assert(mPlayerDataDisposition[i] & (((uint32)1) << inPlayerIndex));
+                mPlayerDataDisposition[i] &= ~(((uint32)1) << inPlayerIndex);
 		
 		// remove the player from the list of lagging players, and
 		// dequeue his late flags
-		sLaggingPlayersBitmask &= ~(((uint32)1) << inPlayerIndex);
+		mLaggingPlayersBitmask &= ~(((uint32)1) << inPlayerIndex);
 		TickBasedActionQueue& theLateQueue = getLateFlagsQueue(inPlayerIndex);
 		while (theLateQueue.getReadTick() < theLateQueue.getWriteTick())
 			theLateQueue.dequeue();
 
-                if(sPlayerDataDisposition[i] == 0)
+                if(mPlayerDataDisposition[i] == 0)
                 {
-                        assert(sSmallestIncompleteTick == i);
-                        sSmallestIncompleteTick++;
-			sLastRealUpdate = sNetworkTicker;
+                        assert(mSmallestIncompleteTick == i);
+                        mSmallestIncompleteTick++;
+			mLastRealUpdate = mNetworkTicker;
                         shouldSend = true;
 
                         // Now people need to ACK
-                        sPlayerDataDisposition[i] = sConnectedPlayersBitmask;
+                        mPlayerDataDisposition[i] = mConnectedPlayersBitmask;
                 }
 
         } // loop over ticks with new data
@@ -1282,8 +1296,8 @@ player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTi
 
 
 
-static void
-process_messages(AIStream& ps, int inSenderIndex)
+void
+StarHub::process_messages(AIStream& ps, int inSenderIndex)
 {
         bool done = false;
 
@@ -1307,60 +1321,37 @@ process_messages(AIStream& ps, int inSenderIndex)
 
 
 
-static void
-process_lossy_byte_stream_message(AIStream& ps, int inSenderIndex, uint16 inLength)
+void
+StarHub::process_lossy_byte_stream_message(AIStream& ps, int inSenderIndex, uint16 inLength)
 {
-	assert(inSenderIndex >= 0 && inSenderIndex < static_cast<int>(sNetworkPlayers.size()));
+	assert(inSenderIndex >= 0 && inSenderIndex < static_cast<int>(mNetworkPlayers.size()));
 
-	HubLossyByteStreamChunkDescriptor theDescriptor;
+	int16 theType;
+	uint32 theDestinations;
 
 	size_t theHeaderStreamPosition = ps.tellg();
-	ps >> theDescriptor.mType >> theDescriptor.mDestinations;
-	theDescriptor.mLength = inLength - (ps.tellg() - theHeaderStreamPosition);
-	theDescriptor.mSender = inSenderIndex;
+	ps >> theType >> theDestinations;
+	uint16 theLength = inLength - (ps.tellg() - theHeaderStreamPosition);
 
-	logDumpNMT("got %d bytes of lossy stream type %d from player %d for destinations 0x%x", theDescriptor.mLength, theDescriptor.mType, theDescriptor.mSender, theDescriptor.mDestinations);
-
-	bool canEnqueue = true;
-	
-	if(sOutgoingLossyByteStreamDescriptors.getRemainingSpace() < 1)
-	{
-		logNoteNMT("no descriptor space remains; discarding (%uh) bytes of lossy streaming data of distribution type %hd from player %hu destined for 0x%lx", theDescriptor.mLength, theDescriptor.mType, theDescriptor.mSender, theDescriptor.mDestinations);
-		canEnqueue = false;
-	}
+	logDumpNMT("got %d bytes of lossy stream type %d from player %d for destinations 0x%x", theLength, theType, inSenderIndex, theDestinations);
 
-	// We avoid enqueueing a partial chunk to make things easier on code that uses us
-	if(theDescriptor.mLength > sOutgoingLossyByteStreamData.getRemainingSpace())
+	// Only the types the protocol knows get relayed, so a spoke can't fill us up with others
+	if(!LossyByteStreamMultiplexer::isKnownType(theType))
 	{
-		logNoteNMT("insufficient buffer space for %uh bytes of lossy streaming data of distribution type %hd from player %hu destined for 0x%lx; discarded", theDescriptor.mLength, theDescriptor.mType, theDescriptor.mSender, theDescriptor.mDestinations);
-		canEnqueue = false;
+		logNoteNMT("refusing %d bytes of unknown lossy stream type %d from player %d", theLength, theType, inSenderIndex);
+		ps.ignore(theLength);
+		return;
 	}
 
-	if(canEnqueue)
-	{
-		if(theDescriptor.mLength > 0)
-		{
-			// This is an assert, not a test, because the data buffer should be no
-			// bigger than the scratch buffer (and if it didn't fit into the data buffer,
-			// canEnqueue would be false).
-			assert(theDescriptor.mLength <= sizeof(sScratchBuffer));
-
-			// XXX extraneous copy, needed given the current interfaces to these things
-			ps.read(sScratchBuffer, theDescriptor.mLength);
-	
-			sOutgoingLossyByteStreamData.enqueueBytes(sScratchBuffer, theDescriptor.mLength);
-			sOutgoingLossyByteStreamDescriptors.enqueue(theDescriptor);
-		}
-	}
-	else
-		// We still have to gobble up the entire message, even if we can't use it.
-		ps.ignore(theDescriptor.mLength);
+	// This reads (or, if it can't be queued, skips) the data
+	if(theLength > 0)
+		mOutgoingLossyByteStreams.enqueue(theType, theDestinations, static_cast<uint8>(inSenderIndex), ps, theLength);
 }
 
 
 
-static void
-process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType)
+void
+StarHub::process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType)
 {
         // All optional messages are required to give their length in the two bytes
         // immediately following their type.  (The message length value does not include
@@ -1379,8 +1370,8 @@ process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType)
 
 
 
-static void
-make_player_netdead(int inPlayerIndex)
+void
+StarHub::make_player_netdead(int inPlayerIndex)
 {
 	logContextNMT("making player %d netdead", inPlayerIndex);
 	
@@ -1389,19 +1380,33 @@ make_player_netdead(int inPlayerIndex)
 	// make sure we're not processing a packet
 	{
 		MyTMMutexTaker mutex;
-		thePlayer.mNetDeadTick = sSmallestIncompleteTick;
+		thePlayer.mNetDeadTick = mSmallestIncompleteTick;
 		thePlayer.mConnected = false;
-		sConnectedPlayersBitmask &= ~(((uint32)1) << inPlayerIndex);
-		sAddressToPlayerIndex.erase(thePlayer.mAddress);
+		mConnectedPlayersBitmask &= ~(((uint32)1) << inPlayerIndex);
+		mAddressToPlayerIndex.erase(thePlayer.mAddress);
+	}
+
+	// Without a local player, our timing follows whichever spoke is the reference; don't
+	// let it go on following a dead one.
+	if(isDedicated() && static_cast<size_t>(inPlayerIndex) == mReferencePlayerIndex)
+	{
+		for(size_t i = 0; i < mNetworkPlayers.size(); i++)
+		{
+			if(mNetworkPlayers[i].mConnected)
+			{
+				mReferencePlayerIndex = i;
+				break;
+			}
+		}
 	}
 
 	// We save this off because player_provided... call below may change it.
-	int32 theSavedIncompleteTick = sSmallestIncompleteTick;
+	int32 theSavedIncompleteTick = mSmallestIncompleteTick;
 	
         // Pretend for housekeeping that he's provided data for all currently known ticks
         // We go from the first tick for which we don't actually have his data through the last
         // tick we actually know about.
-        player_provided_flags_from_tick_to_tick(inPlayerIndex, getFlagsQueue(inPlayerIndex).getWriteTick(), sPlayerDataDisposition.getWriteTick());
+        player_provided_flags_from_tick_to_tick(inPlayerIndex, getFlagsQueue(inPlayerIndex).getWriteTick(), mPlayerDataDisposition.getWriteTick());
 
         // Pretend for housekeeping that he's already acknowledged all sent ticks
         player_acknowledged_up_to_tick(inPlayerIndex, theSavedIncompleteTick);
@@ -1409,27 +1414,27 @@ make_player_netdead(int inPlayerIndex)
 
 static int add_squares(int x, int y) { return x + y * y; }
 
-static bool
-hub_tick()
+bool
+StarHub::tick()
 {
-        sNetworkTicker++;
+        mNetworkTicker++;
 
-	logContextNMT("performing hub_tick %d", sNetworkTicker);
+	logContextNMT("performing hub_tick %d", mNetworkTicker);
 
         // Check for newly netdead players
         bool shouldSend = false;
-        for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+        for(size_t i = 0; i < mNetworkPlayers.size(); i++)
         {
-                int theSilentTicksBeforeNetDeath = (sNetworkPlayers[i].mSmallestUnacknowledgedTick < sSmallestRealGameTick) ? sHubPreferences.mPregameTicksBeforeNetDeath : sHubPreferences.mInGameTicksBeforeNetDeath;
-                if (sNetworkPlayers[i].mConnected && sNetworkTicker - sNetworkPlayers[i].mLastNetworkTickHeard > theSilentTicksBeforeNetDeath)
+                int theSilentTicksBeforeNetDeath = (mNetworkPlayers[i].mSmallestUnacknowledgedTick < mSmallestRealGameTick) ? sHubPreferences.mPregameTicksBeforeNetDeath : sHubPreferences.mInGameTicksBeforeNetDeath;
+                if (mNetworkPlayers[i].mConnected && mNetworkTicker - mNetworkPlayers[i].mLastNetworkTickHeard > theSilentTicksBeforeNetDeath)
                 {
                         make_player_netdead(i);
                         shouldSend = true;
                 }
 		// if this guy's last ACK was longer ago than the queues have space to store things, I guess dump him
-		else if (i != sLocalPlayerIndex && sNetworkPlayers[i].mConnected && sNetworkPlayers[i].mSmallestUnacknowledgedTick >= sSmallestRealGameTick && (sNetworkPlayers[sReferencePlayerIndex].mSmallestUnacknowledgedTick - sNetworkPlayers[i].mSmallestUnacknowledgedTick) >= kFlagsQueueSize) {
+		else if (i != mLocalPlayerIndex && mNetworkPlayers[i].mConnected && mNetworkPlayers[i].mSmallestUnacknowledgedTick >= mSmallestRealGameTick && (mNetworkPlayers[mReferencePlayerIndex].mSmallestUnacknowledgedTick - mNetworkPlayers[i].mSmallestUnacknowledgedTick) >= kFlagsQueueSize) {
 			{
-				logWarningNMT("Disconnecting player %i for late ACKs (last ACK %i, reference ACK %i", i, sNetworkPlayers[i].mSmallestUnacknowledgedTick, sNetworkPlayers[sReferencePlayerIndex].mSmallestUnacknowledgedTick);
+				logWarningNMT("Disconnecting player %i for late ACKs (last ACK %i, reference ACK %i", i, mNetworkPlayers[i].mSmallestUnacknowledgedTick, mNetworkPlayers[mReferencePlayerIndex].mSmallestUnacknowledgedTick);
 				make_player_netdead(i);
 				shouldSend = true;
 			}
@@ -1439,33 +1444,33 @@ hub_tick()
     
 	// if we're getting behind, make up flags
 	
-	if (sHubPreferences.mBandwidthReduction && sPlayerDataDisposition.getReadTick() >= sSmallestRealGameTick)
+	if (sHubPreferences.mBandwidthReduction && mPlayerDataDisposition.getReadTick() >= mSmallestRealGameTick)
 	{
-		if (sHubPreferences.mMinimumSendPeriod >= sHubPreferences.mSendPeriod && sSmallestIncompleteTick < sPlayerDataDisposition.getWriteTick())
+		if (sHubPreferences.mMinimumSendPeriod >= sHubPreferences.mSendPeriod && mSmallestIncompleteTick < mPlayerDataDisposition.getWriteTick())
 		{
 			
-			if (sNetworkTicker - sLastRealUpdate >= sHubPreferences.mMinimumSendPeriod)
+			if (mNetworkTicker - mLastRealUpdate >= sHubPreferences.mMinimumSendPeriod)
 			{
 				// add anybody holding us back to the lagging player bitmask
-				for (int i = 0; i < sNetworkPlayers.size(); i++)
+				for (int i = 0; i < mNetworkPlayers.size(); i++)
 				{
-					if (i != sLocalPlayerIndex && sNetworkPlayers[i].mConnected && sSmallestRealGameTick > sNetworkPlayers[i].mNetDeadTick)
+					if (i != mLocalPlayerIndex && mNetworkPlayers[i].mConnected && mSmallestRealGameTick > mNetworkPlayers[i].mNetDeadTick)
 					{
-						if (sPlayerDataDisposition[sSmallestIncompleteTick] & (1 << i))
-							sLaggingPlayersBitmask |= (1 << i);
+						if (mPlayerDataDisposition[mSmallestIncompleteTick] & (1 << i))
+							mLaggingPlayersBitmask |= (1 << i);
 					}
 				}
 			}
 			
-			if (sLaggingPlayersBitmask) {
+			if (mLaggingPlayersBitmask) {
 				// make up flags if a majority of players are ready to go
 				int readyPlayers = 0;
 				int nonReadyPlayers = 0;
-				for (int i = 0; i < sNetworkPlayers.size(); i++)
+				for (int i = 0; i < mNetworkPlayers.size(); i++)
 				{
-					if (sNetworkPlayers[i].mConnected && sSmallestRealGameTick > sNetworkPlayers[i].mNetDeadTick)
+					if (mNetworkPlayers[i].mConnected && mSmallestRealGameTick > mNetworkPlayers[i].mNetDeadTick)
 					{
-						if (sPlayerDataDisposition[sSmallestIncompleteTick] & (1 << i))
+						if (mPlayerDataDisposition[mSmallestIncompleteTick] & (1 << i))
 							nonReadyPlayers++;
 						else
 							readyPlayers++;
@@ -1487,7 +1492,7 @@ hub_tick()
 		else
 		{
 			// Make sure we send at least every once in a while to keep things going
-			if(sNetworkTicker > sLastNetworkTickSent && (sNetworkTicker - sLastNetworkTickSent) >= sHubPreferences.mRecoverySendPeriod)
+			if(mNetworkTicker > mLastNetworkTickSent && (mNetworkTicker - mLastNetworkTickSent) >= sHubPreferences.mRecoverySendPeriod)
 				send_packets();
 		}
 		
@@ -1495,13 +1500,13 @@ hub_tick()
         check_send_packet_to_spoke();
 
 	// calculate standard deviation
-	if (sNetworkTicker % kJitterUpdateInterval == 0)
+	if (mNetworkTicker % kJitterUpdateInterval == 0)
 	{
-		for (int i = 0; i < sNetworkPlayers.size(); ++i)
+		for (int i = 0; i < mNetworkPlayers.size(); ++i)
 		{
-			if (i != sLocalPlayerIndex)
+			if (i != mLocalPlayerIndex)
 			{
-				NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
+				NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
 				if (thePlayer.mConnected)
 				{
 					if (thePlayer.mLatencyBuffer.size())
@@ -1512,27 +1517,33 @@ hub_tick()
 						double deviation = std::sqrt(squares / thePlayer.mLatencyBuffer.size() - average * average);
 						thePlayer.mStats.jitter = static_cast<int16>(std::floor(deviation * 1000 / TICKS_PER_SECOND));
 					} 
+
+					thePlayer.mStats.bytes_per_tick = std::min<uint32>(thePlayer.mGameDataBytes / kJitterUpdateInterval, UINT16_MAX);
+					thePlayer.mStats.unpacked_bytes_per_tick = std::min<uint32>(thePlayer.mUnpackedGameDataBytes / kJitterUpdateInterval, UINT16_MAX);
 				}
 				else if (thePlayer.mStats.jitter != NetworkStats::disconnected)
 				{
 					thePlayer.mStats.jitter = NetworkStats::disconnected;
 				}
+
+				thePlayer.mGameDataBytes = 0;
+				thePlayer.mUnpackedGameDataBytes = 0;
 			}
 		}
 	}
 
 	// calculate ping
-	for (int i = 0; i < sNetworkPlayers.size(); ++i)
+	for (int i = 0; i < mNetworkPlayers.size(); ++i)
 	{
-		NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
-		if (i != sLocalPlayerIndex)
+		NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
+		if (i != mLocalPlayerIndex)
 		{
 			if (thePlayer.mConnected)
 			{
 				if (thePlayer.mLatencyBuffer.size())
 				{
 					int32 samples = std::min(thePlayer.mLatencyBuffer.size(), static_cast<size_t>(kDisplayLatencyWindow));
-					int32 latency_ticks = std::max(thePlayer.mLatencyTicks, ((sNetworkTicker - thePlayer.mLastNetworkTickHeard) * samples));
+					int32 latency_ticks = std::max(thePlayer.mLatencyTicks, ((mNetworkTicker - thePlayer.mLastNetworkTickHeard) * samples));
 					thePlayer.mStats.latency = (latency_ticks * 1000 / TICKS_PER_SECOND / samples);
 				}
 			}
@@ -1543,10 +1554,38 @@ hub_tick()
 		}
 	}
 
+	if (star_telemetry_enabled())
+		record_telemetry();
+
         // We want to run again.
         return true;
 }
 
+void
+StarHub::record_telemetry()
+{
+	StarTelemetryRecord theRecord = mTelemetry.newRecord(kStarTelemetryHubTick, mNetworkTicker);
+	theRecord.mValues[1] = mSmallestIncompleteTick;
+	theRecord.mValues[2] = mPlayerDataDisposition.size();
+	theRecord.mValues[3] = mFlagSendTimeQueue.size();
+	theRecord.mValues[4] = mOutgoingLossyByteStreams.queuedBytes();
+	theRecord.mValues[5] = mOutgoingLossyByteStreams.queuedChunks();
+	theRecord.mValues[6] = mConnectedPlayersBitmask;
+	theRecord.mValues[7] = mLaggingPlayersBitmask;
+	mTelemetry.takeFlagCounts(theRecord.mValues[8], theRecord.mValues[9]);
+	star_telemetry_record(theRecord);
+
+	if (mNetworkTicker % kStarTelemetryReportPeriod == 0)
+	{
+		for (size_t i = 0; i < mNetworkPlayers.size(); i++)
+		{
+			if (i != mLocalPlayerIndex)
+				mTelemetry.reportPlayer(mNetworkTicker, i, mNetworkPlayers[i].mStats);
+		}
+		mTelemetry.reportTraffic(mNetworkTicker);
+	}
+}
+
 #ifndef INT8_MAX
 #define INT8_MAX 127
 #endif
@@ -1554,37 +1593,25 @@ hub_tick()
 #define INT8_MIN -128
 #endif
 
-static void
-send_packets()
+void
+StarHub::send_packets()
 {
-	// Currently, at most one lossy data descriptor is used per trip through this function.  So,
-	// we do some processing here outside the loop since the results'd be the same every time.
-	HubLossyByteStreamChunkDescriptor theDescriptor = { 0, 0, 0, 0 };
-	bool haveLossyData = false;
-	if(sOutgoingLossyByteStreamDescriptors.getCountOfElements() > 0)
-	{
-		haveLossyData = true;
-		theDescriptor = sOutgoingLossyByteStreamDescriptors.peek();
-
-		// XXX extraneous copy due to limited interfaces
-		// We assert here; the real "test" happened when it was enqueued.
-		assert(theDescriptor.mLength <= sizeof(sScratchBuffer));
-		sOutgoingLossyByteStreamData.peekBytes(sScratchBuffer, theDescriptor.mLength);
-	}
+	// The same lossy chunks are offered to every player; each packet gets those addressed to its player.
+	mOutgoingLossyByteStreams.select(mNetworkTicker);
 
 	// remember when we sent flags for the first time
-	for (int32 i = sFlagSendTimeQueue.getWriteTick(); i < sSmallestIncompleteTick; i++) 
+	for (int32 i = mFlagSendTimeQueue.getWriteTick(); i < mSmallestIncompleteTick; i++) 
 	{
-		sFlagSendTimeQueue.enqueue(sNetworkTicker);
+		mFlagSendTimeQueue.enqueue(mNetworkTicker);
 	}
 		
-        for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+        for(size_t i = 0; i < mNetworkPlayers.size(); i++)
         {
-                NetworkPlayer_hub& thePlayer = sNetworkPlayers[i];
+                NetworkPlayer_hub& thePlayer = mNetworkPlayers[i];
                 if(thePlayer.mConnected && thePlayer.mAddressKnown)
                 {
-			AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-                        AOStreamBE ps(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+			AOStreamBE hdr(mOutgoingFrame->data, kStarPacketHeaderSize);
+                        AOStreamBE ps(mOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
 
                         try {
                                 // acknowledgement
@@ -1600,30 +1627,18 @@ send_packets()
                                 }
         
                                 // Netdead players?
-                                for(size_t j = 0; j < sNetworkPlayers.size(); j++)
+                                for(size_t j = 0; j < mNetworkPlayers.size(); j++)
                                 {
-                                        if(thePlayer.mSmallestUnacknowledgedTick <= sNetworkPlayers[j].mNetDeadTick)
+                                        if(thePlayer.mSmallestUnacknowledgedTick <= mNetworkPlayers[j].mNetDeadTick)
                                         {
                                                 ps << (uint16)kPlayerNetDeadMessageType
                                                         << (uint8)j	// dead player index
-                                                        << sNetworkPlayers[j].mNetDeadTick;
+                                                        << mNetworkPlayers[j].mNetDeadTick;
                                         }
                                 }
 
-				// Lossy streaming data?
-				if(haveLossyData && ((theDescriptor.mDestinations & (((uint32)1) << i)) != 0))
-				{
-					logDumpNMT("packet to player %d will contain %d bytes of lossy byte stream type %d from player %d", i, theDescriptor.mLength, theDescriptor.mType, theDescriptor.mSender);
-					// In AStreams, sizeof(packed scalar) == sizeof(unpacked scalar)
-					uint16 theMessageLength = sizeof(theDescriptor.mType) + sizeof(theDescriptor.mSender) + theDescriptor.mLength;
-					
-					ps << (uint16)kHubToSpokeLossyByteStreamMessageType
-						<< theMessageLength
-						<< theDescriptor.mType
-						<< theDescriptor.mSender;
-
-					ps.write(sScratchBuffer, theDescriptor.mLength);
-				}
+				// Lossy streaming data
+				mOutgoingLossyByteStreams.writeSelected(ps, i);
         
                                 // End of messages
                                 ps << (uint16)kEndOfMessagesMessageType;
@@ -1636,7 +1651,7 @@ send_packets()
 				int32 startTick;
 				int32 endTick;
 
-				if (sHubPreferences.mBandwidthReduction && sPlayerDataDisposition.getReadTick() >= sSmallestRealGameTick)
+				if (sHubPreferences.mBandwidthReduction && mPlayerDataDisposition.getReadTick() >= mSmallestRealGameTick)
 				{
 					// never send fewer than 2 full updates per second, or more than 15
 					int32 latencyCount = std::min(thePlayer.mLatencyBuffer.size(), static_cast<size_t>(kDisplayLatencyWindow));
@@ -1650,51 +1665,58 @@ send_packets()
 						effectiveLatency = TICKS_PER_SECOND / 2;
 					}
 					
-					if (sNetworkTicker - thePlayer.mLastRecoverySend >= effectiveLatency)
+					if (mNetworkTicker - thePlayer.mLastRecoverySend >= effectiveLatency)
 					{
 						// send a large update
-						thePlayer.mLastRecoverySend = sNetworkTicker;
+						thePlayer.mLastRecoverySend = mNetworkTicker;
 						
 						// we want to send 4 seconds worth of flags per second
 						int maxTicks = 4 * effectiveLatency;
 
 						int bytesAvailableForFlags = ps.maxp() - ps.tellp() - 4; // have to encode the tick
+						// packed flags can cost a few bits more than unpacked when every byte changes
+						int maximumBytesPerPlayerTick = 4;
+						if (thePlayer.mPackedActionFlags)
+						{
+							bytesAvailableForFlags -= 2; // and the tick count
+							maximumBytesPerPlayerTick = 5;
+						}
 						// don't run out of room in the packet, though
-						if (maxTicks * sNetworkPlayers.size() * 4 > bytesAvailableForFlags) 
+						if (maxTicks * mNetworkPlayers.size() * maximumBytesPerPlayerTick > bytesAvailableForFlags) 
 						{
-							int maximumBytesPerTick = sNetworkPlayers.size() * 4;
+							int maximumBytesPerTick = mNetworkPlayers.size() * maximumBytesPerPlayerTick;
 							maxTicks = bytesAvailableForFlags / maximumBytesPerTick;
 						}
 
 						startTick = thePlayer.mSmallestUnacknowledgedTick;
-						endTick = (startTick + maxTicks < sSmallestIncompleteTick) ? startTick + maxTicks : sSmallestIncompleteTick;
+						endTick = (startTick + maxTicks < mSmallestIncompleteTick) ? startTick + maxTicks : mSmallestIncompleteTick;
 					}
 					else
 					{
 						// send the last 3 flags
-						startTick = std::max(sSmallestIncompleteTick - 3, thePlayer.mSmallestUnacknowledgedTick);
-						endTick = sSmallestIncompleteTick;
+						startTick = std::max(mSmallestIncompleteTick - 3, thePlayer.mSmallestUnacknowledgedTick);
+						endTick = mSmallestIncompleteTick;
 					}
 				}
 				else 
 				{
 					startTick = thePlayer.mSmallestUnacknowledgedTick;
-					endTick = sSmallestIncompleteTick;
+					endTick = mSmallestIncompleteTick;
 				}
 
 				bool reflectFlags = false;
 				// find out if we need to reflect flags
 				for (int32 tick = startTick; tick < endTick && !reflectFlags; tick++)
 				{
-					if (sPlayerReflectedFlags.peek(tick) & (1 << i)) reflectFlags = true;
+					if (mPlayerReflectedFlags.peek(tick) & (1 << i)) reflectFlags = true;
 				}
         
                                 // Action_flags!!
                                 // First, preprocess the players to figure out at what tick they'll each stop
                                 // contributing
 				std::vector<int32> theSmallestTickWeWontSend;
-                                theSmallestTickWeWontSend.resize(sNetworkPlayers.size());
-                                for(size_t j = 0; j < sNetworkPlayers.size(); j++)
+                                theSmallestTickWeWontSend.resize(mNetworkPlayers.size());
+                                for(size_t j = 0; j < mNetworkPlayers.size(); j++)
                                 {
                                         // Don't encode our own flags
                                         if(j == i && !reflectFlags)
@@ -1703,8 +1725,8 @@ send_packets()
                                                 continue;
                                         }
         
-                                        theSmallestTickWeWontSend[j] = sSmallestIncompleteTick;
-                                        NetworkPlayer_hub& theOtherPlayer = sNetworkPlayers[j];
+                                        theSmallestTickWeWontSend[j] = mSmallestIncompleteTick;
+                                        NetworkPlayer_hub& theOtherPlayer = mNetworkPlayers[j];
         
                                         // Don't send flags for netdead people
                                         if(!theOtherPlayer.mConnected && theSmallestTickWeWontSend[j] > theOtherPlayer.mNetDeadTick)
@@ -1713,9 +1735,10 @@ send_packets()
         
                                 // Now, encode the flags in tick-major order (this is much easier to decode
                                 // at the other end)
+				PackedActionFlagsWriter thePackedFlags;
                                 for(int32 tick = startTick; tick < endTick; tick++)
                                 {
-                                        for(size_t j = 0; j < sNetworkPlayers.size(); j++)
+                                        for(size_t j = 0; j < mNetworkPlayers.size(); j++)
                                         {
                                                 if(tick < theSmallestTickWeWontSend[j])
                                                 {
@@ -1724,26 +1747,47 @@ send_packets()
                                                                 ps << tick;
                                                                 haveSentStartTick = true;
                                                         }
-                                                        ps << getFlagsQueue(j).peek(tick);
+							if(thePlayer.mPackedActionFlags)
+								thePackedFlags.append(j, getFlagsQueue(j).peek(tick));
+							else
+								ps << getFlagsQueue(j).peek(tick);
                                                 }
                                         }
+					thePackedFlags.endTick();
                                 }
-				
-				hdr << (uint16) (reflectFlags ? kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic : kHubToSpokeGameDataPacketV1Magic);
+
+				int32 theUnpackedSize = ps.tellp();
+				if(thePlayer.mPackedActionFlags)
+				{
+					if(haveSentStartTick)
+					{
+						theUnpackedSize += thePackedFlags.unpackedSize();
+						thePackedFlags.write(ps);
+					}
+
+					hdr << (uint16) (reflectFlags ? kHubToSpokeGameDataPacketWithSpokeFlagsV2Magic : kHubToSpokeGameDataPacketV2Magic);
+				}
+				else
+				{
+					hdr << (uint16) (reflectFlags ? kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic : kHubToSpokeGameDataPacketV1Magic);
+				}
 
 				// blank out the CRC field before calculating
-				sOutgoingFrame->data[2] = 0;
-				sOutgoingFrame->data[3] = 0;
+				mOutgoingFrame->data[2] = 0;
+				mOutgoingFrame->data[3] = 0;
 
-				uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ps.tellp());
+				uint16 crc = calculate_data_crc_ccitt(mOutgoingFrame->data, ps.tellp());
 				hdr << crc;
         
                                 // Send the packet
-                                sOutgoingFrame->data_size = ps.tellp();
-                                if(i == sLocalPlayerIndex)
-                                        send_frame_to_local_spoke(sOutgoingFrame, &thePlayer.mAddress, kPROTOCOL_TYPE, 0 /* ignored */);
+                                mOutgoingFrame->data_size = ps.tellp();
+				thePlayer.mGameDataBytes += ps.tellp();
+				thePlayer.mUnpackedGameDataBytes += theUnpackedSize;
+				mTelemetry.sent(*mOutgoingFrame);
+                                if(i == mLocalPlayerIndex)
+                                        send_frame_to_local_spoke(mOutgoingFrame, &thePlayer.mAddress, kPROTOCOL_TYPE, 0 /* ignored */);
                                 else
-                                        NetDDPSendFrame(sOutgoingFrame, &thePlayer.mAddress, kPROTOCOL_TYPE, 0 /* ignored */);
+                                        mSendFrame(mOutgoingFrame, &thePlayer.mAddress, kPROTOCOL_TYPE, 0 /* ignored */);
                         } // try
                         catch (...)
                         {
@@ -1754,20 +1798,17 @@ send_packets()
 
         } // iterate over players
 
-        sLastNetworkTickSent = sNetworkTicker;
-	sSmallestUnsentTick = sSmallestIncompleteTick;
+        mLastNetworkTickSent = mNetworkTicker;
+	mSmallestUnsentTick = mSmallestIncompleteTick;
+
+	mOutgoingLossyByteStreams.dequeueSelected();
 
-	if(haveLossyData)
-	{
-		sOutgoingLossyByteStreamData.dequeue(theDescriptor.mLength);
-		sOutgoingLossyByteStreamDescriptors.dequeue();
-	}
-	
 } // send_packets()
 
-const NetworkStats& hub_stats(int player_index)
+const NetworkStats&
+StarHub::stats(int inPlayerIndex)
 {
-	return getNetworkPlayer(player_index).mStats;
+	return getNetworkPlayer(inPlayerIndex).mStats;
 }
 
 enum {
@@ -1856,6 +1897,7 @@ void HubParsePreferencesTree(InfoTree prefs, std::string version)
 	}
 
 	prefs.read_attr("use_bandwidth_reduction", sHubPreferences.mBandwidthReduction);
+	prefs.read_attr("adaptive_timing", sHubPreferences.mAdaptiveTiming);
 
 		
 	// The checks above are not sufficient to catch all bad cases; if user specified a window size
@@ -1880,6 +1922,7 @@ InfoTree HubPreferencesTree()
 	for (size_t i = 0; i < kNumAttributes; ++i)
 		root.put_attr(sAttributeStrings[i], *(sAttributeDestinations[i]));
 	root.put_attr("use_bandwidth_reduction", sHubPreferences.mBandwidthReduction);
+	root.put_attr("adaptive_timing", sHubPreferences.mAdaptiveTiming);
 	
 	return root;
 }
@@ -1892,6 +1935,7 @@ DefaultHubPreferences()
 	for(size_t i = 0; i < kNumAttributes; i++)
 		*(sAttributeDestinations[i]) = sDefaultHubPreferences[i];
 	sHubPreferences.mBandwidthReduction = true;
+	sHubPreferences.mAdaptiveTiming = false;
 /*
 	sHubPreferences.mPregameWindowSize = kDefaultPregameWindowSize;
 	sHubPreferences.mInGameWindowSize = kDefaultInGameWindowSize;
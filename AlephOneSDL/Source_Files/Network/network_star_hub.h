@@ -0,0 +1,274 @@
+/*
+ *  network_star_hub.h
+
+	Copyright (C) 2003 and beyond by Woody Zenfell, III
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  The hub half of the star protocol as an object, so that one process can run the hub for
+ *  the game it's playing (see hub_initialize() etc. in network_star.h) or for many games at
+ *  once without playing in any of them (see network_star_hub_dedicated.cpp).
+ */
+
+#ifndef NETWORK_STAR_HUB_H
+#define NETWORK_STAR_HUB_H
+
+#include "network_star.h"
+#include "network.h" // NetworkStats
+#include "network_star_telemetry.h"
+#include "network_star_lossy.h"
+#include "WindowedNthElementFinder.h"
+#include "world_hash.h"
+
+#include <vector>
+#include <map>
+#include <deque>
+
+class AIStream;
+
+typedef OSErr (*StarHubSendFrameProc)(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port);
+
+class StarHub
+{
+public:
+	// Pass NONE as inLocalPlayerIndex for a dedicated hub, which has no player of its own and
+	// doesn't run the game: it only relays action flags between the spokes.
+	StarHub(int32 inStartingTick, size_t inNumPlayers, const NetAddrBlock* const* inPlayerAddresses, size_t inLocalPlayerIndex, StarHubSendFrameProc inSendFrame);
+	~StarHub();
+
+	// Neither of these is reentrant, and they must not run at the same time.
+	void receivedNetworkPacket(DDPPacketBufferPtr inPacket);
+	bool tick();
+
+	// A dedicated hub learns player addresses from its join packets rather than identification packets
+	void playerIdentified(int inPlayerIndex, const NetAddrBlock& inAddress);
+
+	// Once every connected player has ACKed inSmallestPostGameTick, isActive() becomes false
+	void endGame(int32 inSmallestPostGameTick);
+	void deactivate() { mHubActive = false; }
+	bool isActive() const { return mHubActive; }
+	bool isDedicated() const { return mLocalPlayerIndex == static_cast<size_t>(NONE); }
+	bool hasConnectedPlayers() const { return mConnectedPlayersBitmask != 0; }
+	size_t playerCount() const { return mNetworkPlayers.size(); }
+	int32 startingTick() const { return mSmallestRealGameTick; }
+
+	const NetworkStats& stats(int inPlayerIndex);
+	void capturePositionSumsAndCheckForDesync();
+
+private:
+	enum {
+		kFlagsQueueSize = TICKS_PER_SECOND * 5,
+
+		// The number of ticks to wait for position sum verfication. The player gets a desync strike
+		// if position is not verified upon wraparound.
+		kNumPositionSnapshots = 100,
+		kMaximumPlayers = 8
+	};
+
+	struct NetworkPlayer_hub {
+		NetAddrBlock	mAddress;		// network address of player
+		bool		mAddressKnown;		// did player tell us his address yet?
+		bool		mConnected;		// is player still connected?
+		int32		mLastNetworkTickHeard;	// our mNetworkTicker last time we got a packet from them
+		int32		mSmallestUnacknowledgedTick;
+
+		WindowedNthElementFinder<int32>	mNthElementFinder;
+		// We can "hear" ticks that we can't enqueue - this is useful for timing data.
+		int32		mSmallestUnheardTick;
+
+		// When we decide a timing adjustment is needed, we include the timing adjustment
+		// request in every packet outbound to the player until we're sure he's seen it.
+		// In particular, mTimingAdjustmentTick is set to the mSmallestIncompleteTick, so we
+		// know nobody's received data for that tick yet.  We continue to send the message
+		// until the station ACKs past that tick; at that point we know he must have seen
+		// our message.
+		// When we get that ACK, we clear the window and let it fill up again to make sure
+		// we have clean, fresh, post-adjustment data to work from.  We won't make any new
+		// timing adjustment requests to a station with an outstanding timing adjustment
+		// or an incomplete averaging window.
+		int		mOutstandingTimingAdjustment;
+		int32		mTimingAdjustmentTick;
+
+		// If the player is dropped during a game, we need to tell the other players about it.
+		// This is accomplished in much the same way as the timing adjustment - we include
+		// a "player netdead" message in every outbound packet until we're sure they've gotten
+		// the message.  mNetDeadTick, then, works pretty much just like mTimingAdjustmentTick.
+		// mNetDeadTick is the first tick for which the netdead player isn't providing data.
+		int32		mNetDeadTick;
+
+		// the last time a recovery set of flags was sent instead of incremental
+		int32           mLastRecoverySend;
+
+		// latency stuff
+		int32 mLatencyTicks; // sum of the latency ticks from the last second
+		std::deque<int32> mLatencyBuffer;
+
+		NetworkStats mStats;
+
+		// Does the player send (so can receive) packed action flags?
+		bool mPackedActionFlags;
+
+		// Game data bytes to and from the player since we last updated mStats, and what they'd
+		// have been unpacked
+		uint32 mGameDataBytes;
+		uint32 mUnpackedGameDataBytes;
+	};
+
+	struct NetAddrBlockCompare
+	{
+		bool operator()(const NetAddrBlock& a, const NetAddrBlock& b) const
+		{
+			if (a.host == b.host)
+				return a.port < b.port;
+			else
+				return a.host < b.host;
+		}
+	};
+
+	struct positionSumSnapshot {
+		int32 positionSum[kMaximumPlayers];
+	};
+
+	typedef std::vector<TickBasedActionQueue> TickBasedActionQueueCollection;
+	typedef std::map<NetAddrBlock, int, NetAddrBlockCompare> AddressToPlayerIndexType;
+	typedef std::vector<NetworkPlayer_hub> NetworkPlayerCollection;
+
+	void hub_check_for_completion();
+	void player_acknowledged_up_to_tick(size_t inPlayerIndex, int32 inSmallestUnacknowledgedTick);
+	bool player_provided_flags_from_tick_to_tick(size_t inPlayerIndex, int32 inFirstNewTick, int32 inSmallestUnreceivedTick);
+	bool make_up_flags_for_first_incomplete_tick();
+	void hub_received_game_data_packet_v1(AIStream& ps, int inSenderIndex, bool inPacked);
+	void hub_received_position_sync_packet(AIStream& ps, int inSenderIndex);
+	void reset_position_sums();
+	void playerReportedPositionSum(int32 inSenderIndex, int32 positionSum);
+	void hub_received_world_hash_packet(AIStream& ps, int inSenderIndex);
+	void check_reported_world_hashes(int inPlayerIndex);
+	void hub_received_identification_packet(AIStream& ps, NetAddrBlock address);
+	void hub_received_ping_request(AIStream& ps, NetAddrBlock address);
+	void hub_received_ping_response(AIStream& ps, NetAddrBlock address);
+	void process_messages(AIStream& ps, int inSenderIndex);
+	void process_lossy_byte_stream_message(AIStream& ps, int inSenderIndex, uint16 inLength);
+	void process_optional_message(AIStream& ps, int inSenderIndex, uint16 inMessageType);
+	void make_player_netdead(int inPlayerIndex);
+	void send_packets();
+	OSErr send_frame_to_local_spoke(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port);
+	void check_send_packet_to_spoke();
+	void record_telemetry();
+
+	NetworkPlayer_hub& getNetworkPlayer(size_t inIndex);
+	TickBasedActionQueue& getFlagsQueue(size_t inIndex);
+	TickBasedActionQueue& getLateFlagsQueue(size_t inIndex);
+
+	StarHubSendFrameProc mSendFrame;
+
+	positionSumSnapshot mPositionRecords[kNumPositionSnapshots];
+	int mCurrentSnapshotIndex;
+	bool mPlayerIsOutOfSync[kMaximumPlayers];
+	int32 mPositionOfInterest[kMaximumPlayers];
+	int32 mDesyncCountdown[kMaximumPlayers];
+	int32 mDesyncStrikes[kMaximumPlayers];
+
+	// World hashes reported by each player, waiting for our own game to reach their tick.
+	std::deque<world_hash_snapshot> mReportedWorldHashes[kMaximumPlayers];
+
+	// mNetworkTicker advances even if the game clock doesn't.
+	// mLastNetworkTickSent is used to force us to resend packets (at a lower rate) even if we're no longer
+	// getting new data.
+	int32 mNetworkTicker;
+	int32 mLastNetworkTickSent;
+
+	// We have a pregame startup period to help establish (via standard adjustment mechanism) everyone's
+	// timing.  Ticks smaller than mSmallestRealGameTick are part of this startup period.  They smell
+	// just like real in-game ticks, except that spokes won't enqueue them on player_queues, and we
+	// may have different adjustment window sizes and timeout periods for pre-game and in-game ticks.
+	int32 mSmallestRealGameTick;
+
+	// Once everyone ACKs this tick, we're satisfied the game is ended.  (They should all agree on which
+	// tick is last due to the symmetric execution model.)
+	int32 mSmallestPostGameTick;
+
+	// The mFlagsQueues hold all flags for ticks for which we've received data from at least one
+	// station, but for which we haven't received an ACK from all stations.
+	// mFlagsQueues[all].getReadIndex() == mPlayerDataDisposition.getReadIndex();
+	// max(mFlagsQueues[all].getWriteIndex()) == mPlayerDataDisposition.getWriteIndex();
+	// min(mFlagsQueues[all].getWriteIndex()) == mSmallestIncompleteTick;
+	TickBasedActionQueueCollection	mFlagsQueues;
+
+	// tracks the net ticks each flags tick was *first* sent out at
+	ConcreteTickBasedCircularQueue<int32> mFlagSendTimeQueue;
+	int32 mLastRealUpdate;
+
+	// Housekeeping queues:
+	// mPlayerDataDisposition holds an element for every tick for which data has been received from
+	// someone, but which at least one player has not yet acknowledged.
+	// mPlayerDataDisposition.getReadIndex() <= mSmallestIncompleteTick <= mPlayerDataDisposition.getWriteIndex()
+	// mSmallestIncompleteTick indexes into mPlayerDataDisposition also; it divides the queue into ticks
+	// for which data has been received from someone but not yet everyone (>= mSmallestIncompleteTick) and
+	// ticks for which data has been sent out (to everyone) but for which someone hasn't yet acknowledged
+	// (< mSmallestIncompleteTick).
+
+	// The value of a queue element is a bit-set (indexed by player index) with a 1 bit for each player
+	// that we're waiting on.  So, we can mask out successive players' bits as their traffic reaches us;
+	// when the value hits 0, all players have checked in and we can advance an index.
+	// mConnectedPlayersBitmask has '1' set for every connected player.
+	MutableElementsTickBasedCircularQueue<uint32>	mPlayerDataDisposition;
+	int32 mSmallestIncompleteTick;
+	uint32 mConnectedPlayersBitmask;
+	uint32 mLaggingPlayersBitmask;
+
+	// mPlayerReflectedFlags holds an element for every tick for which data has been
+	// sent but at least one player has not yet acknowledged
+	//
+	// the value of a queue element is a bit-set (indexed by player index) with a 1
+	// bit for each player we've altered flags and need to reflect flags for
+	MutableElementsTickBasedCircularQueue<uint32> mPlayerReflectedFlags;
+
+	// mLateFlagsQueues hold late flags we've received from lagging players
+	TickBasedActionQueueCollection mLateFlagsQueues;
+
+	// holds the last real flags we received from this player
+	std::vector<action_flags_t> mLastFlagsReceived;
+
+	// mSmallestUnsentTick is used for reducing the number of packets sent: we won't send a packet unless
+	// mSmallestIncompleteTick - mSmallestUnsentTick >= sHubPreferences.mSendPeriod
+	int32 mSmallestUnsentTick;
+
+	AddressToPlayerIndexType	mAddressToPlayerIndex;
+	NetworkPlayerCollection		mNetworkPlayers;
+
+	// Local player index is used to decide how to send a packet; ref is used for timing.
+	// A dedicated hub has no local player, so it times everyone against a connected spoke.
+	size_t			mLocalPlayerIndex;
+	size_t			mReferencePlayerIndex;
+
+	DDPFramePtr		mOutgoingFrame;
+
+	DDPPacketBuffer		mLocalOutgoingBuffer;
+	bool			mNeedToSendLocalOutgoingBuffer;
+
+	// Lossy byte stream data on its way from one spoke to others, several chunks a packet
+	LossyByteStreamMultiplexer mOutgoingLossyByteStreams;
+
+	bool mHubActive;	// used to enable the packet handler
+
+	StarTelemetryCounters mTelemetry;
+
+	// not copyable
+	StarHub(const StarHub&);
+	StarHub& operator=(const StarHub&);
+};
+
+#endif // NETWORK_STAR_HUB_H
@@ -0,0 +1,362 @@
+/*
+ *  network_star_hub_dedicated.cpp
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  A headless star hub for many games at once (run with --dedicated-hub).
+ *
+ *  Spokes name their game in a join packet instead of the usual identification packet; the
+ *  first one to arrive creates that game's StarHub, and everything else from a joined address
+ *  goes to its game's hub.  The gatherer gives each player a random join token along with the
+ *  game identifier; the first join brings everyone's, and after that a player's slot goes only
+ *  to a join showing its token, and only once: a slot or address that's already joined stays
+ *  where it is.  None of the game itself runs here - the hubs only relay action
+ *  flags - so a single thread serves every game, sleeping in the socket until either a packet
+ *  arrives or the hubs' next tick is due.  A game goes away once all of its players have
+ *  gone netdead (including players who never showed up).
+ */
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "cseries.h"
+#include "network_star_hub.h"
+#include "network_private.h" // kPROTOCOL_TYPE
+#include "AStream.h"
+#include "Logging.h"
+#include "mytm.h"
+#include "crc.h"
+
+#include <SDL_net.h>
+#include <csignal>
+#include <map>
+
+enum {
+	kDedicatedHubTickPeriod = 1000 / TICKS_PER_SECOND,	// ms; the same period mytm gives the in-game hub
+	kMaximumCatchUpTicks = TICKS_PER_SECOND / 2,		// after a stall, tick at most this much at once
+	kStatusReportPeriod = 60 * 1000,			// ms between status lines
+	kMaximumDedicatedHubGames = 1024
+};
+
+struct DedicatedHubAddressCompare
+{
+	bool operator()(const NetAddrBlock& a, const NetAddrBlock& b) const
+	{
+		if (a.host == b.host)
+			return a.port < b.port;
+		else
+			return a.host < b.host;
+	}
+};
+
+struct DedicatedHubGame
+{
+	StarHub* mHub;
+	uint32 mJoinTokens[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+	bool mJoined[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+	NetAddrBlock mAddresses[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];	// of the joined players
+};
+
+typedef std::map<uint32, DedicatedHubGame> GameIdentifierToHubType;
+typedef std::map<NetAddrBlock, uint32, DedicatedHubAddressCompare> AddressToGameIdentifierType;
+
+static UDPsocket sSocket = NULL;
+static UDPpacket* sIncomingPacket = NULL;
+static UDPpacket* sOutgoingPacket = NULL;
+
+static GameIdentifierToHubType sGames;
+static AddressToGameIdentifierType sAddressToGame;
+
+static volatile sig_atomic_t sQuitRequested = 0;
+
+static OSErr send_frame(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port);
+static void received_packet(DDPPacketBufferPtr inPacket);
+static void received_join_packet(AIStream& ps, DDPPacketBufferPtr inPacket);
+static void tick_games();
+static void end_game(GameIdentifierToHubType::iterator inGame);
+static void handle_quit_signal(int inSignal);
+
+
+
+static OSErr
+send_frame(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port)
+{
+	assert(frame->data_size <= ddpMaxData);
+
+	sOutgoingPacket->channel = -1;
+	memcpy(sOutgoingPacket->data, frame->data, frame->data_size);
+	sOutgoingPacket->len = frame->data_size;
+	sOutgoingPacket->address = *address;
+	return SDLNet_UDP_Send(sSocket, -1, sOutgoingPacket) ? 0 : -1;
+}
+
+
+
+static void
+received_packet(DDPPacketBufferPtr inPacket)
+{
+	AIStreamBE ps(inPacket->datagramData, inPacket->datagramSize);
+
+	try {
+		uint16 thePacketMagic;
+		ps >> thePacketMagic;
+
+		if (thePacketMagic == kSpokeToHubJoinGame)
+		{
+			received_join_packet(ps, inPacket);
+			return;
+		}
+
+		// Everything else belongs to whichever game the sender joined (the hub checks the CRC)
+		AddressToGameIdentifierType::iterator theEntry = sAddressToGame.find(inPacket->sourceAddress);
+		if (theEntry == sAddressToGame.end())
+			return;
+
+		GameIdentifierToHubType::iterator theGame = sGames.find(theEntry->second);
+		if (theGame != sGames.end())
+			theGame->second.mHub->receivedNetworkPacket(inPacket);
+	}
+	catch (...)
+	{
+		// ignore errors - we just discard the packet, effectively.
+	}
+}
+
+
+
+static void
+received_join_packet(AIStream& ps, DDPPacketBufferPtr inPacket)
+{
+	uint16 thePacketCRC;
+	ps >> thePacketCRC;
+
+	// blank out the CRC field before calculating
+	inPacket->datagramData[2] = 0;
+	inPacket->datagramData[3] = 0;
+
+	if (thePacketCRC != calculate_data_crc_ccitt(inPacket->datagramData, inPacket->datagramSize))
+		return;
+
+	uint32 theGameIdentifier;
+	uint16 thePlayerIndex;
+	uint16 thePlayerCount;
+	int32 theStartingTick;
+	uint32 theConnectedPlayers;
+	ps >> theGameIdentifier
+	   >> thePlayerIndex
+	   >> thePlayerCount
+	   >> theStartingTick
+	   >> theConnectedPlayers;
+
+	if (theGameIdentifier == 0 || thePlayerCount == 0 || thePlayerCount > MAXIMUM_NUMBER_OF_NETWORK_PLAYERS || thePlayerIndex >= thePlayerCount || !(theConnectedPlayers & (((uint32)1) << thePlayerIndex)))
+	{
+		logAnomaly("ignoring malformed join for game %u (player %hu of %hu)", theGameIdentifier, thePlayerIndex, thePlayerCount);
+		return;
+	}
+
+	uint32 theJoinTokens[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+	for (int i = 0; i < thePlayerCount; i++)
+		ps >> theJoinTokens[i];
+
+	GameIdentifierToHubType::iterator theGame = sGames.find(theGameIdentifier);
+	if (theGame == sGames.end())
+	{
+		if (sGames.size() >= kMaximumDedicatedHubGames)
+		{
+			logWarning("already hosting %u games; refusing game %u", (uint32) sGames.size(), theGameIdentifier);
+			return;
+		}
+
+		// Addresses only say who's connected; we learn the real ones as each spoke joins
+		NetAddrBlock theUnknownAddress;
+		obj_clear(theUnknownAddress);
+		const NetAddrBlock* theAddresses[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+		for (int i = 0; i < thePlayerCount; i++)
+			theAddresses[i] = (theConnectedPlayers & (((uint32)1) << i)) ? &theUnknownAddress : NULL;
+
+		DedicatedHubGame theNewGame;
+		obj_clear(theNewGame);
+		theNewGame.mHub = new StarHub(theStartingTick, thePlayerCount, theAddresses, static_cast<size_t>(NONE), send_frame);
+		memcpy(theNewGame.mJoinTokens, theJoinTokens, thePlayerCount * sizeof(uint32));
+		theGame = sGames.insert(GameIdentifierToHubType::value_type(theGameIdentifier, theNewGame)).first;
+
+		logNote("starting game %u for %hu players (%u games)", theGameIdentifier, thePlayerCount, (uint32) sGames.size());
+	}
+	else if (theGame->second.mHub->playerCount() != thePlayerCount || theGame->second.mHub->startingTick() != theStartingTick)
+	{
+		logWarning("player %hu disagrees about the shape of game %u; ignoring", thePlayerIndex, theGameIdentifier);
+		return;
+	}
+
+	DedicatedHubGame& theGameData = theGame->second;
+	if (theJoinTokens[thePlayerIndex] != theGameData.mJoinTokens[thePlayerIndex])
+	{
+		logAnomaly("ignoring join for player %hu of game %u with the wrong token", thePlayerIndex, theGameIdentifier);
+		return;
+	}
+
+	const NetAddrBlock& theAddress = inPacket->sourceAddress;
+	if (theGameData.mJoined[thePlayerIndex])
+	{
+		// The spoke repeats its join until it hears from us; anyone else is refused
+		if (theGameData.mAddresses[thePlayerIndex].host != theAddress.host || theGameData.mAddresses[thePlayerIndex].port != theAddress.port)
+			logAnomaly("player %hu of game %u has already joined from elsewhere; ignoring", thePlayerIndex, theGameIdentifier);
+		return;
+	}
+
+	if (sAddressToGame.find(theAddress) != sAddressToGame.end())
+	{
+		logAnomaly("ignoring join for player %hu of game %u from an address that has already joined", thePlayerIndex, theGameIdentifier);
+		return;
+	}
+
+	theGameData.mJoined[thePlayerIndex] = true;
+	theGameData.mAddresses[thePlayerIndex] = theAddress;
+	sAddressToGame[theAddress] = theGameIdentifier;
+	theGameData.mHub->playerIdentified(thePlayerIndex, theAddress);
+}
+
+
+
+static void
+end_game(GameIdentifierToHubType::iterator inGame)
+{
+	for (AddressToGameIdentifierType::iterator it = sAddressToGame.begin(); it != sAddressToGame.end(); )
+	{
+		if (it->second == inGame->first)
+			sAddressToGame.erase(it++);
+		else
+			++it;
+	}
+
+	delete inGame->second.mHub;
+	sGames.erase(inGame);
+}
+
+
+
+static void
+tick_games()
+{
+	for (GameIdentifierToHubType::iterator it = sGames.begin(); it != sGames.end(); )
+	{
+		it->second.mHub->tick();
+
+		if (!it->second.mHub->hasConnectedPlayers())
+		{
+			logNote("game %u is over", it->first);
+			end_game(it++);
+		}
+		else
+			++it;
+	}
+}
+
+
+
+static void
+handle_quit_signal(int inSignal)
+{
+	sQuitRequested = 1;
+}
+
+
+
+int
+run_dedicated_star_hub(uint16 inPort)
+{
+	if (SDLNet_Init() < 0)
+	{
+		fprintf(stderr, "Couldn't initialize SDL_net (%s)\n", SDLNet_GetError());
+		return 1;
+	}
+
+	// The hubs take the mytm mutex when they drop a player
+	mytm_initialize();
+	DefaultHubPreferences();
+
+	// (only SDLNet_UDP_Open wants the port in host byte order)
+	sSocket = SDLNet_UDP_Open(inPort);
+	sIncomingPacket = SDLNet_AllocPacket(ddpMaxData);
+	sOutgoingPacket = SDLNet_AllocPacket(ddpMaxData);
+	SDLNet_SocketSet theSocketSet = SDLNet_AllocSocketSet(1);
+	if (sSocket == NULL || sIncomingPacket == NULL || sOutgoingPacket == NULL || theSocketSet == NULL)
+	{
+		fprintf(stderr, "Couldn't open UDP port %hu (%s)\n", inPort, SDLNet_GetError());
+		return 1;
+	}
+	SDLNet_UDP_AddSocket(theSocketSet, sSocket);
+
+	signal(SIGINT, handle_quit_signal);
+	signal(SIGTERM, handle_quit_signal);
+
+	printf("Dedicated hub listening on UDP port %hu\n", inPort);
+	logNote("dedicated hub listening on UDP port %hu", inPort);
+
+	uint32 theNextTick = SDL_GetTicks() + kDedicatedHubTickPeriod;
+	uint32 theNextStatusReport = SDL_GetTicks() + kStatusReportPeriod;
+	while (!sQuitRequested)
+	{
+		int32 theTimeout = static_cast<int32>(theNextTick - SDL_GetTicks());
+		if (SDLNet_CheckSockets(theSocketSet, std::max(theTimeout, 0)) > 0)
+		{
+			while (SDLNet_UDP_Recv(sSocket, sIncomingPacket) > 0)
+			{
+				DDPPacketBuffer thePacket;
+				thePacket.datagramSize = sIncomingPacket->len;
+				memcpy(thePacket.datagramData, sIncomingPacket->data, sIncomingPacket->len);
+				thePacket.protocolType = kPROTOCOL_TYPE;
+				thePacket.sourceAddress = sIncomingPacket->address;
+				received_packet(&thePacket);
+			}
+		}
+
+		uint32 theTime = SDL_GetTicks();
+		int theTicksRun = 0;
+		while (static_cast<int32>(theTime - theNextTick) >= 0 && theTicksRun < kMaximumCatchUpTicks)
+		{
+			tick_games();
+			theNextTick += kDedicatedHubTickPeriod;
+			theTicksRun++;
+		}
+		if (static_cast<int32>(theTime - theNextTick) >= 0)
+		{
+			logWarning("dedicated hub fell %u ms behind; skipping ahead", theTime - theNextTick);
+			theNextTick = theTime + kDedicatedHubTickPeriod;
+		}
+
+		if (static_cast<int32>(theTime - theNextStatusReport) >= 0)
+		{
+			printf("%u games, %u players\n", (uint32) sGames.size(), (uint32) sAddressToGame.size());
+			fflush(stdout);
+			theNextStatusReport = theTime + kStatusReportPeriod;
+		}
+	}
+
+	printf("Shutting down dedicated hub (%u games in progress)\n", (uint32) sGames.size());
+	while (!sGames.empty())
+		end_game(sGames.begin());
+
+	SDLNet_FreeSocketSet(theSocketSet);
+	SDLNet_FreePacket(sIncomingPacket);
+	SDLNet_FreePacket(sOutgoingPacket);
+	SDLNet_UDP_Close(sSocket);
+	SDLNet_Quit();
+
+	return 0;
+}
+
+#endif // !defined(DISABLE_NETWORKING)
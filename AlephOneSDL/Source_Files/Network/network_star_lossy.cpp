@@ -0,0 +1,405 @@
+/*
+ *  network_star_lossy.cpp
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  Lossy byte streams multiplexed onto the star protocol's game data packets; see the header.
+ */
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "network_star_lossy.h"
+
+#include "network_star.h" // TICKS_PER_SECOND, message types
+#include "Logging.h"
+
+#include <SDL_atomic.h>	// SDL_SpinLock
+
+#include <algorithm>
+#include <map>
+
+typedef std::map<int16, LossyByteStreamSettings> LossyByteStreamSettingsMap;
+
+// Set from the main thread, read by the network threads
+static LossyByteStreamSettingsMap sSettings;
+static SDL_SpinLock sSettingsLock = 0;
+
+void
+set_lossy_byte_stream_settings(int16 inType, const LossyByteStreamSettings& inSettings)
+{
+	SDL_AtomicLock(&sSettingsLock);
+	sSettings[inType] = inSettings;
+	SDL_AtomicUnlock(&sSettingsLock);
+}
+
+LossyByteStreamSettings
+get_lossy_byte_stream_settings(int16 inType)
+{
+	LossyByteStreamSettings theSettings = { 0, 0, 0 };
+
+	SDL_AtomicLock(&sSettingsLock);
+	LossyByteStreamSettingsMap::const_iterator i = sSettings.find(inType);
+	if(i != sSettings.end())
+		theSettings = i->second;
+	SDL_AtomicUnlock(&sSettingsLock);
+
+	return theSettings;
+}
+
+
+
+LossyByteStreamMultiplexer::LossyByteStreamMultiplexer(bool inAtHub) : mAtHub(inAtHub)
+{
+	// One for each type, all allocated up front
+	for(int i = 0; i < kMaximumStreams; i++)
+		mStreams.push_back(new Stream);
+
+	mStreams[streamIndex(kOriginalNetworkAudioDistributionTypeID)]->mType = kOriginalNetworkAudioDistributionTypeID;
+	mStreams[streamIndex(kNewNetworkAudioDistributionTypeID)]->mType = kNewNetworkAudioDistributionTypeID;
+	for(int i = 0; i < kLuaHUDStreamChannelCount; i++)
+		mStreams[streamIndex(kLuaHUDStreamDistributionTypeID + i)]->mType = kLuaHUDStreamDistributionTypeID + i;
+
+	mOrder.reserve(kMaximumStreams);
+	reset();
+}
+
+
+LossyByteStreamMultiplexer::~LossyByteStreamMultiplexer()
+{
+	for(size_t i = 0; i < mStreams.size(); i++)
+		delete mStreams[i];
+}
+
+
+void
+LossyByteStreamMultiplexer::reset()
+{
+	for(size_t i = 0; i < mStreams.size(); i++)
+	{
+		mStreams[i]->mData.reset();
+		mStreams[i]->mChunks.reset();
+		mStreams[i]->mPriority = 0;
+		mStreams[i]->mTimed = false;
+		mStreams[i]->mLastServed = 0;
+		mStreams[i]->mSelectedChunks = 0;
+	}
+
+	mOrder.clear();
+}
+
+
+// static
+int
+LossyByteStreamMultiplexer::streamIndex(int16 inType)
+{
+	if(inType == kOriginalNetworkAudioDistributionTypeID)
+		return 0;
+	if(inType == kNewNetworkAudioDistributionTypeID)
+		return 1;
+	if(inType >= kLuaHUDStreamDistributionTypeID && inType < kLuaHUDStreamDistributionTypeID + kLuaHUDStreamChannelCount)
+		return 2 + (inType - kLuaHUDStreamDistributionTypeID);
+
+	return -1;
+}
+
+
+// The stream for inType, or NULL if it's not a type we carry
+LossyByteStreamMultiplexer::Stream*
+LossyByteStreamMultiplexer::findStream(int16 inType)
+{
+	int theIndex = streamIndex(inType);
+	return (theIndex >= 0) ? mStreams[theIndex] : NULL;
+}
+
+
+bool
+LossyByteStreamMultiplexer::enqueue(int16 inType, uint32 inDestinations, uint8 inSender, const byte* inBytes, uint16 inLength)
+{
+	Stream* theStream = findStream(inType);
+	if(theStream == NULL)
+	{
+		logNoteNMT("distribution type %hd is not a lossy stream; discarding %hu bytes", inType, inLength);
+		return false;
+	}
+
+	// We avoid enqueueing a partial chunk to make things easier on code that uses us
+	if(inLength > theStream->mData.getRemainingSpace() || theStream->mChunks.getRemainingSpace() < 1)
+	{
+		logNoteNMT("insufficient space for %hu bytes of lossy streaming data of distribution type %hd from player %hu destined for 0x%lx; discarded", inLength, inType, (uint16)inSender, (unsigned long)inDestinations);
+		return false;
+	}
+
+	Chunk theChunk;
+	theChunk.mLength = inLength;
+	theChunk.mDestinations = inDestinations;
+	theChunk.mSender = inSender;
+
+	// Data first; the sending thread goes by the chunks
+	theStream->mData.enqueueBytes(inBytes, inLength);
+	theStream->mChunks.enqueue(theChunk);
+
+	return true;
+}
+
+
+bool
+LossyByteStreamMultiplexer::enqueue(int16 inType, uint32 inDestinations, uint8 inSender, AIStream& ps, uint16 inLength)
+{
+	Stream* theStream = findStream(inType);
+	if(theStream == NULL)
+	{
+		logNoteNMT("distribution type %hd is not a lossy stream; discarding %hu bytes", inType, inLength);
+		ps.ignore(inLength);
+		return false;
+	}
+
+	if(inLength > theStream->mData.getRemainingSpace() || theStream->mChunks.getRemainingSpace() < 1)
+	{
+		logNoteNMT("insufficient space for %hu bytes of lossy streaming data of distribution type %hd from player %hu destined for 0x%lx; discarded", inLength, inType, (uint16)inSender, (unsigned long)inDestinations);
+		ps.ignore(inLength);
+		return false;
+	}
+
+	// Straight from the packet into the buffer
+	void* theFirstBytes;
+	void* theSecondBytes;
+	unsigned int theFirstByteCount;
+	unsigned int theSecondByteCount;
+	theStream->mData.enqueueBytesNoCopyStart(inLength, &theFirstBytes, &theFirstByteCount, &theSecondBytes, &theSecondByteCount);
+	ps.read(static_cast<char*>(theFirstBytes), theFirstByteCount);
+	if(theSecondByteCount > 0)
+		ps.read(static_cast<char*>(theSecondBytes), theSecondByteCount);
+	theStream->mData.enqueueBytesNoCopyFinish(inLength);
+
+	Chunk theChunk;
+	theChunk.mLength = inLength;
+	theChunk.mDestinations = inDestinations;
+	theChunk.mSender = inSender;
+	theStream->mChunks.enqueue(theChunk);
+
+	return true;
+}
+
+
+bool
+LossyByteStreamMultiplexer::hasQueuedChunks() const
+{
+	for(size_t i = 0; i < mStreams.size(); i++)
+	{
+		if(mStreams[i]->mChunks.getCountOfElements() > 0)
+			return true;
+	}
+
+	return false;
+}
+
+
+uint16
+LossyByteStreamMultiplexer::messageHeaderSize() const
+{
+	// message type, message length, distribution type, then the sender (hub to spoke) or the
+	// destinations (spoke to hub)
+	return sizeof(uint16) + sizeof(uint16) + sizeof(int16) + (mAtHub ? sizeof(uint8) : sizeof(uint32));
+}
+
+
+// static
+bool
+LossyByteStreamMultiplexer::streamGoesFirst(const Stream* inFirst, const Stream* inSecond)
+{
+	if(inFirst->mPriority != inSecond->mPriority)
+		return inFirst->mPriority > inSecond->mPriority;
+
+	// Equal priorities take turns
+	return inFirst->mLastServed < inSecond->mLastServed;
+}
+
+
+void
+LossyByteStreamMultiplexer::select(int32 inTicker)
+{
+	mOrder.clear();
+
+	for(size_t i = 0; i < mStreams.size(); i++)
+	{
+		Stream* theStream = mStreams[i];
+		theStream->mSelectedChunks = 0;
+
+		// An idle stream's bucket can wait: refilling it when it next has something comes to
+		// the same thing, since it's capped
+		if(theStream->mChunks.getCountOfElements() == 0)
+			continue;
+
+		LossyByteStreamSettings theSettings = get_lossy_byte_stream_settings(theStream->mType);
+		theStream->mPriority = theSettings.mPriority;
+
+		// Refill the bucket; the spoke's are the only ones that matter (see the header)
+		if(!mAtHub && theSettings.mBytesPerSecond > 0)
+		{
+			uint32 theBurstBytes = (theSettings.mBurstBytes > 0) ? theSettings.mBurstBytes : theSettings.mBytesPerSecond / 4;
+			int64_t theCapacity = static_cast<int64_t>(theBurstBytes) * TICKS_PER_SECOND;
+
+			if(!theStream->mTimed)
+			{
+				theStream->mTokens = theCapacity;
+				theStream->mTimed = true;
+			}
+			else if(inTicker > theStream->mLastRefill)
+			{
+				theStream->mTokens += static_cast<int64_t>(inTicker - theStream->mLastRefill) * theSettings.mBytesPerSecond;
+				theStream->mTokens = std::min(theStream->mTokens, theCapacity);
+			}
+			theStream->mLastRefill = inTicker;
+		}
+		else
+			theStream->mTimed = false;
+
+		mOrder.push_back(theStream);
+	}
+
+	std::stable_sort(mOrder.begin(), mOrder.end(), streamGoesFirst);
+
+	// Fill the budget in that order.  A stream's chunks go in order, so a chunk that doesn't fit
+	// ends that stream's turn; a smaller one from another stream may still fit.  A chunk bigger
+	// than the whole budget would never fit, so it goes anyway when its stream's turn comes.
+	int theBudget = kPacketBudget;
+	for(size_t i = 0; i < mOrder.size(); i++)
+	{
+		Stream* theStream = mOrder[i];
+		unsigned int theChunkCount = theStream->mChunks.getCountOfElements();
+		while(theStream->mSelectedChunks < theChunkCount)
+		{
+			if(theStream->mTimed && theStream->mTokens <= 0)
+				break;
+
+			const Chunk& theChunk = theStream->mChunks.peek(theStream->mSelectedChunks);
+			int theSize = messageHeaderSize() + theChunk.mLength;
+			bool isOversized = (theSize > kPacketBudget && theStream->mSelectedChunks == 0);
+			if(theSize > theBudget && !isOversized)
+				break;
+
+			theBudget -= theSize;
+			theStream->mSelectedChunks++;
+			if(theStream->mTimed)
+				theStream->mTokens -= static_cast<int64_t>(theChunk.mLength) * TICKS_PER_SECOND;
+		}
+
+		if(theStream->mSelectedChunks > 0)
+			theStream->mLastServed = inTicker;
+	}
+}
+
+
+void
+LossyByteStreamMultiplexer::writeSelected(AOStream& ps, size_t inDestination)
+{
+	for(size_t i = 0; i < mOrder.size(); i++)
+	{
+		Stream* theStream = mOrder[i];
+		unsigned int theOffset = 0;
+
+		for(unsigned int j = 0; j < theStream->mSelectedChunks; j++)
+		{
+			const Chunk& theChunk = theStream->mChunks.peek(j);
+			unsigned int theChunkOffset = theOffset;
+			theOffset += theChunk.mLength;
+
+			if(mAtHub && (theChunk.mDestinations & (((uint32)1) << inDestination)) == 0)
+				continue;
+
+			// Leave room for the end of messages, at least; the caller's packet would throw
+			// otherwise, and over and over again, since we'd still have these chunks
+			if(ps.tellp() + messageHeaderSize() + theChunk.mLength + sizeof(uint16) > ps.maxp())
+			{
+				logNoteNMT("no room in packet for %hu bytes of lossy streaming type %hd; discarded", theChunk.mLength, theStream->mType);
+				continue;
+			}
+
+			// In AStreams, sizeof(packed scalar) == sizeof(unpacked scalar)
+			uint16 theMessageLength = messageHeaderSize() - sizeof(uint16) - sizeof(uint16) + theChunk.mLength;
+
+			if(mAtHub)
+			{
+				logDumpNMT("packet to player %d will contain %d bytes of lossy byte stream type %d from player %d", (int)inDestination, theChunk.mLength, theStream->mType, theChunk.mSender);
+				ps << (uint16)kHubToSpokeLossyByteStreamMessageType
+					<< theMessageLength
+					<< theStream->mType
+					<< theChunk.mSender;
+			}
+			else
+			{
+				ps << (uint16)kSpokeToHubLossyByteStreamMessageType
+					<< theMessageLength
+					<< theStream->mType
+					<< theChunk.mDestinations;
+			}
+
+			const void* theFirstBytes;
+			const void* theSecondBytes;
+			unsigned int theFirstByteCount;
+			unsigned int theSecondByteCount;
+			theStream->mData.peekBytesNoCopy(theChunk.mLength, &theFirstBytes, &theFirstByteCount, &theSecondBytes, &theSecondByteCount, theChunkOffset);
+			ps.write(static_cast<char*>(const_cast<void*>(theFirstBytes)), theFirstByteCount);
+			if(theSecondByteCount > 0)
+				ps.write(static_cast<char*>(const_cast<void*>(theSecondBytes)), theSecondByteCount);
+		}
+	}
+}
+
+
+void
+LossyByteStreamMultiplexer::dequeueSelected()
+{
+	for(size_t i = 0; i < mOrder.size(); i++)
+	{
+		Stream* theStream = mOrder[i];
+
+		unsigned int theBytes = 0;
+		for(unsigned int j = 0; j < theStream->mSelectedChunks; j++)
+			theBytes += theStream->mChunks.peek(j).mLength;
+
+		theStream->mChunks.dequeue(theStream->mSelectedChunks);
+		theStream->mData.dequeue(theBytes);
+		theStream->mSelectedChunks = 0;
+	}
+
+	mOrder.clear();
+}
+
+
+uint32
+LossyByteStreamMultiplexer::queuedBytes() const
+{
+	uint32 theBytes = 0;
+	for(size_t i = 0; i < mStreams.size(); i++)
+		theBytes += mStreams[i]->mData.getCountOfElements();
+
+	return theBytes;
+}
+
+
+uint32
+LossyByteStreamMultiplexer::queuedChunks() const
+{
+	uint32 theChunks = 0;
+	for(size_t i = 0; i < mStreams.size(); i++)
+		theChunks += mStreams[i]->mChunks.getCountOfElements();
+
+	return theChunks;
+}
+
+#endif // !defined(DISABLE_NETWORKING)
@@ -0,0 +1,142 @@
+/*
+ *  network_star_lossy.h
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  Lossy byte streams (network audio, Lua stream data) multiplexed onto the star protocol's
+ *  game data packets.
+ *
+ *  Each distribution type the protocol knows (network audio and the Lua HUD channels, see
+ *  network_distribution_types.h) is a stream with a queue of its own, a priority, and
+ *  optionally a token-bucket rate limit; data of any other type is refused.  When a packet goes out, it carries as many chunks as fit in its
+ *  lossy budget: streams with higher priority first, streams of equal priority taking turns,
+ *  and a rate-limited stream only as much as its bucket allows.  Every chunk is its own lossy
+ *  byte stream message, so the packets are the same as ever to the other end.
+ *
+ *  Rate limits are applied where the data starts out, at the spoke; the hub just relays what
+ *  the spokes send, by priority.
+ *
+ *  Chunks are queued by one thread and sent by one thread (at the hub, the same one), with no
+ *  locking, like the CircularQueues underneath.  Every type has its stream from the start, so
+ *  neither thread ever has to hand one out or take it back.
+ */
+
+#ifndef NETWORK_STAR_LOSSY_H
+#define NETWORK_STAR_LOSSY_H
+
+#include "cseries.h"
+#include "AStream.h"
+#include "CircularByteBuffer.h"
+#include "network_distribution_types.h"
+
+#include <vector>
+
+struct LossyByteStreamSettings
+{
+	int16	mPriority;		// higher goes first
+	uint32	mBytesPerSecond;	// 0 for no limit
+	uint32	mBurstBytes;		// how much may go at once after the stream has been quiet (0 for
+					// a quarter second's worth)
+};
+
+// Settings are per distribution type, for every hub and spoke in this process; a type that
+// was never set has priority 0 and no limit
+extern void set_lossy_byte_stream_settings(int16 inType, const LossyByteStreamSettings& inSettings);
+extern LossyByteStreamSettings get_lossy_byte_stream_settings(int16 inType);
+
+class LossyByteStreamMultiplexer
+{
+public:
+	enum {
+		kMaximumStreams = 2 + kLuaHUDStreamChannelCount,	// both network audio types, and every Lua HUD channel
+		kStreamBufferSize = 1280,	// bytes of data queued per stream
+		kPacketBudget = 512		// bytes of lossy messages per packet (one big chunk may exceed it)
+	};
+
+	// inAtHub says which direction (and so which message format) this is for
+	explicit LossyByteStreamMultiplexer(bool inAtHub);
+	~LossyByteStreamMultiplexer();
+
+	// Discards everything, streams and all; nothing may be using us at the time
+	void reset();
+
+	// Queues a chunk for inDestinations (a bitmask of player indices); false (and logged) if
+	// it was discarded for lack of space.  The second form reads the chunk straight out of ps
+	// and always consumes it.
+	bool enqueue(int16 inType, uint32 inDestinations, uint8 inSender, const byte* inBytes, uint16 inLength);
+	bool enqueue(int16 inType, uint32 inDestinations, uint8 inSender, AIStream& ps, uint16 inLength);
+
+	bool hasQueuedChunks() const;
+
+	// Whether we carry inType at all
+	static bool isKnownType(int16 inType) { return streamIndex(inType) >= 0; }
+
+	// Picks the chunks for the next packet (or, at the hub, round of packets); inTicker is the
+	// network tick, for the rate limits.
+	void select(int32 inTicker);
+	// Writes the selected chunks as messages: at the hub, the ones addressed to inDestination;
+	// at the spoke, all of them
+	void writeSelected(AOStream& ps, size_t inDestination = 0);
+	// Done with the selected chunks
+	void dequeueSelected();
+
+	// For telemetry
+	uint32 queuedBytes() const;
+	uint32 queuedChunks() const;
+
+private:
+	struct Chunk
+	{
+		uint16	mLength;
+		uint32	mDestinations;
+		uint8	mSender;
+	};
+
+	struct Stream
+	{
+		Stream() : mData(kStreamBufferSize), mChunks(kStreamBufferSize / 8) {}
+
+		int16			mType;
+
+		CircularByteBuffer	mData;
+		CircularQueue<Chunk>	mChunks;
+
+		// The sending thread's
+		int16			mPriority;	// as of the last select()
+		bool			mTimed;		// mTokens and mLastRefill are good
+		int64_t			mTokens;	// bytes * TICKS_PER_SECOND; negative after an oversized chunk
+		int32			mLastRefill;
+		int32			mLastServed;
+		unsigned int		mSelectedChunks;
+	};
+
+	static bool streamGoesFirst(const Stream* inFirst, const Stream* inSecond);
+	static int streamIndex(int16 inType);
+
+	Stream* findStream(int16 inType);
+	uint16 messageHeaderSize() const;
+
+	bool mAtHub;
+	std::vector<Stream*> mStreams;
+	std::vector<Stream*> mOrder;	// streams with something selected, in sending order
+
+	// not copyable
+	LossyByteStreamMultiplexer(const LossyByteStreamMultiplexer&);
+	LossyByteStreamMultiplexer& operator=(const LossyByteStreamMultiplexer&);
+};
+
+#endif // NETWORK_STAR_LOSSY_H
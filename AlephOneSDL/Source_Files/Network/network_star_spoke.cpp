@@ -27,28 +27,33 @@
  *  June 30, 2003 (Woody Zenfell): lossy byte-stream distribution more tolerant of scheduling jitter
  *	(i.e. will queue multiple chunks before send, instead of dropping all data but most recent)
  *
+ *  2026: lossy byte streams go through a LossyByteStreamMultiplexer (network_star_lossy.h):
+ *	several chunks a packet, by stream priority, within each stream's rate limit.
+ *
  *  September 17, 2004 (jkvw):
  *	NAT-friendly networking - we no longer get spoke addresses form topology -
  *	instead spokes send identification packets to hub with player ID.
  *	Hub can then associate the ID in the identification packet with the paket's source address.
+ *
+ *  The spoke's state now lives in a StarSpoke, which gets its action flags from (and reports
+ *  to) a StarSpokeGame, so the stress test can run many of them with no game behind them
+ *  (see network_star_stress.cpp); the spoke_* functions below run the one for the game
+ *  we're playing.
  */
 
 #if !defined(DISABLE_NETWORKING)
 
-#include "network_star.h"
+#include "network_star_spoke.h"
 #include "AStream.h"
 #include "mytm.h"
 #include "network_private.h" // kPROTOCOL_TYPE
-#include "WindowedNthElementFinder.h"
 #include "vbl.h" // parse_keymap
-#include "CircularByteBuffer.h"
 #include "Logging.h"
 #include "crc.h"
+#include "PackedActionFlags.h"
 #include "player.h"
 #include "InfoTree.h"
 
-#include <map>
-
 extern void make_player_really_net_dead(size_t inPlayerIndex);
 extern void call_distribution_response_function_if_available(byte* inBuffer, uint16 inBufferSize, int16 inDistributionType, uint8 inSendingPlayerIndex);
 
@@ -56,13 +61,9 @@ extern void call_distribution_response_function_if_available(byte* inBuffer, uin
 enum {
         kDefaultPregameTicksBeforeNetDeath = 90 * TICKS_PER_SECOND,
         kDefaultInGameTicksBeforeNetDeath = 5 * TICKS_PER_SECOND,
-        kDefaultOutgoingFlagsQueueSize = TICKS_PER_SECOND / 2,
         kDefaultRecoverySendPeriod = TICKS_PER_SECOND / 2,
 	kDefaultTimingWindowSize =  3 * TICKS_PER_SECOND,
-	kDefaultTimingNthElement = kDefaultTimingWindowSize / 2,
-	kLossyByteStreamDataBufferSize = 1280,
-	kTypicalLossyByteStreamChunkSize = 56,
-	kLossyByteStreamDescriptorCount = kLossyByteStreamDataBufferSize / kTypicalLossyByteStreamChunkSize
+	kDefaultTimingNthElement = kDefaultTimingWindowSize / 2
 };
 
 struct SpokePreferences
@@ -76,98 +77,57 @@ struct SpokePreferences
 	bool	mAdjustTiming;
 };
 
+// Shared by every StarSpoke in the process
 static SpokePreferences sSpokePreferences;
 
-static TickBasedActionQueue sOutgoingFlags(kDefaultOutgoingFlagsQueueSize);
-static TickBasedActionQueue sUnconfirmedFlags(kDefaultOutgoingFlagsQueueSize);
-static DuplicatingTickBasedCircularQueue<action_flags_t> sLocallyGeneratedFlags;
-static int32 sSmallestRealGameTick;
-
-struct IncomingGameDataPacketProcessingContext {
-        bool mMessagesDone;
-        bool mGotTimingAdjustmentMessage;
 
-        IncomingGameDataPacketProcessingContext() : mMessagesDone(false), mGotTimingAdjustmentMessage(false) {}
-};
+// The game this process is playing
+class LocalStarSpokeGame : public StarSpokeGame
+{
+public:
+	action_flags_t actionFlags(int32 /* inTick */) { return parse_keymap(); }
 
-typedef void (*StarMessageHandler)(AIStream& s, IncomingGameDataPacketProcessingContext& c);
-typedef std::map<uint16, StarMessageHandler> MessageTypeToMessageHandler;
+	OSErr sendFrame(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port)
+	{
+		return NetDDPSendFrame(frame, address, protocolType, port);
+	}
 
-static MessageTypeToMessageHandler sMessageTypeToMessageHandler;
+	void playerNetDead(size_t inPlayerIndex) { make_player_really_net_dead(inPlayerIndex); }
 
-static int8 sRequestedTimingAdjustment;
-static int8 sOutstandingTimingAdjustment;
+	void receivedLossyByteStream(byte* inBuffer, uint16 inBufferSize, int16 inDistributionType, uint8 inSendingPlayerIndex)
+	{
+		call_distribution_response_function_if_available(inBuffer, inBufferSize, inDistributionType, inSendingPlayerIndex);
+	}
 
-struct NetworkPlayer_spoke {
-        bool				mZombie;
-        bool				mConnected;
-        int32				mNetDeadTick;
-        WritableTickBasedActionQueue* 	mQueue;
-};
+	bool positionSum(size_t inLocalPlayerIndex, int32& outPositionSum)
+	{
+		player_data *player= get_player_data(inLocalPlayerIndex);
+		outPositionSum = player->location.x + player->location.y + player->location.z;
+		return true;
+	}
 
-static vector<NetworkPlayer_spoke> sNetworkPlayers;
-static int32 sNetworkTicker;
-static int32 sLastNetworkTickHeard;
-static int32 sLastNetworkTickSent;
-static bool sConnected = false;
-static bool sSpokeActive = false;
-static myTMTaskPtr sSpokeTickTask = NULL;
-static DDPFramePtr sOutgoingFrame = NULL;
-static DDPPacketBuffer sLocalOutgoingBuffer;
-static bool sNeedToSendLocalOutgoingBuffer = false;
-static bool sHubIsLocal = false;
-static NetAddrBlock sHubAddress;
-static size_t sLocalPlayerIndex;
-static int32 sSmallestUnreceivedTick;
-static WindowedNthElementFinder<int32> sNthElementFinder(kDefaultTimingWindowSize);
-static bool sTimingMeasurementValid;
-static int32 sTimingMeasurement;
-static bool sHeardFromHub = false;
-
-static vector<int32> sDisplayLatencyBuffer; // stores the last 30 latency calculations, in ticks
-static uint32 sDisplayLatencyCount = 0;
-static int32 sDisplayLatencyTicks = 0; // sum of the latency ticks from the last 30 seconds, using above two
-
-static int32 sSmallestUnconfirmedTick;
-
-struct SpokeLossyByteStreamChunkDescriptor
-{
-	uint16	mLength;
-	int16	mType;
-	uint32	mDestinations;
+	bool latestWorldHash(world_hash_snapshot& outSnapshot) { return get_latest_world_hash(outSnapshot); }
 };
 
-// This holds outgoing lossy byte stream data
-static CircularByteBuffer sOutgoingLossyByteStreamData(kLossyByteStreamDataBufferSize);
+static LocalStarSpokeGame sLocalGame;
 
-// This holds a descriptor for each chunk of lossy byte stream data held in the above buffer
-static CircularQueue<SpokeLossyByteStreamChunkDescriptor> sOutgoingLossyByteStreamDescriptors(kLossyByteStreamDescriptorCount);
+// The spoke for the game we're playing
+static StarSpoke*	sSpoke = NULL;
+static myTMTaskPtr	sSpokeTickTask = NULL;
 
-// This is currently used only to hold incoming streaming data until it's passed to the upper-level code
-static byte sScratchBuffer[kLossyByteStreamDataBufferSize];
+// What the game sees once the spoke is gone: time stands where it was, and nothing's unconfirmed
+static int32		sNetTimeAtCleanup = 0;
+static TickBasedActionQueue	sNoUnconfirmedFlags(1);
 
 
-static void spoke_became_disconnected();
-static void spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags);
-static void spoke_received_ping_request(AIStream& ps, NetAddrBlock address);
-static void spoke_received_ping_response(AIStream& ps, NetAddrBlock address);
-static void process_messages(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
-static void handle_end_of_messages_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
-static void handle_player_net_dead_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
-static void handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
-static void handle_lossy_byte_stream_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
-static void process_optional_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context, uint16 inMessageType);
 static bool spoke_tick();
-static void send_packet();
-static void send_position_sync_packet();
-static void send_identification_packet();
 
 
-static inline NetworkPlayer_spoke&
-getNetworkPlayer(size_t inIndex)
+inline StarSpoke::NetworkPlayer_spoke&
+StarSpoke::getNetworkPlayer(size_t inIndex)
 {
-        assert(inIndex < sNetworkPlayers.size());
-        return sNetworkPlayers[inIndex];
+        assert(inIndex < mNetworkPlayers.size());
+        return mNetworkPlayers[inIndex];
 }
 
 
@@ -180,104 +140,200 @@ operator !=(const NetAddrBlock& a, const NetAddrBlock& b)
 
 
 
-static OSErr
-send_frame_to_local_hub(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port)
+static void
+write_ping_response(DDPFramePtr ioFrame, uint16 inPingIdentifier)
+{
+	AOStreamBE hdr(ioFrame->data, kStarPacketHeaderSize);
+	AOStreamBE ops(ioFrame->data, ddpMaxData, kStarPacketHeaderSize);
+
+	hdr << (uint16)kPingResponsePacket;
+	ops << inPingIdentifier;
+
+	// blank out the CRC field before calculating
+	ioFrame->data[2] = 0;
+	ioFrame->data[3] = 0;
+
+	uint16 crc = calculate_data_crc_ccitt(ioFrame->data, ops.tellp());
+	hdr << crc;
+
+	ioFrame->data_size = ops.tellp();
+}
+
+
+
+// Pings get an answer even when we're not in a game
+static void
+answer_ping_request(DDPPacketBufferPtr inPacket)
 {
-        sLocalOutgoingBuffer.datagramSize = frame->data_size;
-        memcpy(sLocalOutgoingBuffer.datagramData, frame->data, frame->data_size);
-        sLocalOutgoingBuffer.protocolType = protocolType;
+	try {
+		AIStreamBE ps(inPacket->datagramData, inPacket->datagramSize);
+
+		uint16 thePacketMagic;
+		uint16 thePacketCRC;
+		ps >> thePacketMagic >> thePacketCRC;
+		if(thePacketMagic != kPingRequestPacket)
+			return;
+
+		// blank out the CRC field before calculating
+		inPacket->datagramData[2] = 0;
+		inPacket->datagramData[3] = 0;
+
+		if (thePacketCRC != calculate_data_crc_ccitt(inPacket->datagramData, inPacket->datagramSize))
+			return;
+
+		uint16 pingIdentifier;
+		ps >> pingIdentifier;
+
+		DDPFramePtr theFrame = NetDDPNewFrame();
+		write_ping_response(theFrame, pingIdentifier);
+		NetDDPSendFrame(theFrame, &inPacket->sourceAddress, kPROTOCOL_TYPE, 0 /* ignored */);
+		NetDDPDisposeFrame(theFrame);
+	} catch (...) {
+		logWarningNMT("Caught exception while constructing/sending ping response packet");
+	}
+}
+
+
+
+OSErr
+StarSpoke::send_frame_to_hub(DDPFramePtr frame)
+{
+	mTelemetry.sent(*frame);
+
+	if(!mHubIsLocal)
+		return mGame.sendFrame(frame, &mHubAddress, kPROTOCOL_TYPE, 0 /* ignored */);
+
+        mLocalOutgoingBuffer.datagramSize = frame->data_size;
+        memcpy(mLocalOutgoingBuffer.datagramData, frame->data, frame->data_size);
+        mLocalOutgoingBuffer.protocolType = kPROTOCOL_TYPE;
         // An all-0 sourceAddress is the cue for "local spoke" currently.
-        obj_clear(sLocalOutgoingBuffer.sourceAddress);
-        sNeedToSendLocalOutgoingBuffer = true;
+        obj_clear(mLocalOutgoingBuffer.sourceAddress);
+        mNeedToSendLocalOutgoingBuffer = true;
         return noErr;
 }
 
 
 
-static inline void
-check_send_packet_to_hub()
+void
+StarSpoke::check_send_packet_to_hub()
 {
-        if(sNeedToSendLocalOutgoingBuffer)
+        if(mNeedToSendLocalOutgoingBuffer)
 	{
 		logContextNMT("delivering stored packet to local hub");
-                hub_received_network_packet(&sLocalOutgoingBuffer);
+                hub_received_network_packet(&mLocalOutgoingBuffer);
 	}
 
-        sNeedToSendLocalOutgoingBuffer = false;
+        mNeedToSendLocalOutgoingBuffer = false;
 }
 
 
 
-void
-spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal)
+StarSpoke::StarSpoke(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal, uint32 inDedicatedHubGame, bool inPackedActionFlags, const uint32* inDedicatedHubJoinTokens, StarSpokeGame& inGame) :
+	mGame(inGame),
+	mOutgoingFlags(kOutgoingFlagsQueueSize),
+	mUnconfirmedFlags(kOutgoingFlagsQueueSize),
+	mNthElementFinder(kDefaultTimingWindowSize),
+	mOutgoingLossyByteStreams(false)
 {
         assert(inNumberOfPlayers >= 1);
         assert(inLocalPlayerIndex < inNumberOfPlayers);
         assert(inPlayerQueues[inLocalPlayerIndex] != NULL);
         assert(inPlayerConnected[inLocalPlayerIndex]);
 
-        sHubIsLocal = inHubIsLocal;
-        sHubAddress = inHubAddress;
+        mHubIsLocal = inHubIsLocal;
+        mHubAddress = inHubAddress;
+        mDedicatedHubGame = inHubIsLocal ? 0 : inDedicatedHubGame;
+	if(mDedicatedHubGame)
+	{
+		assert(inDedicatedHubJoinTokens != NULL);
+		mDedicatedHubJoinTokens.assign(inDedicatedHubJoinTokens, inDedicatedHubJoinTokens + inNumberOfPlayers);
+	}
+	mPackedActionFlags = inPackedActionFlags;
 
-        sLocalPlayerIndex = inLocalPlayerIndex;
+        mLocalPlayerIndex = inLocalPlayerIndex;
 
-        sOutgoingFrame = NetDDPNewFrame();
+        mOutgoingFrame = NetDDPNewFrame();
+	mTelemetry.reset(false, inNumberOfPlayers);
 
-        sSmallestRealGameTick = inFirstTick;
+        mSmallestRealGameTick = inFirstTick;
         int32 theFirstPregameTick = inFirstTick - kPregameTicks;
-        sOutgoingFlags.reset(theFirstPregameTick);
-	sUnconfirmedFlags.reset(sSmallestRealGameTick);
-	sSmallestUnconfirmedTick = sSmallestRealGameTick;
-        sSmallestUnreceivedTick = theFirstPregameTick;
+        mOutgoingFlags.reset(theFirstPregameTick);
+	mUnconfirmedFlags.reset(mSmallestRealGameTick);
+	mSmallestUnconfirmedTick = mSmallestRealGameTick;
+        mSmallestUnreceivedTick = theFirstPregameTick;
         
-        sNetworkPlayers.clear();
-        sNetworkPlayers.resize(inNumberOfPlayers);
+        mNetworkPlayers.resize(inNumberOfPlayers);
+        mConnectedPlayersBitmask = 0;
 
-        sLocallyGeneratedFlags.children().clear();
-        sLocallyGeneratedFlags.children().insert(&sOutgoingFlags);
-	sLocallyGeneratedFlags.children().insert(&sUnconfirmedFlags);
+        mLocallyGeneratedFlags.children().insert(&mOutgoingFlags);
+	mLocallyGeneratedFlags.children().insert(&mUnconfirmedFlags);
 
         for(size_t i = 0; i < inNumberOfPlayers; i++)
         {
-                sNetworkPlayers[i].mZombie = (inPlayerQueues[i] == NULL);
-                sNetworkPlayers[i].mConnected = inPlayerConnected[i];
-                sNetworkPlayers[i].mNetDeadTick = theFirstPregameTick - 1;
-                sNetworkPlayers[i].mQueue = inPlayerQueues[i];
-                if(sNetworkPlayers[i].mConnected)
+                mNetworkPlayers[i].mZombie = (inPlayerQueues[i] == NULL);
+                mNetworkPlayers[i].mConnected = inPlayerConnected[i];
+                mNetworkPlayers[i].mNetDeadTick = theFirstPregameTick - 1;
+                mNetworkPlayers[i].mQueue = inPlayerQueues[i];
+                if(mNetworkPlayers[i].mConnected)
                 {
-                        sNetworkPlayers[i].mQueue->reset(sSmallestRealGameTick);
+                        mNetworkPlayers[i].mQueue->reset(mSmallestRealGameTick);
+                        mConnectedPlayersBitmask |= (((uint32)1) << i);
                 }
         }
 
-        sRequestedTimingAdjustment = 0;
-        sOutstandingTimingAdjustment = 0;
+        mRequestedTimingAdjustment = 0;
+        mOutstandingTimingAdjustment = 0;
+
+        mNetworkTicker = 0;
+        mLastNetworkTickHeard = 0;
+        mLastNetworkTickSent = 0;
+        mLastWorldHashSent.tick = NONE;
+        mLastWorldHashSent.level = NONE;
+        mConnected = true;
+	mNthElementFinder.reset(sSpokePreferences.mTimingWindowSize);
+	mTimingMeasurementValid = false;
+	mTimingMeasurement = 0;
+	mPreviousDelay = -1;
+
+        mNeedToSendLocalOutgoingBuffer = false;
+
+	mDisplayLatencyBuffer.resize(TICKS_PER_SECOND, 0);
+	mDisplayLatencyCount = 0;
+	mDisplayLatencyTicks = 0;
+	
+	mHeardFromHub = false;
 
-        sNetworkTicker = 0;
-        sLastNetworkTickHeard = 0;
-        sLastNetworkTickSent = 0;
-        sConnected = true;
-	sNthElementFinder.reset(sSpokePreferences.mTimingWindowSize);
-	sTimingMeasurementValid = false;
+        mSpokeActive = true;
+}
 
-	sOutgoingLossyByteStreamDescriptors.reset();
-	sOutgoingLossyByteStreamData.reset();
 
-        sMessageTypeToMessageHandler.clear();
-        sMessageTypeToMessageHandler[kEndOfMessagesMessageType] = handle_end_of_messages_message;
-        sMessageTypeToMessageHandler[kTimingAdjustmentMessageType] = handle_timing_adjustment_message;
-        sMessageTypeToMessageHandler[kPlayerNetDeadMessageType] = handle_player_net_dead_message;
-	sMessageTypeToMessageHandler[kHubToSpokeLossyByteStreamMessageType] = handle_lossy_byte_stream_message;
 
-        sNeedToSendLocalOutgoingBuffer = false;
+StarSpoke::~StarSpoke()
+{
+        NetDDPDisposeFrame(mOutgoingFrame);
+}
 
-        sSpokeActive = true;
-        sSpokeTickTask = myXTMSetup(1000/TICKS_PER_SECOND, spoke_tick);
 
-	sDisplayLatencyBuffer.resize(TICKS_PER_SECOND, 0);
-	sDisplayLatencyCount = 0;
-	sDisplayLatencyTicks = 0;
-	
-	sHeardFromHub = false;
+
+void
+StarSpoke::deactivate()
+{
+        mSpokeActive = false;
+
+	// We send one last packet here to try to not leave the hub hanging on our ACK.
+	send_packet();
+	check_send_packet_to_hub();
+}
+
+
+
+void
+spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal, uint32 inDedicatedHubGame, bool inPackedActionFlags, const uint32* inDedicatedHubJoinTokens)
+{
+	assert(sSpoke == NULL);
+	sSpoke = new StarSpoke(inHubAddress, inFirstTick, inNumberOfPlayers, inPlayerQueues, inPlayerConnected, inLocalPlayerIndex, inHubIsLocal, inDedicatedHubGame, inPackedActionFlags, inDedicatedHubJoinTokens, sLocalGame);
+
+        sSpokeTickTask = myXTMSetup(1000/TICKS_PER_SECOND, spoke_tick);
 }
 
 
@@ -285,8 +341,11 @@ spoke_initialize(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inN
 void
 spoke_cleanup(bool inGraceful)
 {
+	if(sSpoke == NULL)
+		return;
+
         // Stop processing incoming packets (packet processor won't start processing another packet
-        // due to sSpokeActive = false, and we know it's not in the middle of processing one because
+        // due to the spoke being inactive, and we know it's not in the middle of processing one because
         // we take the mutex).
         if(take_mytm_mutex())
         {
@@ -294,24 +353,42 @@ spoke_cleanup(bool inGraceful)
 		myTMRemove(sSpokeTickTask);
 		sSpokeTickTask = NULL;
 
-                sSpokeActive = false;
-
-		// We send one last packet here to try to not leave the hub hanging on our ACK.
-		send_packet();
-		check_send_packet_to_hub();
+		sSpoke->deactivate();
 
 		release_mytm_mutex();
         }
 
         // This waits for the tick task to actually finish
         myTMCleanup(true);
-        
-        sMessageTypeToMessageHandler.clear();
-        sNetworkPlayers.clear();
-        sLocallyGeneratedFlags.children().clear();
-	sDisplayLatencyBuffer.clear();
-        NetDDPDisposeFrame(sOutgoingFrame);
-        sOutgoingFrame = NULL;
+
+	// The packet handler may still be holding on to us
+	MyTMMutexTaker mutex;
+	sNetTimeAtCleanup = sSpoke->netTime();
+	sNoUnconfirmedFlags.reset(sNetTimeAtCleanup);
+	delete sSpoke;
+	sSpoke = NULL;
+}
+
+
+
+void
+spoke_received_network_packet(DDPPacketBufferPtr inPacket)
+{
+	if(sSpoke)
+		sSpoke->receivedNetworkPacket(inPacket);
+	else
+		answer_ping_request(inPacket);
+}
+
+
+
+static bool
+spoke_tick()
+{
+	// Handle whatever arrived since the receiving thread last got a chance to deliver it
+	NetDDPProcessReceivedPackets();
+
+	return sSpoke->tick();
 }
 
 
@@ -319,17 +396,23 @@ spoke_cleanup(bool inGraceful)
 int32
 spoke_get_net_time()
 {
-	static int32 sPreviousDelay = -1;
+	return sSpoke ? sSpoke->netTime() : sNetTimeAtCleanup;
+}
 
-	int32 theDelay = (sSpokePreferences.mAdjustTiming && sTimingMeasurementValid) ? sTimingMeasurement : 0;
 
-	if(theDelay != sPreviousDelay)
+
+int32
+StarSpoke::netTime()
+{
+	int32 theDelay = (sSpokePreferences.mAdjustTiming && mTimingMeasurementValid) ? mTimingMeasurement : 0;
+
+	if(theDelay != mPreviousDelay)
 	{
 		logDump("local delay is now %d", theDelay);
-		sPreviousDelay = theDelay;
+		mPreviousDelay = theDelay;
 	}
 
-	return (sConnected ? sOutgoingFlags.getWriteTick() - theDelay : getNetworkPlayer(sLocalPlayerIndex).mQueue->getWriteTick());
+	return (mConnected ? mOutgoingFlags.getWriteTick() - theDelay : getNetworkPlayer(mLocalPlayerIndex).mQueue->getWriteTick());
 }
 
 
@@ -337,18 +420,22 @@ spoke_get_net_time()
 void
 spoke_distribute_lossy_streaming_bytes_to_everyone(int16 inDistributionType, byte* inBytes, uint16 inLength, bool inExcludeLocalPlayer, bool onlySendToTeam)
 {
+	if(sSpoke == NULL)
+		return;
+
+	size_t theLocalPlayerIndex = sSpoke->localPlayerIndex();
 
 	int16 local_team;
 	if (onlySendToTeam)
 	{
-		player_info* player = (player_info *)NetGetPlayerData(sLocalPlayerIndex);
+		player_info* player = (player_info *)NetGetPlayerData(theLocalPlayerIndex);
 		local_team = player->team;
 	}
 
 	uint32 theDestinations = 0;
-	for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+	for(size_t i = 0; i < sSpoke->playerCount(); i++)
 	{
-		if((i != sLocalPlayerIndex || !inExcludeLocalPlayer) && !sNetworkPlayers[i].mZombie && sNetworkPlayers[i].mConnected)
+		if((i != theLocalPlayerIndex || !inExcludeLocalPlayer) && sSpoke->isPlayerConnected(i))
 		{
 			if (onlySendToTeam)
 			{
@@ -364,7 +451,7 @@ spoke_distribute_lossy_streaming_bytes_to_everyone(int16 inDistributionType, byt
 		}
 	}
 
-	spoke_distribute_lossy_streaming_bytes(inDistributionType, theDestinations, inBytes, inLength);
+	sSpoke->distributeLossyStreamingBytes(inDistributionType, theDestinations, inBytes, inLength);
 }
 
 
@@ -372,51 +459,44 @@ spoke_distribute_lossy_streaming_bytes_to_everyone(int16 inDistributionType, byt
 void
 spoke_distribute_lossy_streaming_bytes(int16 inDistributionType, uint32 inDestinationsBitmask, byte* inBytes, uint16 inLength)
 {
-	if(inLength > sOutgoingLossyByteStreamData.getRemainingSpace())
-	{
-		logNoteNMT("spoke has insufficient buffer space for %hu bytes of outgoing lossy streaming type %hd; discarded", inLength, inDistributionType);
-		return;
-	}
+	if(sSpoke)
+		sSpoke->distributeLossyStreamingBytes(inDistributionType, inDestinationsBitmask, inBytes, inLength);
+}
+
 
-	if(sOutgoingLossyByteStreamDescriptors.getRemainingSpace() < 1)
-	{
-		logNoteNMT("spoke has exhausted descriptor buffer space; discarding %hu bytes of outgoing lossy streaming type %hd", inLength, inDistributionType);
-		return;
-	}
-	
-	struct SpokeLossyByteStreamChunkDescriptor theDescriptor;
-	theDescriptor.mLength = inLength;
-	theDescriptor.mDestinations = inDestinationsBitmask;
-	theDescriptor.mType = inDistributionType;
 
+void
+StarSpoke::distributeLossyStreamingBytes(int16 inDistributionType, uint32 inDestinationsBitmask, byte* inBytes, uint16 inLength)
+{
 	logDumpNMT("spoke application decided to send %d bytes of lossy streaming type %d destined for players 0x%x", inLength, inDistributionType, inDestinationsBitmask);
-	
-	sOutgoingLossyByteStreamData.enqueueBytes(inBytes, inLength);
-	sOutgoingLossyByteStreamDescriptors.enqueue(theDescriptor);
+
+	mOutgoingLossyByteStreams.enqueue(inDistributionType, inDestinationsBitmask, static_cast<uint8>(mLocalPlayerIndex), inBytes, inLength);
 }
 
 
 
-static void
-spoke_became_disconnected()
+void
+StarSpoke::spoke_became_disconnected()
 {
-        sConnected = false;
-        for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+        mConnected = false;
+        for(size_t i = 0; i < mNetworkPlayers.size(); i++)
         {
-                if(sNetworkPlayers[i].mConnected)
-                        make_player_really_net_dead(i);
+                if(mNetworkPlayers[i].mConnected)
+                        mGame.playerNetDead(i);
         }
 }
 
 
 
 void
-spoke_received_network_packet(DDPPacketBufferPtr inPacket)
+StarSpoke::receivedNetworkPacket(DDPPacketBufferPtr inPacket)
 {
 	logContextNMT("spoke processing a received packet");
+
+	mTelemetry.received(*inPacket);
 	
         // Ignore packets not from our hub
-//        if(inPacket->sourceAddress != sHubAddress)
+//        if(inPacket->sourceAddress != mHubAddress)
 //                return;
 
         try {
@@ -426,7 +506,7 @@ spoke_received_network_packet(DDPPacketBufferPtr inPacket)
 		ps >> thePacketMagic;
 			
 		// If we've already given up on the connection, ignore non-ping packets.
-		if((!sConnected || !sSpokeActive) &&
+		if((!mConnected || !mSpokeActive) &&
 		   thePacketMagic != kPingRequestPacket &&
 		   thePacketMagic != kPingResponsePacket)
 			return;
@@ -447,11 +527,19 @@ spoke_received_network_packet(DDPPacketBufferPtr inPacket)
                 switch(thePacketMagic)
                 {
 		case kHubToSpokeGameDataPacketV1Magic:
-			spoke_received_game_data_packet_v1(ps, false);
+			spoke_received_game_data_packet_v1(ps, false, false);
 			break;
 
 		case kHubToSpokeGameDataPacketWithSpokeFlagsV1Magic:
-			spoke_received_game_data_packet_v1(ps, true);
+			spoke_received_game_data_packet_v1(ps, true, false);
+			break;
+
+		case kHubToSpokeGameDataPacketV2Magic:
+			spoke_received_game_data_packet_v1(ps, false, true);
+			break;
+
+		case kHubToSpokeGameDataPacketWithSpokeFlagsV2Magic:
+			spoke_received_game_data_packet_v1(ps, true, true);
 			break;
 		
 		case kPingRequestPacket:
@@ -459,7 +547,7 @@ spoke_received_network_packet(DDPPacketBufferPtr inPacket)
 			break;
 		
 		case kPingResponsePacket:
-			spoke_received_ping_response(ps, inPacket->sourceAddress);
+			spoke_received_ping_response(ps);
 			break;
 		
 		default:
@@ -476,10 +564,10 @@ spoke_received_network_packet(DDPPacketBufferPtr inPacket)
 
 
 
-static void
-spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
+void
+StarSpoke::spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags, bool inPacked)
 {
-	sHeardFromHub = true;
+	mHeardFromHub = true;
 
         IncomingGameDataPacketProcessingContext context;
         
@@ -488,28 +576,28 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
         ps >> theSmallestUnacknowledgedTick;
 
 	// we can get an early ACK only if the server made up flags for us...
-	if (theSmallestUnacknowledgedTick > sOutgoingFlags.getWriteTick())
+	if (theSmallestUnacknowledgedTick > mOutgoingFlags.getWriteTick())
 	{
 		if (reflected_flags) 
 		{
-			theSmallestUnacknowledgedTick = sOutgoingFlags.getWriteTick();
+			theSmallestUnacknowledgedTick = mOutgoingFlags.getWriteTick();
 		}
 		else
 		{
-			logTraceNMT("early ack (%d > %d)", theSmallestUnacknowledgedTick, sOutgoingFlags.getWriteTick());
+			logTraceNMT("early ack (%d > %d)", theSmallestUnacknowledgedTick, mOutgoingFlags.getWriteTick());
 			return;
 		}
 	}
 
 
         // Heard from hub
-        sLastNetworkTickHeard = sNetworkTicker;
+        mLastNetworkTickHeard = mNetworkTicker;
 
         // Remove acknowledged elements from outgoing queue
-        for(int tick = sOutgoingFlags.getReadTick(); tick < theSmallestUnacknowledgedTick; tick++)
+        for(int tick = mOutgoingFlags.getReadTick(); tick < theSmallestUnacknowledgedTick; tick++)
 	{
-		logTraceNMT("dequeueing tick %d from sOutgoingFlags", tick);
-                sOutgoingFlags.dequeue();
+		logTraceNMT("dequeueing tick %d from mOutgoingFlags", tick);
+                mOutgoingFlags.dequeue();
 	}
 
         // Process messages
@@ -517,10 +605,10 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 
         if(!context.mGotTimingAdjustmentMessage)
 	{
-		if(sRequestedTimingAdjustment != 0)
+		if(mRequestedTimingAdjustment != 0)
 			logTraceNMT("timing adjustment no longer requested");
 		
-                sRequestedTimingAdjustment = 0;
+                mRequestedTimingAdjustment = 0;
 	}
 
         // Action_flags!!!
@@ -538,10 +626,10 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 		// sometime in the future.  (If their NetDeadTick is greater than the ACKed tick, we expect
 		// that the hub will be sending actual flags in the future to make up the difference.)
 		bool weAreAlone = true;
-		int32 theSmallestUnacknowledgedTick = sOutgoingFlags.getReadTick();
-		for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+		int32 theSmallestUnacknowledgedTick = mOutgoingFlags.getReadTick();
+		for(size_t i = 0; i < mNetworkPlayers.size(); i++)
 		{
-			if(i != sLocalPlayerIndex && (sNetworkPlayers[i].mConnected || sNetworkPlayers[i].mNetDeadTick > theSmallestUnacknowledgedTick))
+			if(i != mLocalPlayerIndex && (mNetworkPlayers[i].mConnected || mNetworkPlayers[i].mNetDeadTick > theSmallestUnacknowledgedTick))
 			{
 				weAreAlone = false;
 				break;
@@ -552,14 +640,14 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 		{
 			logContextNMT("handling special \"we are alone\" case");
 			
-			for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+			for(size_t i = 0; i < mNetworkPlayers.size(); i++)
 			{
-				NetworkPlayer_spoke& thePlayer = sNetworkPlayers[i];
-				if (i == sLocalPlayerIndex)
+				NetworkPlayer_spoke& thePlayer = mNetworkPlayers[i];
+				if (i == mLocalPlayerIndex)
 				{
-					while (sSmallestUnconfirmedTick < sUnconfirmedFlags.getWriteTick())
+					while (mSmallestUnconfirmedTick < mUnconfirmedFlags.getWriteTick())
 					{
-						sNetworkPlayers[i].mQueue->enqueue(sUnconfirmedFlags.peek(sSmallestUnconfirmedTick++));
+						mNetworkPlayers[i].mQueue->enqueue(mUnconfirmedFlags.peek(mSmallestUnconfirmedTick++));
 					}
 				} 
 				else if (!thePlayer.mZombie)
@@ -572,8 +660,8 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 				}
 			}
 
-			sSmallestUnreceivedTick = theSmallestUnacknowledgedTick;
-			logDumpNMT("sSmallestUnreceivedTick is now %d", sSmallestUnreceivedTick);
+			mSmallestUnreceivedTick = theSmallestUnacknowledgedTick;
+			logDumpNMT("mSmallestUnreceivedTick is now %d", mSmallestUnreceivedTick);
 		}
 		
                 return;
@@ -582,32 +670,40 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
         int32 theSmallestUnreadTick;
         ps >> theSmallestUnreadTick;
 
+	PackedActionFlagsReader theReader;
+	int32 theTicksLeft = 0;
+	if(inPacked)
+	{
+		theReader.readFrom(ps);
+		theTicksLeft = theReader.tickCount();
+	}
+
         // Can't accept packets that skip ticks
-        if(theSmallestUnreadTick > sSmallestUnreceivedTick)
+        if(theSmallestUnreadTick > mSmallestUnreceivedTick)
 	{
-		logTraceNMT("early flags (%d > %d)", theSmallestUnreadTick, sSmallestUnreceivedTick);
+		logTraceNMT("early flags (%d > %d)", theSmallestUnreadTick, mSmallestUnreceivedTick);
                 return;
 	}
 
         // Figure out how many ticks of flags we can actually enqueue
         // We want to stock all queues evenly, since we ACK everyone's flags for a tick together.
         int theSmallestQueueSpace = INT_MAX;
-        for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+        for(size_t i = 0; i < mNetworkPlayers.size(); i++)
         {
 		// we'll never get flags for zombies, and we're not expected 
 		// to enqueue flags for zombies
-                if(sNetworkPlayers[i].mZombie)
+                if(mNetworkPlayers[i].mZombie)
                         continue;
 
-                int theQueueSpace = sNetworkPlayers[i].mQueue->availableCapacity();
+                int theQueueSpace = mNetworkPlayers[i].mQueue->availableCapacity();
 
                 /*
                         hmm, taking this exemption out, because we will start enqueueing PLAYER_NET_DEAD_FLAG onto the queue.
                 // If player is netdead or will become netdead before queue fills,
                 // player's queue space will not limit us
-                if(!sNetworkPlayers[i].mConnected)
+                if(!mNetworkPlayers[i].mConnected)
                 {
-                        int theRemainingLiveTicks = sNetworkPlayers[i].mNetDeadTick - sSmallestUnreceivedTick;
+                        int theRemainingLiveTicks = mNetworkPlayers[i].mNetDeadTick - mSmallestUnreceivedTick;
                         if(theRemainingLiveTicks < theQueueSpace)
                                 continue;
                 }
@@ -623,32 +719,32 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
         // The body of this loop is a bit more convoluted than you might
         // expect, because the same loop is used to skip already-seen action_flags
         // and to enqueue new ones.
-	while(ps.tellg() < ps.maxg())
+	while(inPacked ? theTicksLeft-- > 0 : ps.tellg() < ps.maxg())
         {
                 // If we've no room to enqueue stuff, no point in finishing reading the packet.
                 if(theSmallestQueueSpace <= 0)
                         break;
                 
-                for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+                for(size_t i = 0; i < mNetworkPlayers.size(); i++)
                 {
 
 			// We'll never get flags for zombies
-			if (sNetworkPlayers[i].mZombie)
+			if (mNetworkPlayers[i].mZombie)
 				continue;
 
 			// if our own flags are not sent back to us,
 			// confirm the ones we have in our unconfirmed queue,
 			// and do not read any from the packet
-			if (i == sLocalPlayerIndex && !reflected_flags)
+			if (i == mLocalPlayerIndex && !reflected_flags)
 			{
-				if (theSmallestUnreadTick == sSmallestUnreceivedTick && theSmallestUnreadTick >= sSmallestRealGameTick)
+				if (theSmallestUnreadTick == mSmallestUnreceivedTick && theSmallestUnreadTick >= mSmallestRealGameTick)
 				{
-					assert(sNetworkPlayers[i].mQueue->getWriteTick() == sSmallestUnconfirmedTick);
-					assert(sSmallestUnconfirmedTick >= sUnconfirmedFlags.getReadTick());
-					assert(sSmallestUnconfirmedTick < sUnconfirmedFlags.getWriteTick());
+					assert(mNetworkPlayers[i].mQueue->getWriteTick() == mSmallestUnconfirmedTick);
+					assert(mSmallestUnconfirmedTick >= mUnconfirmedFlags.getReadTick());
+					assert(mSmallestUnconfirmedTick < mUnconfirmedFlags.getWriteTick());
 					// confirm this flag
-					sNetworkPlayers[i].mQueue->enqueue(sUnconfirmedFlags.peek(sSmallestUnconfirmedTick));
-					sSmallestUnconfirmedTick++;
+					mNetworkPlayers[i].mQueue->enqueue(mUnconfirmedFlags.peek(mSmallestUnconfirmedTick));
+					mSmallestUnconfirmedTick++;
 				}
 				
 				continue;
@@ -657,7 +753,7 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
                         bool shouldEnqueueNetDeadFlags = false;
 
                         // We won't get flags for netdead players
-                        NetworkPlayer_spoke& thePlayer = sNetworkPlayers[i];
+                        NetworkPlayer_spoke& thePlayer = mNetworkPlayers[i];
                         if(!thePlayer.mConnected)
                         {
                                 if(thePlayer.mNetDeadTick < theSmallestUnreadTick)
@@ -666,8 +762,8 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
                                 if(thePlayer.mNetDeadTick == theSmallestUnreadTick)
                                 {
                                         // Only actually act if this tick is new to us
-                                        if(theSmallestUnreadTick == sSmallestUnreceivedTick)
-                                                make_player_really_net_dead(i);
+                                        if(theSmallestUnreadTick == mSmallestUnreceivedTick)
+                                                mGame.playerNetDead(i);
                                         shouldEnqueueNetDeadFlags = true;
                                 }
                         }
@@ -682,7 +778,7 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
                                 // We should have a flag for this player for this tick!
 				try 
 				{
-					ps >> theFlags;
+					theFlags = read_action_flags(ps, inPacked ? &theReader : NULL, i);
 				}
 				catch (const AStream::failure& f)
 				{
@@ -693,40 +789,41 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 
 
                         // Now, we've gotten flags, probably from the packet... should we enqueue them?
-                        if(theSmallestUnreadTick == sSmallestUnreceivedTick)
+                        if(theSmallestUnreadTick == mSmallestUnreceivedTick)
                         {
-				if(theSmallestUnreadTick >= sSmallestRealGameTick)
+				if(theSmallestUnreadTick >= mSmallestRealGameTick)
 				{
-					WritableTickBasedActionQueue& theQueue = *(sNetworkPlayers[i].mQueue);
-					assert(theQueue.getWriteTick() == sSmallestUnreceivedTick);
+					WritableTickBasedActionQueue& theQueue = *(mNetworkPlayers[i].mQueue);
+					assert(theQueue.getWriteTick() == mSmallestUnreceivedTick);
 					assert(theQueue.availableCapacity() > 0);
 					logTraceNMT("enqueueing flags %x for player %d tick %d", theFlags, i, theQueue.getWriteTick());
 					theQueue.enqueue(theFlags);
-					if (i == sLocalPlayerIndex) sSmallestUnconfirmedTick++;
+					if (i == mLocalPlayerIndex) mSmallestUnconfirmedTick++;
 				}
                         }
 
                 } // iterate over players
 
 		theSmallestUnreadTick++;
-		if(sSmallestUnreceivedTick < theSmallestUnreadTick)
+		if(mSmallestUnreceivedTick < theSmallestUnreadTick)
 		{
 			theSmallestQueueSpace--;
-			sSmallestUnreceivedTick = theSmallestUnreadTick;
+			mSmallestUnreceivedTick = theSmallestUnreadTick;
 
-			int32 theLatencyMeasurement = sOutgoingFlags.getWriteTick() - sSmallestUnreceivedTick;
+			int32 theLatencyMeasurement = mOutgoingFlags.getWriteTick() - mSmallestUnreceivedTick;
 			logDumpNMT("latency measurement: %d", theLatencyMeasurement);
 
-			sNthElementFinder.insert(theLatencyMeasurement);
+			mNthElementFinder.insert(theLatencyMeasurement);
 			// We capture these values here so we don't have to take a lock in GetNetTime.
-			sTimingMeasurementValid = sNthElementFinder.window_full();
-			if(sTimingMeasurementValid)
-				sTimingMeasurement = sNthElementFinder.nth_largest_element(sSpokePreferences.mTimingNthElement);
+			mTimingMeasurementValid = mNthElementFinder.window_full();
+			if(mTimingMeasurementValid)
+				mTimingMeasurement = mNthElementFinder.nth_largest_element(sSpokePreferences.mTimingNthElement);
 
 			// update the latency display
-			sDisplayLatencyTicks -= sDisplayLatencyBuffer[sDisplayLatencyCount % sDisplayLatencyBuffer.size()];
-			sDisplayLatencyBuffer[sDisplayLatencyCount++ % sDisplayLatencyBuffer.size()] = theLatencyMeasurement;
-			sDisplayLatencyTicks += theLatencyMeasurement;
+			mDisplayLatencyTicks -= mDisplayLatencyBuffer[mDisplayLatencyCount % mDisplayLatencyBuffer.size()];
+			mDisplayLatencyBuffer[mDisplayLatencyCount++ % mDisplayLatencyBuffer.size()] = theLatencyMeasurement;
+			mDisplayLatencyTicks += theLatencyMeasurement;
+			mTelemetry.roundTrip(mLocalPlayerIndex, theLatencyMeasurement);
 		}
 
 	} // loop while there's packet data left
@@ -734,51 +831,27 @@ spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags)
 }
 
 
-static void
-spoke_received_ping_request(AIStream& ps, NetAddrBlock address)
+void
+StarSpoke::spoke_received_ping_request(AIStream& ps, NetAddrBlock address)
 {
 	uint16 pingIdentifier;
 	ps >> pingIdentifier;
 	
 	// respond back to requestor
-	bool initedFrame = false;
-	if (!sOutgoingFrame)
-	{
-		sOutgoingFrame = NetDDPNewFrame();
-		initedFrame = true;
-	}
-	
-	AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-	AOStreamBE ops(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
-	
 	try {
-		hdr << (uint16)kPingResponsePacket;
-		ops << pingIdentifier;
-		
-		// blank out the CRC field before calculating
-		sOutgoingFrame->data[2] = 0;
-		sOutgoingFrame->data[3] = 0;
-		
-		uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ops.tellp());
-		hdr << crc;
-		
+		write_ping_response(mOutgoingFrame, pingIdentifier);
+
 		// Send the packet
-		sOutgoingFrame->data_size = ops.tellp();
-		NetDDPSendFrame(sOutgoingFrame, &address, kPROTOCOL_TYPE, 0 /* ignored */);
+		mTelemetry.sent(*mOutgoingFrame);
+		mGame.sendFrame(mOutgoingFrame, &address, kPROTOCOL_TYPE, 0 /* ignored */);
 	} catch (...) {
 		logWarningNMT("Caught exception while constructing/sending ping response packet");
 	}
-	
-	if (initedFrame)
-	{
-		NetDDPDisposeFrame(sOutgoingFrame);
-		sOutgoingFrame = NULL;
-	}
 } // spoke_received_ping_request()
 
 
-static void
-spoke_received_ping_response(AIStream& ps, NetAddrBlock address)
+void
+StarSpoke::spoke_received_ping_response(AIStream& ps)
 {
 	uint16 pingIdentifier;
 	ps >> pingIdentifier;
@@ -789,64 +862,73 @@ spoke_received_ping_response(AIStream& ps, NetAddrBlock address)
 } // spoke_received_ping_response()
 
 
-static void
-process_messages(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+void
+StarSpoke::process_messages(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
 {
         while(!context.mMessagesDone)
         {
                 uint16 theMessageType;
                 ps >> theMessageType;
 
-                MessageTypeToMessageHandler::iterator i = sMessageTypeToMessageHandler.find(theMessageType);
+                switch(theMessageType)
+                {
+                        case kEndOfMessagesMessageType:
+                                context.mMessagesDone = true;
+                                break;
 
-                if(i == sMessageTypeToMessageHandler.end())
-                        process_optional_message(ps, context, theMessageType);
-                else
-                        i->second(ps, context);
-        }
-}
+                        case kTimingAdjustmentMessageType:
+                                handle_timing_adjustment_message(ps, context);
+                                break;
 
+                        case kPlayerNetDeadMessageType:
+                                handle_player_net_dead_message(ps);
+                                break;
 
+                        case kHubToSpokeLossyByteStreamMessageType:
+                                handle_lossy_byte_stream_message(ps);
+                                break;
 
-static void
-handle_end_of_messages_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
-{
-        context.mMessagesDone = true;
+                        default:
+                                process_optional_message(ps);
+                                break;
+                }
+        }
 }
 
 
 
-static void
-handle_player_net_dead_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+void
+StarSpoke::handle_player_net_dead_message(AIStream& ps)
 {
         uint8 thePlayerIndex;
         int32 theTick;
 
         ps >> thePlayerIndex >> theTick;
 
-        if(thePlayerIndex > sNetworkPlayers.size())
+        if(thePlayerIndex > mNetworkPlayers.size())
                 return;
 
-        sNetworkPlayers[thePlayerIndex].mConnected = false;
-        sNetworkPlayers[thePlayerIndex].mNetDeadTick = theTick;
+        mNetworkPlayers[thePlayerIndex].mConnected = false;
+        mNetworkPlayers[thePlayerIndex].mNetDeadTick = theTick;
 
 	logDumpNMT("netDead message: player %d in tick %d", thePlayerIndex, theTick);
 }
 
 
 
-static void
-handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+void
+StarSpoke::handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
 {
         int8 theAdjustment;
 
         ps >> theAdjustment;
 
-        if(theAdjustment != sRequestedTimingAdjustment)
+        if(theAdjustment != mRequestedTimingAdjustment)
         {
-                sOutstandingTimingAdjustment = theAdjustment;
-                sRequestedTimingAdjustment = theAdjustment;
-		logTraceNMT("new timing adjustment message; requested: %d outstanding: %d", sRequestedTimingAdjustment, sOutstandingTimingAdjustment);
+                mOutstandingTimingAdjustment = theAdjustment;
+                mRequestedTimingAdjustment = theAdjustment;
+		mTelemetry.timingAdjustment(mNetworkTicker, mLocalPlayerIndex, theAdjustment, mSmallestUnreceivedTick);
+		logTraceNMT("new timing adjustment message; requested: %d outstanding: %d", mRequestedTimingAdjustment, mOutstandingTimingAdjustment);
         }
 
         context.mGotTimingAdjustmentMessage = true;
@@ -854,8 +936,8 @@ handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingC
 
 
 
-static void
-handle_lossy_byte_stream_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context)
+void
+StarSpoke::handle_lossy_byte_stream_message(AIStream& ps)
 {
 	uint16 theMessageLength;
 	ps >> theMessageLength;
@@ -868,24 +950,24 @@ handle_lossy_byte_stream_message(AIStream& ps, IncomingGameDataPacketProcessingC
 
 	uint16 theDataLength = theMessageLength - (ps.tellg() - theStartOfMessage);
 	uint16 theSpilloverDataLength = 0;
-	if(theDataLength > sizeof(sScratchBuffer))
+	if(theDataLength > sizeof(mScratchBuffer))
 	{
 		logNoteNMT("received too many bytes (%d) of lossy streaming data type %d from player %d; truncating", theDataLength, theDistributionType, theSendingPlayer);
-		theSpilloverDataLength = theDataLength - sizeof(sScratchBuffer);
-		theDataLength = sizeof(sScratchBuffer);
+		theSpilloverDataLength = theDataLength - sizeof(mScratchBuffer);
+		theDataLength = sizeof(mScratchBuffer);
 	}
-	ps.read(sScratchBuffer, theDataLength);
+	ps.read(mScratchBuffer, theDataLength);
 	ps.ignore(theSpilloverDataLength);
 
 	logDumpNMT("received %d bytes of lossy streaming type %d data from player %d", theDataLength, theDistributionType, theSendingPlayer);
 
-	call_distribution_response_function_if_available(sScratchBuffer, theDataLength, theDistributionType, theSendingPlayer);
+	mGame.receivedLossyByteStream(mScratchBuffer, theDataLength, theDistributionType, theSendingPlayer);
 }
 
 
 
-static void
-process_optional_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context, uint16 inMessageType)
+void
+StarSpoke::process_optional_message(AIStream& ps)
 {
         // We don't know of any optional messages, so we just skip any we encounter.
         // (All optional messages are required to encode their length (not including the
@@ -899,18 +981,18 @@ process_optional_message(AIStream& ps, IncomingGameDataPacketProcessingContext&
 
 
 
-static bool
-spoke_tick()
+bool
+StarSpoke::tick()
 {
-	logContextNMT("processing spoke_tick %d", sNetworkTicker);
+	logContextNMT("processing spoke_tick %d", mNetworkTicker);
 	
-        sNetworkTicker++;
+        mNetworkTicker++;
 
-        if(sConnected)
+        if(mConnected)
         {
-                int32 theSilentTicksBeforeNetDeath = (sOutgoingFlags.getReadTick() >= sSmallestRealGameTick) ? sSpokePreferences.mInGameTicksBeforeNetDeath : sSpokePreferences.mPregameTicksBeforeNetDeath;
+                int32 theSilentTicksBeforeNetDeath = (mOutgoingFlags.getReadTick() >= mSmallestRealGameTick) ? sSpokePreferences.mInGameTicksBeforeNetDeath : sSpokePreferences.mPregameTicksBeforeNetDeath;
         
-                if(sNetworkTicker - sLastNetworkTickHeard > theSilentTicksBeforeNetDeath)
+                if(mNetworkTicker - mLastNetworkTickHeard > theSilentTicksBeforeNetDeath)
                 {
 			logTraceNMT("giving up on hub; disconnecting");
                         spoke_became_disconnected();
@@ -922,9 +1004,9 @@ spoke_tick()
 
         // Negative timing adjustment means we need to provide extra ticks because we're late.
         // We let this cover the normal timing adjustment = 0 case too.
-        if(sOutstandingTimingAdjustment <= 0)
+        if(mOutstandingTimingAdjustment <= 0)
         {
-                int theNumberOfFlagsToProvide = -sOutstandingTimingAdjustment + 1;
+                int theNumberOfFlagsToProvide = -mOutstandingTimingAdjustment + 1;
 
 		logDumpNMT("want to provide %d flags", theNumberOfFlagsToProvide);
 
@@ -937,75 +1019,79 @@ spoke_tick()
 			//	else (if pregame), write only to the outbound flags queue.
 
 			WritableTickBasedActionQueue& theTargetQueue =
-				sConnected ?
-					((sOutgoingFlags.getWriteTick() >= sSmallestRealGameTick) ?
-						static_cast<WritableTickBasedActionQueue&>(sLocallyGeneratedFlags)
-						: static_cast<WritableTickBasedActionQueue&>(sOutgoingFlags))
-					: *(sNetworkPlayers[sLocalPlayerIndex].mQueue);
+				mConnected ?
+					((mOutgoingFlags.getWriteTick() >= mSmallestRealGameTick) ?
+						static_cast<WritableTickBasedActionQueue&>(mLocallyGeneratedFlags)
+						: static_cast<WritableTickBasedActionQueue&>(mOutgoingFlags))
+					: *(mNetworkPlayers[mLocalPlayerIndex].mQueue);
 
 			if(theTargetQueue.availableCapacity() <= 0)
 				break;
 
 			logDumpNMT("enqueueing flags for tick %d", theTargetQueue.getWriteTick());
 
-			theTargetQueue.enqueue(parse_keymap());
+			theTargetQueue.enqueue(mGame.actionFlags(theTargetQueue.getWriteTick()));
 			shouldSend = true;
 			theNumberOfFlagsToProvide--;
 		}
 		
 		// Prevent creeping timing adjustment during "lulls"; OTOH remember to
 		// finish next time if we made progress but couldn't complete our obligation.
-		if(theNumberOfFlagsToProvide != -sOutstandingTimingAdjustment + 1)
-			sOutstandingTimingAdjustment = -theNumberOfFlagsToProvide;
+		if(theNumberOfFlagsToProvide != -mOutstandingTimingAdjustment + 1)
+			mOutstandingTimingAdjustment = -theNumberOfFlagsToProvide;
 	}
         // Positive timing adjustment means we should delay sending for a while,
         // so we just throw away this local tick.
         else
 	{
 		logDumpNMT("ignoring this tick for timing adjustment"); 
-                sOutstandingTimingAdjustment--;
+                mOutstandingTimingAdjustment--;
 	}
 
-	logDumpNMT("sOutstandingTimingAdjustment is now %d", sOutstandingTimingAdjustment);
+	logDumpNMT("mOutstandingTimingAdjustment is now %d", mOutstandingTimingAdjustment);
 
-	if(sOutgoingLossyByteStreamDescriptors.getCountOfElements() > 0)
+	// Chunks held back by a rate limit keep us sending until they're gone, too
+	if(mOutgoingLossyByteStreams.hasQueuedChunks())
 		shouldSend = true;
 
         // If we're connected and (we generated new data or if it's been long enough since we last sent), send.
-        if(sConnected)
+        if(mConnected)
 	{
-		if (sHeardFromHub) {
-			if(shouldSend || (sNetworkTicker - sLastNetworkTickSent) >= sSpokePreferences.mRecoverySendPeriod)
+		if (mHeardFromHub) {
+			if(shouldSend || (mNetworkTicker - mLastNetworkTickSent) >= sSpokePreferences.mRecoverySendPeriod)
 				send_packet();
-      if (sHubIsLocal) {
+      if (mHubIsLocal) {
         capture_position_sums_and_check_for_dsync();
-      } else if(!(sNetworkTicker % 30)) {
+      } else if (!mDedicatedHubGame) {
+        // (a dedicated hub doesn't run the game, so it has nothing to check these against)
+        if(!(mNetworkTicker % 30))
           send_position_sync_packet();
+        send_world_hash_packet();
       }
 		} else {
-			if (!(sNetworkTicker % 30))
+			if (!(mNetworkTicker % 30))
 				send_identification_packet();
 		}
 	}
 	else
 	{
-		int32 theLocalPlayerWriteTick = getNetworkPlayer(sLocalPlayerIndex).mQueue->getWriteTick();
+		int32 theLocalPlayerWriteTick = getNetworkPlayer(mLocalPlayerIndex).mQueue->getWriteTick();
 
 		// Since we're not connected, we won't be enqueueing flags for the other players in the packet handler.
 		// So, we do it here to keep the game moving.
-		for(size_t i = 0; i < sNetworkPlayers.size(); i++)
+		for(size_t i = 0; i < mNetworkPlayers.size(); i++)
 		{
-			if(i == sLocalPlayerIndex)
+			if(i == mLocalPlayerIndex)
 			{
 				// move our flags from sent queue to player queue
-				while (sSmallestUnconfirmedTick < sUnconfirmedFlags.getWriteTick())
+				while (mSmallestUnconfirmedTick < mUnconfirmedFlags.getWriteTick())
 				{
-					sNetworkPlayers[i].mQueue->enqueue(sUnconfirmedFlags.peek(sSmallestUnconfirmedTick++));
+					mNetworkPlayers[i].mQueue->enqueue(mUnconfirmedFlags.peek(mSmallestUnconfirmedTick++));
 				}
 				continue;
 			}
 			
-			NetworkPlayer_spoke& thePlayer = sNetworkPlayers[i];
+			NetworkPlayer_spoke& thePlayer = mNetworkPlayers[i];
 			
 			if(!thePlayer.mZombie)
 			{
@@ -1020,169 +1106,242 @@ spoke_tick()
 
         check_send_packet_to_hub();
 
+	if (star_telemetry_enabled())
+		record_telemetry();
+
         // We want to run again.
         return true;
 }
 
 
 
-static void
-send_packet()
+void
+StarSpoke::record_telemetry()
+{
+	StarTelemetryRecord theRecord = mTelemetry.newRecord(kStarTelemetrySpokeTick, mNetworkTicker);
+	theRecord.mValues[1] = mSmallestUnreceivedTick;
+	theRecord.mValues[2] = mOutgoingFlags.size();
+	theRecord.mValues[3] = mUnconfirmedFlags.size();
+	theRecord.mValues[4] = mOutgoingLossyByteStreams.queuedBytes();
+	theRecord.mValues[5] = mOutgoingLossyByteStreams.queuedChunks();
+	theRecord.mValues[6] = mOutstandingTimingAdjustment;
+	theRecord.mValues[7] = mTimingMeasurementValid ? mTimingMeasurement : NetworkStats::invalid;
+	theRecord.mValues[8] = mNetworkTicker - mLastNetworkTickHeard;
+	star_telemetry_record(theRecord);
+
+	if (mNetworkTicker % kStarTelemetryReportPeriod == 0)
+	{
+		NetworkStats theStats;
+		obj_clear(theStats);
+		theStats.latency = latency();
+		theStats.jitter = NetworkStats::invalid;
+		mTelemetry.reportPlayer(mNetworkTicker, mLocalPlayerIndex, theStats);
+		mTelemetry.reportTraffic(mNetworkTicker);
+	}
+}
+
+
+
+void
+StarSpoke::send_packet()
 {
         try {
-		AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-                AOStreamBE ps(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+		AOStreamBE hdr(mOutgoingFrame->data, kStarPacketHeaderSize);
+                AOStreamBE ps(mOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
         
                 // Packet type
-                hdr << (uint16)kSpokeToHubGameDataPacketV1Magic;
+                hdr << (uint16)(mPackedActionFlags ? kSpokeToHubGameDataPacketV2Magic : kSpokeToHubGameDataPacketV1Magic);
 
                 // Acknowledgement
-                ps << sSmallestUnreceivedTick;
+                ps << mSmallestUnreceivedTick;
         
                 // Messages
-		// Outstanding lossy streaming bytes?
-		if(sOutgoingLossyByteStreamDescriptors.getCountOfElements() > 0)
-		{
-			// Note: we make a conscious decision here to dequeue these things before
-			// writing to ps, so that if the latter operation exhausts ps's buffer and
-			// throws, we have less data to mess with next time, and shouldn't end up
-			// throwing every time we try to send here.
-			// If we eventually got smarter about managing packet space, we could try
-			// harder to preserve and pace data - e.g. change the 'if' immediately before this
-			// comment to a 'while', only put in as much data as we think we can fit, etc.
-			SpokeLossyByteStreamChunkDescriptor theDescriptor = sOutgoingLossyByteStreamDescriptors.peek();
-			sOutgoingLossyByteStreamDescriptors.dequeue();
-			
-			uint16 theMessageLength = theDescriptor.mLength + sizeof(theDescriptor.mType) + sizeof(theDescriptor.mDestinations);
-
-			ps << (uint16)kSpokeToHubLossyByteStreamMessageType
-				<< theMessageLength
-				<< theDescriptor.mType
-				<< theDescriptor.mDestinations;
-
-			// XXX unnecessary copy due to overly restrictive interfaces (retaining for clarity)
-			assert(theDescriptor.mLength <= sizeof(sScratchBuffer));
-			sOutgoingLossyByteStreamData.peekBytes(sScratchBuffer, theDescriptor.mLength);
-			sOutgoingLossyByteStreamData.dequeue(theDescriptor.mLength);
-
-			ps.write(sScratchBuffer, theDescriptor.mLength);
-		}
+		// Outstanding lossy streaming bytes, as many chunks as the budget and rate limits allow.
+		// writeSelected() skips what won't fit in ps rather than throwing, and the chunks go
+		// either way, so an oversized one can't get us stuck.
+		mOutgoingLossyByteStreams.select(mNetworkTicker);
+		mOutgoingLossyByteStreams.writeSelected(ps);
+		mOutgoingLossyByteStreams.dequeueSelected();
 		
                 // No more messages
                 ps << (uint16)kEndOfMessagesMessageType;
         
                 // Action_flags!!!
-                if(sOutgoingFlags.size() > 0)
+                if(mOutgoingFlags.size() > 0)
                 {
-                        ps << sOutgoingFlags.getReadTick();
-                        for(int32 tick = sOutgoingFlags.getReadTick(); tick < sOutgoingFlags.getWriteTick(); tick++)
-                                ps << sOutgoingFlags.peek(tick);
+                        ps << mOutgoingFlags.getReadTick();
+			if(mPackedActionFlags)
+			{
+				PackedActionFlagsWriter thePackedFlags;
+				for(int32 tick = mOutgoingFlags.getReadTick(); tick < mOutgoingFlags.getWriteTick(); tick++)
+				{
+					thePackedFlags.append(mLocalPlayerIndex, mOutgoingFlags.peek(tick));
+					thePackedFlags.endTick();
+				}
+				thePackedFlags.write(ps);
+			}
+			else
+			{
+				for(int32 tick = mOutgoingFlags.getReadTick(); tick < mOutgoingFlags.getWriteTick(); tick++)
+					ps << mOutgoingFlags.peek(tick);
+			}
                 }
 
-		logDumpNMT("preparing to send packet: ACK %d, flags [%d,%d)", sSmallestUnreceivedTick, sOutgoingFlags.getReadTick(), sOutgoingFlags.getWriteTick());
+		logDumpNMT("preparing to send packet: ACK %d, flags [%d,%d)", mSmallestUnreceivedTick, mOutgoingFlags.getReadTick(), mOutgoingFlags.getWriteTick());
 
 		// blank out the CRC before calculating it
-		sOutgoingFrame->data[2] = 0;
-		sOutgoingFrame->data[3] = 0;
+		mOutgoingFrame->data[2] = 0;
+		mOutgoingFrame->data[3] = 0;
 
-		uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ps.tellp());
+		uint16 crc = calculate_data_crc_ccitt(mOutgoingFrame->data, ps.tellp());
 		hdr << crc;
 
                 // Send the packet
-                sOutgoingFrame->data_size = ps.tellp();
+                mOutgoingFrame->data_size = ps.tellp();
 
-                if(sHubIsLocal)
-                        send_frame_to_local_hub(sOutgoingFrame, &sHubAddress, kPROTOCOL_TYPE, 0 /* ignored */);
-                else
-                        NetDDPSendFrame(sOutgoingFrame, &sHubAddress, kPROTOCOL_TYPE, 0 /* ignored */);
+                send_frame_to_hub(mOutgoingFrame);
 
-                sLastNetworkTickSent = sNetworkTicker;
+                mLastNetworkTickSent = mNetworkTicker;
         }
         catch (...) {
         }
 }
 
-static void
-send_position_sync_packet()
+// Sends the world hashes once for each period the game finishes
+void
+StarSpoke::send_world_hash_packet()
+{
+  world_hash_snapshot snapshot;
+  if (!mGame.latestWorldHash(snapshot))
+    return;
+  if (snapshot.tick == mLastWorldHashSent.tick && snapshot.level == mLastWorldHashSent.level)
+    return;
+  mLastWorldHashSent = snapshot;
+
+  try {
+    AOStreamBE hdr(mOutgoingFrame->data, kStarPacketHeaderSize);
+    AOStreamBE ps(mOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+
+    hdr << (uint16)kSpokeToHubWorldHash;
+
+    ps << snapshot.tick
+       << snapshot.level;
+    for (int i = 0; i < NUMBER_OF_WORLD_HASH_SUBSYSTEMS; i++)
+      ps << snapshot.hashes[i];
+
+    // blank out the CRC before calculating it
+    mOutgoingFrame->data[2] = 0;
+    mOutgoingFrame->data[3] = 0;
+
+    uint16 crc = calculate_data_crc_ccitt(mOutgoingFrame->data, ps.tellp());
+    hdr << crc;
+
+    mOutgoingFrame->data_size = ps.tellp();
+
+    send_frame_to_hub(mOutgoingFrame);
+  }
+  catch (...) {
+  }
+}
+
+void
+StarSpoke::send_position_sync_packet()
 {
+  int32 positionSum;
+  if (!mGame.positionSum(mLocalPlayerIndex, positionSum))
+    return;
+
   try {
-    AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-    AOStreamBE ps(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
+    AOStreamBE hdr(mOutgoingFrame->data, kStarPacketHeaderSize);
+    AOStreamBE ps(mOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
     
     // Packet type
     hdr << (uint16)kSpokeToHubPositionSyncSum;
         
-    player_data *player= get_player_data(sLocalPlayerIndex);
-
-    int32 positionSum = player->location.x + player->location.y + player->location.z;
     ps << positionSum;
     
     //printf ("Position sending: %d\n",positionSum);
     
     // blank out the CRC before calculating it
-    sOutgoingFrame->data[2] = 0;
-    sOutgoingFrame->data[3] = 0;
+    mOutgoingFrame->data[2] = 0;
+    mOutgoingFrame->data[3] = 0;
     
-    uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ps.tellp());
+    uint16 crc = calculate_data_crc_ccitt(mOutgoingFrame->data, ps.tellp());
     hdr << crc;
     
     // Send the packet
-    sOutgoingFrame->data_size = ps.tellp();
+    mOutgoingFrame->data_size = ps.tellp();
     
-    if(sHubIsLocal)
-      send_frame_to_local_hub(sOutgoingFrame, &sHubAddress, kPROTOCOL_TYPE, 0 /* ignored */);
-    else
-      NetDDPSendFrame(sOutgoingFrame, &sHubAddress, kPROTOCOL_TYPE, 0 /* ignored */);
+    send_frame_to_hub(mOutgoingFrame);
     
   }
   catch (...) {
   }
 }
 
-static void
-send_identification_packet()
+void
+StarSpoke::send_identification_packet()
 {
         try {
-		AOStreamBE hdr(sOutgoingFrame->data, kStarPacketHeaderSize);
-                AOStreamBE ps(sOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
-        
-		// Message type
-		hdr << (uint16) kSpokeToHubIdentification;
+		AOStreamBE hdr(mOutgoingFrame->data, kStarPacketHeaderSize);
+                AOStreamBE ps(mOutgoingFrame->data, ddpMaxData, kStarPacketHeaderSize);
         
-                // ID
-                ps << (uint16)sLocalPlayerIndex;
+		if(mDedicatedHubGame)
+		{
+			// A dedicated hub hosts many games, and learns the shape of ours (and everyone's
+			// join tokens) from whoever joins it first.
+			hdr << (uint16) kSpokeToHubJoinGame;
+
+			ps << mDedicatedHubGame
+			   << (uint16)mLocalPlayerIndex
+			   << (uint16)mNetworkPlayers.size()
+			   << mSmallestRealGameTick
+			   << mConnectedPlayersBitmask;
+			for(size_t i = 0; i < mDedicatedHubJoinTokens.size(); i++)
+				ps << mDedicatedHubJoinTokens[i];
+		}
+		else
+		{
+			// Message type
+			hdr << (uint16) kSpokeToHubIdentification;
+
+			// ID
+			ps << (uint16)mLocalPlayerIndex;
+		}
 
 		// blank out the CRC field before calculating
-		sOutgoingFrame->data[2] = 0;
-		sOutgoingFrame->data[3] = 0;
+		mOutgoingFrame->data[2] = 0;
+		mOutgoingFrame->data[3] = 0;
 
-		uint16 crc = calculate_data_crc_ccitt(sOutgoingFrame->data, ps.tellp());
+		uint16 crc = calculate_data_crc_ccitt(mOutgoingFrame->data, ps.tellp());
 		hdr << crc;
 
                 // Send the packet
-                sOutgoingFrame->data_size = ps.tellp();
-                if(sHubIsLocal)
-                        send_frame_to_local_hub(sOutgoingFrame, &sHubAddress, kPROTOCOL_TYPE, 0 /* ignored */);
-                else
-                        NetDDPSendFrame(sOutgoingFrame, &sHubAddress, kPROTOCOL_TYPE, 0 /* ignored */);
+                mOutgoingFrame->data_size = ps.tellp();
+                send_frame_to_hub(mOutgoingFrame);
         }
         catch (...) {
         }
 }
 
+int32 StarSpoke::latency() const
+{
+	return (mDisplayLatencyCount >= TICKS_PER_SECOND) ? mDisplayLatencyTicks * 1000 / TICKS_PER_SECOND / mDisplayLatencyBuffer.size() : NetworkStats::invalid;
+}
+
 int32 spoke_latency()
 {
-	return (sDisplayLatencyCount >= TICKS_PER_SECOND) ? sDisplayLatencyTicks * 1000 / TICKS_PER_SECOND / sDisplayLatencyBuffer.size() : NetworkStats::invalid;
+	return sSpoke ? sSpoke->latency() : NetworkStats::invalid;
 }
 
 TickBasedActionQueue* spoke_get_unconfirmed_flags_queue()
 {
-	return &sUnconfirmedFlags;
+	return sSpoke ? sSpoke->unconfirmedFlagsQueue() : &sNoUnconfirmedFlags;
 }
 
 int32 spoke_get_smallest_unconfirmed_tick()
 {
-	return sSmallestUnconfirmedTick;
+	return sSpoke ? sSpoke->smallestUnconfirmedTick() : sNetTimeAtCleanup;
 }
 		
 
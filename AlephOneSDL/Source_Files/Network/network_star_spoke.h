@@ -0,0 +1,173 @@
+/*
+ *  network_star_spoke.h
+
+	Copyright (C) 2003 and beyond by Woody Zenfell, III
+	and the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  The spoke half of the star protocol as an object, so that one process can run the spoke for
+ *  the game it's playing (see spoke_initialize() etc. in network_star.h) or many spokes at once
+ *  with no game behind them (see network_star_stress.cpp).
+ */
+
+#ifndef NETWORK_STAR_SPOKE_H
+#define NETWORK_STAR_SPOKE_H
+
+#include "network_star.h"
+#include "network_star_telemetry.h"
+#include "network_star_lossy.h"
+#include "WindowedNthElementFinder.h"
+#include "world_hash.h"
+
+#include <vector>
+
+class AIStream;
+
+// Everything a spoke needs from the game it's playing.  The spoke calls these from whichever
+// thread calls its tick() and receivedNetworkPacket().
+class StarSpokeGame
+{
+public:
+	virtual ~StarSpokeGame() {}
+
+	// The local player's action flags for inTick
+	virtual action_flags_t actionFlags(int32 inTick) = 0;
+	virtual OSErr sendFrame(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port) = 0;
+	virtual void playerNetDead(size_t inPlayerIndex) = 0;
+	virtual void receivedLossyByteStream(byte* inBuffer, uint16 inBufferSize, int16 inDistributionType, uint8 inSendingPlayerIndex) = 0;
+
+	// What the hub checks our game against; return false to send nothing
+	virtual bool positionSum(size_t inLocalPlayerIndex, int32& outPositionSum) = 0;
+	virtual bool latestWorldHash(world_hash_snapshot& outSnapshot) = 0;
+};
+
+class StarSpoke
+{
+public:
+	StarSpoke(const NetAddrBlock& inHubAddress, int32 inFirstTick, size_t inNumberOfPlayers, WritableTickBasedActionQueue* const inPlayerQueues[], bool inPlayerConnected[], size_t inLocalPlayerIndex, bool inHubIsLocal, uint32 inDedicatedHubGame, bool inPackedActionFlags, const uint32* inDedicatedHubJoinTokens, StarSpokeGame& inGame);
+	~StarSpoke();
+
+	// Neither of these is reentrant, and they must not run at the same time.
+	void receivedNetworkPacket(DDPPacketBufferPtr inPacket);
+	bool tick();
+
+	// Stops handling packets, after one last one to try not to leave the hub waiting on our ACK
+	void deactivate();
+	bool isConnected() const { return mConnected; }
+	size_t playerCount() const { return mNetworkPlayers.size(); }
+	size_t localPlayerIndex() const { return mLocalPlayerIndex; }
+	bool isPlayerConnected(size_t inPlayerIndex) const { return !mNetworkPlayers[inPlayerIndex].mZombie && mNetworkPlayers[inPlayerIndex].mConnected; }
+	int8 requestedTimingAdjustment() const { return mRequestedTimingAdjustment; }
+
+	int32 netTime();
+	void distributeLossyStreamingBytes(int16 inDistributionType, uint32 inDestinationsBitmask, byte* inBytes, uint16 inLength);
+	int32 latency() const;
+	TickBasedActionQueue* unconfirmedFlagsQueue() { return &mUnconfirmedFlags; }
+	int32 smallestUnconfirmedTick() const { return mSmallestUnconfirmedTick; }
+
+private:
+	enum {
+		kOutgoingFlagsQueueSize = TICKS_PER_SECOND / 2,
+		kLossyByteStreamScratchBufferSize = LossyByteStreamMultiplexer::kStreamBufferSize
+	};
+
+	struct IncomingGameDataPacketProcessingContext {
+		bool mMessagesDone;
+		bool mGotTimingAdjustmentMessage;
+
+		IncomingGameDataPacketProcessingContext() : mMessagesDone(false), mGotTimingAdjustmentMessage(false) {}
+	};
+
+	struct NetworkPlayer_spoke {
+		bool				mZombie;
+		bool				mConnected;
+		int32				mNetDeadTick;
+		WritableTickBasedActionQueue* 	mQueue;
+	};
+
+	void spoke_became_disconnected();
+	void spoke_received_game_data_packet_v1(AIStream& ps, bool reflected_flags, bool inPacked);
+	void spoke_received_ping_request(AIStream& ps, NetAddrBlock address);
+	void spoke_received_ping_response(AIStream& ps);
+	void process_messages(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
+	void handle_player_net_dead_message(AIStream& ps);
+	void handle_timing_adjustment_message(AIStream& ps, IncomingGameDataPacketProcessingContext& context);
+	void handle_lossy_byte_stream_message(AIStream& ps);
+	void process_optional_message(AIStream& ps);
+	void record_telemetry();
+	void send_packet();
+	void send_position_sync_packet();
+	void send_world_hash_packet();
+	void send_identification_packet();
+	OSErr send_frame_to_hub(DDPFramePtr frame);
+	void check_send_packet_to_hub();
+
+	NetworkPlayer_spoke& getNetworkPlayer(size_t inIndex);
+
+	StarSpokeGame& mGame;
+
+	TickBasedActionQueue mOutgoingFlags;
+	TickBasedActionQueue mUnconfirmedFlags;
+	DuplicatingTickBasedCircularQueue<action_flags_t> mLocallyGeneratedFlags;
+	int32 mSmallestRealGameTick;
+
+	int8 mRequestedTimingAdjustment;
+	int8 mOutstandingTimingAdjustment;
+
+	std::vector<NetworkPlayer_spoke> mNetworkPlayers;
+	int32 mNetworkTicker;
+	int32 mLastNetworkTickHeard;
+	int32 mLastNetworkTickSent;
+	world_hash_snapshot mLastWorldHashSent;
+	bool mConnected;
+	bool mSpokeActive;	// used to enable the packet handler
+	DDPFramePtr mOutgoingFrame;
+	DDPPacketBuffer mLocalOutgoingBuffer;
+	bool mNeedToSendLocalOutgoingBuffer;
+	bool mHubIsLocal;
+	NetAddrBlock mHubAddress;
+	uint32 mDedicatedHubGame;
+	std::vector<uint32> mDedicatedHubJoinTokens;
+	bool mPackedActionFlags;
+	uint32 mConnectedPlayersBitmask;
+	size_t mLocalPlayerIndex;
+	int32 mSmallestUnreceivedTick;
+	WindowedNthElementFinder<int32> mNthElementFinder;
+	bool mTimingMeasurementValid;
+	int32 mTimingMeasurement;
+	int32 mPreviousDelay;
+	bool mHeardFromHub;
+
+	std::vector<int32> mDisplayLatencyBuffer; // stores the last 30 latency calculations, in ticks
+	uint32 mDisplayLatencyCount;
+	int32 mDisplayLatencyTicks; // sum of the latency ticks from the last 30 seconds, using above two
+
+	int32 mSmallestUnconfirmedTick;
+
+	// Outgoing lossy byte stream data, queued by the main thread and sent by the network thread
+	LossyByteStreamMultiplexer mOutgoingLossyByteStreams;
+
+	// This is currently used only to hold incoming streaming data until it's passed to the upper-level code
+	byte mScratchBuffer[kLossyByteStreamScratchBufferSize];
+
+	StarTelemetryCounters mTelemetry;
+
+	// not copyable
+	StarSpoke(const StarSpoke&);
+	StarSpoke& operator=(const StarSpoke&);
+};
+
+#endif // NETWORK_STAR_SPOKE_H
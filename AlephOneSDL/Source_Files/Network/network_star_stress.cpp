@@ -0,0 +1,971 @@
+/*
+ *  network_star_stress.cpp
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  An in-process stress test for the star hub (run with --net-stress).
+ *
+ *  A real StarHub (in dedicated mode, so it has no player of its own) relays action flags for
+ *  real StarSpokes over simulated links with configurable latency, jitter, loss, reordering,
+ *  bandwidth and clock drift.  Everything runs on a virtual clock driven by one seed, so the
+ *  same options always make the same run - except for the hub's CPU time, which is measured
+ *  on the real clock.
+ *
+ *  There's no game behind the spokes: each one's StarSpokeGame makes up random flags and
+ *  remembers when it made them, and reads the other players' flags out of the queues the game
+ *  would, so when a spoke receives them we know how long they took, and whether the hub had to
+ *  make them up because they were late.
+ *
+ *  Options are key=value pairs separated by spaces or commas:
+ *	players=2-8	player counts to run (one run each)
+ *	seconds=60	length of each run, after the pregame
+ *	seed=1
+ *	packed=0	1 to send and receive packed action flags ('S2'/'H2'/'F2')
+ *	activity=100	percent of ticks a player's flags change; below 100, a change is to one
+ *			byte of them, like a key or a turn (real players mostly repeat themselves)
+ *	latency=30 jitter=5 loss=0 reorder=0 bandwidth=0 drift=0
+ *			link defaults: ms each way, ms of extra random delay, percent lost,
+ *			percent held back a few ticks, bytes/second each way (0 for unlimited),
+ *			parts per million the spoke's clock runs fast
+ *	p3.latency=200	any link setting, for just one player's link
+ *	hub.send_period=1	any <hub> network preference
+ *	spoke.adjust_timing=0	any <spoke> network preference
+ *	window-bench=100000	instead of a stress test, time the hub's windowed percentile finder
+ *			at window sizes from 10 up to this, against the std::multiset walk it replaced
+ */
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "cseries.h"
+#include "network_star_hub.h"
+#include "network_star_spoke.h"
+#include "network_private.h" // kPROTOCOL_TYPE, NET_DEAD_ACTION_FLAG
+#include "Logging.h"
+#include "mytm.h"
+#include "Random.h"
+#include "InfoTree.h"
+#include "WindowedNthElementFinder.h"
+
+#include <algorithm>
+#include <queue>
+#include <set>
+#include <string>
+#include <vector>
+
+enum {
+	kPlayerQueueSize = TICKS_PER_SECOND,	// flags a spoke can hand the game between our reads
+	kMaximumLinkQueueDelay = 250 * 1000,	// us of backlog a bandwidth-capped link holds before dropping
+	kMaximumReorderDelay = 3,		// ticks a reordered packet may be held back
+	kHubPort = 4226,
+	kFirstSpokePort = 5000,
+
+	kWindowBenchmarkOperations = 200000,	// inserts, each followed by the queries the hub makes
+	kWindowBenchmarkReferenceWork = 20000000	// elements the reference may walk, to keep it finite
+};
+
+struct StressLinkParameters
+{
+	int32	mLatency;	// ms, each way
+	int32	mJitter;	// ms of extra delay, uniformly distributed
+	float	mLoss;		// percent of packets dropped
+	float	mReorder;	// percent of packets held back a few ticks
+	int32	mBandwidth;	// bytes per second each way; 0 for unlimited
+	int32	mClockDrift;	// parts per million the spoke's clock runs fast (negative for slow)
+};
+
+struct StressOptions
+{
+	int			mMinimumPlayers;
+	int			mMaximumPlayers;
+	int32			mSeconds;
+	uint32			mSeed;
+	bool			mPackedActionFlags;
+	float			mActivity;	// percent
+	int32			mWindowBenchmarkSize;	// nonzero to run the window benchmark instead
+	StressLinkParameters	mLinks[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+	InfoTree		mHubPreferences;
+	InfoTree		mSpokePreferences;
+};
+
+struct StressPacket
+{
+	uint64_t		mDeliveryTime;	// us
+	uint64_t		mSequence;	// keeps delivery order stable for packets due at the same time
+	int		mSpoke;		// the spoke this travels to or from
+	bool		mToHub;
+	DDPPacketBuffer	mBuffer;
+
+	bool operator<(const StressPacket& other) const
+	{
+		// priority_queue puts the largest on top; we want the earliest
+		if (mDeliveryTime != other.mDeliveryTime)
+			return mDeliveryTime > other.mDeliveryTime;
+		return mSequence > other.mSequence;
+	}
+};
+
+struct StressLink
+{
+	uint64_t	mBusyUntil;	// us; when a bandwidth-capped link finishes sending what it has
+};
+
+struct GeneratedFlags
+{
+	bool		mValid;
+	action_flags_t	mFlags;
+	uint64_t		mTime;		// us
+};
+
+class StarStressTest;
+
+// One player's machine: a real StarSpoke, with the test standing in for its game and network
+struct StressSpoke : public StarSpokeGame
+{
+	StarStressTest&	mTest;
+	int		mIndex;
+	StarSpoke*	mSpoke;
+	NetAddrBlock	mAddress;
+	uint64_t		mStartTime;	// us
+	int32		mTicks;		// how many times we've ticked the spoke
+	bool		mConnected;	// until the spoke gives up on the hub
+	int8		mRequestedTimingAdjustment;
+	action_flags_t	mLastFlags;
+	std::vector<TickBasedActionQueue>	mPlayerQueues;	// what the game would read
+	StressLink	mUplink;
+	StressLink	mDownlink;
+
+	StressSpoke(StarStressTest& inTest, int inIndex) : mTest(inTest), mIndex(inIndex), mSpoke(NULL) {}
+	~StressSpoke() { delete mSpoke; }
+
+	action_flags_t actionFlags(int32 inTick);
+	OSErr sendFrame(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port);
+	void playerNetDead(size_t inPlayerIndex);
+	void receivedLossyByteStream(byte* /* inBuffer */, uint16 /* inBufferSize */, int16 /* inDistributionType */, uint8 /* inSendingPlayerIndex */) {}
+	bool positionSum(size_t /* inLocalPlayerIndex */, int32& /* outPositionSum */) { return false; }
+	bool latestWorldHash(world_hash_snapshot& /* outSnapshot */) { return false; }
+};
+
+struct StressResults
+{
+	int32			mHubTicks;
+	uint32			mFlagsReceived;
+	uint32			mLateFlags;
+	std::vector<uint32>	mFlagLatencies;	// us, for flags that weren't late
+	uint32			mTimingAdjustments;
+	int32			mTimingAdjustmentTicks;
+	uint32			mPacketsSent;
+	uint32			mPacketsLost;
+	uint64_t			mBytesToHub;
+	uint64_t			mBytesFromHub;
+	std::vector<uint64_t>	mHubTickCosts;	// performance counter ticks
+	uint32			mDroppedPlayers;	// bitmask of players some spoke was told are netdead
+	int			mSpokesGaveUp;
+};
+
+class StarStressTest
+{
+public:
+	StarStressTest(const StressOptions& inOptions, int inPlayers);
+	~StarStressTest();
+
+	void run();
+	void report() const;
+
+	static OSErr hubSendFrame(DDPFramePtr frame, NetAddrBlock *address, short protocolType, short port);
+
+private:
+	friend struct StressSpoke;
+
+	uint64_t spokeTickTime(const StressSpoke& inSpoke, int32 inTick) const;
+	void tickHub();
+	void tickSpoke(StressSpoke& ioSpoke);
+	void deliver(StressPacket& inPacket);
+	void transmit(int inSpoke, bool inToHub, const DDPFrame& inFrame);
+	action_flags_t spokeGenerateFlags(StressSpoke& ioSpoke, int32 inTick);
+	void spokeRan(StressSpoke& ioSpoke);
+	void spokeReceivedFlags(int inPlayer, int32 inTick, action_flags_t inFlags);
+	bool chance(float inPercent);
+
+	const StressOptions&	mOptions;
+	int			mPlayers;
+	int32			mFirstTick;	// the first pregame tick
+	uint64_t			mNow;		// us
+	uint64_t			mEndTime;	// us
+	uint64_t			mNextSequence;
+	GM_Random		mRandom;
+	StarHub*		mHub;
+	NetAddrBlock		mHubAddress;
+	std::vector<StressSpoke*>	mSpokes;
+	std::vector<std::vector<GeneratedFlags> > mGeneratedFlags;	// [player][tick - mFirstTick]
+	std::priority_queue<StressPacket>	mInFlight;
+	uint64_t			mHubCost;	// performance counter ticks since the hub's last tick
+	StressResults		mResults;
+
+	static StarStressTest* sCurrentTest;
+};
+
+StarStressTest* StarStressTest::sCurrentTest = NULL;
+
+static bool parse_stress_options(const char* inOptions, StressOptions& outOptions);
+static bool parse_link_parameter(const std::string& inKey, const std::string& inValue, StressLinkParameters& ioLink);
+static double percentile(std::vector<uint32> inValues, double inFraction);
+static int run_window_benchmark(const StressOptions& inOptions);
+
+
+
+static bool
+parse_link_parameter(const std::string& inKey, const std::string& inValue, StressLinkParameters& ioLink)
+{
+	if (inKey == "latency")
+		ioLink.mLatency = atoi(inValue.c_str());
+	else if (inKey == "jitter")
+		ioLink.mJitter = atoi(inValue.c_str());
+	else if (inKey == "loss")
+		ioLink.mLoss = static_cast<float>(atof(inValue.c_str()));
+	else if (inKey == "reorder")
+		ioLink.mReorder = static_cast<float>(atof(inValue.c_str()));
+	else if (inKey == "bandwidth")
+		ioLink.mBandwidth = atoi(inValue.c_str());
+	else if (inKey == "drift")
+		ioLink.mClockDrift = atoi(inValue.c_str());
+	else
+		return false;
+
+	return ioLink.mLatency >= 0 && ioLink.mJitter >= 0 && ioLink.mBandwidth >= 0 &&
+		ioLink.mLoss >= 0 && ioLink.mLoss <= 100 && ioLink.mReorder >= 0 && ioLink.mReorder <= 100 &&
+		ioLink.mClockDrift > -100000 && ioLink.mClockDrift < 100000;
+}
+
+
+
+static bool
+parse_stress_options(const char* inOptions, StressOptions& outOptions)
+{
+	outOptions.mMinimumPlayers = 2;
+	outOptions.mMaximumPlayers = MAXIMUM_NUMBER_OF_NETWORK_PLAYERS;
+	outOptions.mSeconds = 60;
+	outOptions.mSeed = 1;
+	outOptions.mPackedActionFlags = false;
+	outOptions.mActivity = 100;
+	outOptions.mWindowBenchmarkSize = 0;
+
+	StressLinkParameters theDefaultLink = { 30, 5, 0, 0, 0, 0 };
+
+	std::vector<std::pair<std::string, std::string> > thePairs;
+	std::string theOptions(inOptions);
+	std::replace(theOptions.begin(), theOptions.end(), ',', ' ');
+	size_t thePosition = 0;
+	while (thePosition < theOptions.size())
+	{
+		size_t theEnd = theOptions.find(' ', thePosition);
+		if (theEnd == std::string::npos)
+			theEnd = theOptions.size();
+
+		std::string theToken = theOptions.substr(thePosition, theEnd - thePosition);
+		thePosition = theEnd + 1;
+		if (theToken.empty())
+			continue;
+
+		size_t theEquals = theToken.find('=');
+		if (theEquals == std::string::npos)
+		{
+			fprintf(stderr, "net-stress: expected key=value, got '%s'\n", theToken.c_str());
+			return false;
+		}
+		thePairs.push_back(std::make_pair(theToken.substr(0, theEquals), theToken.substr(theEquals + 1)));
+	}
+
+	// Defaults first, so per-player settings can override them whatever the order
+	for (size_t i = 0; i < thePairs.size(); i++)
+	{
+		const std::string& theKey = thePairs[i].first;
+		const std::string& theValue = thePairs[i].second;
+
+		if (theKey == "players")
+		{
+			int theMinimum, theMaximum;
+			int theCount = sscanf(theValue.c_str(), "%d-%d", &theMinimum, &theMaximum);
+			if (theCount == 1)
+				theMaximum = theMinimum;
+			if (theCount < 1 || theMinimum < 2 || theMaximum < theMinimum || theMaximum > MAXIMUM_NUMBER_OF_NETWORK_PLAYERS)
+			{
+				fprintf(stderr, "net-stress: players must be between 2 and %d\n", MAXIMUM_NUMBER_OF_NETWORK_PLAYERS);
+				return false;
+			}
+			outOptions.mMinimumPlayers = theMinimum;
+			outOptions.mMaximumPlayers = theMaximum;
+		}
+		else if (theKey == "seconds")
+		{
+			outOptions.mSeconds = atoi(theValue.c_str());
+			if (outOptions.mSeconds <= 0)
+			{
+				fprintf(stderr, "net-stress: seconds must be positive\n");
+				return false;
+			}
+		}
+		else if (theKey == "seed")
+			outOptions.mSeed = static_cast<uint32>(strtoul(theValue.c_str(), NULL, 10));
+		else if (theKey == "packed")
+			outOptions.mPackedActionFlags = atoi(theValue.c_str()) != 0;
+		else if (theKey == "activity")
+			outOptions.mActivity = static_cast<float>(atof(theValue.c_str()));
+		else if (theKey == "window-bench")
+		{
+			outOptions.mWindowBenchmarkSize = atoi(theValue.c_str());
+			if (outOptions.mWindowBenchmarkSize < 10)
+			{
+				fprintf(stderr, "net-stress: window-bench must be at least 10\n");
+				return false;
+			}
+		}
+		else if (theKey.compare(0, 4, "hub.") == 0)
+			outOptions.mHubPreferences.put_attr(theKey.substr(4), theValue);
+		else if (theKey.compare(0, 6, "spoke.") == 0)
+			outOptions.mSpokePreferences.put_attr(theKey.substr(6), theValue);
+		else if (theKey[0] != 'p' || theKey.find('.') == std::string::npos)
+		{
+			if (!parse_link_parameter(theKey, theValue, theDefaultLink))
+			{
+				fprintf(stderr, "net-stress: bad option %s=%s\n", theKey.c_str(), theValue.c_str());
+				return false;
+			}
+		}
+	}
+
+	for (int i = 0; i < MAXIMUM_NUMBER_OF_NETWORK_PLAYERS; i++)
+		outOptions.mLinks[i] = theDefaultLink;
+
+	for (size_t i = 0; i < thePairs.size(); i++)
+	{
+		const std::string& theKey = thePairs[i].first;
+		if (theKey[0] != 'p' || theKey.find('.') == std::string::npos || theKey == "players")
+			continue;
+
+		int thePlayer = atoi(theKey.c_str() + 1);
+		std::string theParameter = theKey.substr(theKey.find('.') + 1);
+		if (thePlayer < 0 || thePlayer >= MAXIMUM_NUMBER_OF_NETWORK_PLAYERS || !parse_link_parameter(theParameter, thePairs[i].second, outOptions.mLinks[thePlayer]))
+		{
+			fprintf(stderr, "net-stress: bad option %s=%s\n", theKey.c_str(), thePairs[i].second.c_str());
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+
+static double
+percentile(std::vector<uint32> inValues, double inFraction)
+{
+	if (inValues.empty())
+		return 0;
+
+	size_t theIndex = std::min(static_cast<size_t>(inFraction * inValues.size()), inValues.size() - 1);
+	std::nth_element(inValues.begin(), inValues.begin() + theIndex, inValues.end());
+	return inValues[theIndex];
+}
+
+
+
+StarStressTest::StarStressTest(const StressOptions& inOptions, int inPlayers) :
+	mOptions(inOptions),
+	mPlayers(inPlayers),
+	mFirstTick(-kPregameTicks),
+	mNow(0),
+	mNextSequence(0),
+	mHub(NULL),
+	mHubCost(0)
+{
+	mEndTime = static_cast<uint64_t>(kPregameTicks * 1000000 / TICKS_PER_SECOND) + static_cast<uint64_t>(mOptions.mSeconds) * 1000000;
+
+	// GM_Random's default seeds are fixed; fold ours in so runs differ only when asked to
+	mRandom.z ^= mOptions.mSeed;
+	mRandom.jsr ^= mOptions.mSeed * 2654435761U;
+	mRandom.jcong += mOptions.mSeed;
+	if (mRandom.jsr == 0)
+		mRandom.jsr = 123456789;
+
+	mResults.mHubTicks = 0;
+	mResults.mFlagsReceived = 0;
+	mResults.mLateFlags = 0;
+	mResults.mTimingAdjustments = 0;
+	mResults.mTimingAdjustmentTicks = 0;
+	mResults.mPacketsSent = 0;
+	mResults.mPacketsLost = 0;
+	mResults.mBytesToHub = 0;
+	mResults.mBytesFromHub = 0;
+	mResults.mDroppedPlayers = 0;
+	mResults.mSpokesGaveUp = 0;
+
+	mHubAddress.host = SDL_SwapBE32(0x7f000001);
+	mHubAddress.port = SDL_SwapBE16(kHubPort);
+
+	mGeneratedFlags.resize(mPlayers);
+
+	DefaultHubPreferences();
+	HubParsePreferencesTree(mOptions.mHubPreferences, "");
+	DefaultSpokePreferences();
+	SpokeParsePreferencesTree(mOptions.mSpokePreferences, "");
+
+	NetAddrBlock theUnknownAddress;
+	obj_clear(theUnknownAddress);
+	const NetAddrBlock* theAddresses[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+	bool thePlayerConnected[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+	for (int i = 0; i < mPlayers; i++)
+	{
+		theAddresses[i] = &theUnknownAddress;
+		thePlayerConnected[i] = true;
+	}
+
+	for (int i = 0; i < mPlayers; i++)
+	{
+		StressSpoke* theSpoke = new StressSpoke(*this, i);
+		theSpoke->mAddress.host = SDL_SwapBE32(0x7f000001);
+		theSpoke->mAddress.port = SDL_SwapBE16(kFirstSpokePort + i);
+		// Nobody's clock is in phase with anybody else's
+		theSpoke->mStartTime = mRandom.KISS() % (1000000 / TICKS_PER_SECOND);
+		theSpoke->mTicks = 0;
+		theSpoke->mConnected = true;
+		theSpoke->mRequestedTimingAdjustment = 0;
+		theSpoke->mLastFlags = 0;
+		theSpoke->mPlayerQueues.resize(mPlayers, TickBasedActionQueue(kPlayerQueueSize));
+		theSpoke->mUplink.mBusyUntil = 0;
+		theSpoke->mDownlink.mBusyUntil = 0;
+
+		WritableTickBasedActionQueue* theQueues[MAXIMUM_NUMBER_OF_NETWORK_PLAYERS];
+		for (int j = 0; j < mPlayers; j++)
+			theQueues[j] = &theSpoke->mPlayerQueues[j];
+
+		theSpoke->mSpoke = new StarSpoke(mHubAddress, 0, mPlayers, theQueues, thePlayerConnected, i, false, 0, mOptions.mPackedActionFlags, NULL, *theSpoke);
+		mSpokes.push_back(theSpoke);
+	}
+
+	mHub = new StarHub(0, mPlayers, theAddresses, static_cast<size_t>(NONE), hubSendFrame);
+}
+
+
+
+StarStressTest::~StarStressTest()
+{
+	delete mHub;
+	for (size_t i = 0; i < mSpokes.size(); i++)
+		delete mSpokes[i];
+}
+
+
+
+uint64_t
+StarStressTest::spokeTickTime(const StressSpoke& inSpoke, int32 inTick) const
+{
+	int64_t theRate = 1000000 + mOptions.mLinks[inSpoke.mIndex].mClockDrift;
+	return inSpoke.mStartTime + static_cast<uint64_t>(inTick) * 1000000 * 1000000 / (TICKS_PER_SECOND * theRate);
+}
+
+
+
+bool
+StarStressTest::chance(float inPercent)
+{
+	return inPercent > 0 && mRandom.UNI() * 100 < inPercent;
+}
+
+
+
+void
+StarStressTest::run()
+{
+	sCurrentTest = this;
+
+	for (;;)
+	{
+		// Whichever comes first: a packet arriving, the hub's tick or a spoke's tick.
+		// Ties go in that order too, and spokes in index order, so runs are repeatable.
+		uint64_t theHubTickTime = static_cast<uint64_t>(mResults.mHubTicks + 1) * 1000000 / TICKS_PER_SECOND;
+		uint64_t theNextTime = theHubTickTime;
+		if (!mInFlight.empty())
+			theNextTime = std::min(theNextTime, mInFlight.top().mDeliveryTime);
+
+		StressSpoke* theNextSpoke = NULL;
+		uint64_t theNextSpokeTickTime = 0;
+		for (size_t i = 0; i < mSpokes.size(); i++)
+		{
+			uint64_t theSpokeTickTime = spokeTickTime(*mSpokes[i], mSpokes[i]->mTicks + 1);
+			if (theNextSpoke == NULL || theSpokeTickTime < theNextSpokeTickTime)
+			{
+				theNextSpoke = mSpokes[i];
+				theNextSpokeTickTime = theSpokeTickTime;
+			}
+		}
+		theNextTime = std::min(theNextTime, theNextSpokeTickTime);
+
+		if (theNextTime > mEndTime)
+			break;
+		mNow = theNextTime;
+
+		if (!mInFlight.empty() && mInFlight.top().mDeliveryTime == mNow)
+		{
+			StressPacket thePacket = mInFlight.top();
+			mInFlight.pop();
+			deliver(thePacket);
+		}
+		else if (theHubTickTime == mNow)
+			tickHub();
+		else
+			tickSpoke(*theNextSpoke);
+	}
+
+	sCurrentTest = NULL;
+}
+
+
+
+void
+StarStressTest::tickHub()
+{
+	uint64_t theStart = SDL_GetPerformanceCounter();
+	mHub->tick();
+	mHubCost += SDL_GetPerformanceCounter() - theStart;
+
+	mResults.mHubTicks++;
+	mResults.mHubTickCosts.push_back(mHubCost);
+	mHubCost = 0;
+}
+
+
+
+void
+StarStressTest::deliver(StressPacket& inPacket)
+{
+	if (inPacket.mToHub)
+	{
+		uint64_t theStart = SDL_GetPerformanceCounter();
+		mHub->receivedNetworkPacket(&inPacket.mBuffer);
+		mHubCost += SDL_GetPerformanceCounter() - theStart;
+	}
+	else
+	{
+		StressSpoke& theSpoke = *mSpokes[inPacket.mSpoke];
+		theSpoke.mSpoke->receivedNetworkPacket(&inPacket.mBuffer);
+		spokeRan(theSpoke);
+	}
+}
+
+
+
+void
+StarStressTest::transmit(int inSpoke, bool inToHub, const DDPFrame& inFrame)
+{
+	const StressLinkParameters& theParameters = mOptions.mLinks[inSpoke];
+	StressLink& theLink = inToHub ? mSpokes[inSpoke]->mUplink : mSpokes[inSpoke]->mDownlink;
+
+	mResults.mPacketsSent++;
+	if (inToHub)
+		mResults.mBytesToHub += inFrame.data_size;
+	else
+		mResults.mBytesFromHub += inFrame.data_size;
+
+	if (chance(theParameters.mLoss))
+	{
+		mResults.mPacketsLost++;
+		return;
+	}
+
+	// A capped link sends one packet at a time, and drops what won't fit in its queue
+	uint64_t theDepartureTime = mNow;
+	if (theParameters.mBandwidth > 0)
+	{
+		uint64_t theStart = std::max(mNow, theLink.mBusyUntil);
+		if (theStart - mNow > kMaximumLinkQueueDelay)
+		{
+			mResults.mPacketsLost++;
+			return;
+		}
+		theLink.mBusyUntil = theStart + static_cast<uint64_t>(inFrame.data_size) * 1000000 / theParameters.mBandwidth;
+		theDepartureTime = theLink.mBusyUntil;
+	}
+
+	StressPacket thePacket;
+	thePacket.mDeliveryTime = theDepartureTime + static_cast<uint64_t>(theParameters.mLatency) * 1000;
+	if (theParameters.mJitter > 0)
+		thePacket.mDeliveryTime += mRandom.KISS() % (static_cast<uint32>(theParameters.mJitter) * 1000);
+	if (chance(theParameters.mReorder))
+		thePacket.mDeliveryTime += (1 + mRandom.KISS() % kMaximumReorderDelay) * 1000000 / TICKS_PER_SECOND;
+	thePacket.mSequence = mNextSequence++;
+	thePacket.mSpoke = inSpoke;
+	thePacket.mToHub = inToHub;
+	thePacket.mBuffer.protocolType = kPROTOCOL_TYPE;
+	thePacket.mBuffer.sourceAddress = inToHub ? mSpokes[inSpoke]->mAddress : mHubAddress;
+	thePacket.mBuffer.datagramSize = inFrame.data_size;
+	memcpy(thePacket.mBuffer.datagramData, inFrame.data, inFrame.data_size);
+
+	mInFlight.push(thePacket);
+}
+
+
+
+OSErr
+StarStressTest::hubSendFrame(DDPFramePtr frame, NetAddrBlock *address, short /* protocolType */, short /* port */)
+{
+	StarStressTest* theTest = sCurrentTest;
+	assert(theTest != NULL);
+
+	int theSpoke = SDL_SwapBE16(address->port) - kFirstSpokePort;
+	if (theSpoke < 0 || theSpoke >= theTest->mPlayers)
+		return -1;
+
+	theTest->transmit(theSpoke, false, *frame);
+	return noErr;
+}
+
+
+
+void
+StarStressTest::tickSpoke(StressSpoke& ioSpoke)
+{
+	ioSpoke.mTicks++;
+	ioSpoke.mSpoke->tick();
+	spokeRan(ioSpoke);
+}
+
+
+
+action_flags_t
+StarStressTest::spokeGenerateFlags(StressSpoke& ioSpoke, int32 inTick)
+{
+	action_flags_t theFlags = ioSpoke.mLastFlags;
+	if (mOptions.mActivity >= 100)
+		theFlags = static_cast<action_flags_t>(mRandom.KISS());
+	else if (chance(mOptions.mActivity))
+		theFlags ^= (1 + mRandom.KISS() % 255) << ((mRandom.KISS() % 4) * 8);
+
+	// Real flags are never the ones the spoke makes up for netdead players
+	if (theFlags == static_cast<action_flags_t>(NET_DEAD_ACTION_FLAG))
+		theFlags = 0;
+	ioSpoke.mLastFlags = theFlags;
+
+	// Once it's given up on the hub, the spoke plays on alone, and its flags go nowhere
+	if (!ioSpoke.mConnected)
+		return theFlags;
+
+	std::vector<GeneratedFlags>& theGenerated = mGeneratedFlags[ioSpoke.mIndex];
+	size_t theIndex = inTick - mFirstTick;
+	if (theGenerated.size() <= theIndex)
+	{
+		GeneratedFlags theInvalid = { false, 0, 0 };
+		theGenerated.resize(theIndex + 1, theInvalid);
+	}
+	theGenerated[theIndex].mValid = true;
+	theGenerated[theIndex].mFlags = theFlags;
+	theGenerated[theIndex].mTime = mNow;
+
+	return theFlags;
+}
+
+
+
+// After the spoke has ticked or handled a packet: read what it gave the game, as the game would
+void
+StarStressTest::spokeRan(StressSpoke& ioSpoke)
+{
+	if (ioSpoke.mConnected && !ioSpoke.mSpoke->isConnected())
+	{
+		ioSpoke.mConnected = false;
+		mResults.mSpokesGaveUp++;
+	}
+
+	int8 theAdjustment = ioSpoke.mSpoke->requestedTimingAdjustment();
+	if (theAdjustment != ioSpoke.mRequestedTimingAdjustment)
+	{
+		ioSpoke.mRequestedTimingAdjustment = theAdjustment;
+		if (theAdjustment != 0)
+		{
+			mResults.mTimingAdjustments++;
+			mResults.mTimingAdjustmentTicks += std::abs(static_cast<int>(theAdjustment));
+		}
+	}
+
+	for (int i = 0; i < mPlayers; i++)
+	{
+		TickBasedActionQueue& theQueue = ioSpoke.mPlayerQueues[i];
+		while (theQueue.size() > 0)
+		{
+			int32 theTick = theQueue.getReadTick();
+			action_flags_t theFlags = theQueue.peek(theTick);
+			theQueue.dequeue();
+
+			if (i != ioSpoke.mIndex && ioSpoke.mConnected && theFlags != static_cast<action_flags_t>(NET_DEAD_ACTION_FLAG))
+				spokeReceivedFlags(i, theTick, theFlags);
+		}
+	}
+
+	// The game forgets its predicted flags once the hub confirms them (see StarGameProtocol)
+	TickBasedActionQueue* theUnconfirmedFlags = ioSpoke.mSpoke->unconfirmedFlagsQueue();
+	while (theUnconfirmedFlags->getReadTick() < ioSpoke.mSpoke->smallestUnconfirmedTick() && theUnconfirmedFlags->getReadTick() < theUnconfirmedFlags->getWriteTick())
+		theUnconfirmedFlags->dequeue();
+}
+
+
+
+void
+StarStressTest::spokeReceivedFlags(int inPlayer, int32 inTick, action_flags_t inFlags)
+{
+	mResults.mFlagsReceived++;
+
+	// If they're not the flags the player sent, the hub made them up because the real ones were late
+	const std::vector<GeneratedFlags>& theGenerated = mGeneratedFlags[inPlayer];
+	size_t theIndex = inTick - mFirstTick;
+	if (theIndex >= theGenerated.size() || !theGenerated[theIndex].mValid || theGenerated[theIndex].mFlags != inFlags)
+		mResults.mLateFlags++;
+	else
+		mResults.mFlagLatencies.push_back(static_cast<uint32>(mNow - theGenerated[theIndex].mTime));
+}
+
+
+
+action_flags_t
+StressSpoke::actionFlags(int32 inTick)
+{
+	return mTest.spokeGenerateFlags(*this, inTick);
+}
+
+
+
+OSErr
+StressSpoke::sendFrame(DDPFramePtr frame, NetAddrBlock* /* address */, short /* protocolType */, short /* port */)
+{
+	// Everything a spoke sends goes to the hub
+	mTest.transmit(mIndex, true, *frame);
+	return noErr;
+}
+
+
+
+void
+StressSpoke::playerNetDead(size_t inPlayerIndex)
+{
+	// The spoke also calls this for everyone when it gives up on the hub; that's counted elsewhere
+	if (mSpoke->isConnected())
+		mTest.mResults.mDroppedPlayers |= (((uint32)1) << inPlayerIndex);
+}
+
+
+
+void
+StarStressTest::report() const
+{
+	double theFrequency = static_cast<double>(SDL_GetPerformanceFrequency());
+	uint64_t theTotalCost = 0;
+	uint64_t theMaximumCost = 0;
+	for (size_t i = 0; i < mResults.mHubTickCosts.size(); i++)
+	{
+		theTotalCost += mResults.mHubTickCosts[i];
+		theMaximumCost = std::max(theMaximumCost, mResults.mHubTickCosts[i]);
+	}
+
+	double theMeanLatency = 0;
+	if (!mResults.mFlagLatencies.empty())
+	{
+		uint64_t theSum = 0;
+		for (size_t i = 0; i < mResults.mFlagLatencies.size(); i++)
+			theSum += mResults.mFlagLatencies[i];
+		theMeanLatency = static_cast<double>(theSum) / mResults.mFlagLatencies.size();
+	}
+
+	int theDroppedPlayers = 0;
+	for (int i = 0; i < mPlayers; i++)
+		if (mResults.mDroppedPlayers & (((uint32)1) << i))
+			theDroppedPlayers++;
+
+	int32 theTicks = std::max<int32>(mResults.mHubTicks, 1);
+	printf("%7d %9u %6.2f %8.1f %6.1f %6.1f %6.1f %7.1f %5u %6d %6.2f %8.1f %8.1f %8.2f %8.2f %4d %4d\n",
+	       mPlayers,
+	       mResults.mFlagsReceived,
+	       mResults.mFlagsReceived ? 100.0 * mResults.mLateFlags / mResults.mFlagsReceived : 0.0,
+	       theMeanLatency / 1000,
+	       percentile(mResults.mFlagLatencies, 0.50) / 1000,
+	       percentile(mResults.mFlagLatencies, 0.95) / 1000,
+	       percentile(mResults.mFlagLatencies, 0.99) / 1000,
+	       percentile(mResults.mFlagLatencies, 1.0) / 1000,
+	       mResults.mTimingAdjustments,
+	       mResults.mTimingAdjustmentTicks,
+	       mResults.mPacketsSent ? 100.0 * mResults.mPacketsLost / mResults.mPacketsSent : 0.0,
+	       static_cast<double>(mResults.mBytesToHub) / theTicks,
+	       static_cast<double>(mResults.mBytesFromHub) / theTicks,
+	       theTotalCost * 1000000.0 / theFrequency / theTicks,
+	       theMaximumCost * 1000000.0 / theFrequency,
+	       theDroppedPlayers,
+	       mResults.mSpokesGaveUp);
+	fflush(stdout);
+}
+
+
+
+// The windowed multiset the hub used to keep its arrival offsets in, walked for each query
+class ReferenceNthElementFinder
+{
+public:
+	explicit ReferenceNthElementFinder(size_t inWindowSize) : mWindowSize(inWindowSize) {}
+
+	void insert(int32 inElement)
+	{
+		if (mWindow.size() == mWindowSize)
+		{
+			mSortedElements.erase(mSortedElements.find(mWindow.front()));
+			mWindow.pop();
+		}
+		mSortedElements.insert(inElement);
+		mWindow.push(inElement);
+	}
+
+	int32 nth_smallest_element(size_t n) const
+	{
+		std::multiset<int32>::const_iterator i = mSortedElements.begin();
+		std::advance(i, n);
+		return *i;
+	}
+
+private:
+	size_t mWindowSize;
+	std::queue<int32> mWindow;
+	std::multiset<int32> mSortedElements;
+};
+
+// Arrival offsets in ticks: mostly a little jitter around zero, now and then a spike
+static int32
+benchmark_arrival_offset(GM_Random& ioRandom)
+{
+	int32 theOffset = static_cast<int32>(ioRandom.KISS() % 7) - 3;
+	if (ioRandom.KISS() % 50 == 0)
+		theOffset += static_cast<int32>(ioRandom.KISS() % 61) - 30;
+	return theOffset;
+}
+
+static int
+run_window_benchmark(const StressOptions& inOptions)
+{
+	double theFrequency = static_cast<double>(SDL_GetPerformanceFrequency());
+	bool theResultsMatch = true;
+
+	printf("Windowed nth element benchmark: on a full window, ns per insert (and eviction) followed by\n");
+	printf("the nth smallest (window / 30), 25th and 75th percentile queries\n");
+	printf("\n%8s %10s %10s %8s\n", "window", "finder", "multiset", "speedup");
+	fflush(stdout);
+
+	for (int32 theWindowSize = 10; theWindowSize <= inOptions.mWindowBenchmarkSize; theWindowSize *= 10)
+	{
+		unsigned int theNthElement = theWindowSize / 30;
+		int32 theReferenceOperations = std::max<int32>(std::min<int32>(kWindowBenchmarkOperations, kWindowBenchmarkReferenceWork / theWindowSize), 100);
+
+		GM_Random theRandom;
+		theRandom.z ^= inOptions.mSeed;
+		std::vector<int32> theOffsets(theWindowSize + kWindowBenchmarkOperations);
+		for (size_t i = 0; i < theOffsets.size(); i++)
+			theOffsets[i] = benchmark_arrival_offset(theRandom);
+
+		// Fill both windows first; the timing is of a player well into a game
+		WindowedNthElementFinder<int32> theFinder(theWindowSize);
+		ReferenceNthElementFinder theReference(theWindowSize);
+		for (int32 i = 0; i < theWindowSize; i++)
+		{
+			theFinder.insert(theOffsets[i]);
+			theReference.insert(theOffsets[i]);
+		}
+
+		// What the finder found, for the operations the reference also runs
+		std::vector<int32> theResults(theReferenceOperations * 3);
+
+		uint64_t theStart = SDL_GetPerformanceCounter();
+		for (int32 i = 0; i < kWindowBenchmarkOperations; i++)
+		{
+			theFinder.insert(theOffsets[theWindowSize + i]);
+			int32 theNth = theFinder.nth_smallest_element(theNthElement);
+			int32 theLowerQuartile = theFinder.percentile(25);
+			int32 theUpperQuartile = theFinder.percentile(75);
+
+			if (i < theReferenceOperations)
+			{
+				theResults[i * 3] = theNth;
+				theResults[i * 3 + 1] = theLowerQuartile;
+				theResults[i * 3 + 2] = theUpperQuartile;
+			}
+		}
+		double theFinderTime = (SDL_GetPerformanceCounter() - theStart) * 1e9 / theFrequency / kWindowBenchmarkOperations;
+
+		theStart = SDL_GetPerformanceCounter();
+		for (int32 i = 0; i < theReferenceOperations; i++)
+		{
+			theReference.insert(theOffsets[theWindowSize + i]);
+			int32 theNth = theReference.nth_smallest_element(theNthElement);
+			int32 theLowerQuartile = theReference.nth_smallest_element((theWindowSize - 1) * 25 / 100);
+			int32 theUpperQuartile = theReference.nth_smallest_element((theWindowSize - 1) * 75 / 100);
+
+			if (theResults[i * 3] != theNth || theResults[i * 3 + 1] != theLowerQuartile || theResults[i * 3 + 2] != theUpperQuartile)
+				theResultsMatch = false;
+		}
+		double theReferenceTime = (SDL_GetPerformanceCounter() - theStart) * 1e9 / theFrequency / theReferenceOperations;
+
+		printf("%8d %10.1f %10.1f %7.1fx\n", theWindowSize, theFinderTime, theReferenceTime, theReferenceTime / theFinderTime);
+		fflush(stdout);
+	}
+
+	if (!theResultsMatch)
+	{
+		fprintf(stderr, "net-stress: the windowed nth element finder disagrees with the reference\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+
+
+int
+run_star_stress_test(const char* inOptions)
+{
+	StressOptions theOptions;
+	if (!parse_stress_options(inOptions, theOptions))
+		return 1;
+
+	if (theOptions.mWindowBenchmarkSize)
+		return run_window_benchmark(theOptions);
+
+	// The hub takes the mytm mutex when it drops a player
+	mytm_initialize();
+
+	printf("Star protocol stress test: seed %u, %d seconds per run after %d pregame ticks, %s action flags, %.0f%% activity\n", theOptions.mSeed, theOptions.mSeconds, kPregameTicks, theOptions.mPackedActionFlags ? "packed" : "unpacked", theOptions.mActivity);
+	for (int i = 0; i < theOptions.mMaximumPlayers; i++)
+	{
+		const StressLinkParameters& theLink = theOptions.mLinks[i];
+		printf("  player %d link: latency %d ms, jitter %d ms, loss %.1f%%, reorder %.1f%%, bandwidth %d B/s, drift %d ppm\n", i, theLink.mLatency, theLink.mJitter, theLink.mLoss, theLink.mReorder, theLink.mBandwidth, theLink.mClockDrift);
+	}
+	printf("\n%7s %9s %6s %8s %6s %6s %6s %7s %5s %6s %6s %8s %8s %8s %8s %4s %4s\n",
+	       "players", "flags", "late%", "lat-mean", "p50", "p95", "p99", "max", "TAs", "TAtick", "lost%",
+	       "up-B/tk", "dn-B/tk", "hub-us", "hub-max", "drop", "gave");
+
+	for (int thePlayers = theOptions.mMinimumPlayers; thePlayers <= theOptions.mMaximumPlayers; thePlayers++)
+	{
+		StarStressTest theTest(theOptions, thePlayers);
+		theTest.run();
+		theTest.report();
+	}
+
+	return 0;
+}
+
+#endif // !defined(DISABLE_NETWORKING)
@@ -0,0 +1,406 @@
+/*
+ *  network_star_telemetry.cpp
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  See network_star_telemetry.h.
+ */
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "network_star_telemetry.h"
+#include "Logging.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <SDL_thread.h>
+#include <SDL_mutex.h>
+#include <SDL_atomic.h>
+
+enum {
+	kRingSize = 4096,		// records; a couple of minutes of a busy hub
+	kWriterPeriod = 250		// ms between emptying the ring
+};
+
+// Created by the first open and kept until the process exits, since the tick threads may be
+// recording while we close; sMutex guards everything below it
+static SDL_mutex* sMutex = NULL;
+static SDL_cond* sWriterCondition = NULL;
+static SDL_Thread* sWriterThread = NULL;
+static FILE* sFile = NULL;
+static bool sClosing = false;
+static std::vector<StarTelemetryRecord> sRing;
+static size_t sRingStart = 0;
+static size_t sRingCount = 0;
+static uint32 sDroppedRecords = 0;
+static uint16 sNextSource = 0;
+
+// Set once the writer is running and cleared before it stops; recorders check it again
+// under the mutex, but star_telemetry_enabled() reads it without
+static SDL_atomic_t sEnabled;
+static uint32 sStartTime = 0;
+
+static const char* sSideNames[2] = { "spoke", "hub" };
+
+static void
+format_record(FILE* inFile, const StarTelemetryRecord& inRecord)
+{
+	const int32* v = inRecord.mValues;
+	fprintf(inFile, "%s %u %s%u ",
+		inRecord.mKind == kStarTelemetryHubTick ? "hub" :
+		inRecord.mKind == kStarTelemetrySpokeTick ? "spoke" :
+		inRecord.mKind == kStarTelemetryPlayer ? "player" :
+		inRecord.mKind == kStarTelemetryTraffic ? "traffic" : "timing",
+		inRecord.mTime, sSideNames[inRecord.mFromHub], inRecord.mSource);
+
+	switch (inRecord.mKind)
+	{
+	case kStarTelemetryHubTick:
+		fprintf(inFile, "ticker=%d incomplete=%d disposition=%d send_times=%d lossy_bytes=%d lossy_chunks=%d connected=0x%x lagging=0x%x late=%d made_up=%d\n",
+			v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8], v[9]);
+		break;
+
+	case kStarTelemetrySpokeTick:
+		fprintf(inFile, "ticker=%d unreceived=%d outgoing=%d unconfirmed=%d lossy_bytes=%d lossy_chunks=%d adjustment=%d timing=%d silent=%d\n",
+			v[0], v[1], v[2], v[3], v[4], v[5], v[6], v[7], v[8]);
+		break;
+
+	case kStarTelemetryPlayer:
+		fprintf(inFile, "ticker=%d p=%d latency=%d jitter=%d errors=%d rtt=", v[0], v[1], v[2], v[3], v[4]);
+		for (int i = 0; i < kStarTelemetryLatencyBuckets; i++)
+			fprintf(inFile, i ? ",%d" : "%d", v[5 + i]);
+		fputc('\n', inFile);
+		break;
+
+	case kStarTelemetryTraffic:
+		fprintf(inFile, "ticker=%d type=%c%c packets_in=%d bytes_in=%d packets_out=%d bytes_out=%d\n",
+			v[0], (v[1] >> 8) & 0xff, v[1] & 0xff, v[2], v[3], v[4], v[5]);
+		break;
+
+	case kStarTelemetryTimingAdjustment:
+		fprintf(inFile, "ticker=%d p=%d adjustment=%d tick=%d\n", v[0], v[1], v[2], v[3]);
+		break;
+	}
+}
+
+static int
+writer_thread(void*)
+{
+	std::vector<StarTelemetryRecord> theRecords;
+	theRecords.reserve(kRingSize);
+
+	SDL_LockMutex(sMutex);
+	while (true)
+	{
+		bool closing = sClosing;
+		if (!closing)
+		{
+			SDL_CondWaitTimeout(sWriterCondition, sMutex, kWriterPeriod);
+			closing = sClosing;
+		}
+
+		theRecords.clear();
+		for (size_t i = 0; i < sRingCount; i++)
+			theRecords.push_back(sRing[(sRingStart + i) % sRing.size()]);
+		sRingStart = sRingCount = 0;
+		uint32 theDroppedRecords = sDroppedRecords;
+		sDroppedRecords = 0;
+		SDL_UnlockMutex(sMutex);
+
+		if (theDroppedRecords)
+			fprintf(sFile, "dropped %u count=%u\n", machine_tick_count() - sStartTime, theDroppedRecords);
+		for (size_t i = 0; i < theRecords.size(); i++)
+			format_record(sFile, theRecords[i]);
+		fflush(sFile);
+
+		if (closing)
+			return 0;
+
+		SDL_LockMutex(sMutex);
+	}
+}
+
+bool
+star_telemetry_open(const char* inPath)
+{
+	star_telemetry_close();
+
+	sFile = fopen(inPath, "a");
+	if (!sFile)
+	{
+		logError("Couldn't open %s for network telemetry: %s", inPath, strerror(errno));
+		return false;
+	}
+
+	if (!sMutex)
+		sMutex = SDL_CreateMutex();
+	if (!sWriterCondition)
+		sWriterCondition = SDL_CreateCond();
+	if (!sMutex || !sWriterCondition)
+	{
+		logError("Couldn't start the network telemetry writer");
+		fclose(sFile);
+		sFile = NULL;
+		return false;
+	}
+
+	SDL_LockMutex(sMutex);
+	sRing.resize(kRingSize);
+	sRingStart = sRingCount = 0;
+	sDroppedRecords = 0;
+	sClosing = false;
+	sStartTime = machine_tick_count();
+	SDL_UnlockMutex(sMutex);
+
+	// So the ms on every line can be matched up with the time of a lag report
+	fprintf(sFile, "start 0 time=%ld\n", static_cast<long>(time(NULL)));
+
+	sWriterThread = SDL_CreateThread(writer_thread, "star_telemetry_writer", NULL);
+
+	if (!sWriterThread)
+	{
+		logError("Couldn't start the network telemetry writer");
+		star_telemetry_close();
+		return false;
+	}
+
+	// Flush what's left however the process ends up exiting
+	static bool sRegisteredAtExit = false;
+	if (!sRegisteredAtExit)
+	{
+		atexit(star_telemetry_close);
+		sRegisteredAtExit = true;
+	}
+
+	SDL_LockMutex(sMutex);
+	SDL_AtomicSet(&sEnabled, 1);
+	SDL_UnlockMutex(sMutex);
+	return true;
+}
+
+void
+star_telemetry_close()
+{
+	if (!sMutex)
+		return;
+
+	// Once this is done no recorder can touch the ring; the mutex and condition stay
+	// around, since a tick thread may be waiting on the mutex right now
+	SDL_LockMutex(sMutex);
+	SDL_AtomicSet(&sEnabled, 0);
+	sClosing = true;
+	SDL_CondSignal(sWriterCondition);
+	SDL_UnlockMutex(sMutex);
+
+	if (sWriterThread)
+	{
+		int status;
+		SDL_WaitThread(sWriterThread, &status);
+		sWriterThread = NULL;
+	}
+
+	if (sFile)
+	{
+		fclose(sFile);
+		sFile = NULL;
+	}
+
+	SDL_LockMutex(sMutex);
+	std::vector<StarTelemetryRecord>().swap(sRing);
+	sRingStart = sRingCount = 0;
+	SDL_UnlockMutex(sMutex);
+}
+
+bool
+star_telemetry_enabled()
+{
+	return SDL_AtomicGet(&sEnabled) != 0;
+}
+
+void
+star_telemetry_record(const StarTelemetryRecord& inRecord)
+{
+	if (!SDL_AtomicGet(&sEnabled))
+		return;
+
+	SDL_LockMutex(sMutex);
+	if (!SDL_AtomicGet(&sEnabled))
+	{
+		SDL_UnlockMutex(sMutex);
+		return;
+	}
+
+	if (sRingCount == sRing.size())
+	{
+		sRingStart = (sRingStart + 1) % sRing.size();
+		sRingCount--;
+		sDroppedRecords++;
+	}
+
+	StarTelemetryRecord& theRecord = sRing[(sRingStart + sRingCount++) % sRing.size()];
+	theRecord = inRecord;
+	theRecord.mTime = machine_tick_count() - sStartTime;
+	SDL_UnlockMutex(sMutex);
+}
+
+
+
+void
+StarTelemetryCounters::reset(bool inFromHub, size_t inPlayerCount)
+{
+	mFromHub = inFromHub;
+	if (SDL_AtomicGet(&sEnabled))
+	{
+		SDL_LockMutex(sMutex);
+		mSource = sNextSource++;
+		SDL_UnlockMutex(sMutex);
+	}
+
+	mTraffic.clear();
+	mRoundTrips.assign(inPlayerCount, std::vector<uint32>(kStarTelemetryLatencyBuckets, 0));
+	mLateFlags = 0;
+	mMadeUpFlags = 0;
+}
+
+StarTelemetryCounters::Traffic&
+StarTelemetryCounters::traffic(uint16 inPacketMagic)
+{
+	for (size_t i = 0; i < mTraffic.size(); i++)
+		if (mTraffic[i].mPacketMagic == inPacketMagic)
+			return mTraffic[i];
+
+	Traffic theTraffic = { inPacketMagic, 0, 0, 0, 0 };
+	mTraffic.push_back(theTraffic);
+	return mTraffic.back();
+}
+
+void
+StarTelemetryCounters::received(const DDPPacketBuffer& inPacket)
+{
+	if (!SDL_AtomicGet(&sEnabled) || inPacket.datagramSize < 2)
+		return;
+
+	Traffic& theTraffic = traffic((inPacket.datagramData[0] << 8) | inPacket.datagramData[1]);
+	theTraffic.mPacketsIn++;
+	theTraffic.mBytesIn += inPacket.datagramSize;
+}
+
+void
+StarTelemetryCounters::sent(const DDPFrame& inFrame)
+{
+	if (!SDL_AtomicGet(&sEnabled) || inFrame.data_size < 2)
+		return;
+
+	Traffic& theTraffic = traffic((inFrame.data[0] << 8) | inFrame.data[1]);
+	theTraffic.mPacketsOut++;
+	theTraffic.mBytesOut += inFrame.data_size;
+}
+
+void
+StarTelemetryCounters::roundTrip(size_t inPlayer, int32 inTicks)
+{
+	if (SDL_AtomicGet(&sEnabled) && inPlayer < mRoundTrips.size())
+		mRoundTrips[inPlayer][PIN(inTicks, 0, kStarTelemetryLatencyBuckets - 1)]++;
+}
+
+void
+StarTelemetryCounters::lateFlags(int inCount)
+{
+	if (SDL_AtomicGet(&sEnabled))
+		mLateFlags += inCount;
+}
+
+void
+StarTelemetryCounters::madeUpFlags(int inCount)
+{
+	if (SDL_AtomicGet(&sEnabled))
+		mMadeUpFlags += inCount;
+}
+
+StarTelemetryRecord
+StarTelemetryCounters::newRecord(StarTelemetryKind inKind, int32 inTicker) const
+{
+	StarTelemetryRecord theRecord;
+	obj_clear(theRecord);
+	theRecord.mKind = inKind;
+	theRecord.mFromHub = mFromHub;
+	theRecord.mSource = mSource;
+	theRecord.mValues[0] = inTicker;
+	return theRecord;
+}
+
+void
+StarTelemetryCounters::takeFlagCounts(int32& outLateFlags, int32& outMadeUpFlags)
+{
+	outLateFlags = mLateFlags;
+	outMadeUpFlags = mMadeUpFlags;
+	mLateFlags = mMadeUpFlags = 0;
+}
+
+void
+StarTelemetryCounters::reportPlayer(int32 inTicker, size_t inPlayer, const NetworkStats& inStats)
+{
+	if (inPlayer >= mRoundTrips.size())
+		return;
+
+	std::vector<uint32>& theRoundTrips = mRoundTrips[inPlayer];
+	StarTelemetryRecord theRecord = newRecord(kStarTelemetryPlayer, inTicker);
+	theRecord.mValues[1] = inPlayer;
+	theRecord.mValues[2] = inStats.latency;
+	theRecord.mValues[3] = inStats.jitter;
+	theRecord.mValues[4] = inStats.errors;
+	for (int i = 0; i < kStarTelemetryLatencyBuckets; i++)
+		theRecord.mValues[5 + i] = theRoundTrips[i];
+	star_telemetry_record(theRecord);
+
+	std::fill(theRoundTrips.begin(), theRoundTrips.end(), 0);
+}
+
+void
+StarTelemetryCounters::reportTraffic(int32 inTicker)
+{
+	for (size_t i = 0; i < mTraffic.size(); i++)
+	{
+		const Traffic& theTraffic = mTraffic[i];
+		StarTelemetryRecord theRecord = newRecord(kStarTelemetryTraffic, inTicker);
+		theRecord.mValues[1] = theTraffic.mPacketMagic;
+		theRecord.mValues[2] = theTraffic.mPacketsIn;
+		theRecord.mValues[3] = theTraffic.mBytesIn;
+		theRecord.mValues[4] = theTraffic.mPacketsOut;
+		theRecord.mValues[5] = theTraffic.mBytesOut;
+		star_telemetry_record(theRecord);
+	}
+
+	mTraffic.clear();
+}
+
+void
+StarTelemetryCounters::timingAdjustment(int32 inTicker, size_t inPlayer, int32 inAdjustment, int32 inTick)
+{
+	StarTelemetryRecord theRecord = newRecord(kStarTelemetryTimingAdjustment, inTicker);
+	theRecord.mValues[1] = inPlayer;
+	theRecord.mValues[2] = inAdjustment;
+	theRecord.mValues[3] = inTick;
+	star_telemetry_record(theRecord);
+}
+
+#endif // !defined(DISABLE_NETWORKING)
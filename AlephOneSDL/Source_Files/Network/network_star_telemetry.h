@@ -0,0 +1,134 @@
+/*
+ *  network_star_telemetry.h
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  A record of what the star hub and spoke were doing, tick by tick, for diagnosing lag
+ *  (run with --net-telemetry file).
+ *
+ *  The hub and spoke each keep a StarTelemetryCounters, bump it as packets come and go, and
+ *  once a tick hand star_telemetry_record() a fixed-size record of their queues.  Recording
+ *  copies the record into a ring buffer and nothing more; a writer thread empties the ring a
+ *  few times a second and appends a line per record to the file.  If the writer can't keep up,
+ *  the oldest records are overwritten and a "dropped" line says how many.  Without a file,
+ *  nothing is recorded at all.
+ *
+ *  Each line is the record's kind, ms since telemetry started, the hub or spoke it's from
+ *  (hub0, spoke1, ...) and then key=value fields:
+ *	hub	every hub tick: queue depths, late flags received and flags made up that tick
+ *	spoke	every spoke tick: queue depths and timing
+ *	player	every second, for each player at the hub and for its own at the spoke: latency,
+ *		jitter, CRC errors and a histogram of round trips (0 to 14 ticks, then 15 or more)
+ *		since the last one
+ *	traffic	every second, per packet type: packets and bytes in and out
+ *	timing	when the hub asks for a timing adjustment, or the spoke is asked for one
+ */
+
+#ifndef NETWORK_STAR_TELEMETRY_H
+#define NETWORK_STAR_TELEMETRY_H
+
+#include "cseries.h"
+#include "network.h" // NetworkStats
+#include "network_star.h" // TICKS_PER_SECOND
+
+#include <vector>
+
+enum {
+	kStarTelemetryLatencyBuckets = 16,
+	kStarTelemetryReportPeriod = TICKS_PER_SECOND	// between player and traffic records
+};
+
+enum StarTelemetryKind {
+	kStarTelemetryHubTick,
+	kStarTelemetrySpokeTick,
+	kStarTelemetryPlayer,
+	kStarTelemetryTraffic,
+	kStarTelemetryTimingAdjustment,
+	NUMBER_OF_STAR_TELEMETRY_KINDS
+};
+
+struct StarTelemetryRecord
+{
+	enum { kMaximumValues = 5 + kStarTelemetryLatencyBuckets };
+
+	int16	mKind;
+	bool	mFromHub;
+	uint16	mSource;
+	uint32	mTime;		// filled in by star_telemetry_record()
+	// What these are depends on mKind; see format_record() in network_star_telemetry.cpp
+	int32	mValues[kMaximumValues];
+};
+
+// Starts appending telemetry to inPath, until star_telemetry_close() or exit; false (and
+// logged) if it can't be opened
+extern bool star_telemetry_open(const char* inPath);
+extern void star_telemetry_close();
+extern bool star_telemetry_enabled();
+
+extern void star_telemetry_record(const StarTelemetryRecord& inRecord);
+
+// Counts for one hub or spoke between records.  Not thread-safe, but a hub or spoke only
+// touches its own from its packet handler and its tick, which never run at the same time.
+class StarTelemetryCounters
+{
+public:
+	StarTelemetryCounters() : mFromHub(false), mSource(0), mLateFlags(0), mMadeUpFlags(0) {}
+
+	// For a new game; each one gets its own source number
+	void reset(bool inFromHub, size_t inPlayerCount);
+
+	// These count nothing unless telemetry is enabled
+	void received(const DDPPacketBuffer& inPacket);
+	void sent(const DDPFrame& inFrame);
+	void roundTrip(size_t inPlayer, int32 inTicks);
+	void lateFlags(int inCount);
+	void madeUpFlags(int inCount);
+
+	// A record from this hub or spoke, ready for the caller to fill in the values
+	StarTelemetryRecord newRecord(StarTelemetryKind inKind, int32 inTicker) const;
+
+	// The late and made up flag counts since the last call
+	void takeFlagCounts(int32& outLateFlags, int32& outMadeUpFlags);
+
+	// Records inStats and the round trips since the last report for inPlayer
+	void reportPlayer(int32 inTicker, size_t inPlayer, const NetworkStats& inStats);
+	// Records and clears the traffic counts
+	void reportTraffic(int32 inTicker);
+
+	void timingAdjustment(int32 inTicker, size_t inPlayer, int32 inAdjustment, int32 inTick);
+
+private:
+	struct Traffic
+	{
+		uint16	mPacketMagic;
+		uint32	mPacketsIn;
+		uint32	mBytesIn;
+		uint32	mPacketsOut;
+		uint32	mBytesOut;
+	};
+
+	Traffic& traffic(uint16 inPacketMagic);
+
+	bool mFromHub;
+	uint16 mSource;
+	std::vector<Traffic> mTraffic;	// a handful of packet types, so just searched
+	std::vector<std::vector<uint32> > mRoundTrips;
+	int32 mLateFlags;
+	int32 mMadeUpFlags;
+};
+
+#endif // NETWORK_STAR_TELEMETRY_H
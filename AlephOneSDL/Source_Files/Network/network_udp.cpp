@@ -27,6 +27,10 @@
  *  Sept-Nov 2001 (Woody Zenfell): a few additions to implement socket-listening thread.
  *
  *  May 18, 2003 (Woody Zenfell): now uses passed-in port number for local socket.
+ *
+ *  The receiving thread no longer runs the packet handler under the mytm mutex.  It drains the
+ *  socket in batches into a bounded lock-free queue; whoever holds the mytm mutex (a protocol
+ *  tick, or the receiving thread itself when no tick is running) hands packets to the handler.
  */
 
 #if !defined(DISABLE_NETWORKING)
@@ -36,12 +40,14 @@
 #include "network_private.h"
 
 #include <SDL_thread.h>
+#include <SDL_atomic.h>
 
 #include <sched.h> //DCW needed for setting self QOS
 #include <pthread.h> //DCW needed for setting self QOS
 
 #include "thread_priority_sdl.h"
 #include "mytm.h" // mytm_mutex stuff
+#include "Logging.h"
 
 //DCW
 //DCW
@@ -64,12 +70,32 @@ struct _UDPsocket {
 
 
 
+enum {
+	kReceiveQueueSize	= 256,	// must be a power of two
+	kReceiveBatchSize	= 16	// packets taken from the socket per wakeup
+};
+
+// One slot of the receive queue.  mSequence says whose turn it is: a producer may fill the slot
+// at write position p when mSequence == p; the consumer may read it when mSequence == p + 1.
+struct ReceivedPacketSlot {
+	SDL_atomic_t		mSequence;
+	DDPPacketBuffer		mPacket;
+};
+
+
 // Global variables (most comments and "sSomething" variables are ZZZ)
-// Storage for incoming packet data
+// Storage for outgoing packet data
 static UDPpacket*		sUDPPacketBuffer	= NULL;
 
-// Storage for the DDP packet we pass back to the handler proc
-static DDPPacketBuffer		ddpPacketBuffer;
+// Storage for incoming packet data (only the receiving thread uses it)
+static UDPpacket*		sReceivePacket		= NULL;
+
+// Incoming packets wait here for the packet handler; slots are allocated with the socket
+static ReceivedPacketSlot*	sReceiveQueue		= NULL;
+static SDL_atomic_t		sReceiveQueueWriteIndex;
+static SDL_atomic_t		sReceiveQueueReadIndex;	// only advanced under the mytm mutex
+static SDL_atomic_t		sReceiveQueueDrops;
+static SDL_atomic_t		sReceiveQueueMaxDepth;
 
 // Keep track of our one sending/receiving socket
 static UDPsocket 		sSocket			= NULL;
@@ -87,8 +113,90 @@ static SDL_Thread*		sReceivingThread	= NULL;
 static volatile bool		sKeepListening		= false;
 
 
-// ZZZ: the socket listening thread loops in this function.  It calls the registered
-// packet handler when it gets something.
+static inline int
+receive_queue_depth() {
+    return SDL_AtomicGet(&sReceiveQueueWriteIndex) - SDL_AtomicGet(&sReceiveQueueReadIndex);
+}
+
+
+// Any thread may add packets; returns false (and counts a drop) if the queue is full.
+static bool
+enqueue_received_packet(const IPaddress& inSource, const void* inData, int inLength) {
+    ReceivedPacketSlot* theSlot;
+    int thePosition = SDL_AtomicGet(&sReceiveQueueWriteIndex);
+
+    while(true) {
+        theSlot = &sReceiveQueue[thePosition & (kReceiveQueueSize - 1)];
+        int theDifference = (int)((uint32)SDL_AtomicGet(&theSlot->mSequence) - (uint32)thePosition);
+
+        if(theDifference == 0) {
+            // The slot is free; claim it (unless another producer beat us to it)
+            if(SDL_AtomicCAS(&sReceiveQueueWriteIndex, thePosition, thePosition + 1))
+                break;
+            thePosition = SDL_AtomicGet(&sReceiveQueueWriteIndex);
+        }
+        else if(theDifference < 0) {
+            // The consumer hasn't gotten to this slot since last time around
+            SDL_AtomicAdd(&sReceiveQueueDrops, 1);
+            return false;
+        }
+        else
+            thePosition = SDL_AtomicGet(&sReceiveQueueWriteIndex);
+    }
+
+    theSlot->mPacket.protocolType	= kPROTOCOL_TYPE;
+    theSlot->mPacket.sourceAddress	= inSource;
+    theSlot->mPacket.datagramSize	= MIN(inLength, ddpMaxData);
+    memcpy(theSlot->mPacket.datagramData, inData, theSlot->mPacket.datagramSize);
+
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&theSlot->mSequence, thePosition + 1);
+
+    int theDepth = receive_queue_depth();
+    int theMaxDepth = SDL_AtomicGet(&sReceiveQueueMaxDepth);
+    while(theDepth > theMaxDepth && !SDL_AtomicCAS(&sReceiveQueueMaxDepth, theMaxDepth, theDepth))
+        theMaxDepth = SDL_AtomicGet(&sReceiveQueueMaxDepth);
+
+    return true;
+}
+
+
+// Takes whatever the socket has waiting (up to a batch) and queues it.
+static void
+receive_packet_batch() {
+#if defined(__linux__)
+    // One system call for the whole batch
+    static byte		sBatchData[kReceiveBatchSize][ddpMaxData];
+    struct mmsghdr	theMessages[kReceiveBatchSize];
+    struct iovec	theVectors[kReceiveBatchSize];
+    struct sockaddr_in	theAddresses[kReceiveBatchSize];
+
+    memset(theMessages, 0, sizeof(theMessages));
+    for(int i = 0; i < kReceiveBatchSize; i++) {
+        theVectors[i].iov_base			= sBatchData[i];
+        theVectors[i].iov_len			= ddpMaxData;
+        theMessages[i].msg_hdr.msg_iov		= &theVectors[i];
+        theMessages[i].msg_hdr.msg_iovlen	= 1;
+        theMessages[i].msg_hdr.msg_name		= &theAddresses[i];
+        theMessages[i].msg_hdr.msg_namelen	= sizeof(theAddresses[i]);
+    }
+
+    int theCount = recvmmsg(sSocket->channel, theMessages, kReceiveBatchSize, MSG_DONTWAIT, NULL);
+    for(int i = 0; i < theCount; i++) {
+        IPaddress theSource;
+        theSource.host = theAddresses[i].sin_addr.s_addr;
+        theSource.port = theAddresses[i].sin_port;
+        enqueue_received_packet(theSource, sBatchData[i], theMessages[i].msg_len);
+    }
+#else
+    for(int i = 0; i < kReceiveBatchSize && SDLNet_UDP_Recv(sSocket, sReceivePacket) > 0; i++)
+        enqueue_received_packet(sReceivePacket->address, sReceivePacket->data, sReceivePacket->len);
+#endif
+}
+
+
+// ZZZ: the socket listening thread loops in this function.  It queues what it gets, and delivers
+// the queue itself if no TMTask is running; otherwise the next protocol tick takes care of it.
 static int
 receive_thread_function(void*) {
   
@@ -97,30 +205,18 @@ receive_thread_function(void*) {
   
     while(true) {
         // We listen with a timeout so we can shut ourselves down when needed.
-        int theResult = SDLNet_CheckSockets(sSocketSet, 1000);
+        // If packets are still waiting for delivery, come back around soon.
+        int theResult = SDLNet_CheckSockets(sSocketSet, receive_queue_depth() > 0 ? 1 : 1000);
         
         if(!sKeepListening)
             break;
         
-        if(theResult > 0) {
-            theResult = SDLNet_UDP_Recv(sSocket, sUDPPacketBuffer);
-            if(theResult > 0) {
-                if(take_mytm_mutex()) {
-                    ddpPacketBuffer.protocolType	= kPROTOCOL_TYPE;
-                    ddpPacketBuffer.sourceAddress	= sUDPPacketBuffer->address;
-                    ddpPacketBuffer.datagramSize	= sUDPPacketBuffer->len;
-                    
-                    // Hope the other guy is done using whatever's in there!
-                    // (As I recall, all uses happen in sPacketHandler and its progeny, so we should be fine.)
-                    memcpy(ddpPacketBuffer.datagramData, sUDPPacketBuffer->data, sUDPPacketBuffer->len);
-                    
-                    sPacketHandler(&ddpPacketBuffer);
-                    
-                    release_mytm_mutex();
-                }
-                else
-                    fdprintf("could not take mytm mutex - incoming packet dropped");
-            }
+        if(theResult > 0)
+            receive_packet_batch();
+
+        if(receive_queue_depth() > 0 && try_take_mytm_mutex()) {
+            NetDDPProcessReceivedPackets();
+            release_mytm_mutex();
         }
     }
     
@@ -128,6 +224,39 @@ receive_thread_function(void*) {
 }
 
 
+// Caller must hold the mytm mutex, which makes it the only consumer.
+void
+NetDDPProcessReceivedPackets(void) {
+    if(sReceiveQueue == NULL)
+        return;
+
+    while(true) {
+        int thePosition = SDL_AtomicGet(&sReceiveQueueReadIndex);
+        ReceivedPacketSlot& theSlot = sReceiveQueue[thePosition & (kReceiveQueueSize - 1)];
+        if(SDL_AtomicGet(&theSlot.mSequence) != thePosition + 1)
+            break;
+
+        SDL_MemoryBarrierAcquire();
+        sPacketHandler(&theSlot.mPacket);
+
+        // Hand the slot back to the producers for the next time around
+        SDL_AtomicSet(&theSlot.mSequence, thePosition + kReceiveQueueSize);
+        SDL_AtomicSet(&sReceiveQueueReadIndex, thePosition + 1);
+    }
+}
+
+
+void
+NetDDPGetReceiveQueueStats(uint32* outDropped, int32* outDepth, int32* outMaxDepth) {
+    if(outDropped)
+        *outDropped = SDL_AtomicGet(&sReceiveQueueDrops);
+    if(outDepth)
+        *outDepth = sReceiveQueue ? receive_queue_depth() : 0;
+    if(outMaxDepth)
+        *outMaxDepth = SDL_AtomicGet(&sReceiveQueueMaxDepth);
+}
+
+
 /*
  *  Initialize/shutdown module
  */
@@ -163,6 +292,13 @@ OSErr NetDDPOpenSocket(short *ioPortNumber, PacketHandlerProcPtr packetHandler)
 	if (sUDPPacketBuffer == NULL)
 		return -1;
 
+	sReceivePacket = SDLNet_AllocPacket(ddpMaxData);
+	if (sReceivePacket == NULL) {
+		SDLNet_FreePacket(sUDPPacketBuffer);
+		sUDPPacketBuffer = NULL;
+		return -1;
+	}
+
         //PORTGUESS
 	// Open socket (SDLNet_Open seems to like port in host byte order)
         // NOTE: only SDLNet_UDP_Open wants port in host byte order.  All other uses of port in SDL_net
@@ -171,6 +307,8 @@ OSErr NetDDPOpenSocket(short *ioPortNumber, PacketHandlerProcPtr packetHandler)
 	if (sSocket == NULL) {
 		SDLNet_FreePacket(sUDPPacketBuffer);
 		sUDPPacketBuffer = NULL;
+		SDLNet_FreePacket(sReceivePacket);
+		sReceivePacket = NULL;
 		return -1;
 	}
   
@@ -183,6 +321,15 @@ OSErr NetDDPOpenSocket(short *ioPortNumber, PacketHandlerProcPtr packetHandler)
         sSocketSet = SDLNet_AllocSocketSet(1);
         SDLNet_UDP_AddSocket(sSocketSet, sSocket);
         
+        // Set up the receive queue; every slot starts out free for its first write position
+        sReceiveQueue = new ReceivedPacketSlot[kReceiveQueueSize];
+        for(int i = 0; i < kReceiveQueueSize; i++)
+            SDL_AtomicSet(&sReceiveQueue[i].mSequence, i);
+        SDL_AtomicSet(&sReceiveQueueWriteIndex, 0);
+        SDL_AtomicSet(&sReceiveQueueReadIndex, 0);
+        SDL_AtomicSet(&sReceiveQueueDrops, 0);
+        SDL_AtomicSet(&sReceiveQueueMaxDepth, 0);
+
         // Set up receiver
         sKeepListening		= true;
         sPacketHandler		= packetHandler;
@@ -220,6 +367,22 @@ OSErr NetDDPCloseSocket(short portNumber)
             SDLNet_FreeSocketSet(sSocketSet);
             sSocketSet = NULL;
         }
+
+        if(sReceiveQueue) {
+            uint32 theDrops;
+            int32 theMaxDepth;
+            NetDDPGetReceiveQueueStats(&theDrops, NULL, &theMaxDepth);
+            if(theDrops > 0)
+                logNote("receive queue dropped %u packets (deepest %d of %d)", theDrops, theMaxDepth, kReceiveQueueSize);
+
+            delete [] sReceiveQueue;
+            sReceiveQueue = NULL;
+        }
+
+        if(sReceivePacket) {
+            SDLNet_FreePacket(sReceivePacket);
+            sReceivePacket = NULL;
+        }
     
         // (CB's code follows)
 	if (sUDPPacketBuffer) {
@@ -0,0 +1,588 @@
+/*
+ *  network_voice.cpp
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  The voice thread; see network_voice.h.
+ */
+
+#if !defined(DISABLE_NETWORKING)
+
+#include "network_voice.h"
+#include "network.h"
+#include "network_data_formats.h"
+#include "network_distribution_types.h"
+#include "network_sound.h"
+#include "map.h" // _force_unique_teams!
+#include "Logging.h"
+
+#ifdef SPEEX
+#include "network_speex.h"
+#endif
+
+#include <vector>
+
+#include <SDL_atomic.h>
+#include <SDL_mutex.h>
+#include <SDL_thread.h>
+#include <SDL_timer.h>
+
+#ifdef DEBUG
+// For testing: don't send audio on the network - pass it directly to network_speaker.
+//#define MICROPHONE_LOCAL_LOOPBACK
+#endif
+
+enum {
+	kCaptureRingFrames = 32,		// must be a power of two
+	kOutputRingFrames = 8,			// must be a power of two; also bounds the mixer's lag
+	kOutputLeadFrames = 2,			// how far ahead of the mixer playout starts
+	kMaximumEncodedFrameBytes = 200,
+	kMaximumBufferedFrames = 32,		// per player; must be a power of two
+	kMaximumConcealedFrames = 3,		// in a row, before we decide the player stopped talking
+	kExcessFrames = 2,			// past the target before the jitter buffer drops one
+	kMaximumPlayoutDelay = 300,		// ms
+	kSameBurstInterval = 1000,		// ms between packets still counted toward jitter
+	kMaximumOutgoingPackets = 32		// waiting for the main thread
+};
+
+struct VoiceFrame {
+	int16	mSamples[kNetworkVoiceFrameSamples];
+};
+
+// A ring with one producer and one consumer.  Each side only ever advances its own index and
+// publishes with a barrier, so neither waits on the other, or on a lock.
+template <int tSize>
+class VoiceFrameRing {
+public:
+	void reset() {
+		SDL_AtomicSet(&mWriteIndex, 0);
+		SDL_AtomicSet(&mReadIndex, 0);
+	}
+
+	int count() {
+		return SDL_AtomicGet(&mWriteIndex) - SDL_AtomicGet(&mReadIndex);
+	}
+
+	// Producer: the slot to fill next, or NULL if the ring is full
+	VoiceFrame* slotToWrite() {
+		if(count() >= tSize)
+			return NULL;
+		return &mSlots[SDL_AtomicGet(&mWriteIndex) & (tSize - 1)];
+	}
+
+	void publish() {
+		SDL_MemoryBarrierRelease();
+		SDL_AtomicAdd(&mWriteIndex, 1);
+	}
+
+	// Consumer: the inAhead'th oldest filled slot, or NULL
+	VoiceFrame* slotToRead(int inAhead) {
+		if(count() <= inAhead)
+			return NULL;
+		SDL_MemoryBarrierAcquire();
+		return &mSlots[(SDL_AtomicGet(&mReadIndex) + inAhead) & (tSize - 1)];
+	}
+
+	void consume() {
+		SDL_AtomicAdd(&mReadIndex, 1);
+	}
+
+private:
+	SDL_atomic_t	mWriteIndex;
+	SDL_atomic_t	mReadIndex;
+	VoiceFrame	mSlots[tSize];
+};
+
+struct ReceivedVoicePacket {
+	short			mPlayer;
+	uint32			mArrival;
+	std::vector<byte>	mData;
+};
+
+enum {
+	kTalkerIdle,
+	kTalkerBuffering,	// waiting out the playout delay
+	kTalkerPlaying
+};
+
+// One player's decoder and jitter buffer; only the voice thread touches these
+struct VoiceTalker {
+	void*	mDecoder;
+	int	mState;
+	uint32	mPlayAt;
+	int	mTargetFrames;
+	int	mConcealedFrames;
+
+	// Interarrival jitter in ms, scaled by 16 (as in RFC 3550)
+	int32	mJitter;
+	uint32	mLastArrival;
+	int	mLastPacketFrames;
+
+	// Encoded frames waiting to be played
+	uint8	mFrames[kMaximumBufferedFrames][kMaximumEncodedFrameBytes];
+	uint8	mFrameLengths[kMaximumBufferedFrames];
+	int	mFirstFrame;
+	int	mFrameCount;
+};
+
+// Created by the first start and kept for good, since the packet handler may be queueing
+// received voice while we stop
+static SDL_mutex*			sMutex = NULL;
+static SDL_cond*			sCondition = NULL;
+static SDL_Thread*			sThread = NULL;
+static bool				sQuitting = false;
+
+// Set once voice has started and cleared under sMutex as it stops; anyone else checks it
+// again once they hold sMutex
+static SDL_atomic_t			sRunning;
+
+// Guarded by sMutex
+static std::vector<ReceivedVoicePacket>	sReceivedPackets;
+static std::vector<std::vector<byte> >	sOutgoingPackets;
+
+static VoiceFrameRing<kCaptureRingFrames>	sCaptureRing;
+static VoiceFrameRing<kOutputRingFrames>	sOutputRing;
+static int					sOutputFramesTaken = 0;	// by the consumer, not yet released
+
+// The voice thread's own
+static std::vector<VoiceTalker*>	sTalkers;
+static int				sCapturedFramesLastTime = 0;
+static bool				sPlayoutRunning = false;
+static uint32				sPlayoutClock = 0;
+#ifdef SPEEX
+static SpeexBits			sDecoderBits;
+#endif
+
+// For the summary at the end
+static int32				sConcealedFrames = 0;
+static int32				sDroppedFrames = 0;
+static int32				sOverflowedFrames = 0;
+
+
+#ifdef SPEEX
+static VoiceTalker&
+talker(short inPlayer) {
+	if(inPlayer >= static_cast<short>(sTalkers.size()))
+		sTalkers.resize(inPlayer + 1, NULL);
+
+	if(sTalkers[inPlayer] == NULL) {
+		VoiceTalker* theTalker = new VoiceTalker;
+		obj_clear(*theTalker);
+		theTalker->mDecoder = create_speex_decoder();
+		theTalker->mState = kTalkerIdle;
+		sTalkers[inPlayer] = theTalker;
+	}
+
+	return *sTalkers[inPlayer];
+}
+
+
+// Puts a packet's frames in its player's jitter buffer, and updates the jitter estimate
+static void
+buffer_received_packet(const ReceivedVoicePacket& inPacket) {
+	VoiceTalker& theTalker = talker(inPacket.mPlayer);
+
+	const byte* theData = inPacket.mData.empty() ? NULL : &inPacket.mData[0];
+	const byte* theEnd = theData + inPacket.mData.size();
+	int thePacketFrames = 0;
+	while(theData < theEnd) {
+		int theLength = *theData++;
+		if(theLength > theEnd - theData || theLength > kMaximumEncodedFrameBytes)
+			break;
+
+		if(theLength > 0) {
+			if(theTalker.mFrameCount == kMaximumBufferedFrames) {
+				// Way behind; the oldest is least worth keeping
+				theTalker.mFirstFrame = (theTalker.mFirstFrame + 1) & (kMaximumBufferedFrames - 1);
+				theTalker.mFrameCount--;
+				sOverflowedFrames++;
+			}
+
+			int theSlot = (theTalker.mFirstFrame + theTalker.mFrameCount) & (kMaximumBufferedFrames - 1);
+			memcpy(theTalker.mFrames[theSlot], theData, theLength);
+			theTalker.mFrameLengths[theSlot] = theLength;
+			theTalker.mFrameCount++;
+			thePacketFrames++;
+		}
+
+		theData += theLength;
+	}
+
+	if(thePacketFrames == 0)
+		return;
+
+	// Without sequence numbers, deviation from the previous packet's arrival plus its length
+	// in frames is what we have to go on
+	int32 theInterval = inPacket.mArrival - theTalker.mLastArrival;
+	if(theTalker.mLastPacketFrames > 0 && theInterval < kSameBurstInterval) {
+		int32 theDeviation = theInterval - theTalker.mLastPacketFrames * kNetworkVoiceFrameMilliseconds;
+		if(theDeviation < 0)
+			theDeviation = -theDeviation;
+		theTalker.mJitter += theDeviation - ((theTalker.mJitter + 8) >> 4);
+	}
+	theTalker.mLastArrival = inPacket.mArrival;
+	theTalker.mLastPacketFrames = thePacketFrames;
+
+	int32 theDelay = MIN(kMaximumPlayoutDelay, kNetworkVoiceFrameMilliseconds + 2 * (theTalker.mJitter >> 4));
+	theTalker.mTargetFrames = (theDelay + kNetworkVoiceFrameMilliseconds - 1) / kNetworkVoiceFrameMilliseconds;
+
+	if(theTalker.mState == kTalkerIdle) {
+		// Start of a burst of speech
+		speex_decoder_ctl(theTalker.mDecoder, SPEEX_RESET_STATE, NULL);
+		theTalker.mState = kTalkerBuffering;
+		theTalker.mPlayAt = inPacket.mArrival + theDelay;
+		theTalker.mConcealedFrames = 0;
+	}
+}
+
+
+static void
+decode_buffered_frame(VoiceTalker& ioTalker, int16* outFrame) {
+	int theSlot = ioTalker.mFirstFrame;
+	ioTalker.mFirstFrame = (ioTalker.mFirstFrame + 1) & (kMaximumBufferedFrames - 1);
+	ioTalker.mFrameCount--;
+
+	speex_bits_read_from(&sDecoderBits, reinterpret_cast<char*>(ioTalker.mFrames[theSlot]), ioTalker.mFrameLengths[theSlot]);
+	if(speex_decode_int(ioTalker.mDecoder, &sDecoderBits, outFrame) != 0)
+		speex_decode_int(ioTalker.mDecoder, NULL, outFrame);
+}
+
+
+// The talker's next frame, if it's talking
+static bool
+play_talker_frame(VoiceTalker& ioTalker, int16* outFrame) {
+	if(ioTalker.mState != kTalkerPlaying)
+		return false;
+
+	if(ioTalker.mFrameCount > 0) {
+		if(ioTalker.mFrameCount > ioTalker.mLastPacketFrames + ioTalker.mTargetFrames + kExcessFrames) {
+			// Decoded rather than skipped, to keep the decoder in step
+			decode_buffered_frame(ioTalker, outFrame);
+			sDroppedFrames++;
+		}
+
+		decode_buffered_frame(ioTalker, outFrame);
+		ioTalker.mConcealedFrames = 0;
+		return true;
+	}
+
+	if(ioTalker.mConcealedFrames < kMaximumConcealedFrames) {
+		speex_decode_int(ioTalker.mDecoder, NULL, outFrame);
+		ioTalker.mConcealedFrames++;
+		sConcealedFrames++;
+		return true;
+	}
+
+	ioTalker.mState = kTalkerIdle;
+	return false;
+}
+
+
+// Mixes as many frames as have come due since last time into the output ring
+static void
+play_frames(uint32 inNow) {
+	bool isAnyonePlaying = false;
+	for(size_t i = 0; i < sTalkers.size(); i++) {
+		VoiceTalker* theTalker = sTalkers[i];
+		if(theTalker == NULL)
+			continue;
+
+		if(theTalker->mState == kTalkerBuffering && static_cast<int32>(inNow - theTalker->mPlayAt) >= 0)
+			theTalker->mState = kTalkerPlaying;
+
+		if(theTalker->mState == kTalkerPlaying)
+			isAnyonePlaying = true;
+	}
+
+	if(!isAnyonePlaying) {
+		sPlayoutRunning = false;
+		return;
+	}
+
+	if(!sPlayoutRunning) {
+		// Give the mixer a little in hand, since it's only started from the main thread
+		sPlayoutRunning = true;
+		sPlayoutClock = inNow - kOutputLeadFrames * kNetworkVoiceFrameMilliseconds;
+	}
+
+	int theDueFrames = static_cast<int32>(inNow - sPlayoutClock) / kNetworkVoiceFrameMilliseconds;
+	sPlayoutClock += theDueFrames * kNetworkVoiceFrameMilliseconds;
+	// If we were held up, don't try to catch up on more than the mixer could hold
+	theDueFrames = MIN(theDueFrames, static_cast<int>(kOutputRingFrames));
+
+	for(int theFrame = 0; theFrame < theDueFrames; theFrame++) {
+		int32 theMix[kNetworkVoiceFrameSamples];
+		bool haveAudio = false;
+
+		for(size_t i = 0; i < sTalkers.size(); i++) {
+			int16 theSamples[kNetworkVoiceFrameSamples];
+			if(sTalkers[i] == NULL || !play_talker_frame(*sTalkers[i], theSamples))
+				continue;
+
+			for(int j = 0; j < kNetworkVoiceFrameSamples; j++)
+				theMix[j] = (haveAudio ? theMix[j] : 0) + theSamples[j];
+			haveAudio = true;
+		}
+
+		if(!haveAudio)
+			continue;
+
+		// If the mixer isn't keeping up, the frame is lost rather than the lag growing
+		VoiceFrame* theOutput = sOutputRing.slotToWrite();
+		if(theOutput == NULL)
+			continue;
+
+		for(int j = 0; j < kNetworkVoiceFrameSamples; j++)
+			theOutput->mSamples[j] = PIN(theMix[j], INT16_MIN, INT16_MAX);
+		sOutputRing.publish();
+	}
+}
+
+
+// Encodes captured frames into packets: whole packets while the microphone keeps delivering,
+// and whatever's left once it stops
+static void
+encode_captured_frames(std::vector<std::vector<byte> >& outPackets) {
+	int theCapturedFrames = sCaptureRing.count();
+	bool isCaptureIdle = (theCapturedFrames == sCapturedFramesLastTime);
+
+	while(theCapturedFrames >= kNetworkVoiceFramesPerPacket || (theCapturedFrames > 0 && isCaptureIdle)) {
+		int thePacketFrames = MIN(theCapturedFrames, static_cast<int>(kNetworkVoiceFramesPerPacket));
+
+		network_audio_header theHeader;
+		theHeader.mReserved = 1;
+		theHeader.mFlags = 0;
+
+		std::vector<byte> thePacket(SIZEOF_network_audio_header + thePacketFrames * (kMaximumEncodedFrameBytes + 1));
+		netcpy(reinterpret_cast<network_audio_header_NET*>(&thePacket[0]), &theHeader);
+		size_t theSize = SIZEOF_network_audio_header;
+
+		for(int i = 0; i < thePacketFrames; i++) {
+			VoiceFrame* theFrame = sCaptureRing.slotToRead(0);
+			int theLength = speex_encode_frame(theFrame->mSamples, reinterpret_cast<char*>(&thePacket[theSize + 1]), kMaximumEncodedFrameBytes);
+			sCaptureRing.consume();
+
+			if(theLength > 0) {
+				thePacket[theSize] = theLength;
+				theSize += theLength + 1;
+			}
+		}
+		theCapturedFrames -= thePacketFrames;
+
+		if(theSize > SIZEOF_network_audio_header) {
+			thePacket.resize(theSize);
+			outPackets.push_back(thePacket);
+		}
+	}
+
+	sCapturedFramesLastTime = theCapturedFrames;
+}
+#endif // SPEEX
+
+
+static int
+voice_thread(void*) {
+	std::vector<ReceivedVoicePacket> theReceivedPackets;
+	std::vector<std::vector<byte> > theEncodedPackets;
+
+	SDL_LockMutex(sMutex);
+	while(!sQuitting) {
+		SDL_CondWaitTimeout(sCondition, sMutex, kNetworkVoiceFrameMilliseconds);
+		if(sQuitting)
+			break;
+
+		theReceivedPackets.swap(sReceivedPackets);
+		SDL_UnlockMutex(sMutex);
+
+#ifdef SPEEX
+		for(size_t i = 0; i < theReceivedPackets.size(); i++)
+			buffer_received_packet(theReceivedPackets[i]);
+		encode_captured_frames(theEncodedPackets);
+		play_frames(SDL_GetTicks());
+#endif
+		theReceivedPackets.clear();
+
+		SDL_LockMutex(sMutex);
+		for(size_t i = 0; i < theEncodedPackets.size(); i++) {
+			if(sOutgoingPackets.size() == kMaximumOutgoingPackets)
+				sOutgoingPackets.erase(sOutgoingPackets.begin());
+			sOutgoingPackets.push_back(theEncodedPackets[i]);
+		}
+		theEncodedPackets.clear();
+	}
+	SDL_UnlockMutex(sMutex);
+
+	return 0;
+}
+
+
+void
+start_network_voice() {
+	if(SDL_AtomicGet(&sRunning))
+		return;
+
+	sCaptureRing.reset();
+	sOutputRing.reset();
+	sOutputFramesTaken = 0;
+	sCapturedFramesLastTime = 0;
+	sPlayoutRunning = false;
+	sConcealedFrames = 0;
+	sDroppedFrames = 0;
+	sOverflowedFrames = 0;
+#ifdef SPEEX
+	speex_bits_init(&sDecoderBits);
+#endif
+
+	if(sMutex == NULL)
+		sMutex = SDL_CreateMutex();
+	if(sCondition == NULL)
+		sCondition = SDL_CreateCond();
+	if(sMutex == NULL || sCondition == NULL) {
+		logWarning("couldn't start network voice: %s", SDL_GetError());
+		return;
+	}
+
+	SDL_LockMutex(sMutex);
+	sReceivedPackets.clear();
+	sOutgoingPackets.clear();
+	sQuitting = false;
+	SDL_UnlockMutex(sMutex);
+
+	sThread = SDL_CreateThread(voice_thread, "network_voice", NULL);
+	if(sThread == NULL)
+		logWarning("couldn't start the voice thread: %s", SDL_GetError());
+
+	SDL_AtomicSet(&sRunning, 1);
+}
+
+
+void
+stop_network_voice() {
+	if(!SDL_AtomicGet(&sRunning))
+		return;
+
+	SDL_LockMutex(sMutex);
+	SDL_AtomicSet(&sRunning, 0);
+	sQuitting = true;
+	SDL_CondSignal(sCondition);
+	SDL_UnlockMutex(sMutex);
+
+	if(sThread != NULL) {
+		int theStatus;
+		SDL_WaitThread(sThread, &theStatus);
+		sThread = NULL;
+	}
+
+	SDL_LockMutex(sMutex);
+	sReceivedPackets.clear();
+	sOutgoingPackets.clear();
+	SDL_UnlockMutex(sMutex);
+
+#ifdef SPEEX
+	for(size_t i = 0; i < sTalkers.size(); i++) {
+		if(sTalkers[i] != NULL) {
+			destroy_speex_decoder(sTalkers[i]->mDecoder);
+			delete sTalkers[i];
+		}
+	}
+	sTalkers.clear();
+	speex_bits_destroy(&sDecoderBits);
+#endif
+
+	if(sConcealedFrames || sDroppedFrames || sOverflowedFrames)
+		logNote("voice: concealed %d late frames, dropped %d to cut latency and %d that overflowed", sConcealedFrames, sDroppedFrames, sOverflowedFrames);
+}
+
+
+void
+send_network_voice_packets() {
+	if(!SDL_AtomicGet(&sRunning))
+		return;
+
+	static std::vector<std::vector<byte> > sPackets;
+	SDL_LockMutex(sMutex);
+	sPackets.swap(sOutgoingPackets);
+	SDL_UnlockMutex(sMutex);
+
+	for(size_t i = 0; i < sPackets.size(); i++) {
+#ifdef MICROPHONE_LOCAL_LOOPBACK
+		received_network_audio_proc(&sPackets[i][0], sPackets[i].size(), 0);
+#else
+		NetDistributeInformation(kNewNetworkAudioDistributionTypeID, &sPackets[i][0], sPackets[i].size(), false, !(GET_GAME_OPTIONS() & _force_unique_teams));
+#endif
+	}
+	sPackets.clear();
+}
+
+
+void
+queue_received_network_voice(short inPlayer, const byte* inData, int inLength) {
+	if(!SDL_AtomicGet(&sRunning) || inLength <= 0 || inPlayer < 0)
+		return;
+
+	SDL_LockMutex(sMutex);
+	if(!SDL_AtomicGet(&sRunning)) {
+		SDL_UnlockMutex(sMutex);
+		return;
+	}
+
+	sReceivedPackets.resize(sReceivedPackets.size() + 1);
+	ReceivedVoicePacket& thePacket = sReceivedPackets.back();
+	thePacket.mPlayer = inPlayer;
+	thePacket.mArrival = SDL_GetTicks();
+	thePacket.mData.assign(inData, inData + inLength);
+	SDL_UnlockMutex(sMutex);
+}
+
+
+void
+queue_captured_network_voice(const int16* inFrame) {
+	VoiceFrame* theFrame = sCaptureRing.slotToWrite();
+	if(theFrame == NULL)
+		return;
+
+	memcpy(theFrame->mSamples, inFrame, sizeof(theFrame->mSamples));
+	sCaptureRing.publish();
+}
+
+
+byte*
+take_network_voice_frame() {
+	VoiceFrame* theFrame = sOutputRing.slotToRead(sOutputFramesTaken);
+	if(theFrame == NULL)
+		return NULL;
+
+	sOutputFramesTaken++;
+	return reinterpret_cast<byte*>(theFrame->mSamples);
+}
+
+
+void
+release_network_voice_frame() {
+	if(sOutputFramesTaken > 0) {
+		sOutputFramesTaken--;
+		sOutputRing.consume();
+	}
+}
+
+
+bool
+network_voice_frames_waiting() {
+	return sOutputRing.count() > 0;
+}
+
+#endif // !defined(DISABLE_NETWORKING)
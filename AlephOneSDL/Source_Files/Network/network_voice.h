@@ -0,0 +1,69 @@
+/*
+ *  network_voice.h
+
+	Copyright (C) 2026 and beyond by the "Aleph One" developers.
+
+	This program is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	This license is contained in the file "COPYING",
+	which is included with this source code; it is available online at
+	http://www.gnu.org/licenses/gpl.html
+
+ *  The voice thread: Speex encoding and decoding for the network microphone and speaker, off
+ *  the capture, network and mixer paths.
+ *
+ *  Captured audio arrives a frame at a time from the microphone code (which may be running in
+ *  an audio callback or a signal handler, so that hand-off is a lock-free ring); the voice
+ *  thread encodes it in packet-sized batches and leaves the packets for the main thread to send.
+ *
+ *  Received packets are queued with the time they arrived.  Each player gets a decoder
+ *  and a jitter buffer of still-encoded frames: playout of a burst of speech starts once the
+ *  buffer has had time to cover that player's recent arrival jitter, a frame that hasn't shown
+ *  up in time is concealed by Speex, and a buffer that has grown well past its target drops a
+ *  frame to win the latency back.  Every frame period the voice thread decodes the next frame
+ *  for each player who is talking, mixes them and hands the result to the mixer through a
+ *  second lock-free ring.
+ */
+
+#ifndef NETWORK_VOICE_H
+#define NETWORK_VOICE_H
+
+#include "cseries.h"
+#include "network_audio_shared.h"
+
+enum {
+	kNetworkVoiceFrameSamples = 160,	// one Speex narrowband frame
+	kNetworkVoiceFrameBytes = kNetworkVoiceFrameSamples * kNetworkAudioBytesPerFrame,
+	kNetworkVoiceFrameMilliseconds = 1000 * kNetworkVoiceFrameSamples / kNetworkAudioSampleRate,
+	kNetworkVoiceFramesPerPacket = 5
+};
+
+// Main thread, with the network speaker
+extern void start_network_voice();
+extern void stop_network_voice();
+
+// Main thread: sends the packets the voice thread has encoded since the last call
+extern void send_network_voice_packets();
+
+// Packet handler: queues the Speex frames (after the network audio header) of a packet from inPlayer
+extern void queue_received_network_voice(short inPlayer, const byte* inData, int inLength);
+
+// Capture code (one thread at a time): a frame of microphone audio for the voice thread to
+// encode.  Never blocks; the frame is dropped if the voice thread has fallen that far behind.
+extern void queue_captured_network_voice(const int16* inFrame);
+
+// The mixer (or, while the network audio channel isn't playing, the main thread): the oldest
+// mixed frame not yet taken, or NULL.  It stays valid until released.
+extern byte* take_network_voice_frame();
+extern void release_network_voice_frame();
+extern bool network_voice_frames_waiting();
+
+#endif // NETWORK_VOICE_H
@@ -3376,6 +3376,54 @@ void OGL_RenderRect(const SDL_Rect& rect)
 	OGL_RenderRect(rect.x, rect.y, rect.w, rect.h);
 }
 
+void OGL_RenderRects(const float *rects, size_t count)
+{
+  if (!count)
+    return;
+  
+  AOA::pushGroupMarker(0, "OGL_RenderRects");
+  
+  // two triangles each
+  static std::vector<GLfloat> vertices;
+  vertices.resize(count * 12);
+  GLfloat *v = &vertices[0];
+  for (size_t i = 0; i < count; ++i, rects += 4, v += 12)
+  {
+    GLfloat x = rects[0], y = rects[1], w = rects[2], h = rects[3];
+    v[0] = x;     v[1] = y;
+    v[2] = x + w; v[3] = y;
+    v[4] = x + w; v[5] = y + h;
+    v[6] = x;     v[7] = y;
+    v[8] = x + w; v[9] = y + h;
+    v[10] = x;    v[11] = y + h;
+  }
+  
+	glDisable(GL_TEXTURE_2D);
+  
+  if(useShaderRenderer()){
+    Shader *lastShader = lastEnabledShader();
+    if(lastShader) {
+      lastShader->setVec4(Shader::U_MS_Color, MatrixStack::Instance()->color());
+
+      AOA::vertexAttribPointer(Shader::ATTRIB_VERTEX, 2, GL_FLOAT, GL_FALSE, 0, &vertices[0]);
+      AOA::enableVertexAttribArray(Shader::ATTRIB_VERTEX);
+    }
+  } else {
+      glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+      glVertexPointer(2, GL_FLOAT, 0, &vertices[0]);
+  }
+
+	glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(count * 6));
+
+	glEnable(GL_TEXTURE_2D);
+  
+  if(!useShaderRenderer()){
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  }
+  
+  glPopGroupMarkerEXT();
+}
+
 void OGL_RenderTexturedRect(float x, float y, float w, float h, float tleft, float ttop, float tright, float tbottom)
 {
   if ( useShaderRenderer() ) {
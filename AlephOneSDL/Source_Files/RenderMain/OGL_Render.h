@@ -101,6 +101,8 @@ bool OGL_RenderTextCursor(const SDL_Rect& rect, unsigned char r = 0xff, unsigned
 // Render rectangles (set color beforehand)
 void OGL_RenderRect(float x, float y, float w, float h);
 void OGL_RenderRect(const SDL_Rect& rect);
+// count rectangles as x, y, w, h, in one draw call
+void OGL_RenderRects(const float *rects, size_t count);
 
 void OGL_RenderTexturedRect(float x, float y, float w, float h, float tleft, float ttop, float tright, float tbottom);
 void OGL_RenderTexturedRect(const SDL_Rect& rect, float tleft, float ttop, float tright, float tbottom);
@@ -34,12 +34,14 @@ HUD_RENDERER_LUA.CPP
 #ifdef HAVE_OPENGL
 #include "OGL_Headers.h"
 #include "OGL_Render.h"
+#include "OGL_Blitter.h"
 #endif
 
 #include "MatrixStack.hpp"
 #include "AlephOneHelper.h"
 
 #include <math.h>
+#include <algorithm>
 
 #if defined(__WIN32__) || defined(__MINGW32__)
 #undef DrawText
@@ -51,6 +53,11 @@ extern bool MotionSensorActive;
 // Rendering object
 static HUD_Lua_Class HUD_Lua;
 
+// Frame timing, in ms
+static float hud_script_ms = 0;
+static float hud_draw_ms = 0;
+static uint32 hud_timed_at = 0;
+
 
 HUD_Lua_Class *Lua_HUDInstance()
 {
@@ -60,9 +67,42 @@ HUD_Lua_Class *Lua_HUDInstance()
 void Lua_DrawHUD(short time_elapsed)
 {
 	HUD_Lua.update_motion_sensor(time_elapsed);
+	
+	uint64_t start = SDL_GetPerformanceCounter();
 	HUD_Lua.start_draw();
+	uint64_t script_start = SDL_GetPerformanceCounter();
 	L_Call_HUDDraw();
+	uint64_t script_end = SDL_GetPerformanceCounter();
 	HUD_Lua.end_draw();
+	uint64_t end = SDL_GetPerformanceCounter();
+	
+	float to_ms = 1000.0f / SDL_GetPerformanceFrequency();
+	float script_ms = (script_end - script_start) * to_ms;
+	float draw_ms = ((script_start - start) + (end - script_end)) * to_ms;
+	
+	// smoothed, unless this is the first frame in a while
+	uint32 ticks = SDL_GetTicks();
+	if (hud_timed_at && ticks - hud_timed_at < MACHINE_TICKS_PER_SECOND)
+	{
+		hud_script_ms += (script_ms - hud_script_ms) * 0.1f;
+		hud_draw_ms += (draw_ms - hud_draw_ms) * 0.1f;
+	}
+	else
+	{
+		hud_script_ms = script_ms;
+		hud_draw_ms = draw_ms;
+	}
+	hud_timed_at = ticks ? ticks : 1;
+}
+
+bool Lua_HUDFrameTime(float& script_ms, float& draw_ms)
+{
+	if (!hud_timed_at || SDL_GetTicks() - hud_timed_at >= MACHINE_TICKS_PER_SECOND)
+		return false;
+	
+	script_ms = hud_script_ms;
+	draw_ms = hud_draw_ms;
+	return true;
 }
 
 /*
@@ -108,6 +148,11 @@ blip_info HUD_Lua_Class::entity_blip(size_t index)
 // DJB OpenGL SaveState
 #include "SaveState.h"
 
+// frames a rasterized string is kept after it was last drawn
+static const uint32 text_cache_frames = 120;
+// rasterized strings kept before the least recently drawn go early
+static const size_t text_cache_entries = 256;
+
 void HUD_Lua_Class::start_draw(void)
 {
 	alephone::Screen *scr = alephone::Screen::instance();
@@ -174,15 +219,48 @@ void HUD_Lua_Class::start_draw(void)
 //		SDL_SetAlpha(MainScreenSurface(), SDL_SRCALPHA, 0xff);
 	}
 	
+	// last frame's commands (and text images) are only good for the same renderer and
+	// window
+	if (m_opengl != m_commands_opengl)
+	{
+		clear_text_cache();
+		m_commands_opengl = m_opengl;
+		m_commands_valid = false;
+	}
+	if (m_wr.x != m_commands_wr.x || m_wr.y != m_commands_wr.y ||
+		m_wr.w != m_commands_wr.w || m_wr.h != m_commands_wr.h)
+	{
+		m_commands_wr = m_wr;
+		m_commands_valid = false;
+	}
 	
 	m_drawing = true;
-	clear_mask();
+	m_recording = false;
+	m_reusing = false;
+	m_frame_invalidated = false;
 }
 
 void HUD_Lua_Class::end_draw(void)
 {
 	m_drawing = false;
 	
+	// a frame that drew nothing
+	if (!m_recording && !m_reusing)
+		m_commands.clear();
+	
+	submit();
+	m_commands_valid = !m_frame_invalidated;
+	
+	for (size_t i = 0; i < m_released_images.size(); ++i)
+		delete m_released_images[i];
+	m_released_images.clear();
+	for (size_t i = 0; i < m_released_shapes.size(); ++i)
+		delete m_released_shapes[i];
+	m_released_shapes.clear();
+	
+	++m_frame;
+	prune_text_cache();
+	
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
@@ -208,7 +286,100 @@ void HUD_Lua_Class::end_draw(void)
 	}
 }
 
-void HUD_Lua_Class::apply_clip(void)
+bool HUD_Lua_Class::reuse_frame(void)
+{
+	if (!m_drawing || m_recording || !m_commands_valid)
+		return false;
+	
+	m_reusing = true;
+	return true;
+}
+
+void HUD_Lua_Class::invalidate_frame(void)
+{
+	m_commands_valid = false;
+	if (m_drawing)
+		m_frame_invalidated = true;
+}
+
+// true if this frame's commands use it, so it has to last until they are submitted
+bool HUD_Lua_Class::forget_object(const void *object)
+{
+	bool used = false;
+	for (std::vector<draw_command>::iterator it = m_commands.begin(); it != m_commands.end(); ++it)
+	{
+		if (it->image == object || it->shape == object)
+		{
+			it->text = NULL;
+			used = true;
+		}
+	}
+	if (!used)
+		return false;
+	
+	invalidate_frame();
+	if (m_drawing && (m_recording || m_reusing))
+		return true;
+	
+	m_commands.clear();
+	return false;
+}
+
+void HUD_Lua_Class::release_image(Image_Blitter *image)
+{
+	if (forget_object(image))
+		m_released_images.push_back(image);
+	else
+		delete image;
+}
+
+void HUD_Lua_Class::release_shape(Shape_Blitter *shape)
+{
+	if (forget_object(shape))
+		m_released_shapes.push_back(shape);
+	else
+		delete shape;
+}
+
+void HUD_Lua_Class::release_font(FontSpecifier *font)
+{
+	// a new font could turn up at the same address
+	for (std::map<text_key, cached_text>::iterator it = m_text_cache.begin(); it != m_text_cache.end(); )
+	{
+		if (it->first.font == font)
+		{
+			release_image(it->second.image);
+			m_text_cache.erase(it++);
+		}
+		else
+			++it;
+	}
+	delete font;
+}
+
+HUD_Lua_Class::draw_command *HUD_Lua_Class::record(short type)
+{
+	if (!m_drawing || m_reusing)
+		return NULL;
+	
+	if (!m_recording)
+	{
+		m_commands.clear();
+		m_recording = true;
+	}
+	
+	m_commands.push_back(draw_command());
+	draw_command *c = &m_commands.back();
+	c->type = type;
+	c->image = NULL;
+	c->shape = NULL;
+	c->text = NULL;
+	if (m_surface)
+		c->clip = clip_rect();
+	return c;
+}
+
+SDL_Rect HUD_Lua_Class::clip_rect(void)
 {
 	alephone::Screen *scr = alephone::Screen::instance();
 	
@@ -217,10 +388,100 @@ void HUD_Lua_Class::apply_clip(void)
     r.y = m_wr.y + scr->lua_clip_rect.y;
     r.w = MIN(scr->lua_clip_rect.w, m_wr.w - scr->lua_clip_rect.x);
     r.h = MIN(scr->lua_clip_rect.h, m_wr.h - scr->lua_clip_rect.y);
-	if (m_surface)
+	return r;
+}
+
+static uint8 color_byte(float value)
+{
+	return static_cast<uint8>(PIN(value, 0, 1) * 255);
+}
+
+HUD_Lua_Class::cached_text *HUD_Lua_Class::text_image(FontSpecifier *font, const char *text, uint32 color)
+{
+	m_text_lookup.font = font;
+	m_text_lookup.color = color;
+	m_text_lookup.text = text;
+	
+	std::map<text_key, cached_text>::iterator it = m_text_cache.find(m_text_lookup);
+	if (it != m_text_cache.end())
+		return &it->second;
+	
+	// leave room for glyphs that overhang their width
+	int width = font->TextWidth(text) + font->Descent;
+	int height = font->LineSpacing;
+	if (width <= 0 || height <= 0)
+		return NULL;
+	
+#ifdef ALEPHONE_LITTLE_ENDIAN
+	SDL_Surface *s = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32, 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000);
+#else
+	SDL_Surface *s = SDL_CreateRGBSurface(SDL_SWSURFACE, width, height, 32, 0xff000000, 0x00ff0000, 0x0000ff00, 0x000000ff);
+#endif
+	if (!s)
+		return NULL;
+	
+	// blended glyphs take on the text color, not black, at their edges
+	uint8 r = color >> 24, g = color >> 16, b = color >> 8, a = color;
+	SDL_FillRect(s, NULL, SDL_MapRGBA(s->format, r, g, b, 0));
+	font->Info->draw_text(s, text, strlen(text), 0, font->Height,
+	                      SDL_MapRGBA(s->format, r, g, b, a), font->Style);
+	
+#ifdef HAVE_OPENGL
+	Image_Blitter *image = m_opengl ? new OGL_Blitter() : new Image_Blitter();
+#else
+	Image_Blitter *image = new Image_Blitter();
+#endif
+	bool loaded = image->Load(*s);
+	SDL_FreeSurface(s);
+	if (!loaded)
 	{
-		SDL_SetClipRect(MainScreenSurface(), &r);
+		delete image;
+		return NULL;
 	}
+	
+	cached_text entry;
+	entry.image = image;
+	entry.last_used = m_frame;
+	return &m_text_cache.insert(std::make_pair(m_text_lookup, entry)).first->second;
+}
+
+void HUD_Lua_Class::prune_text_cache(void)
+{
+	bool over_limit = m_text_cache.size() > text_cache_entries;
+	if (m_frame % 64 && !over_limit)
+		return;
+	
+	// a string that changes every frame, like a timer, leaves a new image behind each
+	// frame; past the limit, drop the least recently drawn, but never one the last frame
+	// drew, since its commands may be drawn again
+	uint32 oldest_kept = 0;
+	if (over_limit)
+	{
+		std::vector<uint32> last_used;
+		last_used.reserve(m_text_cache.size());
+		for (std::map<text_key, cached_text>::iterator it = m_text_cache.begin(); it != m_text_cache.end(); ++it)
+			last_used.push_back(it->second.last_used);
+		std::nth_element(last_used.begin(), last_used.end() - text_cache_entries, last_used.end());
+		oldest_kept = MIN(*(last_used.end() - text_cache_entries), m_frame - 1);
+	}
+	
+	for (std::map<text_key, cached_text>::iterator it = m_text_cache.begin(); it != m_text_cache.end(); )
+	{
+		if (m_frame - it->second.last_used > text_cache_frames || it->second.last_used < oldest_kept)
+		{
+			release_image(it->second.image);
+			m_text_cache.erase(it++);
+		}
+		else
+			++it;
+	}
+}
+
+void HUD_Lua_Class::clear_text_cache(void)
+{
+	for (std::map<text_key, cached_text>::iterator it = m_text_cache.begin(); it != m_text_cache.end(); ++it)
+		release_image(it->second.image);
+	m_text_cache.clear();
 }
 
 short HUD_Lua_Class::masking_mode(void)
@@ -235,27 +496,250 @@ void HUD_Lua_Class::set_masking_mode(short masking_mode)
 		masking_mode >= NUMBER_OF_LUA_MASKING_MODES)
 		return;
 	
-	if (m_masking_mode == _mask_drawing)
+	draw_command *c = record(_set_masking_mode_command);
+	if (!c)
+		return;
+	
+	c->masking_mode = masking_mode;
+	m_masking_mode = masking_mode;
+}
+	
+void HUD_Lua_Class::clear_mask(void)
+{
+	record(_clear_mask_command);
+}
+
+void HUD_Lua_Class::fill_rect(float x, float y, float w, float h,
+															float r, float g, float b, float a)
+{
+	if (!w || !h)
+		return;
+	
+	draw_command *c = record(_fill_rect_command);
+	if (!c)
+		return;
+	
+	c->x = x;
+	c->y = y;
+	c->w = w;
+	c->h = h;
+	c->r = r;
+	c->g = g;
+	c->b = b;
+	c->a = a;
+}	
+
+void HUD_Lua_Class::frame_rect(float x, float y, float w, float h,
+												 			 float r, float g, float b, float a,
+															 float t)
+{
+	draw_command *c = record(_frame_rect_command);
+	if (!c)
+		return;
+	
+	c->x = x;
+	c->y = y;
+	c->w = w;
+	c->h = h;
+	c->r = r;
+	c->g = g;
+	c->b = b;
+	c->a = a;
+	c->t = t;
+}	
+
+void HUD_Lua_Class::draw_text(FontSpecifier *font, const char *text,
+															float x, float y,
+															float r, float g, float b, float a,
+															float scale)
+{
+	if (!m_drawing || m_reusing)
+		return;
+	
+	if (!text || !strlen(text))
+		return;
+	
+	// OpenGL tints white text; software bakes in the color, and can't scale
+	uint32 color = 0xffffffff;
+	if (!m_opengl)
+	{
+		color = (color_byte(r) << 24) | (color_byte(g) << 16) | (color_byte(b) << 8) | color_byte(a);
+		r = g = b = a = 1;
+		scale = 1;
+	}
+	
+	cached_text *cached = text_image(font, text, color);
+	if (!cached)
+		return;
+	
+	draw_command *c = record(_draw_image_command);
+	c->image = cached->image;
+	c->text = cached;
+	c->x = x;
+	c->y = y;
+	c->w = cached->image->Width() * scale;
+	c->h = cached->image->Height() * scale;
+	c->r = r;
+	c->g = g;
+	c->b = b;
+	c->a = a;
+	c->t = 0;
+	c->crop.x = 0;
+	c->crop.y = 0;
+	c->crop.w = cached->image->Width();
+	c->crop.h = cached->image->Height();
+}
+
+void HUD_Lua_Class::draw_image(Image_Blitter *image, float x, float y)
+{
+	if (!image->crop_rect.w || !image->crop_rect.h)
+		return;
+	
+	draw_command *c = record(_draw_image_command);
+	if (!c)
+		return;
+	
+	c->image = image;
+	c->x = x;
+	c->y = y;
+	c->w = image->crop_rect.w;
+	c->h = image->crop_rect.h;
+	c->r = image->tint_color_r;
+	c->g = image->tint_color_g;
+	c->b = image->tint_color_b;
+	c->a = image->tint_color_a;
+	c->t = image->rotation;
+	c->crop = image->crop_rect;
+}
+
+void HUD_Lua_Class::draw_shape(Shape_Blitter *shape, float x, float y)
+{
+	if (!shape->crop_rect.w || !shape->crop_rect.h)
+		return;
+	
+	draw_command *c = record(_draw_shape_command);
+	if (!c)
+		return;
+	
+	c->shape = shape;
+	c->x = x;
+	c->y = y;
+	c->w = shape->crop_rect.w;
+	c->h = shape->crop_rect.h;
+	c->r = shape->tint_color_r;
+	c->g = shape->tint_color_g;
+	c->b = shape->tint_color_b;
+	c->a = shape->tint_color_a;
+	c->t = shape->rotation;
+	c->crop = shape->crop_rect;
+}
+
+void HUD_Lua_Class::submit(void)
+{
+	short masking_mode = _mask_disabled;
+	apply_clear_mask();
+	
+	const draw_command *batch_color = NULL;
+	for (std::vector<draw_command>::const_iterator it = m_commands.begin(); it != m_commands.end(); ++it)
+	{
+		const draw_command& c = *it;
+		
+#ifdef HAVE_OPENGL
+		// a run of rectangles in the same color is one draw call
+		if (m_opengl && c.type == _fill_rect_command)
+		{
+			if (batch_color &&
+				(c.r != batch_color->r || c.g != batch_color->g ||
+				 c.b != batch_color->b || c.a != batch_color->a))
+				submit_rect_batch(*batch_color);
+			if (m_rect_batch.empty())
+				batch_color = &c;
+			m_rect_batch.push_back(c.x);
+			m_rect_batch.push_back(c.y);
+			m_rect_batch.push_back(c.w);
+			m_rect_batch.push_back(c.h);
+			continue;
+		}
+		if (batch_color)
+		{
+			submit_rect_batch(*batch_color);
+			batch_color = NULL;
+		}
+#endif
+		
+		switch (c.type)
+		{
+			case _fill_rect_command:
+				submit_fill_rect(c);
+				break;
+			case _frame_rect_command:
+				submit_frame_rect(c);
+				break;
+			case _draw_image_command:
+				if (c.text)
+					c.text->last_used = m_frame;
+				submit_image(c);
+				break;
+			case _draw_shape_command:
+				submit_shape(c);
+				break;
+			case _set_masking_mode_command:
+				apply_masking_mode(masking_mode, c.masking_mode);
+				masking_mode = c.masking_mode;
+				break;
+			case _clear_mask_command:
+				apply_clear_mask();
+				break;
+		}
+	}
+	
+#ifdef HAVE_OPENGL
+	if (batch_color)
+		submit_rect_batch(*batch_color);
+#endif
+	apply_masking_mode(masking_mode, _mask_disabled);
+}
+
+void HUD_Lua_Class::submit_rect_batch(const draw_command& color)
+{
+#ifdef HAVE_OPENGL
+	glColor4f(color.r, color.g, color.b, color.a);
+	OGL_RenderRects(&m_rect_batch[0], m_rect_batch.size() / 4);
+#endif
+	m_rect_batch.clear();
+}
+
+void HUD_Lua_Class::apply_clip(const SDL_Rect& clip)
+{
+	if (m_surface)
+	{
+		SDL_Rect r = clip;
+		SDL_SetClipRect(MainScreenSurface(), &r);
+	}
+}
+
+void HUD_Lua_Class::apply_masking_mode(short from, short to)
+{
+	if (from == to)
+		return;
+	
+	if (from == _mask_drawing)
 		end_drawing_mask();
-	else if (m_masking_mode == _mask_erasing)
+	else if (from == _mask_erasing)
 		end_drawing_mask();
-	else if (m_masking_mode == _mask_enabled)
+	else if (from == _mask_enabled)
 		end_using_mask();
 	
-	m_masking_mode = masking_mode;
-	if (m_masking_mode == _mask_drawing)
+	if (to == _mask_drawing)
 		start_drawing_mask(false);
-	else if (m_masking_mode == _mask_erasing)
+	else if (to == _mask_erasing)
 		start_drawing_mask(true);
-	else if (m_masking_mode == _mask_enabled)
+	else if (to == _mask_enabled)
 		start_using_mask();
 }
-	
-void HUD_Lua_Class::clear_mask(void)
+
+void HUD_Lua_Class::apply_clear_mask(void)
 {
-	if (!m_drawing)
-		return;
-	
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
@@ -316,56 +800,46 @@ void HUD_Lua_Class::end_drawing_mask(void)
 #endif
 }
 
-void HUD_Lua_Class::fill_rect(float x, float y, float w, float h,
-															float r, float g, float b, float a)
+void HUD_Lua_Class::submit_fill_rect(const draw_command& c)
 {
-	if (!m_drawing)
-		return;
-	
-	if (!w || !h)
-		return;
-	
-	apply_clip();
+	apply_clip(c.clip);
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
-		glColor4f(r, g, b, a);
-		OGL_RenderRect(x, y, w, h);
+		glColor4f(c.r, c.g, c.b, c.a);
+		OGL_RenderRect(c.x, c.y, c.w, c.h);
 	}
 	else
 #endif
 	if (m_surface)
 	{
 		SDL_Rect rect;
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.y = static_cast<Sint16>(y) + m_wr.y;
-		rect.w = static_cast<Uint16>(w);
-		rect.h = static_cast<Uint16>(h);
+		rect.x = static_cast<Sint16>(c.x) + m_wr.x;
+		rect.y = static_cast<Sint16>(c.y) + m_wr.y;
+		rect.w = static_cast<Uint16>(c.w);
+		rect.h = static_cast<Uint16>(c.h);
 		SDL_FillRect(m_surface, &rect,
-								 SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(r * 255), static_cast<unsigned char>(g * 255), static_cast<unsigned char>(b * 255), static_cast<unsigned char>(a * 255)));
+								 SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(c.r * 255), static_cast<unsigned char>(c.g * 255), static_cast<unsigned char>(c.b * 255), static_cast<unsigned char>(c.a * 255)));
 		SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
 	}
 }	
 
-void HUD_Lua_Class::frame_rect(float x, float y, float w, float h,
-												 			 float r, float g, float b, float a,
-															 float t)
+void HUD_Lua_Class::submit_frame_rect(const draw_command& c)
 {
-	if (!m_drawing)
-		return;
-		
-	apply_clip();
+	float x = c.x, y = c.y, w = c.w, h = c.h, t = c.t;
+	
+	apply_clip(c.clip);
 #ifdef HAVE_OPENGL
 	if (m_opengl)
 	{
-		glColor4f(r, g, b, a);
+		glColor4f(c.r, c.g, c.b, c.a);
 		OGL_RenderFrame(x, y, w, h, t);
 	}
 	else
 #endif
 	if (m_surface)
 	{
-		Uint32 color = SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(r * 255), static_cast<unsigned char>(g * 255), static_cast<unsigned char>(b * 255), static_cast<unsigned char>(a * 255));
+		Uint32 color = SDL_MapRGBA(m_surface->format, static_cast<unsigned char>(c.r * 255), static_cast<unsigned char>(c.g * 255), static_cast<unsigned char>(c.b * 255), static_cast<unsigned char>(c.a * 255));
 		SDL_Rect rect;
 		rect.x = static_cast<Sint16>(x) + m_wr.x;
 		rect.w = static_cast<Uint16>(w);
@@ -394,136 +868,56 @@ void HUD_Lua_Class::frame_rect(float x, float y, float w, float h,
 	}
 }	
 
-void HUD_Lua_Class::draw_text(FontSpecifier *font, const char *text,
-															float x, float y,
-															float r, float g, float b, float a,
-															float scale)
+// images and shapes are drawn as they were when recorded, then put back
+void HUD_Lua_Class::submit_image(const draw_command& c)
 {
-	if (!m_drawing)
-		return;
+	Image_Blitter *image = c.image;
+	float tint_r = image->tint_color_r, tint_g = image->tint_color_g, tint_b = image->tint_color_b, tint_a = image->tint_color_a;
+	float rotation = image->rotation;
+	Image_Rect crop = image->crop_rect;
 	
-	if (!text || !strlen(text))
-		return;
-	
-	apply_clip();
-#ifdef HAVE_OPENGL
-	if (m_opengl)
-	{
-    int previousMode;
-    if(useShaderRenderer()) {
-      previousMode=MatrixStack::Instance()->currentActiveMode();
-      MatrixStack::Instance()->matrixMode(MS_MODELVIEW);
-      MatrixStack::Instance()->pushMatrix();
-      MatrixStack::Instance()->translatef(x, y + (font->Height * scale), 0);
-      MatrixStack::Instance()->scalef(scale, scale, 1.0);
-      MatrixStack::Instance()->color4f(r, g, b, a);
-    } else {
-      glMatrixMode(GL_MODELVIEW);
-      glPushMatrix();
-      glTranslatef(x, y + (font->Height * scale), 0);
-      glScalef(scale, scale, 1.0);
-      glColor4f(r, g, b, a);
-    }
-		font->OGL_Render(text);
-    if(useShaderRenderer()) {
-      MatrixStack::Instance()->color4f(1, 1, 1, 1);
-      MatrixStack::Instance()->popMatrix();
-      MatrixStack::Instance()->matrixMode(previousMode);
-    } else {
-      glColor4f(1, 1, 1, 1);
-      glPopMatrix();
-    }
-	}
-	else
-#endif
-	if (m_surface)
-	{
-		SDL_Rect rect;
-		rect.x = static_cast<Sint16>(x) + m_wr.x;
-		rect.y = static_cast<Sint16>(y) + m_wr.y;
-		rect.w = font->TextWidth(text);
-		rect.h = font->LineSpacing;
-        
-        // FIXME: draw_text doesn't support full RGBA transfer for proper scaling,
-        // so draw blended but unscaled text instead
-#if 0
-        if (scale < 0.99 || scale > 1.01)
-        {
-            SDL_Surface *s2 = SDL_CreateRGBSurface(SDL_SWSURFACE, rect.w, rect.h, m_surface->format->BitsPerPixel, m_surface->format->Rmask, m_surface->format->Gmask, m_surface->format->Bmask, m_surface->format->Amask);
-            
-            font->Info->draw_text(s2, text, strlen(text),
-                                  0, font->Height,
-                                  SDL_MapRGBA(m_surface->format,
-                                              static_cast<unsigned char>(r * 255),
-                                              static_cast<unsigned char>(g * 255),
-                                              static_cast<unsigned char>(b * 255),
-                                              static_cast<unsigned char>(a * 255)),
-                                  font->Style);
-            
-            SDL_Rect srcrect;
-            srcrect.x = 0;
-            srcrect.y = 0;
-            srcrect.w = ceilf(rect.w * scale);
-            srcrect.h = ceilf(rect.h * scale);
-            SDL_Surface *s3 = rescale_surface(s2, srcrect.w, srcrect.h);
-            SDL_FreeSurface(s2);
-            
-            rect.w = srcrect.w;
-            rect.h = srcrect.h;
-            SDL_BlitSurface(s3, &srcrect, MainScreenSurface(), &rect);
-            SDL_FreeSurface(s3);
-        }
-        else
-#endif
-        {
-            SDL_BlitSurface(MainScreenSurface(), &rect, m_surface, &rect);
-            font->Info->draw_text(m_surface, text, strlen(text),
-                                  rect.x, rect.y + font->Height,
-                                  SDL_MapRGBA(m_surface->format,
-                                              static_cast<unsigned char>(r * 255),
-                                              static_cast<unsigned char>(g * 255),
-                                              static_cast<unsigned char>(b * 255),
-                                              static_cast<unsigned char>(a * 255)),
-                                  font->Style);
-            SDL_BlitSurface(m_surface, &rect, MainScreenSurface(), &rect);
-        }
-	}
-}
-
-void HUD_Lua_Class::draw_image(Image_Blitter *image, float x, float y)
-{
-	if (!m_drawing)
-		return;
+	image->tint_color_r = c.r;
+	image->tint_color_g = c.g;
+	image->tint_color_b = c.b;
+	image->tint_color_a = c.a;
+	image->rotation = c.t;
+	image->crop_rect = c.crop;
 	
-	Image_Rect r = { x, y, image->crop_rect.w, image->crop_rect.h };
+	Image_Rect r = { c.x, c.y, c.w, c.h };
 	
-	if (!r.w || !r.h)
-		return;
-
-	apply_clip();
+	apply_clip(c.clip);
     if (m_surface)
     {
         r.x += m_wr.x;
         r.y += m_wr.y;
     }
 	image->Draw(MainScreenSurface(), r);
+	
+	image->tint_color_r = tint_r;
+	image->tint_color_g = tint_g;
+	image->tint_color_b = tint_b;
+	image->tint_color_a = tint_a;
+	image->rotation = rotation;
+	image->crop_rect = crop;
 }
 
-void HUD_Lua_Class::draw_shape(Shape_Blitter *shape, float x, float y)
+void HUD_Lua_Class::submit_shape(const draw_command& c)
 {
-	if (!m_drawing)
-		return;
+	Shape_Blitter *shape = c.shape;
+	float tint_r = shape->tint_color_r, tint_g = shape->tint_color_g, tint_b = shape->tint_color_b, tint_a = shape->tint_color_a;
+	float rotation = shape->rotation;
+	Image_Rect crop = shape->crop_rect;
 	
-	Image_Rect r;
-	r.x = x;
-	r.y = y;
-	r.w = shape->crop_rect.w;
-	r.h = shape->crop_rect.h;
+	shape->tint_color_r = c.r;
+	shape->tint_color_g = c.g;
+	shape->tint_color_b = c.b;
+	shape->tint_color_a = c.a;
+	shape->rotation = c.t;
+	shape->crop_rect = c.crop;
 	
-	if (!r.w || !r.h)
-		return;
+	Image_Rect r = { c.x, c.y, c.w, c.h };
     
-	apply_clip();
+	apply_clip(c.clip);
 #ifdef HAVE_OPENGL
     if (m_opengl)
     {
@@ -537,4 +931,11 @@ void HUD_Lua_Class::draw_shape(Shape_Blitter *shape, float x, float y)
         r.y += m_wr.y;
         shape->SDL_Draw(MainScreenSurface(), r);
     }
+	
+	shape->tint_color_r = tint_r;
+	shape->tint_color_g = tint_g;
+	shape->tint_color_b = tint_b;
+	shape->tint_color_a = tint_a;
+	shape->rotation = rotation;
+	shape->crop_rect = crop;
 }
@@ -20,9 +20,20 @@ HUD_RENDERER_LUA.H
     http://www.gnu.org/licenses/gpl.html
 
     Implements HUD helper class for Lua HUD themes
+
+    The draw trigger's calls are recorded as a list of commands and submitted once the
+    trigger returns.  A script whose HUD looks the same as last frame can say so with
+    Screen.reuse_frame(), and the last frame's list is submitted again without the
+    script drawing anything.  Text is rasterized once into an image, kept for as long as
+    the script keeps drawing it.
 */
 
 #include "HUDRenderer.h"
+#include "Image_Blitter.h"
+
+#include <map>
+#include <string>
+#include <vector>
 
 struct blip_info {
 	short mtype;
@@ -47,7 +58,7 @@ class Shape_Blitter;
 class HUD_Lua_Class : public HUD_Class
 {
 public:
-	HUD_Lua_Class() : m_drawing(false) {}
+	HUD_Lua_Class() : m_drawing(false), m_opengl(false), m_surface(NULL), m_recording(false), m_reusing(false), m_commands_valid(false), m_frame_invalidated(false), m_commands_opengl(false), m_frame(0) { m_commands_wr.x = m_commands_wr.y = m_commands_wr.w = m_commands_wr.h = 0; }
 	~HUD_Lua_Class() {}
 
 	void update_motion_sensor(short time_elapsed);
@@ -59,7 +70,16 @@ public:
 	
 	void start_draw(void);
 	void end_draw(void);
-	void apply_clip(void);
+	
+	// true if last frame's commands will be drawn again this frame, in which case
+	// anything else drawn this frame is ignored; only possible before drawing anything
+	bool reuse_frame(void);
+	// the next frame has to be drawn from scratch
+	void invalidate_frame(void);
+	// deletes the object, once nothing recorded this frame still needs it
+	void release_image(Image_Blitter *image);
+	void release_shape(Shape_Blitter *shape);
+	void release_font(FontSpecifier *font);
 	
 	short masking_mode(void);
 	void set_masking_mode(short masking_mode);
@@ -78,6 +98,45 @@ public:
 	void draw_shape(Shape_Blitter *shape, float x, float y);
 	
 protected:
+	enum {
+		_fill_rect_command,
+		_frame_rect_command,
+		_draw_image_command,
+		_draw_shape_command,
+		_set_masking_mode_command,
+		_clear_mask_command
+	};
+	
+	struct cached_text {
+		Image_Blitter *image;
+		uint32 last_used;	// frame
+	};
+	
+	struct text_key {
+		FontSpecifier *font;
+		uint32 color;		// RGBA, white if tinted when drawn
+		std::string text;
+		
+		bool operator<(const text_key& other) const {
+			if (font != other.font) return font < other.font;
+			if (color != other.color) return color < other.color;
+			return text < other.text;
+		}
+	};
+	
+	struct draw_command {
+		short type;
+		short masking_mode;	// for _set_masking_mode_command
+		SDL_Rect clip;		// software only
+		float x, y, w, h;
+		float r, g, b, a;	// color, or tint for images and shapes
+		float t;		// frame thickness, or rotation for images and shapes
+		Image_Rect crop;
+		Image_Blitter *image;	// for images and text
+		Shape_Blitter *shape;
+		cached_text *text;	// for text
+	};
+	
 	std::vector<blip_info> m_blips;
 	bool m_drawing;
 	bool m_opengl;
@@ -85,6 +144,40 @@ protected:
 	SDL_Rect m_wr;
 	short m_masking_mode;
 	
+	std::vector<draw_command> m_commands;
+	bool m_recording;	// m_commands has been started over this frame
+	bool m_reusing;
+	bool m_commands_valid;	// m_commands can be drawn again
+	bool m_frame_invalidated;	// this frame's commands can't be
+	SDL_Rect m_commands_wr;
+	bool m_commands_opengl;
+	
+	std::map<text_key, cached_text> m_text_cache;
+	text_key m_text_lookup;
+	uint32 m_frame;
+	
+	std::vector<float> m_rect_batch;
+	
+	std::vector<Image_Blitter *> m_released_images;
+	std::vector<Shape_Blitter *> m_released_shapes;
+	
+	draw_command *record(short type);
+	bool forget_object(const void *object);
+	SDL_Rect clip_rect(void);
+	cached_text *text_image(FontSpecifier *font, const char *text, uint32 color);
+	void prune_text_cache(void);
+	void clear_text_cache(void);
+	
+	void submit(void);
+	void submit_rect_batch(const draw_command& color);
+	void apply_clip(const SDL_Rect& clip);
+	void apply_masking_mode(short from, short to);
+	void apply_clear_mask(void);
+	void submit_fill_rect(const draw_command& c);
+	void submit_frame_rect(const draw_command& c);
+	void submit_image(const draw_command& c);
+	void submit_shape(const draw_command& c);
+	
 	void start_using_mask(void);
 	void end_using_mask(void);
 	void start_drawing_mask(bool erase);
@@ -112,4 +205,8 @@ protected:
 HUD_Lua_Class *Lua_HUDInstance();
 void Lua_DrawHUD(short time_elapsed);
 
+// Smoothed time per frame spent in the draw trigger and drawing what it recorded; false
+// if the Lua HUD hasn't been drawn lately
+bool Lua_HUDFrameTime(float& script_ms, float& draw_ms);
+
 #endif
@@ -479,8 +479,9 @@ static void update_fps_display(SDL_Surface *s)
 	if (displaying_fps && !player_in_terminal_mode(current_player_index))
 	{
 		uint32 ticks = SDL_GetTicks();
-		char fps[sizeof("120.00fps (10000 ms)")];
+		char fps[sizeof("120.00fps (10000 ms) HUD 1000.0+1000.0 ms")];
 		char ms[sizeof("(10000 ms)")];
+		char hud[sizeof(" HUD 1000.0+1000.0 ms")];
 		
 		frame_ticks[frame_index]= ticks;
 		frame_index= (frame_index+1)%FRAME_SAMPLE_SIZE;
@@ -497,11 +498,18 @@ static void update_fps_display(SDL_Surface *s)
 				sprintf(ms, "(%i ms)", latency);
 			else
 				ms[0] = '\0';
+			
+			// Lua HUD script and drawing time per frame
+			float script_ms, draw_ms;
+			if (Lua_HUDFrameTime(script_ms, draw_ms))
+				snprintf(hud, sizeof(hud), " HUD %.1f+%.1f ms", MIN(script_ms, 999.9f), MIN(draw_ms, 999.9f));
+			else
+				hud[0] = '\0';
 							
 			if (count >= TICKS_PER_SECOND)
-				sprintf(fps, "%lu%s %s",(unsigned long)TICKS_PER_SECOND,".00fps", ms);
+				sprintf(fps, "%lu%s %s%s",(unsigned long)TICKS_PER_SECOND,".00fps", ms, hud);
 			else
-				sprintf(fps, "%3.2ffps %s", count, ms);
+				sprintf(fps, "%3.2ffps %s%s", count, ms, hud);
 		}
 		
 		FontSpecifier& Font = GetOnScreenFont();
@@ -43,6 +43,11 @@
 #include <fcntl.h> // hacky non-cross-platform setting of nonblocking
 #endif
 #include <algorithm>
+#include <set>
+#if !defined(WIN32)
+#include <poll.h>
+#include <unistd.h>
+#endif
 
   //DCW we need to set socket options; defining the needed struct here. If SDLnet ever changes this, we are hosed.
 #include "SDLnetsys.h"
@@ -60,26 +65,236 @@ enum
 	// If any incoming message claims to be longer than this, we bail
 	kMaximumMessageLength = 4 * 1024 * 1024,
 
+	// Outgoing messages up to this long are copied into the gather buffer with their
+	// headers; longer ones are sent from their own buffers
+	kMaximumGatheredMessageLength = 4 * 1024,
+	kOutgoingGatherSize = 16 * 1024,
+
 	// Milliseconds we wait between pump() calls during receive[Specific]Message()
 	kSSRPumpInterval = 50,
 
 	// Milliseconds we wait between pump() calls during flushOutgoingMessages()
 	kFlushPumpInterval = kSSRPumpInterval,
+
+	// Milliseconds the reactor sleeps in poll() when nobody wakes it
+	kReactorPollTimeout = 1000,
 };
 
 // if you really want to read what this does, scroll down
 static void MakeTCPsocketNonBlocking(TCPsocket *socket); 
 
+
+
+#if !defined(WIN32)
+
+// One thread poll()s the sockets of every connected channel, receiving whatever arrives and
+// sending whatever's queued as soon as each socket is ready.  Idle channels cost nothing,
+// and nothing waits on how often the UI gets around to pumping.  It only runs while there
+// are channels to watch.
+class CommunicationsReactor
+{
+public:
+	static CommunicationsReactor* instance();
+
+	// False if the channel will have to pump itself
+	bool add(CommunicationsChannel* inChannel);
+	// Once this returns, the reactor won't touch the channel again
+	void remove(CommunicationsChannel* inChannel);
+	// Makes the thread look at its channels again
+	void wake();
+
+private:
+	CommunicationsReactor();
+
+	static int reactor_thread(void*);
+	int Thread();
+
+	// guards mChannels and mRunning; held while the thread pumps a channel
+	SDL_mutex*	mMutex;
+	std::set<CommunicationsChannel*> mChannels;
+	bool		mRunning;
+
+	// a byte written here pops the thread out of poll()
+	int		mWakePipe[2];
+	bool		mFunctional;
+};
+
+
+
+CommunicationsReactor*
+CommunicationsReactor::instance()
+{
+	// never deleted; its thread may outlive everything else at exit
+	static CommunicationsReactor* sInstance = new CommunicationsReactor;
+	return sInstance;
+}
+
+
+
+CommunicationsReactor::CommunicationsReactor()
+	: mMutex(SDL_CreateMutex()), mRunning(false), mFunctional(false)
+{
+	if(mMutex != NULL && pipe(mWakePipe) == 0)
+	{
+		fcntl(mWakePipe[0], F_SETFL, O_NONBLOCK);
+		fcntl(mWakePipe[1], F_SETFL, O_NONBLOCK);
+		mFunctional = true;
+	}
+}
+
+
+
+bool
+CommunicationsReactor::add(CommunicationsChannel* inChannel)
+{
+	if(!mFunctional)
+		return false;
+
+	bool isWatching = true;
+
+	SDL_LockMutex(mMutex);
+	mChannels.insert(inChannel);
+	if(!mRunning)
+	{
+		SDL_Thread* theThread = SDL_CreateThread(reactor_thread, "CommunicationsReactor_thread", this);
+		if(theThread != NULL)
+		{
+			// it clears mRunning when it runs out of channels, and then just returns
+			SDL_DetachThread(theThread);
+			mRunning = true;
+		}
+		else
+		{
+			mChannels.erase(inChannel);
+			isWatching = false;
+		}
+	}
+	SDL_UnlockMutex(mMutex);
+
+	wake();
+	return isWatching;
+}
+
+
+
+void
+CommunicationsReactor::remove(CommunicationsChannel* inChannel)
+{
+	SDL_LockMutex(mMutex);
+	mChannels.erase(inChannel);
+	SDL_UnlockMutex(mMutex);
+
+	wake();
+}
+
+
+
+void
+CommunicationsReactor::wake()
+{
+	// if the pipe's full, the thread has plenty of wakeups coming already
+	char theByte = 0;
+	if(write(mWakePipe[1], &theByte, 1) < 0) { }
+}
+
+
+
+int
+CommunicationsReactor::reactor_thread(void* inReactor)
+{
+	return static_cast<CommunicationsReactor*>(inReactor)->Thread();
+}
+
+
+
+int
+CommunicationsReactor::Thread()
+{
+	std::vector<pollfd> thePollFDs;
+	std::vector<CommunicationsChannel*> thePolledChannels;
+
+	SDL_LockMutex(mMutex);
+	while(!mChannels.empty())
+	{
+		thePollFDs.resize(1);
+		thePollFDs[0].fd = mWakePipe[0];
+		thePollFDs[0].events = POLLIN;
+		thePollFDs[0].revents = 0;
+		thePolledChannels.clear();
+
+		for(std::set<CommunicationsChannel*>::iterator i = mChannels.begin(); i != mChannels.end(); )
+		{
+			CommunicationsChannel* theChannel = *i++;
+
+			// its owner may have dropped it while pumping it
+			SDL_LockMutex(theChannel->mMutex);
+			if(theChannel->mConnected)
+			{
+				pollfd thePollFD;
+				thePollFD.fd = theChannel->mSocket->channel;
+				thePollFD.events = POLLIN | (theChannel->mOutgoingMessages.empty() ? 0 : POLLOUT);
+				thePollFD.revents = 0;
+				thePollFDs.push_back(thePollFD);
+				thePolledChannels.push_back(theChannel);
+			}
+			else
+			{
+				mChannels.erase(theChannel);
+			}
+			SDL_UnlockMutex(theChannel->mMutex);
+		}
+
+		SDL_UnlockMutex(mMutex);
+
+		poll(&thePollFDs[0], thePollFDs.size(), kReactorPollTimeout);
+
+		if(thePollFDs[0].revents & POLLIN)
+		{
+			char theBytes[64];
+			while(read(mWakePipe[0], theBytes, sizeof(theBytes)) > 0) { }
+		}
+
+		SDL_LockMutex(mMutex);
+
+		for(size_t i = 0; i < thePolledChannels.size(); i++)
+		{
+			short theEvents = thePollFDs[i + 1].revents;
+			CommunicationsChannel* theChannel = thePolledChannels[i];
+
+			// skip any that were removed (and maybe deleted) while we were polling
+			if(theEvents == 0 || mChannels.find(theChannel) == mChannels.end())
+				continue;
+
+			// errors and hangups show up when we try to receive
+			if(!theChannel->pumpFromReactor((theEvents & ~POLLOUT) != 0, (theEvents & POLLOUT) != 0))
+				mChannels.erase(theChannel);
+		}
+	}
+
+	mRunning = false;
+	SDL_UnlockMutex(mMutex);
+
+	return 0;
+}
+
+#endif // !defined(WIN32)
+
+
 CommunicationsChannel::CommunicationsChannel()
 	: mConnected(false),
 	mSocket(NULL),
 	mMessageInflater(NULL),
 	mMessageHandler(NULL),
 	mMemento(NULL),
+	mMutex(SDL_CreateMutex()),
+	mActivity(SDL_CreateCond()),
+	mReactorOwned(false),
 	mIncomingHeaderPosition(0),
 	mIncomingMessage(NULL),
 	mIncomingMessagePosition(0),
-	mOutgoingHeaderPosition(0),
+	mOutgoingGatherPosition(0),
+	mOutgoingGatheredMessageCount(0),
+	mOutgoingSendingBody(false),
 	mOutgoingMessagePosition(0)
 {
 	mTicksAtLastReceive = SDL_GetTicks();
@@ -94,14 +309,22 @@ CommunicationsChannel::CommunicationsChannel(TCPsocket inSocket)
 	mMessageInflater(NULL),
 	mMessageHandler(NULL),
 	mMemento(NULL),
+	mMutex(SDL_CreateMutex()),
+	mActivity(SDL_CreateCond()),
+	mReactorOwned(false),
 	mIncomingHeaderPosition(0),
 	mIncomingMessage(NULL),
 	mIncomingMessagePosition(0),
-	mOutgoingHeaderPosition(0),
+	mOutgoingGatherPosition(0),
+	mOutgoingGatheredMessageCount(0),
+	mOutgoingSendingBody(false),
 	mOutgoingMessagePosition(0)
 {
 	mTicksAtLastReceive = SDL_GetTicks();
 	mTicksAtLastSend = SDL_GetTicks();
+
+	if(mConnected)
+		startWatching();
 }
 
 
@@ -109,6 +332,13 @@ CommunicationsChannel::CommunicationsChannel(TCPsocket inSocket)
 CommunicationsChannel::~CommunicationsChannel()
 {
     disconnect();
+
+	delete mIncomingMessage;
+	for(MessageQueue::iterator i = mIncomingMessages.begin(); i != mIncomingMessages.end(); ++i)
+		delete *i;
+
+	SDL_DestroyCond(mActivity);
+	SDL_DestroyMutex(mMutex);
 }
 
 
@@ -133,7 +363,7 @@ CommunicationsChannel::receive_some(TCPsocket inSocket, byte* inBuffer, size_t&
 #ifdef SANE_RECV_RESULTS
 		if(theResult < 0)
 		{
-			disconnect();
+			dropConnection();
 			return kError;
 		}
 		else
@@ -151,7 +381,7 @@ CommunicationsChannel::receive_some(TCPsocket inSocket, byte* inBuffer, size_t&
 		if(theResult == 0)
 		{
 			// For some reason we get 0 back if the connection is lost ...
-			disconnect();
+			dropConnection();
 			return kError;
 		}
 		
@@ -171,7 +401,7 @@ CommunicationsChannel::receive_some(TCPsocket inSocket, byte* inBuffer, size_t&
 		    theResult = 0;
 		  } else {
 		    std::cout << "theResult == " << theResult << std::endl;
-		    disconnect();
+		    dropConnection();
 		    return kError;
 		  }
 #else
@@ -183,7 +413,7 @@ CommunicationsChannel::receive_some(TCPsocket inSocket, byte* inBuffer, size_t&
 			{
 				std::cout << "theResult == " << theResult << " ; errno == " << errno << " ; strerror() == " << strerror(errno) << " ; SDL_GetError() == " << SDL_GetError() << std::endl;
 				
-				disconnect();
+				dropConnection();
 				return kError;
 			}
 #endif
@@ -203,7 +433,7 @@ CommunicationsChannel::receive_some(TCPsocket inSocket, byte* inBuffer, size_t&
 
 
 CommunicationsChannel::CommunicationResult
-CommunicationsChannel::send_some(TCPsocket inSocket, byte* inBuffer, size_t& ioBufferPosition, size_t inBufferLength)
+CommunicationsChannel::send_some(TCPsocket inSocket, const byte* inBuffer, size_t& ioBufferPosition, size_t inBufferLength)
 {
 //	std::cout << "Want to send " << inBufferLength << " bytes; buffer position " << ioBufferPosition << std::endl;
 	
@@ -215,7 +445,7 @@ CommunicationsChannel::send_some(TCPsocket inSocket, byte* inBuffer, size_t& ioB
 
 	if(theResult < 0)
 	{
-		disconnect();
+		dropConnection();
 		return kError;
 	}
 	else
@@ -254,7 +484,7 @@ CommunicationsChannel::receiveHeader()
 
 		if(theMagic != kHeaderMagic || theMessageLength > kMaximumMessageLength)
 		{
-			disconnect();
+			dropConnection();
 		}
 		else
 		{
@@ -283,16 +513,8 @@ CommunicationsChannel::_receiveMessage()
 
 	if(theResult == kComplete)
 	{
-		// Received a complete message; inflate (if possible) then enqueue it
-		Message* theMessageToEnqueue = mIncomingMessage;
-
-		if(mMessageInflater != NULL)
-		{
-			theMessageToEnqueue = mMessageInflater->inflate(*mIncomingMessage);
-			delete mIncomingMessage;
-		}
-
-		mIncomingMessages.push_back(theMessageToEnqueue);
+		// Received a complete message; enqueue it (it's inflated when it's taken off)
+		mIncomingMessages.push_back(mIncomingMessage);
 
 		// No longer receiving message body - prepare to receive next header
 		mIncomingMessage = NULL;
@@ -310,54 +532,41 @@ CommunicationsChannel::_receiveMessage()
 
 
 
-bool
-CommunicationsChannel::sendHeader()
+void
+CommunicationsChannel::gatherOutgoingMessages()
 {
-	CommunicationResult theResult =
-		send_some(mSocket, mOutgoingHeader, mOutgoingHeaderPosition, kHeaderPackedSize);
+	assert(mOutgoingGather.empty());
+	assert(!mOutgoingSendingBody);
 
-	if(theResult == kComplete)
-	{
-		// Finished sending a header; switch to sending message now
-		mOutgoingMessagePosition = 0;
-		
-		// We should try to send more stuff, since we sent all we asked to.
-		return true;
-	}
-	else
+	for(UninflatedMessageQueue::const_iterator i = mOutgoingMessages.begin(); i != mOutgoingMessages.end(); ++i)
 	{
-		// We sent less than we wanted - no sense in trying for more.
-		return false;
-	}	
-}
+		const UninflatedMessage& theMessage = **i;
+		bool isSmall = theMessage.length() <= kMaximumGatheredMessageLength;
 
+		// Leave small messages that don't fit for next time
+		if(isSmall && mOutgoingGather.size() + kHeaderPackedSize + theMessage.length() > kOutgoingGatherSize)
+			break;
 
+		Uint8 theHeader[kHeaderPackedSize];
+		AOStreamBE theHeaderStream(theHeader, kHeaderPackedSize);
+		theHeaderStream << (Uint16)kHeaderMagic
+			<< theMessage.inflatedType()
+			<< (uint32)(theMessage.length() + kHeaderPackedSize);
+		mOutgoingGather.insert(mOutgoingGather.end(), theHeader, theHeader + kHeaderPackedSize);
 
-bool
-CommunicationsChannel::sendMessage()
-{
-	UninflatedMessage* theOutgoingMessage = mOutgoingMessages.front();
-	
-	CommunicationResult theResult =
-		send_some(mSocket, theOutgoingMessage->buffer(), mOutgoingMessagePosition, theOutgoingMessage->length());
-	
-	if(theResult == kComplete)
-	{
-		// Sent a complete message; delete and dequeue it
-		delete theOutgoingMessage;
-		mOutgoingMessages.pop_front();
-	
-		// No longer sending message body - prepare to send next header
-		mOutgoingHeaderPosition = 0;
-	
-		// We sent all we wanted - so we should go again to see if we can do more.
-		return true;
-	}
-	else
-	{
-		// Could not send it all, or error - no sense trying for more data
-		return false;
+		if(!isSmall)
+		{
+			// Its body goes straight from its buffer, once the gather buffer's gone
+			mOutgoingSendingBody = true;
+			mOutgoingMessagePosition = 0;
+			break;
+		}
+
+		mOutgoingGather.insert(mOutgoingGather.end(), theMessage.buffer(), theMessage.buffer() + theMessage.length());
+		mOutgoingGatheredMessageCount++;
 	}
+
+	mOutgoingGatherPosition = 0;
 }
 
 
@@ -386,28 +595,33 @@ CommunicationsChannel::pumpReceivingSide()
 void
 CommunicationsChannel::pumpSendingSide()
 {
-	bool keepGoing = true;
-	while(keepGoing && mConnected && !mOutgoingMessages.empty())
+	while(mConnected && !mOutgoingMessages.empty())
 	{
-		if(mOutgoingHeaderPosition == 0)
+		if(!mOutgoingGather.empty())
 		{
-			// Need to fill packed header buffer with packed header
-			// We may end up doing this more than once if for some reason we can't
-			// send any data bytes to TCP ... but that's OK.
-			UninflatedMessage* theMessage = mOutgoingMessages.front();
-			AOStreamBE theHeaderStream(mOutgoingHeader, kHeaderPackedSize);
-			theHeaderStream << (Uint16)kHeaderMagic
-				<< theMessage->inflatedType()
-				<< (uint32)(theMessage->length() + kHeaderPackedSize);
-		}
+			// We sent less than we wanted, or error - no sense in trying for more.
+			if(send_some(mSocket, &mOutgoingGather[0], mOutgoingGatherPosition, mOutgoingGather.size()) != kComplete)
+				return;
+
+			for(size_t i = 0; i < mOutgoingGatheredMessageCount; i++)
+				mOutgoingMessages.pop_front();
 
-		if(mOutgoingHeaderPosition < kHeaderPackedSize)
+			mOutgoingGather.clear();
+			mOutgoingGatheredMessageCount = 0;
+		}
+		else if(mOutgoingSendingBody)
 		{
-			keepGoing = sendHeader();
+			const UninflatedMessage& theMessage = *mOutgoingMessages.front();
+			if(send_some(mSocket, theMessage.buffer(), mOutgoingMessagePosition, theMessage.length()) != kComplete)
+				return;
+
+			// Sent a complete message; dequeue it (and free it, if nobody else is sending it)
+			mOutgoingMessages.pop_front();
+			mOutgoingSendingBody = false;
 		}
 		else
 		{
-			keepGoing = sendMessage();
+			gatherOutgoingMessages();
 		}
 	}
 }
@@ -417,19 +631,178 @@ CommunicationsChannel::pumpSendingSide()
 void
 CommunicationsChannel::pump()
 {
+	SDL_LockMutex(mMutex);
 	pumpSendingSide();
-	pumpReceivingSide();
+	if(!mReactorOwned)
+		pumpReceivingSide();
+	SDL_UnlockMutex(mMutex);
+}
+
+
+
+Message*
+CommunicationsChannel::popIncomingMessage()
+{
+	SDL_LockMutex(mMutex);
+	UninflatedMessage* theUninflatedMessage = NULL;
+	if(!mIncomingMessages.empty())
+	{
+		theUninflatedMessage = mIncomingMessages.front();
+		mIncomingMessages.pop_front();
+	}
+	SDL_UnlockMutex(mMutex);
+
+	if(theUninflatedMessage == NULL || mMessageInflater == NULL)
+		return theUninflatedMessage;
+
+	Message* theMessage = mMessageInflater->inflate(*theUninflatedMessage);
+	delete theUninflatedMessage;
+	return theMessage;
+}
+
+
+
+bool
+CommunicationsChannel::hasIncomingMessages()
+{
+	SDL_LockMutex(mMutex);
+	bool theResult = !mIncomingMessages.empty();
+	SDL_UnlockMutex(mMutex);
+	return theResult;
+}
+
+
+
+bool
+CommunicationsChannel::hasOutgoingMessages()
+{
+	SDL_LockMutex(mMutex);
+	bool theResult = !mOutgoingMessages.empty();
+	SDL_UnlockMutex(mMutex);
+	return theResult;
+}
+
+
+
+bool
+CommunicationsChannel::isConnected() const
+{
+	SDL_LockMutex(mMutex);
+	bool theResult = mConnected;
+	SDL_UnlockMutex(mMutex);
+	return theResult;
+}
+
+
+
+Uint32
+CommunicationsChannel::ticksAtLastReceive() const
+{
+	SDL_LockMutex(mMutex);
+	Uint32 theResult = mTicksAtLastReceive;
+	SDL_UnlockMutex(mMutex);
+	return theResult;
+}
+
+
+
+Uint32
+CommunicationsChannel::ticksAtLastSend() const
+{
+	SDL_LockMutex(mMutex);
+	Uint32 theResult = mTicksAtLastSend;
+	SDL_UnlockMutex(mMutex);
+	return theResult;
+}
+
+
+
+size_t
+CommunicationsChannel::outgoingMessageCount()
+{
+	SDL_LockMutex(mMutex);
+	size_t theResult = mOutgoingMessages.size();
+	SDL_UnlockMutex(mMutex);
+	return theResult;
+}
+
+
+
+void
+CommunicationsChannel::waitForActivity(Uint32 inTimeout, bool inForSending)
+{
+	if(!mReactorOwned)
+	{
+		SDL_Delay(inTimeout);
+		pump();
+		return;
+	}
+
+	SDL_LockMutex(mMutex);
+	if(mConnected && (inForSending ? !mOutgoingMessages.empty() : mIncomingMessages.empty()))
+		SDL_CondWaitTimeout(mActivity, mMutex, inTimeout);
+	SDL_UnlockMutex(mMutex);
+}
+
+
+
+bool
+CommunicationsChannel::pumpFromReactor(bool inReadable, bool inWritable)
+{
+	SDL_LockMutex(mMutex);
+	if(inWritable)
+		pumpSendingSide();
+	if(inReadable)
+		pumpReceivingSide();
+
+	bool isStillConnected = mConnected;
+	SDL_CondBroadcast(mActivity);
+	SDL_UnlockMutex(mMutex);
+
+	return isStillConnected;
+}
+
+
+
+void
+CommunicationsChannel::startWatching()
+{
+#if !defined(WIN32)
+	mReactorOwned = CommunicationsReactor::instance()->add(this);
+#endif
+}
+
+
+
+void
+CommunicationsChannel::stopWatching()
+{
+#if !defined(WIN32)
+	if(mReactorOwned)
+		CommunicationsReactor::instance()->remove(this);
+#endif
+	mReactorOwned = false;
+}
+
+
+
+void
+CommunicationsChannel::startSending()
+{
+#if !defined(WIN32)
+	if(mReactorOwned)
+		CommunicationsReactor::instance()->wake();
+#endif
 }
 
 bool CommunicationsChannel::dispatchOneIncomingMessage() 
 {
-  if (mIncomingMessages.empty()) return false;
-  Message* theMessage = mIncomingMessages.front();
+  Message* theMessage = popIncomingMessage();
+  if (theMessage == NULL) return false;
   if (messageHandler() != NULL) {
     messageHandler()->handle(theMessage, this);
   }
   delete theMessage;
-  mIncomingMessages.pop_front();
   return true;
 }
 
@@ -445,12 +818,42 @@ void
 CommunicationsChannel::enqueueOutgoingMessage(const Message& inMessage)
 {
 	if(isConnected())
+		enqueueDeflatedMessage(SharedUninflatedMessage(inMessage.deflate()));
+}
+
+
+
+void
+CommunicationsChannel::multipleEnqueueOutgoingMessage(
+	const std::vector<CommunicationsChannel*>& channels,
+	const Message& inMessage)
+{
+	SharedUninflatedMessage theMessage;
+
+	for (std::vector<CommunicationsChannel*>::const_iterator it = channels.begin(); it != channels.end(); it++)
 	{
-		UninflatedMessage* theUninflatedMessage = inMessage.deflate();
-		mOutgoingMessages.push_back(theUninflatedMessage);
+		if (!(*it)->isConnected())
+			continue;
+
+		if (!theMessage)
+			theMessage.reset(inMessage.deflate());
+
+		(*it)->enqueueDeflatedMessage(theMessage);
 	}
 }
 
+
+
+void
+CommunicationsChannel::enqueueDeflatedMessage(const SharedUninflatedMessage& inMessage)
+{
+	SDL_LockMutex(mMutex);
+	mOutgoingMessages.push_back(inMessage);
+	SDL_UnlockMutex(mMutex);
+
+	startSending();
+}
+
 IPaddress
 CommunicationsChannel::peerAddress() const
 {
@@ -462,6 +865,10 @@ CommunicationsChannel::connect(const IPaddress& inAddress)
 {
 	assert(!isConnected());
 
+	// The reactor may still have it if it was the one to notice the disconnection
+	stopWatching();
+
+	SDL_LockMutex(mMutex);
 	mIncomingHeaderPosition = 0;
 	mIncomingMessagePosition = 0;
 	delete mIncomingMessage;
@@ -471,6 +878,7 @@ CommunicationsChannel::connect(const IPaddress& inAddress)
 		delete *i;
 	
 	mIncomingMessages.clear();
+	SDL_UnlockMutex(mMutex);
 
 	// Have to copy the address since we get a const, but SDL_net takes a non-const
 	IPaddress theAddress = inAddress;
@@ -488,6 +896,8 @@ CommunicationsChannel::connect(const IPaddress& inAddress)
 		mTicksAtLastSend = SDL_GetTicks();
 		
 		MakeTCPsocketNonBlocking(&mSocket);
+
+		startWatching();
 	}
 }
 
@@ -511,6 +921,18 @@ CommunicationsChannel::connect(const std::string& inAddressString, uint16 inPort
 
 void
 CommunicationsChannel::disconnect()
+{
+	stopWatching();
+
+	SDL_LockMutex(mMutex);
+	dropConnection();
+	SDL_UnlockMutex(mMutex);
+}
+
+
+
+void
+CommunicationsChannel::dropConnection()
 {
 	if(mSocket != NULL)
 	{
@@ -520,13 +942,15 @@ CommunicationsChannel::disconnect()
 	}
 
     // Discard all data so next connect()ion starts with a clean slate
-    mOutgoingHeaderPosition = 0;
+    mOutgoingGather.clear();
+    mOutgoingGatherPosition = 0;
+    mOutgoingGatheredMessageCount = 0;
+    mOutgoingSendingBody = false;
     mOutgoingMessagePosition = 0;
 
-    for(UninflatedMessageQueue::iterator i = mOutgoingMessages.begin(); i != mOutgoingMessages.end(); ++i)
-        delete *i;
-
     mOutgoingMessages.clear();
+
+	SDL_CondBroadcast(mActivity);
 }
 
 
@@ -536,7 +960,7 @@ CommunicationsChannel::isMessageAvailable()
 {
 	pump();
 
-	return !mIncomingMessages.empty();
+	return hasIncomingMessages();
 }
 
 
@@ -553,24 +977,15 @@ CommunicationsChannel::receiveMessage(Uint32 inOverallTimeout, Uint32 inInactivi
 
 	pump();
 
-	while(SDL_GetTicks() - std::max(mTicksAtLastReceive, theTicksAtStart) < inInactivityTimeout
+	while(SDL_GetTicks() - std::max(ticksAtLastReceive(), theTicksAtStart) < inInactivityTimeout
 		&& SDL_GetTicks() < theDeadline
 		&& isConnected()
-		&& mIncomingMessages.empty())
-	{
-		SDL_Delay(kSSRPumpInterval);
-		pump();
-	}
-
-	Message* theMessage = NULL;
-
-	if(!mIncomingMessages.empty())
+		&& !hasIncomingMessages())
 	{
-		theMessage = mIncomingMessages.front();
-		mIncomingMessages.pop_front();
+		waitForActivity(kSSRPumpInterval, false);
 	}
 
-	return theMessage;
+	return popIncomingMessage();
 }
 
 
@@ -625,12 +1040,11 @@ CommunicationsChannel::flushOutgoingMessages(bool shouldDispatchIncomingMessages
 	Uint32	theTicksAtStart = SDL_GetTicks();
 
 	while(isConnected()
-		&& !mOutgoingMessages.empty()
+		&& hasOutgoingMessages()
 		&& SDL_GetTicks() < theDeadline
-		&& SDL_GetTicks() - std::max(mTicksAtLastSend, theTicksAtStart) < inInactivityTimeout)
+		&& SDL_GetTicks() - std::max(ticksAtLastSend(), theTicksAtStart) < inInactivityTimeout)
 	{
-		SDL_Delay(kFlushPumpInterval);
-		pump();
+		waitForActivity(kFlushPumpInterval, true);
 		if(shouldDispatchIncomingMessages)
 			dispatchIncomingMessages();
 	}
@@ -656,7 +1070,7 @@ void CommunicationsChannel::multipleFlushOutgoingMessages(
 
 		for (std::vector<CommunicationsChannel*>::iterator it = channels.begin(); it != channels.end(); it++)
 		{
-			if (!(*it)->mOutgoingMessages.empty() && SDL_GetTicks() - std::max((*it)->mTicksAtLastSend, theTicksAtStart) < inInactivityTimeout)
+			if ((*it)->hasOutgoingMessages() && SDL_GetTicks() - std::max((*it)->ticksAtLastSend(), theTicksAtStart) < inInactivityTimeout)
 			{
 				someoneIsStillActive = true;
 			}
@@ -702,8 +1116,9 @@ CommunicationsChannelFactory::newIncomingConnection()
       int st = NET_SERVICE_TYPE_VO;
       setsockopt((int)(theNewSocket->channel), SOL_SOCKET, SO_NET_SERVICE_TYPE, (void *)&st, sizeof(st));
 
-			theNewChannel = new CommunicationsChannel(theNewSocket);
+			// before the reactor can get its hands on it
 			MakeTCPsocketNonBlocking(&theNewSocket);
+			theNewChannel = new CommunicationsChannel(theNewSocket);
 
 		}
 		SDLNet_FreeSocketSet(theSocketSet);
@@ -32,13 +32,19 @@
 // In most cases future communication would be meaningless anyway.
 // Channels can be created by the caller (for outgoing connections) or by some sort of
 // listener/acceptor/factory thingy (for incoming connections).
+// Where it can, a connected channel hands its socket to a background thread that polls all
+// of them at once (see CommunicationsReactor in the .cpp): it receives messages and keeps
+// sending queued ones whenever the socket is ready, however often pump() gets called.
+// Messages are still inflated and handled only on the thread that uses the channel.
 
 #include <list>
 #include <string>
 #include <memory>
 #include <stdexcept>
 #include <vector>
+#include <boost/shared_ptr.hpp>
 #include "SDL_net.h"
+#include "SDL_mutex.h"
 
 #include "Message.h"
 
@@ -55,6 +61,7 @@ public:
 
 class MessageInflater;
 class MessageHandler;
+class CommunicationsReactor;
 
 
 class CommunicationsChannel
@@ -86,7 +93,8 @@ public:
 	void		setMemento(Memento* inMemento) { mMemento = inMemento; }
 	Memento*	memento() const { return mMemento; }
 
-	// Moves data around but does not callback handlers
+	// Moves data around but does not callback handlers (with the reactor watching the
+	// channel, just starts sending whatever's queued)
 	void		pump();
 
 	// Calls back message handler (if appropriate)
@@ -168,7 +176,16 @@ public:
 	// Copies the given message (or at least its bytes) to make use less error-prone
 	void		enqueueOutgoingMessage(const Message& inMessage);
 
-	bool		isConnected() const { return mConnected; }
+	// As above, but deflates the message only once, and the channels all send from the
+	// same copy of its bytes (freed when the last of them finishes sending it)
+	static void	multipleEnqueueOutgoingMessage(
+		const std::vector<CommunicationsChannel*>&,
+		const Message& inMessage);
+
+	bool		isConnected() const;
+
+	// Messages queued that haven't been completely sent yet
+	size_t		outgoingMessageCount();
 
 	// inPort should be in host byte order
 	void		connect(const std::string& inAddressString, Uint16 inPort);
@@ -182,14 +199,16 @@ public:
 
 	// Callers can use these (compared with SDL_GetTicks()) to gauge activity on the Channel:
 	// each time pump() receives/sends new data, value is set to SDL_GetTicks() at that time.
-	Uint32		ticksAtLastReceive() const { return mTicksAtLastReceive; }
-	Uint32		ticksAtLastSend() const { return mTicksAtLastSend; }
+	Uint32		ticksAtLastReceive() const;
+	Uint32		ticksAtLastSend() const;
 
 	// Or callers can just use these.
-	Uint32		millisecondsSinceLastReceive() const { return SDL_GetTicks() - mTicksAtLastReceive; }
-	Uint32		millisecondsSinceLastSend() const { return SDL_GetTicks() - mTicksAtLastSend; }
+	Uint32		millisecondsSinceLastReceive() const { return SDL_GetTicks() - ticksAtLastReceive(); }
+	Uint32		millisecondsSinceLastSend() const { return SDL_GetTicks() - ticksAtLastSend(); }
 
 private:
+	friend class CommunicationsReactor;
+
 	enum CommunicationResult
 	{
 		kIncomplete,
@@ -198,15 +217,34 @@ private:
 	};
 
 	CommunicationResult receive_some(TCPsocket inSocket, Uint8* inBuffer, size_t& ioBufferPosition, size_t inBufferLength);
-	CommunicationResult send_some(TCPsocket inSocket, Uint8* inBuffer, size_t& ioBufferPosition, size_t inBufferLength);
+	CommunicationResult send_some(TCPsocket inSocket, const Uint8* inBuffer, size_t& ioBufferPosition, size_t inBufferLength);
 
 	void		pumpReceivingSide();
 	bool		receiveHeader();
 	bool		_receiveMessage();
+	Message*	popIncomingMessage();
+	bool		hasIncomingMessages();
+	bool		hasOutgoingMessages();
+
+	// Sleeps up to inTimeout ms, or until the reactor receives a message (or, if
+	// inForSending, sends something); pumps instead if there's no reactor
+	void		waitForActivity(Uint32 inTimeout, bool inForSending);
+
+	// For the reactor: pumps whichever sides are ready; false once disconnected
+	bool		pumpFromReactor(bool inReadable, bool inWritable);
+	void		startWatching();
+	void		stopWatching();
+	void		startSending();	// lets the reactor know there's something to send
+
+	// Closes the socket and forgets outgoing data; with mMutex held
+	void		dropConnection();
 	
+	// Outgoing messages are never changed once deflated, so channels can share them
+	typedef boost::shared_ptr<const UninflatedMessage> SharedUninflatedMessage;
+
+	void		enqueueDeflatedMessage(const SharedUninflatedMessage& inMessage);
 	void		pumpSendingSide();
-	bool		sendHeader();
-	bool		sendMessage();
+	void		gatherOutgoingMessages();
 
 
 	bool		mConnected;
@@ -214,6 +252,12 @@ private:
 	MessageInflater* mMessageInflater;
 	MessageHandler*	mMessageHandler;
 	Memento*	mMemento;
+
+	// Guards the socket and the queues against the reactor; mActivity is signalled
+	// whenever the reactor has pumped the channel
+	SDL_mutex*	mMutex;
+	SDL_cond*	mActivity;
+	bool		mReactorOwned;
 	
 
 	enum
@@ -230,17 +274,23 @@ private:
 
 	Uint32		mTicksAtLastReceive;
 
-	typedef std::list<Message*>	MessageQueue;
+	// Inflated when they're taken off the queue, on the channel user's thread
+	typedef std::list<UninflatedMessage*>	MessageQueue;
 	MessageQueue	mIncomingMessages;
 
 
-	Uint8		mOutgoingHeader[kHeaderPackedSize];
-	size_t		mOutgoingHeaderPosition;
-
 	Uint32		mTicksAtLastSend;
 
-	typedef std::list<UninflatedMessage*>	UninflatedMessageQueue;
+	typedef std::list<SharedUninflatedMessage>	UninflatedMessageQueue;
 	UninflatedMessageQueue	mOutgoingMessages;
+
+	// SDL_net has no writev(), so headers and small messages from the front of the queue are
+	// gathered into one buffer to go to TCP together.  A big message's body is sent straight
+	// from its (shared) buffer after its header instead.
+	std::vector<Uint8>	mOutgoingGather;
+	size_t		mOutgoingGatherPosition;
+	size_t		mOutgoingGatheredMessageCount;	// complete messages in mOutgoingGather
+	bool		mOutgoingSendingBody;		// sending the next message's body directly
 	size_t		mOutgoingMessagePosition;
 };
 
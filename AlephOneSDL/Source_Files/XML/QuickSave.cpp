@@ -500,13 +500,12 @@ bool load_quick_save_dialog(FileSpecifier& saved_game)
 extern SDL_Surface *draw_surface;
 extern bool OGL_MapActive;
 
-//DCW making non-static
-bool build_map_preview(std::ostringstream& ostream)
+SDL_Surface *render_map_preview(void)
 {
     SDL_Rect r = {0, 0, RENDER_WIDTH, RENDER_HEIGHT};
     SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, r.w, r.h, 32, 0xff0000, 0x00ff00, 0x0000ff, 0);
     if (!surface)
-        return false;
+        return NULL;
 	
     SDL_FillRect(surface, &r, SDL_MapRGB(surface->format, 0, 0, 0));
 	
@@ -528,18 +527,20 @@ bool build_map_preview(std::ostringstream& ostream)
     OGL_MapActive = old_OGL_MapActive;
     _restore_port();
 	
-    SDL_RWops *rwops = SDL_RWFromOStream(ostream);
-//#if defined(HAVE_PNG) && defined(HAVE_SDL_IMAGE)
-//    int ret = aoIMG_SavePNG_RW(rwops, surface, IMG_COMPRESS_DEFAULT, NULL, 0);
-#ifdef HAVE_SDL_IMAGE
-	int ret = IMG_SavePNG_RW(surface, rwops, 0);
-#else
-    int ret = SDL_SaveBMP_RW(surface, rwops, false);
-#endif
+    return surface;
+}
+
+//DCW making non-static
+bool build_map_preview(std::ostringstream& ostream)
+{
+    SDL_Surface *surface = render_map_preview();
+    if (!surface)
+        return false;
+	
+    bool ret = encode_saved_game_preview(surface, ostream);
     SDL_FreeSurface(surface);
-    SDL_RWclose(rwops);
 	
-    return (ret == 0);
+    return ret;
 }
 
 std::string build_save_metadata(QuickSave& save)
@@ -654,6 +655,17 @@ void create_updated_save(QuickSave& save)
 	}
 }
 
+static void quick_save_finished(FileSpecifier& File, bool success, const std::string& imagedata, void *arg)
+{
+    if (success)
+    {
+        QuickSaves::instance()->delete_surplus_saves(environment_preferences->maximum_quick_saves);
+        screen_printf("Game saved");
+    }
+    else
+        screen_printf("Save failed");
+}
+
 bool create_quick_save(void)
 {
     QuickSave save;
@@ -689,13 +701,7 @@ bool create_quick_save(void)
     save.save_file.AddPart(base + ".sgaA");
 	
     std::string metadata = build_save_metadata(save);
-    std::ostringstream image_stream;
-    bool success = build_map_preview(image_stream);
-    success = save_game_file(save.save_file, metadata, image_stream.str());
-    
-    if (success)
-        QuickSaves::instance()->delete_surplus_saves(environment_preferences->maximum_quick_saves);
-    return success;
+    return save_game_file_in_background(save.save_file, metadata, render_map_preview(), quick_save_finished);
 }
 
 bool delete_quick_save(QuickSave& save)
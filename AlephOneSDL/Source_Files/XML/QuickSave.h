@@ -64,6 +64,7 @@ private:
     std::vector<QuickSave> m_saves;
 };
 
+// Saves in the background, and says how that went once it's done
 bool create_quick_save(void);
 bool delete_quick_save(QuickSave& save);
 bool load_quick_save_dialog(FileSpecifier& saved_game);
@@ -72,5 +73,7 @@ size_t saved_game_was_networked(FileSpecifier& saved_game);
 //DCW adding definitions here wo we can access these externally
 std::string build_save_metadata(QuickSave& save);
 bool build_map_preview(std::ostringstream& ostream);
+// The overhead map around the player, for build_map_preview() or a background save
+SDL_Surface *render_map_preview(void);
 
 #endif
@@ -103,6 +103,8 @@
 
 #if !defined(DISABLE_NETWORKING)
 #include "SDL_net.h"
+#include "network_star.h" // run_dedicated_star_hub()
+#include "network_star_telemetry.h"
 #endif
 
 #ifdef HAVE_PNG
@@ -131,6 +133,8 @@
 #include "Movie.h"
 #include "network/a1HTTP.h"
 #include "WadImageCache.h"
+#include "FilmAnalyzer.h"
+#include "LevelLoadProfile.h"
 
 // LP addition: whether or not the cheats are active
 // Defined in shell_misc.cpp
@@ -172,6 +176,7 @@ DirectorySpecifier preferences_dir;   // Directory for preferences
 DirectorySpecifier saved_games_dir;   // Directory for saved games
 DirectorySpecifier quick_saves_dir;   // Directory for auto-named saved games
 DirectorySpecifier image_cache_dir;   // Directory for image cache
+DirectorySpecifier map_cache_dir;     // Directory for cached redundant map data
 DirectorySpecifier recordings_dir;    // Directory for recordings (except film buffer, which is stored in local_data_dir)
 DirectorySpecifier screenshots_dir;   // Directory for screenshots
 DirectorySpecifier log_dir;           // Directory for Aleph One Log.txt
@@ -187,6 +192,15 @@ bool option_nojoystick = false;
 bool insecure_lua = false;
 static bool force_fullscreen = false; // Force fullscreen mode
 static bool force_windowed = false;   // Force windowed mode
+static std::string analyze_films_directory; // Replay these films headless and print their stats
+static int analyze_films_jobs = 1;    // Worker processes for film analysis
+static int32 analyze_films_seek = NONE; // Also replay each film from the keyframe for this tick
+static int dedicated_hub_port = 0;    // Only relay other people's games, on this UDP port
+static const char* net_stress_options = NULL; // Run the star protocol stress test with these options
+static const char* net_telemetry_path = NULL; // Append the star protocol's telemetry to this file
+static int bench_lua_trigger_events = 0; // Time this many calls of each benchmarked Lua trigger
+static int bench_lua_save_records = 0; // Time saving and restoring a Lua table of this many records
+static const char* bench_level_load_map = NULL; // Time loading every level of this map
 
 // Prototypes
 static void main_event_loop(void);
@@ -232,6 +246,25 @@ static void usage(const char *prg_name)
 	  "\t[-s | --nosound]       Do not access the sound card\n"
 	  "\t[-m | --nogamma]       Disable gamma table effects (menu fades)\n"
           "\t[-j | --nojoystick]    Do not initialize joysticks\n"
+	  "\t[--analyze-films dir]  Replay every film in dir without rendering\n"
+	  "\t                       and print one line of JSON stats per film\n"
+	  "\t[--jobs n]             Analyze films in n worker processes\n"
+	  "\t[--seek tick]          Replay each analyzed film again, seeking to\n"
+	  "\t                       tick, and check that it ends the same way\n"
+	  "\t[--bench-lua-triggers n]  Time n calls of Lua triggers, with and\n"
+	  "\t                       without the trigger cache\n"
+	  "\t[--bench-lua-save n]   Time saving and restoring n records of Lua\n"
+	  "\t                       state in each save format\n"
+	  "\t[--bench-level-load map]  Load every level of map in turn and print\n"
+	  "\t                       where the time went\n"
+#if !defined(DISABLE_NETWORKING)
+	  "\t[--dedicated-hub port]  Host the hub for any number of network games\n"
+	  "\t                       on UDP port, without playing in them\n"
+	  "\t[--net-stress options] Run the star hub against simulated players over\n"
+	  "\t                       simulated links, e.g. \"players=2-8 loss=2\"\n"
+	  "\t[--net-telemetry file] Append a line per tick of network game timing and\n"
+	  "\t                       queue depths to file\n"
+#endif
 	  // Documenting this might be a bad idea?
 	  // "\t[-i | --insecure_lua]  Allow Lua netscripts to take over your computer\n"
 	  "\tdirectory              Directory containing scenario data files\n"
@@ -353,6 +386,42 @@ int main(int argc, char **argv)
 			insecure_lua = true;
 		} else if (strcmp(*argv, "-d") == 0 || strcmp(*argv, "--debug") == 0) {
 		  option_debug = true;
+		} else if (strcmp(*argv, "--analyze-films") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			analyze_films_directory = *argv;
+		} else if (strcmp(*argv, "--jobs") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			analyze_films_jobs = atoi(*argv);
+		} else if (strcmp(*argv, "--seek") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			analyze_films_seek = atoi(*argv);
+		} else if (strcmp(*argv, "--bench-lua-triggers") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			bench_lua_trigger_events = atoi(*argv);
+		} else if (strcmp(*argv, "--bench-lua-save") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			bench_lua_save_records = atoi(*argv);
+		} else if (strcmp(*argv, "--bench-level-load") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			bench_level_load_map = *argv;
+		} else if (strcmp(*argv, "--dedicated-hub") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			dedicated_hub_port = atoi(*argv);
+		} else if (strcmp(*argv, "--net-stress") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			net_stress_options = *argv;
+		} else if (strcmp(*argv, "--net-telemetry") == 0 && argc > 1) {
+			argc--;
+			argv++;
+			net_telemetry_path = *argv;
 		} else if (*argv[0] != '-') {
 			// if it's a directory, make it the default data dir
 			// otherwise push it and handle it later
@@ -375,6 +444,28 @@ int main(int argc, char **argv)
 
 	try {
 		
+		if (!analyze_films_directory.empty())
+		{
+			option_nosound = true;
+			return analyze_films(analyze_films_directory, analyze_films_jobs, analyze_films_seek);
+		}
+
+		if (bench_lua_trigger_events > 0)
+			return run_lua_trigger_benchmark(bench_lua_trigger_events);
+		if (bench_lua_save_records > 0)
+			return run_lua_save_benchmark(bench_lua_save_records);
+		if (bench_level_load_map)
+			return run_level_load_benchmark(bench_level_load_map);
+
+#if !defined(DISABLE_NETWORKING)
+		if (net_telemetry_path && !star_telemetry_open(net_telemetry_path))
+			return 1;
+		if (dedicated_hub_port > 0)
+			return run_dedicated_star_hub(static_cast<uint16>(dedicated_hub_port));
+		if (net_stress_options)
+			return run_star_stress_test(net_stress_options);
+#endif
+
 		// Initialize everything
 		initialize_application();
 
@@ -601,6 +692,7 @@ void initialize_application(void)
 	saved_games_dir = local_data_dir + "Saved Games";
 	quick_saves_dir = local_data_dir + "Quick Saves";
 	image_cache_dir = local_data_dir + "Image Cache";
+	map_cache_dir = local_data_dir + "Map Cache";
 	recordings_dir = local_data_dir + "Recordings";
 	screenshots_dir = local_data_dir + "Screenshots";
 #if defined(__APPLE__) && defined(__MACH__)
@@ -671,6 +763,7 @@ void initialize_application(void)
 		quick_saves_dir.CreateDirectory();
 	}
 	image_cache_dir.CreateDirectory();
+	map_cache_dir.CreateDirectory();
 	recordings_dir.CreateDirectory();
 	screenshots_dir.CreateDirectory();
 	local_mml_dir.CreateDirectory();
@@ -739,6 +832,7 @@ void shutdown_application(void)
 
         already_shutting_down = true;
         
+	finish_background_saves();
 	WadImageCache::instance()->save_cache();
 	close_external_resources();
         
@@ -930,6 +1024,7 @@ static void main_event_loop(void)
 
 		execute_timer_tasks(SDL_GetTicks());
 		idle_game_state(SDL_GetTicks());
+		poll_background_saves();
 
 		if (game_state == _game_in_progress && !graphics_preferences->hog_the_cpu && (TICKS_PER_SECOND - (SDL_GetTicks() - cur_time)) > 10)
 		{
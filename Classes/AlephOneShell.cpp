@@ -192,6 +192,7 @@ void AlephOneMainLoop()
   
   execute_timer_tasks(SDL_GetTicks());
     idle_game_state(SDL_GetTicks());
+    poll_background_saves();
   
   if (game_state == _game_in_progress &&
       !graphics_preferences->hog_the_cpu &&
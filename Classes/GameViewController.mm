@@ -282,6 +282,19 @@ short localFindActionTarget(
 
 #define kPauseAlphaDefault 0.5;
 
+// The thumbnail is the saved game's own preview, so it's written once the save is
+static void savedGameFinished(FileSpecifier& File, bool success, const std::string& imagedata, void *arg)
+{
+  std::string *thumbPath = static_cast<std::string *>(arg);
+  if (success) {
+    ofstream thumbFile;
+    thumbFile.open(thumbPath->c_str());
+    thumbFile << imagedata;
+    thumbFile.close();
+  }
+  delete thumbPath;
+}
+
 @implementation GameViewController
 @synthesize pause, viewGL, hud, menuView, lookView, moveView, moveGesture, newGameView, preferencesView, pauseView;
 @synthesize rightWeaponSwipe, leftWeaponSwipe, panGesture, menuTapGesture;
@@ -1119,14 +1132,10 @@ extern SDL_Surface *draw_surface;
   save.save_file.FromDirectory(quicksave_dir);
   save.save_file.AddPart(base + ".sgaA");
   std::string metadata = build_save_metadata(save);
-  std::ostringstream image_stream;
-  
-  bool success = build_map_preview(image_stream);
   
-  ofstream thumbFile;
-  thumbFile.open ((char*)[[self.saveGameViewController fullPath:self.currentSavedGame.mapFilename] UTF8String]);
-  thumbFile << image_stream.str();
-  thumbFile.close();
+  // Written with the saved game, in the background
+  SDL_Surface *preview = render_map_preview();
+  std::string *thumbPath = new std::string([[self.saveGameViewController fullPath:self.currentSavedGame.mapFilename] UTF8String]);
   
   SavedGame* game = currentSavedGame;
   game.lastSaveTime = [NSDate date];
@@ -1184,7 +1193,10 @@ extern SDL_Surface *draw_surface;
   FileSpecifier file ( (char*)[[self.saveGameViewController fullPath:self.currentSavedGame.filename] UTF8String] );
   //save_game_file(file);
   
-  success = save_game_file(file, metadata, image_stream.str());
+  bool success = save_game_file_in_background(file, metadata, preview, savedGameFinished, thumbPath);
+  if (!success) {
+    delete thumbPath;
+  }
   
   
   MLog ( @"Saving game: %@", game );